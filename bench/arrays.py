@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""Measures how fast interp runs element-wise array operations.
+
+Every variant runs one expression over arrays of --elements doubles
+--rounds times and reports the execute phase less that of a program that
+only creates the arrays, along with the bytes the expression reads and
+writes per second. An expression that makes a new array also pays for
+the pages of it, so compare those with the reductions, which write
+nothing.
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+
+SETUP = """
+a = array(%(elements)d, 1.5);
+b = array(%(elements)d, 2.5);
+i = 0;
+"""
+
+LOOP = """
+loop if (i < %(rounds)d)
+begin
+    c = %(expression)s;
+    i = i + 1;
+end
+"""
+
+# Expression, bytes read and written per element
+VARIANTS = [
+    ("a * 2", 16),
+    ("a + b", 24),
+    ("a < b", 24),
+    ("sum(a)", 8),
+    ("max(a)", 8),
+]
+
+
+def execute_time(blaise, program):
+    result = subprocess.run([blaise, "interp", program, "--time-phases", "--no-cache"],
+                            stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+
+    if result.returncode != 0:
+        sys.exit("%s interp %s failed:\n%s" % (blaise, program, result.stderr))
+
+    for line in result.stderr.splitlines():
+        fields = line.split()
+
+        if len(fields) >= 3 and fields[0] == "phase" and fields[1] == "execute":
+            return float(fields[2])
+
+    sys.exit("%s reported no execute phase" % blaise)
+
+
+def fastest(blaise, workdir, name, text, repeat):
+    program = os.path.join(workdir, name + ".bls")
+
+    with open(program, "w") as out:
+        out.write(text)
+
+    return min(execute_time(blaise, program) for _ in range(repeat))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--blaise", default="./blaise", help="blaise binary")
+    parser.add_argument("--elements", type=int, default=10000000, help="elements of every array")
+    parser.add_argument("--rounds", type=int, default=10, help="times every expression runs")
+    parser.add_argument("--repeat", type=int, default=3, help="runs per variant, the fastest one counts")
+    args = parser.parse_args()
+
+    values = {"elements": args.elements, "rounds": args.rounds}
+    setup = SETUP % values
+
+    with tempfile.TemporaryDirectory(prefix="blaise-arrays-") as workdir:
+        setup_time = fastest(args.blaise, workdir, "setup", setup, args.repeat)
+
+        for number, (expression, bytes_per_element) in enumerate(VARIANTS):
+            text = setup + LOOP % dict(values, expression=expression)
+            time = fastest(args.blaise, workdir, "variant%d" % number, text, args.repeat) - setup_time
+            per_round = time / args.rounds
+            bandwidth = bytes_per_element * args.elements / (per_round / 1000) / 1e9
+
+            print("%8s  %8.2f ms  %6.2f GB/s" % (expression, per_round, bandwidth))
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+"""Measures exec-tac against interp on loops and calls.
+
+Runs each program under interp and exec-tac --repeat times and prints the
+fastest wall time of each and their ratio. The programs are a loop of
+arithmetic on globals, a recursive function and a loop that calls a
+function reading a variable of its caller, so that the dynamic scoping of
+exec-tac is measured too.
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+PROGRAMS = [
+    ("loop", """
+i = 0;
+s = 0;
+
+loop if (i < %(iterations)d)
+begin
+    s = s + i * 2 - i / 3;
+    i = i + 1;
+end
+
+writeln(s);
+"""),
+    ("recursion", """
+function fib(n)
+begin
+    if (n < 2) then return n;
+    return fib(n - 1) + fib(n - 2);
+end
+
+writeln(fib(%(depth)d));
+"""),
+    ("caller variable", """
+function scaled(v) return v * factor;
+
+function total(factor)
+begin
+    i = 0;
+    s = 0;
+
+    loop if (i < %(iterations)d)
+    begin
+        s = s + scaled(i);
+        i = i + 1;
+    end
+
+    return s;
+end
+
+writeln(total(3));
+"""),
+]
+
+
+def wall_time(command):
+    start = time.perf_counter()
+    result = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+    elapsed = time.perf_counter() - start
+
+    if result.returncode != 0:
+        sys.exit("%s failed:\n%s" % (" ".join(command), result.stderr))
+
+    return elapsed * 1000, result.stdout
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--blaise", default="./blaise", help="blaise binary")
+    parser.add_argument("--iterations", type=int, default=1000000, help="iterations of the loops")
+    parser.add_argument("--depth", type=int, default=25, help="argument of the recursive function")
+    parser.add_argument("--repeat", type=int, default=3, help="runs per mode, the fastest one counts")
+    args = parser.parse_args()
+
+    values = {"iterations": args.iterations, "depth": args.depth}
+
+    with tempfile.TemporaryDirectory(prefix="blaise-exectac-") as workdir:
+        for number, (name, text) in enumerate(PROGRAMS):
+            program = os.path.join(workdir, "program%d.bls" % number)
+
+            with open(program, "w") as out:
+                out.write(text % values)
+
+            runs = {mode: [wall_time([args.blaise, mode, program]) for _ in range(args.repeat)]
+                    for mode in ("interp", "exec-tac")}
+
+            if runs["interp"][0][1] != runs["exec-tac"][0][1]:
+                sys.exit("%s: exec-tac prints %r, interp %r" % (name, runs["exec-tac"][0][1], runs["interp"][0][1]))
+
+            interp = min(elapsed for elapsed, _ in runs["interp"])
+            exec_tac = min(elapsed for elapsed, _ in runs["exec-tac"])
+            print("%16s  interp %10.1f ms  exec-tac %10.1f ms  %5.1fx" % (name, interp, exec_tac, interp / exec_tac))
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
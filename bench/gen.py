@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+"""Generates large Blaise programs for bench/run.py.
+
+The program consists of --functions small functions followed by
+--statements top-level statements. Statements are assignments of random
+arithmetic expressions with --expr-size leaves, calls of the generated
+functions, short loops and if/else if chains of --chain branches. Values
+stay small, so every generated program runs to completion under interp.
+"""
+
+import argparse
+import random
+import sys
+
+
+class Generator:
+    VARIABLES = 16
+    KINDS = ["expr", "call", "loop", "chain"]
+    WEIGHTS = [6, 2, 1, 1]
+
+    def __init__(self, args):
+        self.args = args
+        self.random = random.Random(args.seed)
+        self.lines = []
+
+    def leaf(self):
+        if self.random.random() < 0.5:
+            return str(self.random.randint(1, 9))
+
+        return "v%d" % self.random.randrange(self.VARIABLES)
+
+    # Only + and - between variables and at most a product of two
+    # constants, so a value grows by at most 81 per leaf.
+    def expr(self, leaves):
+        if leaves == 1:
+            return self.leaf()
+
+        if leaves == 2 and self.random.random() < 0.3:
+            return "%d * %d" % (self.random.randint(1, 9), self.random.randint(1, 9))
+
+        left = self.random.randint(1, leaves - 1)
+        op = self.random.choice("+-")
+
+        return "(%s %s %s)" % (self.expr(left), op, self.expr(leaves - left))
+
+    def function(self, index):
+        self.lines += [
+            "function f%d(a, b)" % index,
+            "begin",
+            "    t = a - b + %d;" % self.random.randint(1, 9),
+            "    if (t > 1000) then return t - 1000;",
+            "    else if (t < -1000) then return t + 1000;",
+            "    return t;",
+            "end",
+        ]
+
+    def call(self):
+        return "f%d(%s, %s)" % (self.random.randrange(self.args.functions), self.leaf(), self.leaf())
+
+    # Every variable is clamped back to [0, 100] after use, otherwise long
+    # programs overflow int.
+    def clamp(self, var):
+        self.lines += [
+            "if (%s > 100) then %s = %s - ((%s / 100) * 100);" % (var, var, var, var),
+            "if (%s < 0) then %s = 0 - %s;" % (var, var, var),
+        ]
+
+    def chain(self, var):
+        first = True
+        step = max(1, 100 // self.args.chain)
+
+        for branch in range(self.args.chain):
+            keyword = "if" if first else "else if"
+            self.lines.append("%s (%s < %d) then v%d = v%d + %d;"
+                              % (keyword, var, (branch + 1) * step, self.random.randrange(self.VARIABLES),
+                                 self.random.randrange(self.VARIABLES), branch))
+            first = False
+
+        self.lines.append("else %s = 0;" % var)
+
+    def statement(self, index):
+        var = "v%d" % self.random.randrange(self.VARIABLES)
+        kind = self.args.only or self.random.choices(self.KINDS, self.WEIGHTS)[0]
+
+        if kind == "call" and self.args.functions == 0:
+            kind = "expr"
+
+        if kind == "expr":
+            self.lines.append("%s = %s;" % (var, self.expr(self.args.expr_size)))
+        elif kind == "call":
+            self.lines.append("%s = %s;" % (var, self.call()))
+        elif kind == "loop":
+            self.lines += [
+                "i = 0;",
+                "loop if (i < %d) begin" % self.args.loop,
+                "    %s = %s + i;" % (var, var),
+                "    i = i + 1;",
+                "end",
+            ]
+        else:
+            self.chain(var)
+
+        self.clamp(var)
+
+        if index % 100 == 99:
+            self.lines.append("writeln(%s);" % var)
+
+    def generate(self):
+        for var in range(self.VARIABLES):
+            self.lines.append("v%d = %d;" % (var, var))
+
+        for index in range(self.args.functions):
+            self.function(index)
+
+        for index in range(self.args.statements):
+            self.statement(index)
+
+        self.lines.append("writeln(v0);")
+
+        return "\n".join(self.lines) + "\n"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--statements", type=int, default=1000, help="top-level statements")
+    parser.add_argument("--expr-size", type=int, default=8, help="leaves per expression")
+    parser.add_argument("--functions", type=int, default=16, help="generated functions")
+    parser.add_argument("--chain", type=int, default=8, help="branches per if/else if chain")
+    parser.add_argument("--loop", type=int, default=10, help="iterations per loop")
+    parser.add_argument("--only", choices=Generator.KINDS, help="generate statements of one kind only")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("-o", "--output", help="output file, stdout by default")
+    args = parser.parse_args()
+
+    if args.expr_size < 1 or args.chain < 1 or args.statements < 0 or args.functions < 0:
+        parser.error("sizes must be positive")
+
+    text = Generator(args).generate()
+
+    if args.output:
+        with open(args.output, "w") as out:
+            out.write(text)
+    else:
+        sys.stdout.write(text)
+
+
+if __name__ == "__main__":
+    main()
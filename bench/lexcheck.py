@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+"""Differential check of the hand-written lexer against the generated one.
+
+Runs `blaise lexcheck` over a corpus: the given .bls files, programs
+from bench/gen.py and random mixes of fragments that exercise the edge
+cases of the grammar (unterminated strings and comments, incomplete
+numbers, lone '!', multibyte characters). Exits with 1 on the first file
+where the token streams or lexer errors differ and keeps that file.
+"""
+
+import argparse
+import os
+import random
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+FRAGMENTS = [
+    " ", "\t", "\n", "\r\n", ";", "x", "_a1", "begin", "end", "beginx", "writeln", "if", "then", "else",
+    "loop", "function", "returns", "return", "true", "falsey", "0", "42", "1.5", "1.", "2e+3", "2e-3", "2e|3",
+    "2e", "2e+", "(", ")", ",", "*", "/", "+", "-", "=", "==", "!=", "!", "<", "<=", ">", ">=", "'a'", "''",
+    "'''", "'ab'", "'", "\"str\"", "\"multi\nline\"", "\"", "// comment", "/* block */", "/* multi\nline */",
+    "/*", "*/", "/**/", "#", ".", "\u00e9", "'\u00e9'", "\"\u043f\u0440\u0438\u0432\u0435\u0442\"",
+    "/* \u20ac */", "\u20ac", "import", "importx", "[", "]", "a[0]", "[1, 2.5]",
+]
+
+
+def check(blaise, path):
+    result = subprocess.run([blaise, "lexcheck", path], stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                            text=True)
+    return result.returncode == 0, result.stdout
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--blaise", default="./blaise", help="blaise binary")
+    parser.add_argument("--random", type=int, default=200, help="random fragment mixes to check")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("files", nargs="*", help=".bls files to check as well")
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    workdir = tempfile.mkdtemp(prefix="blaise-lexcheck-")
+    corpus = list(args.files)
+
+    for seed in range(4):
+        path = os.path.join(workdir, "gen-%d.bls" % seed)
+        subprocess.run([sys.executable, os.path.join(HERE, "gen.py"), "--statements", "500", "--seed", str(seed),
+                        "-o", path], check=True)
+        corpus.append(path)
+
+    for index in range(args.random):
+        path = os.path.join(workdir, "mix-%d.bls" % index)
+
+        with open(path, "w", encoding="utf-8", newline="") as out:
+            out.write("".join(rng.choice(FRAGMENTS) for _ in range(rng.randint(1, 60))))
+
+        corpus.append(path)
+
+    for path in corpus:
+        ok, output = check(args.blaise, path)
+
+        if not ok:
+            print("%s:\n%s" % (path, output))
+            return 1
+
+    print("%d files match" % len(corpus))
+
+    for path in os.listdir(workdir):
+        os.remove(os.path.join(workdir, path))
+
+    os.rmdir(workdir)
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+"""Measures what the --max-steps and --timeout safepoints and the memory
+counting of --max-memory cost.
+
+Runs interp on a program that does little besides loop iterations and
+function calls, the two places where steps are counted and where frames
+come and go, and reports the execute phase without limits, with step and
+time limits too high to be hit and with such a memory limit. With
+--baseline the same program also runs on another binary, for example
+one built before the safepoints, to compare against. A round runs every
+variant once; an overhead is the median over the rounds of the ratio of
+the two times in the same round, which keeps a slower stretch of the
+machine out of it better than comparing the fastest runs. With
+--max-overhead the harness exits with 1 if the limits or the safepoints
+cost more than that many percent, the memory counting is only reported.
+"""
+
+import argparse
+import os
+import statistics
+import subprocess
+import sys
+import tempfile
+
+PROGRAM = """
+function step(x)
+begin
+    return x + 1;
+end
+
+i = 0;
+s = 0;
+
+loop if (i < %d)
+begin
+    s = step(s);
+    i = i + 1;
+end
+
+writeln(s);
+"""
+
+
+def execute_time(blaise, program, options):
+    result = subprocess.run([blaise, "interp", program, "--time-phases", "--no-cache"] + options,
+                            stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+
+    if result.returncode != 0:
+        sys.exit("%s interp %s failed:\n%s" % (blaise, program, result.stderr))
+
+    for line in result.stderr.splitlines():
+        fields = line.split()
+
+        if len(fields) >= 3 and fields[0] == "phase" and fields[1] == "execute":
+            return float(fields[2])
+
+    sys.exit("%s reported no execute phase" % blaise)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--blaise", default="./blaise", help="blaise binary")
+    parser.add_argument("--baseline", help="binary to compare the run without limits against")
+    parser.add_argument("--iterations", type=int, default=200000, help="loop iterations of the program")
+    parser.add_argument("--repeat", type=int, default=21, help="rounds, each runs every variant once")
+    parser.add_argument("--max-overhead", type=float, help="fail if the safepoints cost more percent")
+    args = parser.parse_args()
+
+    limits = ["--max-steps=%d" % (args.iterations * 4), "--timeout=%d" % (3600 * 1000)]
+    variants = [("no limits", args.blaise, []), ("limits", args.blaise, limits),
+                ("memory", args.blaise, ["--max-memory=%d" % (1 << 20)])]
+
+    if args.baseline:
+        variants.insert(0, ("baseline", args.baseline, []))
+
+    times = {name: [] for name, _, _ in variants}
+
+    with tempfile.TemporaryDirectory(prefix="blaise-limits-") as workdir:
+        program = os.path.join(workdir, "steps.bls")
+
+        with open(program, "w") as out:
+            out.write(PROGRAM % args.iterations)
+
+        # Every other round runs the variants backwards, so that none of
+        # them always runs right after the same other one
+        for number in range(args.repeat):
+            for name, blaise, options in variants if number % 2 == 0 else reversed(variants):
+                times[name].append(execute_time(blaise, program, options))
+
+    print("%s, %d iterations, %d rounds" % (args.blaise, args.iterations, args.repeat))
+
+    if args.baseline:
+        print("baseline %s" % args.baseline)
+
+    for name, _, _ in variants:
+        print("%10s  %10.2f ms fastest  %10.2f ms median" % (name, min(times[name]), statistics.median(times[name])))
+
+    comparisons = [("limits", "no limits"), ("memory", "no limits")]
+
+    if args.baseline:
+        comparisons.append(("no limits", "baseline"))
+
+    failures = []
+
+    for name, reference in comparisons:
+        overhead = (statistics.median(a / b for a, b in zip(times[name], times[reference])) - 1) * 100
+        print("%s over %s: %+.2f%%" % (name, reference, overhead))
+
+        if args.max_overhead is not None and name != "memory" and overhead > args.max_overhead:
+            failures.append("%s are %.2f%% slower than %s" % (name, overhead, reference))
+
+    for failure in failures:
+        print(failure, file=sys.stderr)
+
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
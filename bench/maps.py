@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+"""Measures map lookups and inserts in interp against if/else if chains.
+
+Scripts without maps look a key up with a function that compares it
+against every key in turn. The harness runs --operations lookups of
+--keys int keys that way and with a map, each in a loop that also
+computes the key, next to the loop alone, whose statements take most
+of the time of a map lookup. Then it puts --operations distinct keys into
+a map and looks all of them up, which no longer fits in the caches.
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+
+KEY_LOOP = """
+i = 0;
+s = 0;
+
+loop if (i < %(operations)d)
+begin
+    k = i - (i / %(keys)d) * %(keys)d;
+    %(lookup)s
+    i = i + 1;
+end
+
+writeln(s);
+"""
+
+INSERT_LOOP = """
+m = map();
+i = 0;
+
+loop if (i < %(operations)d)
+begin
+    m[i] = i;
+    i = i + 1;
+end
+"""
+
+LOOKUP_LOOP = """
+i = 0;
+s = 0;
+
+loop if (i < %(operations)d)
+begin
+    s = s + m[i];
+    i = i + 1;
+end
+
+writeln(s);
+"""
+
+
+def chain_program(values):
+    branches = ["if (k == 0) then v = 0;"]
+    branches += ["else if (k == %d) then v = %d;" % (key, key * 3) for key in range(1, values["keys"])]
+    function = "function lookup(k)\nbegin\n    v = -1;\n    %s\n    return v;\nend\n" % "\n    ".join(branches)
+
+    return function + KEY_LOOP % dict(values, lookup="s = s + lookup(k);")
+
+
+def map_program(values):
+    setup = "m = map();\n" + "".join("m[%d] = %d;\n" % (key, key * 3) for key in range(values["keys"]))
+
+    return setup + KEY_LOOP % dict(values, lookup="s = s + m[k];")
+
+
+def execute_time(blaise, program):
+    result = subprocess.run([blaise, "interp", program, "--time-phases", "--no-cache"],
+                            stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+
+    if result.returncode != 0:
+        sys.exit("%s interp %s failed:\n%s" % (blaise, program, result.stderr))
+
+    for line in result.stderr.splitlines():
+        fields = line.split()
+
+        if len(fields) >= 3 and fields[0] == "phase" and fields[1] == "execute":
+            return float(fields[2])
+
+    sys.exit("%s reported no execute phase" % blaise)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--blaise", default="./blaise", help="blaise binary")
+    parser.add_argument("--operations", type=int, default=10000000, help="lookups and inserts of every variant")
+    parser.add_argument("--keys", type=int, default=64, help="keys of the if chain")
+    parser.add_argument("--repeat", type=int, default=1, help="runs per variant, the fastest one counts")
+    args = parser.parse_args()
+
+    values = {"operations": args.operations, "keys": args.keys}
+    programs = [
+        ("loop", KEY_LOOP % dict(values, lookup="")),
+        ("if chain", chain_program(values)),
+        ("map", map_program(values)),
+        ("insert", INSERT_LOOP % values),
+        ("insert+lookup", INSERT_LOOP % values + LOOKUP_LOOP % values),
+    ]
+    times = {}
+
+    with tempfile.TemporaryDirectory(prefix="blaise-maps-") as workdir:
+        for number, (name, text) in enumerate(programs):
+            program = os.path.join(workdir, "variant%d.bls" % number)
+
+            with open(program, "w") as out:
+                out.write(text)
+
+            times[name] = min(execute_time(args.blaise, program) for _ in range(args.repeat))
+
+    # The lookups of the big map are what the second loop adds
+    times["lookup"] = times.pop("insert+lookup") - times["insert"]
+
+    for name, time in times.items():
+        print("%8s  %10.2f ms  %8.1f ns per iteration" % (name, time, time * 1e6 / args.operations))
+
+
+if __name__ == "__main__":
+    sys.exit(main())
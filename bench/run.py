@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+"""Measures how blaise scales with program size.
+
+Each series grows one dimension of the programs made by bench/gen.py
+(statements, expression size, functions, else if chain length) and runs
+`comp` and `interp` with --time-phases on every size. For every phase the
+scaling exponent k in time ~ size^k is fitted by least squares over
+log(size) and log(time): 1 is linear, 2 is quadratic. With
+--max-exponent the harness exits with 1 if some phase scales worse.
+"""
+
+import argparse
+import math
+import os
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+# name -> generator option, sizes, options fixed for the series
+SERIES = {
+    "statements": ("--statements", [1000, 2000, 4000, 8000, 16000], []),
+    "expr-size": ("--expr-size", [32, 64, 128, 256, 512], ["--statements", "50", "--only", "expr"]),
+    "functions": ("--functions", [250, 500, 1000, 2000, 4000], ["--statements", "10", "--only", "call"]),
+    "chain": ("--chain", [32, 64, 128, 256, 512], ["--statements", "50", "--only", "chain"]),
+}
+
+# command -> phases it reports
+COMMANDS = {
+    "comp": ["parse", "compile"],
+    "interp": ["parse", "execute"],
+}
+
+
+# Without the cache, so that the parse phase parses the program and the
+# runs leave nothing behind in ~/.cache/blaise
+def run_phases(blaise, command, program):
+    result = subprocess.run([blaise, command, program, "--time-phases", "--no-cache"], stdout=subprocess.DEVNULL,
+                            stderr=subprocess.PIPE, text=True)
+
+    if result.returncode != 0:
+        sys.exit("%s %s %s failed:\n%s" % (blaise, command, program, result.stderr))
+
+    phases = {}
+
+    for line in result.stderr.splitlines():
+        fields = line.split()
+
+        if len(fields) >= 3 and fields[0] == "phase":
+            phases[fields[1]] = float(fields[2])
+
+    return phases
+
+
+def exponent(sizes, times):
+    # Times under 0.1 ms are timer noise, they would dominate the fit
+    xs = [math.log(size) for size in sizes]
+    ys = [math.log(max(time, 0.1)) for time in times]
+    mean_x = sum(xs) / len(xs)
+    mean_y = sum(ys) / len(ys)
+    var = sum((x - mean_x) ** 2 for x in xs)
+
+    return sum((x - mean_x) * (y - mean_y) for x, y in zip(xs, ys)) / var
+
+
+def measure(args, name, workdir):
+    option, sizes, fixed = SERIES[name]
+    sizes = [max(1, int(size * args.scale)) for size in sizes]
+    columns = [(command, phase) for command, phases in COMMANDS.items() for phase in phases]
+    times = {column: [] for column in columns}
+
+    print("%s:" % name)
+    print("  %8s" % "size" + "".join("  %16s" % ("%s %s" % column) for column in columns))
+
+    for size in sizes:
+        program = os.path.join(workdir, "%s-%d.bls" % (name, size))
+        subprocess.run([sys.executable, os.path.join(HERE, "gen.py"), option, str(size), "-o", program] + fixed,
+                       check=True)
+
+        for command, phases in COMMANDS.items():
+            best = {}
+
+            for _ in range(args.repeat):
+                for phase, time in run_phases(args.blaise, command, program).items():
+                    best[phase] = min(best.get(phase, time), time)
+
+            for phase in phases:
+                times[(command, phase)].append(best[phase])
+
+        print("  %8d" % size + "".join("  %13.2f ms" % times[column][-1] for column in columns))
+
+    exponents = {column: exponent(sizes, times[column]) for column in columns}
+    print("  %8s" % "exponent" + "".join("  %16.2f" % exponents[column] for column in columns))
+
+    return exponents
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--blaise", default="./blaise", help="blaise binary")
+    parser.add_argument("--series", action="append", choices=SERIES.keys(), help="series to run, all by default")
+    parser.add_argument("--repeat", type=int, default=3, help="runs per size, the fastest one counts")
+    parser.add_argument("--scale", type=float, default=1.0, help="multiplier for every size")
+    parser.add_argument("--max-exponent", type=float, help="fail if some phase scales worse")
+    args = parser.parse_args()
+
+    failures = []
+
+    with tempfile.TemporaryDirectory(prefix="blaise-bench-") as workdir:
+        for name in args.series or SERIES.keys():
+            for (command, phase), value in measure(args, name, workdir).items():
+                if args.max_exponent is not None and value > args.max_exponent:
+                    failures.append("%s: %s %s scales as size^%.2f" % (name, command, phase, value))
+
+    for failure in failures:
+        print(failure, file=sys.stderr)
+
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+"""Checks that exec-tac and compiled programs resolve variables the way interp does.
+
+Runs small programs that read variables before they are assigned, read
+variables of the calling function, define functions inside functions and
+assign variables inside blocks, under interp and exec-tac. With --cc also
+compiles the output of `blaise comp --emit=c` and runs it, with --runtime
+links the output of `blaise comp --emit=asm` against libblaisert.a and runs
+it. Output and the error message have to be the same. Exits with 1 on the
+first case that differs.
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+RUNTIME = os.path.join(HERE, os.pardir, "src", "runtime")
+
+# Name, program
+CASES = [
+    ("undefined", "writeln(1);\nwriteln(x);\n"),
+    ("undefined in function", "function f(a)\nbegin\n    writeln(zz);\nend\nf(1);\n"),
+    ("assigned after call", "function f() return k;\nwriteln(f());\nk = 1;\n"),
+    ("assigned before call", "function f() return k;\nk = 3;\nwriteln(f());\n"),
+    ("operand", "x = 1;\nwriteln(x + 1);\nwriteln(x + y);\n"),
+    ("no value", "function f()\nbegin\n    y = 1;\nend\nx = f();\nwriteln(x);\n"),
+    ("caller local", "function f() return a;\nfunction g()\nbegin\n    a = 7;\n    return f();\nend\n"
+                     "writeln(g());\nwriteln(a);\n"),
+    ("caller parameter", "function f() return n;\nfunction g(n) return f();\nn = 1;\nwriteln(g(4));\n"
+                         "writeln(n);\n"),
+    ("assigned by callee", "function f()\nbegin\n    a = a + 1;\nend\nfunction g()\nbegin\n    a = 1;\n"
+                           "    f();\n    return a;\nend\nwriteln(g());\nwriteln(a);\n"),
+    ("recursion", "function f(n)\nbegin\n    if (n == 0) then return d;\n    d = n;\n    return f(n - 1);\n"
+                  "end\nwriteln(f(3));\nwriteln(d);\n"),
+    ("block local", "begin\n    b = 1;\n    writeln(b);\nend\nwriteln(b);\n"),
+    ("branch local", "if (true) then c = 2;\nwriteln(c);\n"),
+    ("loop local", "i = 0;\nloop if (i < 2)\nbegin\n    i = i + 1;\n    s = i;\nend\nwriteln(i);\nwriteln(s);\n"),
+    ("outer assigned in block", "b = 0;\nbegin\n    b = 5;\nend\nwriteln(b);\n"),
+    ("nested definition", "function f()\nbegin\n    function g() return 1;\n    return g();\nend\n"
+                          "writeln(f());\nwriteln(f());\n"),
+    ("nested definition hides", "function g() return 1;\nfunction h() return g();\nfunction f()\nbegin\n"
+                                "    function g() return 2;\n    return h();\nend\nwriteln(f());\nwriteln(h());\n"),
+    ("redefinition", "function f() return 1;\nfunction f() return 2;\n"),
+]
+
+
+# Standard output and the message of the error, if any
+def run(command):
+    result = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+    errors = [line.replace("what():", "").strip() for line in result.stderr.splitlines()
+              if not line.startswith("terminate called")]
+
+    return result.stdout, errors[-1] if result.returncode != 0 and errors else ""
+
+
+# Like run(), for the program compiled from the output of comp --emit=c
+def run_c(blaise, cc, path):
+    source = path[:-len(".bls")] + ".c"
+    binary = path[:-len(".bls")] + ".bin"
+
+    with open(source, "w") as out:
+        emitted = run([blaise, "comp", "--emit=c", path])
+        out.write(emitted[0])
+
+    if emitted[1]:
+        return "", emitted[1]
+
+    subprocess.run([cc, "-O1", "-I", RUNTIME, source, "-o", binary], check=True)
+
+    return run([binary])
+
+
+# Like run(), for the program assembled from the output of comp --emit=asm
+def run_asm(blaise, runtime, path):
+    source = path[:-len(".bls")] + ".s"
+    binary = path[:-len(".bls")] + ".asm.bin"
+
+    with open(source, "w") as out:
+        emitted = run([blaise, "comp", "--emit=asm", path])
+        out.write(emitted[0])
+
+    if emitted[1]:
+        return "", emitted[1]
+
+    subprocess.run(["cc", source, runtime, "-o", binary], check=True)
+
+    return run([binary])
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--blaise", default="./blaise", help="blaise binary")
+    parser.add_argument("--cc", help="C compiler for the output of comp --emit=c, not checked without it")
+    parser.add_argument("--runtime", help="libblaisert.a for the output of comp --emit=asm, not checked without it")
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory(prefix="blaise-tacscope-") as workdir:
+        for number, (name, text) in enumerate(CASES):
+            path = os.path.join(workdir, "case%d.bls" % number)
+
+            with open(path, "w") as out:
+                out.write(text)
+
+            expected = run([args.blaise, "interp", path])
+            results = [("exec-tac", run([args.blaise, "exec-tac", path]))]
+
+            if args.cc:
+                results.append(("comp --emit=c", run_c(args.blaise, args.cc, path)))
+
+            if args.runtime:
+                results.append(("comp --emit=asm", run_asm(args.blaise, args.runtime, path)))
+
+            for mode, result in results:
+                if result != expected:
+                    print("%s: %s gives %r, interp %r" % (name, mode, result, expected))
+                    return 1
+
+    print("%d cases match" % len(CASES))
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
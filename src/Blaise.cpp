@@ -0,0 +1,114 @@
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <typeinfo>
+
+#include "antlr4-runtime.h"
+#include "Blaise.h"
+#include "BlaiseAst.h"
+#include "BlaiseParse.h"
+#include "BlaiseSource.h"
+#include "InterpreterVisitor.h"
+#include "antlr/BlaiseLexer.h"
+#include "antlr/BlaiseParser.h"
+
+namespace {
+
+// Collects lexer and parser errors for the exception of a failed compile
+class ErrorCollector : public antlr4::BaseErrorListener {
+public:
+    std::string name;
+    std::ostringstream messages;
+    size_t count = 0;
+
+    void syntaxError(antlr4::Recognizer *recognizer, antlr4::Token *offendingSymbol, size_t line,
+                     size_t charPositionInLine, const std::string &msg, std::exception_ptr e) override {
+        messages << (count++ ? "\n" : "") << name << ":" << line << ":" << charPositionInLine << ": " << msg;
+    }
+};
+
+}
+
+BlaiseProgram::BlaiseProgram(std::shared_ptr<const BlaiseAst> ast) : ast_(std::move(ast)) {}
+
+BlaiseProgram BlaiseProgram::Compile(std::string_view source, const std::string& name) {
+    ErrorCollector errors;
+    errors.name = name;
+
+    MappedCharStream input(source, name);
+    BlaiseLexer lexer(&input);
+    lexer.removeErrorListeners();
+    lexer.addErrorListener(&errors);
+
+    antlr4::CommonTokenStream tokens(&lexer);
+    BlaiseParser parser(&tokens);
+    bool retried;
+    BlaiseParser::ProgramContext *program = ParseRule(parser, tokens, errors, retried, &BlaiseParser::program);
+
+    if (errors.count != 0)
+        throw std::invalid_argument(errors.messages.str());
+
+    auto ast = std::make_shared<const BlaiseAst>(BlaiseAst::Build(program));
+
+    // A context has no module loader, the import would only fail when it runs
+    for (AstNodeId id = 0; id < ast->Root(); id++) {
+        const AstNode& node = ast->Node(id);
+
+        if (node.kind == AST_NODE_KIND::IMPORT_STMT) {
+            SourcePosition position = ast->Position(node);
+            throw std::invalid_argument(name + ":" + std::to_string(position.line) + ":"
+                                        + std::to_string(position.column - 1)
+                                        + ": import is not supported by programs compiled with BlaiseProgram");
+        }
+    }
+
+    return BlaiseProgram(std::move(ast));
+}
+
+BlaiseProgram BlaiseProgram::CompileFile(const std::string& path) {
+    MappedFile file(path);
+
+    if (!file.IsOpen())
+        throw std::invalid_argument("Cannot open " + path);
+
+    return Compile(file.Data(), path);
+}
+
+BlaiseContext::BlaiseContext(const BlaiseProgram& program, std::ostream& out)
+        : program_(program), interpreter_(std::make_unique<InterpreterVisitor>(out)) {}
+
+BlaiseContext::~BlaiseContext() = default;
+
+void BlaiseContext::SetGlobal(const std::string& name, const std::any& value) {
+    const std::type_info& type = value.type();
+
+    if (type != typeid(int) && type != typeid(double) && type != typeid(bool) && type != typeid(char)
+        && type != typeid(std::string))
+        throw std::invalid_argument("Global " + name + " has to be an int, double, bool, char or string");
+
+    for (BlaiseVariable& var : interpreter_->gl_block->variables) {
+        if (var.Name() == name) {
+            var.SetValue(value);
+            return;
+        }
+    }
+
+    interpreter_->AddGlobal(name, value);
+}
+
+std::any BlaiseContext::Global(const std::string& name) const {
+    for (const BlaiseVariable& var : interpreter_->gl_block->variables) {
+        if (var.Name() == name)
+            return var.Value();
+    }
+
+    return std::any();
+}
+
+void BlaiseContext::Run() {
+    if (ran_)
+        throw std::invalid_argument("A context runs its program only once");
+
+    ran_ = true;
+    interpreter_->Visit(*program_.ast_);
+}
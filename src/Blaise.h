@@ -0,0 +1,65 @@
+#pragma once
+
+#include <any>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// Embedding API of libblaise. Only standard headers are needed to use it,
+// the ANTLR runtime is only needed to link.
+
+class BlaiseAst;
+class InterpreterVisitor;
+
+// Compiled program. It never changes once compiled: copies share it, and
+// any number of contexts may run it at once, from any threads.
+class BlaiseProgram {
+    friend class BlaiseContext;
+
+    std::shared_ptr<const BlaiseAst> ast_;
+
+    explicit BlaiseProgram(std::shared_ptr<const BlaiseAst> ast);
+
+public:
+    // Parses source, name is only used in error messages. Throws
+    // std::invalid_argument with one line per syntax error. Modules cannot
+    // be loaded through this API, a source with an import statement is
+    // rejected the same way.
+    static BlaiseProgram Compile(std::string_view source, const std::string& name = "<source>");
+
+    // Compiles the file at path, throws std::invalid_argument if it
+    // cannot be read
+    static BlaiseProgram CompileFile(const std::string& path);
+};
+
+// One run of a program: its global variables and functions, and the
+// stream writeln writes to. A context belongs to one thread at a time and
+// runs its program once, it is cheap to create one per run.
+class BlaiseContext {
+    BlaiseProgram program_;
+    std::unique_ptr<InterpreterVisitor> interpreter_;
+    bool ran_ = false;
+
+public:
+    // out has to outlive the context
+    explicit BlaiseContext(const BlaiseProgram& program, std::ostream& out = std::cout);
+
+    BlaiseContext(const BlaiseContext&) = delete;
+
+    BlaiseContext& operator=(const BlaiseContext&) = delete;
+
+    ~BlaiseContext();
+
+    // Defines a global variable for the program to read before it runs.
+    // value has to hold an int, double, bool, char or std::string,
+    // otherwise std::invalid_argument is thrown.
+    void SetGlobal(const std::string& name, const std::any& value);
+
+    // Value of a global variable, empty if there is none
+    std::any Global(const std::string& name) const;
+
+    // Runs the program. Runtime errors are thrown as std::invalid_argument,
+    // the globals set so far stay readable.
+    void Run();
+};
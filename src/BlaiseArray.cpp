@@ -0,0 +1,187 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include "BlaiseArray.h"
+
+namespace {
+
+// Writes size elements to out. The shapes are array and array, array and
+// number, number and array.
+using MapKernel = void (*)(const double *lhs, const double *rhs, double *out, size_t size);
+
+enum Shape {
+    ARRAY_ARRAY,
+    ARRAY_NUMBER,
+    NUMBER_ARRAY,
+
+    SHAPE_COUNT
+};
+
+constexpr size_t OP_COUNT = static_cast<size_t>(BLAISE_OP_ID::GEQUAL) + 1;
+
+struct ArrayKernels {
+    MapKernel map[OP_COUNT][SHAPE_COUNT];
+    double (*sum)(const double *data, size_t size);
+    double (*min)(const double *data, size_t size);
+    double (*max)(const double *data, size_t size);
+};
+
+// SSE2 on x86-64, which every such processor has, NEON on ARM64
+namespace baseline {
+#define VECTOR_BYTES 16
+#include "BlaiseArrayKernels.h"
+#undef VECTOR_BYTES
+}
+
+#if defined(__x86_64__)
+#define BLAISE_AVX2
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+namespace avx2 {
+#define VECTOR_BYTES 32
+#include "BlaiseArrayKernels.h"
+#undef VECTOR_BYTES
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+#endif
+
+// Picked once, by what the processor running the program supports
+const ArrayKernels& Kernels() {
+#ifdef BLAISE_AVX2
+    static const ArrayKernels& kernels = __builtin_cpu_supports("avx2") ? avx2::KERNELS : baseline::KERNELS;
+    return kernels;
+#else
+    return baseline::KERNELS;
+#endif
+}
+
+MapKernel KernelFor(BLAISE_OP_ID op, Shape shape) {
+    return Kernels().map[static_cast<size_t>(op)][shape];
+}
+
+}
+
+BlaiseArray::BlaiseArray(const std::vector<double>& elements) : BlaiseArray(Uninitialized(elements.size())) {
+    std::copy(elements.begin(), elements.end(), elements_.get());
+}
+
+BlaiseArray::BlaiseArray(size_t size, double value) : BlaiseArray(Uninitialized(size)) {
+    std::fill_n(elements_.get(), size, value);
+}
+
+BlaiseArray BlaiseArray::Uninitialized(size_t size) {
+    BlaiseArray array;
+
+    array.elements_.reset(new double[size]);
+    array.size_ = size;
+
+    return array;
+}
+
+size_t BlaiseArray::Size() const {
+    return size_;
+}
+
+const double *BlaiseArray::Data() const {
+    return elements_.get();
+}
+
+void BlaiseArray::CheckIndex(int index) const {
+    if (index < 0 || static_cast<size_t>(index) >= size_)
+        throw std::invalid_argument("Index " + std::to_string(index) + " is out of range for an array of length "
+                                    + std::to_string(size_));
+}
+
+double BlaiseArray::At(int index) const {
+    CheckIndex(index);
+    return elements_[index];
+}
+
+void BlaiseArray::Set(int index, double value) {
+    CheckIndex(index);
+
+    // Other copies keep the elements they had
+    if (elements_.use_count() > 1) {
+        BlaiseArray copy = Uninitialized(size_);
+
+        std::copy_n(elements_.get(), size_, copy.elements_.get());
+        elements_ = std::move(copy.elements_);
+    }
+
+    elements_[index] = value;
+}
+
+std::string BlaiseArray::ToString() const {
+    std::ostringstream out;
+
+    out << "[";
+
+    for (size_t i = 0; i < size_; i++)
+        out << (i ? ", " : "") << elements_[i];
+
+    out << "]";
+
+    return out.str();
+}
+
+size_t BlaiseArray::Footprint() const {
+    return size_ * sizeof(double);
+}
+
+BlaiseArray BlaiseArray::Apply(BLAISE_OP_ID op, const BlaiseArray& lhs, const BlaiseArray& rhs) {
+    if (lhs.size_ != rhs.size_)
+        throw std::invalid_argument("Arrays of lengths " + std::to_string(lhs.size_) + " and "
+                                    + std::to_string(rhs.size_) + " cannot be combined");
+
+    BlaiseArray result = Uninitialized(lhs.size_);
+    KernelFor(op, ARRAY_ARRAY)(lhs.Data(), rhs.Data(), result.elements_.get(), lhs.size_);
+
+    return result;
+}
+
+BlaiseArray BlaiseArray::Apply(BLAISE_OP_ID op, const BlaiseArray& lhs, double rhs) {
+    BlaiseArray result = Uninitialized(lhs.size_);
+    KernelFor(op, ARRAY_NUMBER)(lhs.Data(), &rhs, result.elements_.get(), lhs.size_);
+
+    return result;
+}
+
+BlaiseArray BlaiseArray::Apply(BLAISE_OP_ID op, double lhs, const BlaiseArray& rhs) {
+    BlaiseArray result = Uninitialized(rhs.size_);
+    KernelFor(op, NUMBER_ARRAY)(&lhs, rhs.Data(), result.elements_.get(), rhs.size_);
+
+    return result;
+}
+
+double BlaiseArray::Sum() const {
+    return Kernels().sum(Data(), size_);
+}
+
+double BlaiseArray::Min() const {
+    if (size_ == 0)
+        throw std::invalid_argument("An empty array has no minimum");
+
+    return Kernels().min(Data(), size_);
+}
+
+double BlaiseArray::Max() const {
+    if (size_ == 0)
+        throw std::invalid_argument("An empty array has no maximum");
+
+    return Kernels().max(Data(), size_);
+}
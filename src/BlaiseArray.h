@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "BlaiseClasses.h"
+
+// Value of an array variable: numbers, all of them double, one after
+// another in memory. Copies share the elements until one of them sets
+// an element, so passing an array to a function or reading a variable
+// copies no elements.
+class BlaiseArray {
+public:
+    BlaiseArray() = default;
+
+    explicit BlaiseArray(const std::vector<double>& elements);
+
+    // size elements of value
+    BlaiseArray(size_t size, double value);
+
+    size_t Size() const;
+
+    const double *Data() const;
+
+    // Throw std::invalid_argument for an index out of range
+    double At(int index) const;
+    void Set(int index, double value);
+
+    std::string ToString() const;
+
+    // Bytes of the elements. Every copy sharing them counts them again.
+    size_t Footprint() const;
+
+    // Element-wise op of two arrays of the same size, or of an array and
+    // a number applied to every element. Comparisons give 1 where they
+    // hold and 0 elsewhere.
+    static BlaiseArray Apply(BLAISE_OP_ID op, const BlaiseArray& lhs, const BlaiseArray& rhs);
+    static BlaiseArray Apply(BLAISE_OP_ID op, const BlaiseArray& lhs, double rhs);
+    static BlaiseArray Apply(BLAISE_OP_ID op, double lhs, const BlaiseArray& rhs);
+
+    double Sum() const;
+
+    // NaN if any element is NaN. Throw std::invalid_argument for an empty
+    // array.
+    double Min() const;
+    double Max() const;
+
+private:
+    // Elements are left uninitialized, the kernels overwrite them
+    static BlaiseArray Uninitialized(size_t size);
+
+    void CheckIndex(int index) const;
+
+    std::shared_ptr<double[]> elements_;
+    size_t size_ = 0;
+};
@@ -0,0 +1,167 @@
+// Kernels of BlaiseArray over vectors of VECTOR_BYTES bytes. BlaiseArray.cpp
+// includes this once per instruction set, each time in a namespace and
+// under a target of its own, so there is no include guard.
+//
+// The vectors are GCC vector extensions, the compiler turns their
+// operators into SIMD instructions of the target even without
+// optimization. Helpers are always inlined for the same reason.
+
+#define KERNEL_INLINE inline __attribute__((always_inline))
+
+using Vector = double __attribute__((vector_size(VECTOR_BYTES)));
+using Mask = int64_t __attribute__((vector_size(VECTOR_BYTES)));
+
+constexpr size_t LANES = VECTOR_BYTES / sizeof(double);
+
+// Loads and stores need no alignment
+KERNEL_INLINE Vector Load(const double *data) {
+    Vector vector;
+    std::memcpy(&vector, data, sizeof(vector));
+    return vector;
+}
+
+KERNEL_INLINE void Store(double *data, Vector vector) {
+    std::memcpy(data, &vector, sizeof(vector));
+}
+
+KERNEL_INLINE Vector Broadcast(double value) {
+    return Vector{} + value;
+}
+
+// 1 where mask is set, 0 elsewhere
+KERNEL_INLINE Vector Truth(Mask mask) {
+    return (Vector)(mask & (Mask)Broadcast(1.0));
+}
+
+KERNEL_INLINE double Truth(bool condition) {
+    return condition ? 1.0 : 0.0;
+}
+
+KERNEL_INLINE Vector Select(Mask mask, Vector yes, Vector no) {
+    return (Vector)((mask & (Mask)yes) | (~mask & (Mask)no));
+}
+
+KERNEL_INLINE double Select(bool condition, double yes, double no) {
+    return condition ? yes : no;
+}
+
+// For a Vector or a single double
+template<BLAISE_OP_ID OP, typename T>
+KERNEL_INLINE T Apply(T lhs, T rhs) {
+    if constexpr (OP == BLAISE_OP_ID::PLUS)
+        return lhs + rhs;
+    else if constexpr (OP == BLAISE_OP_ID::MINUS)
+        return lhs - rhs;
+    else if constexpr (OP == BLAISE_OP_ID::MUL)
+        return lhs * rhs;
+    else if constexpr (OP == BLAISE_OP_ID::DIV)
+        return lhs / rhs;
+    else if constexpr (OP == BLAISE_OP_ID::EQUAL)
+        return Truth(lhs == rhs);
+    else if constexpr (OP == BLAISE_OP_ID::NEQUAL)
+        return Truth(lhs != rhs);
+    else if constexpr (OP == BLAISE_OP_ID::LESS)
+        return Truth(lhs < rhs);
+    else if constexpr (OP == BLAISE_OP_ID::LEQUAL)
+        return Truth(lhs <= rhs);
+    else if constexpr (OP == BLAISE_OP_ID::GREATER)
+        return Truth(lhs > rhs);
+    else
+        return Truth(lhs >= rhs);
+}
+
+// A side that is not an array points to the number to use for every
+// element
+template<BLAISE_OP_ID OP, bool LHS_ARRAY, bool RHS_ARRAY>
+void Map(const double *lhs, const double *rhs, double *out, size_t size) {
+    Vector lhs_all = LHS_ARRAY ? Vector{} : Broadcast(*lhs);
+    Vector rhs_all = RHS_ARRAY ? Vector{} : Broadcast(*rhs);
+    size_t i = 0;
+
+    for (; i + LANES <= size; i += LANES)
+        Store(out + i, Apply<OP>(LHS_ARRAY ? Load(lhs + i) : lhs_all, RHS_ARRAY ? Load(rhs + i) : rhs_all));
+
+    for (; i < size; i++)
+        out[i] = Apply<OP>(LHS_ARRAY ? lhs[i] : *lhs, RHS_ARRAY ? rhs[i] : *rhs);
+}
+
+// Two sums in flight, so that one addition does not wait on the other
+double Sum(const double *data, size_t size) {
+    Vector sums[2] = {};
+    size_t i = 0;
+
+    for (; i + 2 * LANES <= size; i += 2 * LANES) {
+        sums[0] += Load(data + i);
+        sums[1] += Load(data + i + LANES);
+    }
+
+    Vector lanes = sums[0] + sums[1];
+    double sum = 0;
+
+    for (size_t lane = 0; lane < LANES; lane++)
+        sum += lanes[lane];
+
+    for (; i < size; i++)
+        sum += data[i];
+
+    return sum;
+}
+
+// Smallest element, or largest with MAX, NaN if any element is NaN. size
+// is at least 1.
+template<bool MAX>
+double Extreme(const double *data, size_t size) {
+    double extreme = data[0];
+    bool unordered = false;
+    size_t i = 0;
+
+    if (size >= LANES) {
+        Vector lanes = Load(data);
+        Mask nans = lanes != lanes;
+
+        for (i = LANES; i + LANES <= size; i += LANES) {
+            Vector next = Load(data + i);
+            lanes = Select(MAX ? next > lanes : next < lanes, next, lanes);
+            nans |= next != next;
+        }
+
+        extreme = lanes[0];
+
+        for (size_t lane = 1; lane < LANES; lane++)
+            extreme = Select(MAX ? lanes[lane] > extreme : lanes[lane] < extreme, lanes[lane], extreme);
+
+        for (size_t lane = 0; lane < LANES; lane++)
+            unordered |= nans[lane] != 0;
+    }
+
+    for (; i < size; i++) {
+        extreme = Select(MAX ? data[i] > extreme : data[i] < extreme, data[i], extreme);
+        unordered |= data[i] != data[i];
+    }
+
+    return unordered ? std::numeric_limits<double>::quiet_NaN() : extreme;
+}
+
+#define KERNEL_ROW(op) \
+    { Map<op, true, true>, Map<op, true, false>, Map<op, false, true> }
+
+const ArrayKernels KERNELS = {
+    {
+        KERNEL_ROW(BLAISE_OP_ID::PLUS),
+        KERNEL_ROW(BLAISE_OP_ID::MINUS),
+        KERNEL_ROW(BLAISE_OP_ID::MUL),
+        KERNEL_ROW(BLAISE_OP_ID::DIV),
+        KERNEL_ROW(BLAISE_OP_ID::EQUAL),
+        KERNEL_ROW(BLAISE_OP_ID::NEQUAL),
+        KERNEL_ROW(BLAISE_OP_ID::LESS),
+        KERNEL_ROW(BLAISE_OP_ID::LEQUAL),
+        KERNEL_ROW(BLAISE_OP_ID::GREATER),
+        KERNEL_ROW(BLAISE_OP_ID::GEQUAL),
+    },
+    Sum,
+    Extreme<false>,
+    Extreme<true>,
+};
+
+#undef KERNEL_ROW
+#undef KERNEL_INLINE
@@ -0,0 +1,545 @@
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+#include "BlaiseAst.h"
+#include "antlr/BlaiseBaseVisitor.h"
+
+// Lowers the parse tree bottom up. Ids of finished nodes wait on a stack
+// until their parent is added, which moves them to the child list as one
+// range.
+class AstBuilder : public BlaiseBaseVisitor {
+    BlaiseAst& ast_;
+    const LazyBodies *lazy_bodies_;
+    std::unordered_map<std::string, uint32_t> string_ids_;
+    std::vector<AstNodeId> pending_;
+
+    uint32_t Intern(const std::string& str) {
+        auto [iter, inserted] = string_ids_.emplace(str, ast_.strings_.size());
+
+        if (inserted)
+            ast_.strings_.push_back(str);
+
+        return iter->second;
+    }
+
+    // Adds a node with the last child_count pending nodes as children
+    // and leaves it pending itself
+    std::any Add(AST_NODE_KIND kind, const antlr4::ParserRuleContext *context, size_t child_count,
+                 const std::string& text = "") {
+        SourcePosition position = SourcePosition::Of(context);
+        AstNode node{ kind, BLAISE_OP_ID::PLUS, Intern(text), static_cast<uint32_t>(ast_.children_.size()),
+                      static_cast<uint32_t>(child_count), static_cast<uint32_t>(position.line),
+                      static_cast<uint32_t>(position.column) };
+
+        ast_.children_.insert(ast_.children_.end(), pending_.end() - child_count, pending_.end());
+        pending_.resize(pending_.size() - child_count);
+        pending_.push_back(ast_.nodes_.size());
+        ast_.nodes_.push_back(node);
+
+        return {};
+    }
+
+    // Range of a block the parser only saw begin and end of
+    const SourceRange *FindLazyBody(const antlr4::ParserRuleContext *block) const {
+        if (lazy_bodies_ == nullptr)
+            return nullptr;
+
+        auto iter = lazy_bodies_->find(block->getStart()->getStartIndex());
+
+        return iter == lazy_bodies_->end() ? nullptr : &iter->second;
+    }
+
+public:
+    explicit AstBuilder(BlaiseAst& ast, const LazyBodies *lazy_bodies = nullptr)
+        : ast_(ast), lazy_bodies_(lazy_bodies) {
+        Intern("");
+    }
+
+    virtual std::any visitProgram(BlaiseParser::ProgramContext *context) override {
+        for (auto stmt : context->stmt())
+            visit(stmt);
+
+        return Add(AST_NODE_KIND::PROGRAM, context, context->stmt().size());
+    }
+
+    virtual std::any visitStmt(BlaiseParser::StmtContext *context) override {
+        return visit(context->children.front());
+    }
+
+    std::any visitSingleStmt(BlaiseParser::StmtContext *context) {
+        visit(context);
+
+        return Add(AST_NODE_KIND::PROGRAM, context, 1);
+    }
+
+    virtual std::any visitImportStmt(BlaiseParser::ImportStmtContext *context) override {
+        const std::string literal = context->STRING()->getText();
+
+        return Add(AST_NODE_KIND::IMPORT_STMT, context, 0, literal.substr(1, literal.size() - 2));
+    }
+
+    virtual std::any visitFunctionDefinition(BlaiseParser::FunctionDefinitionContext *context) override {
+        BlaiseParser::Param_listContext *params = context->param_list();
+        size_t count = 1;
+
+        for (; params; count++) {
+            auto comma = dynamic_cast<BlaiseParser::ParamListCommaContext *>(params);
+            auto identifier = comma ? comma->IDENTIFIER()
+                                    : static_cast<BlaiseParser::ParamListEndContext *>(params)->IDENTIFIER();
+
+            Add(AST_NODE_KIND::PARAMETER, params, 0, identifier->getText());
+            params = comma ? comma->param_list() : nullptr;
+        }
+
+        auto block = dynamic_cast<BlaiseParser::CodeBlockContext *>(context->stmt()->children.front());
+        const SourceRange *lazy = block ? FindLazyBody(block) : nullptr;
+
+        if (lazy) {
+            Add(AST_NODE_KIND::LAZY_BODY, block, 0);
+            ast_.nodes_.back().first_child = ast_.ranges_.size();
+            ast_.ranges_.push_back(*lazy);
+        } else {
+            visit(context->stmt());
+        }
+
+        return Add(AST_NODE_KIND::FUNCTION_DEFINITION, context, count, context->IDENTIFIER()->getText());
+    }
+
+    // Leaves a node for every element of list pending and returns their
+    // count. A bare identifier becomes an OPERAND_ID, all visitors treated
+    // it the same way as an expression consisting of it.
+    size_t AddArgs(BlaiseParser::Arg_listContext *list) {
+        size_t count = 0;
+
+        for (; list; count++) {
+            auto comma = dynamic_cast<BlaiseParser::ArgListCommaContext *>(list);
+            auto end = dynamic_cast<BlaiseParser::ArgListEndContext *>(list);
+            antlr4::tree::TerminalNode *identifier = comma ? comma->IDENTIFIER() : end->IDENTIFIER();
+
+            if (identifier)
+                Add(AST_NODE_KIND::OPERAND_ID, list, 0, identifier->getText());
+            else
+                visit(comma ? comma->expr() : end->expr());
+
+            list = comma ? comma->arg_list() : nullptr;
+        }
+
+        return count;
+    }
+
+    virtual std::any visitFunctionCall(BlaiseParser::FunctionCallContext *context) override {
+        size_t count = AddArgs(context->arg_list());
+
+        return Add(AST_NODE_KIND::FUNCTION_CALL, context, count, context->IDENTIFIER()->getText());
+    }
+
+    virtual std::any visitCodeBlock(BlaiseParser::CodeBlockContext *context) override {
+        for (auto stmt : context->stmt())
+            visit(stmt);
+
+        return Add(AST_NODE_KIND::CODE_BLOCK, context, context->stmt().size());
+    }
+
+    virtual std::any visitReturnStmt(BlaiseParser::ReturnStmtContext *context) override {
+        visit(context->expr());
+        return Add(AST_NODE_KIND::RETURN_STMT, context, 1);
+    }
+
+    virtual std::any visitWritelnStmt(BlaiseParser::WritelnStmtContext *context) override {
+        visit(context->expr());
+        return Add(AST_NODE_KIND::WRITELN_STMT, context, 1);
+    }
+
+    virtual std::any visitIfStmtBlock(BlaiseParser::IfStmtBlockContext *context) override {
+        visit(context->expr());
+        visit(context->stmt());
+
+        if (context->else_stmt())
+            visit(context->else_stmt());
+
+        return Add(AST_NODE_KIND::IF_STMT, context, context->else_stmt() ? 3 : 2);
+    }
+
+    virtual std::any visitElseStmtBlock(BlaiseParser::ElseStmtBlockContext *context) override {
+        return visit(context->stmt());
+    }
+
+    virtual std::any visitLoopStmt(BlaiseParser::LoopStmtContext *context) override {
+        visit(context->expr());
+
+        if (context->stmt())
+            visit(context->stmt());
+
+        return Add(AST_NODE_KIND::LOOP_STMT, context, context->stmt() ? 2 : 1);
+    }
+
+    virtual std::any visitAssignStmt(BlaiseParser::AssignStmtContext *context) override {
+        visit(context->expr());
+        return Add(AST_NODE_KIND::ASSIGN_STMT, context, 1, context->IDENTIFIER()->getText());
+    }
+
+    virtual std::any visitIndexAssignStmt(BlaiseParser::IndexAssignStmtContext *context) override {
+        visit(context->expr(0));
+        visit(context->expr(1));
+        return Add(AST_NODE_KIND::INDEX_ASSIGN_STMT, context, 2, context->IDENTIFIER()->getText());
+    }
+
+    virtual std::any visitExprOperation(BlaiseParser::ExprOperationContext *context) override {
+        visit(context->operand());
+        visit(context->expr());
+        Add(AST_NODE_KIND::EXPR_OPERATION, context, 2);
+
+        ast_.nodes_.back().operation = std::any_cast<BLAISE_OP_ID>(visit(context->operator_()));
+
+        return {};
+    }
+
+    virtual std::any visitExprUnaryMinusOperation(BlaiseParser::ExprUnaryMinusOperationContext *context) override {
+        visit(context->operand());
+        return Add(AST_NODE_KIND::EXPR_UNARY_MINUS, context, 1);
+    }
+
+    virtual std::any visitExprUnaryPlusOperation(BlaiseParser::ExprUnaryPlusOperationContext *context) override {
+        visit(context->operand());
+        return Add(AST_NODE_KIND::EXPR_UNARY_PLUS, context, 1);
+    }
+
+    virtual std::any visitExprOperand(BlaiseParser::ExprOperandContext *context) override {
+        return visit(context->operand());
+    }
+
+    virtual std::any visitOperandBoolean(BlaiseParser::OperandBooleanContext *context) override {
+        return Add(AST_NODE_KIND::OPERAND_BOOLEAN, context, 0, context->BOOLEAN()->getText());
+    }
+
+    virtual std::any visitOperandInt(BlaiseParser::OperandIntContext *context) override {
+        return Add(AST_NODE_KIND::OPERAND_INT, context, 0, context->INT()->getText());
+    }
+
+    virtual std::any visitOperandDouble(BlaiseParser::OperandDoubleContext *context) override {
+        return Add(AST_NODE_KIND::OPERAND_DOUBLE, context, 0, context->DOUBLE()->getText());
+    }
+
+    virtual std::any visitOperandChar(BlaiseParser::OperandCharContext *context) override {
+        return Add(AST_NODE_KIND::OPERAND_CHAR, context, 0, context->CHAR()->getText());
+    }
+
+    virtual std::any visitOperandString(BlaiseParser::OperandStringContext *context) override {
+        return Add(AST_NODE_KIND::OPERAND_STRING, context, 0, context->STRING()->getText());
+    }
+
+    virtual std::any visitOperandId(BlaiseParser::OperandIdContext *context) override {
+        return Add(AST_NODE_KIND::OPERAND_ID, context, 0, context->IDENTIFIER()->getText());
+    }
+
+    virtual std::any visitOperandArray(BlaiseParser::OperandArrayContext *context) override {
+        size_t count = AddArgs(context->arg_list());
+
+        return Add(AST_NODE_KIND::OPERAND_ARRAY, context, count);
+    }
+
+    virtual std::any visitOperandIndex(BlaiseParser::OperandIndexContext *context) override {
+        visit(context->expr());
+        return Add(AST_NODE_KIND::OPERAND_INDEX, context, 1, context->IDENTIFIER()->getText());
+    }
+
+    virtual std::any visitOperandFunctionCall(BlaiseParser::OperandFunctionCallContext *context) override {
+        return visit(context->function_call());
+    }
+
+    virtual std::any visitOperandExpr(BlaiseParser::OperandExprContext *context) override {
+        visit(context->expr());
+        return Add(AST_NODE_KIND::OPERAND_EXPR, context, 1);
+    }
+
+    virtual std::any visitOperatorPlus(BlaiseParser::OperatorPlusContext *context) override {
+        return BLAISE_OP_ID::PLUS;
+    }
+
+    virtual std::any visitOperatorMinus(BlaiseParser::OperatorMinusContext *context) override {
+        return BLAISE_OP_ID::MINUS;
+    }
+
+    virtual std::any visitOperatorAster(BlaiseParser::OperatorAsterContext *context) override {
+        return BLAISE_OP_ID::MUL;
+    }
+
+    virtual std::any visitOperatorSlash(BlaiseParser::OperatorSlashContext *context) override {
+        return BLAISE_OP_ID::DIV;
+    }
+
+    virtual std::any visitOperatorEqual(BlaiseParser::OperatorEqualContext *context) override {
+        return BLAISE_OP_ID::EQUAL;
+    }
+
+    virtual std::any visitOperatorNEqual(BlaiseParser::OperatorNEqualContext *context) override {
+        return BLAISE_OP_ID::NEQUAL;
+    }
+
+    virtual std::any visitOperatorLess(BlaiseParser::OperatorLessContext *context) override {
+        return BLAISE_OP_ID::LESS;
+    }
+
+    virtual std::any visitOperatorLEqual(BlaiseParser::OperatorLEqualContext *context) override {
+        return BLAISE_OP_ID::LEQUAL;
+    }
+
+    virtual std::any visitOperatorGreater(BlaiseParser::OperatorGreaterContext *context) override {
+        return BLAISE_OP_ID::GREATER;
+    }
+
+    virtual std::any visitOperatorGEqual(BlaiseParser::OperatorGEqualContext *context) override {
+        return BLAISE_OP_ID::GEQUAL;
+    }
+};
+
+BlaiseAst BlaiseAst::Build(BlaiseParser::ProgramContext *program, const LazyBodies *lazy_bodies) {
+    BlaiseAst ast;
+    AstBuilder builder(ast, lazy_bodies);
+
+    builder.visitProgram(program);
+    ast.root_ = ast.nodes_.size() - 1;
+
+    ast.nodes_.shrink_to_fit();
+    ast.children_.shrink_to_fit();
+    ast.strings_.shrink_to_fit();
+
+    return ast;
+}
+
+BlaiseAst BlaiseAst::Build(BlaiseParser::StmtContext *stmt) {
+    BlaiseAst ast;
+    AstBuilder builder(ast);
+
+    builder.visitSingleStmt(stmt);
+    ast.root_ = ast.nodes_.size() - 1;
+
+    return ast;
+}
+
+BlaiseAst BlaiseAst::Join(const std::vector<BlaiseAst>& parts) {
+    BlaiseAst ast;
+    std::unordered_map<std::string, uint32_t> string_ids;
+    std::vector<AstNodeId> stmts;
+
+    for (const BlaiseAst& part : parts) {
+        const AstNode& root = part.Node(part.Root());
+        uint32_t first_node = ast.nodes_.size();
+        uint32_t first_child = ast.children_.size();
+        std::vector<uint32_t> strings(part.strings_.size());
+
+        for (size_t i = 0; i < part.strings_.size(); i++) {
+            auto [iter, inserted] = string_ids.emplace(part.strings_[i], ast.strings_.size());
+
+            if (inserted)
+                ast.strings_.push_back(part.strings_[i]);
+
+            strings[i] = iter->second;
+        }
+
+        // The root of a part is its last node and its children are listed
+        // last, everything before is copied over
+        for (AstNodeId id = 0; id < part.root_; id++) {
+            AstNode node = part.nodes_[id];
+
+            node.text = strings[node.text];
+            node.first_child += first_child;
+            ast.nodes_.push_back(node);
+        }
+
+        for (size_t i = 0; i < root.first_child; i++)
+            ast.children_.push_back(part.children_[i] + first_node);
+
+        for (size_t i = 0; i < root.child_count; i++)
+            stmts.push_back(part.Child(root, i) + first_node);
+    }
+
+    AstNode root{ AST_NODE_KIND::PROGRAM, BLAISE_OP_ID::PLUS, 0, static_cast<uint32_t>(ast.children_.size()),
+                  static_cast<uint32_t>(stmts.size()), 0, 0 };
+
+    if (!parts.empty()) {
+        root.line = parts.front().Node(parts.front().Root()).line;
+        root.column = parts.front().Node(parts.front().Root()).column;
+    }
+
+    if (ast.strings_.empty())
+        ast.strings_.emplace_back();
+
+    ast.children_.insert(ast.children_.end(), stmts.begin(), stmts.end());
+    ast.root_ = ast.nodes_.size();
+    ast.nodes_.push_back(root);
+
+    return ast;
+}
+
+namespace {
+
+template<typename T>
+void Append(std::string& out, const T *data, size_t count) {
+    out.append(reinterpret_cast<const char *>(data), count * sizeof(T));
+}
+
+// Reads count values of T at pos and moves pos past them
+template<typename T>
+bool Read(std::string_view data, size_t& pos, T *values, size_t count) {
+    if (count > (data.size() - pos) / sizeof(T))
+        return false;
+
+    std::memcpy(values, data.data() + pos, count * sizeof(T));
+    pos += count * sizeof(T);
+
+    return true;
+}
+
+}
+
+// Layout: node, child and string counts, root, nodes, children, string
+// lengths, string bytes
+void BlaiseAst::Serialize(std::string& out) const {
+    uint32_t counts[] = { static_cast<uint32_t>(nodes_.size()), static_cast<uint32_t>(children_.size()),
+                          static_cast<uint32_t>(strings_.size()), root_ };
+    std::vector<uint32_t> lengths;
+
+    for (const std::string& str : strings_)
+        lengths.push_back(str.size());
+
+    Append(out, counts, 4);
+    Append(out, nodes_.data(), nodes_.size());
+    Append(out, children_.data(), children_.size());
+    Append(out, lengths.data(), lengths.size());
+
+    for (const std::string& str : strings_)
+        out += str;
+}
+
+bool BlaiseAst::Deserialize(std::string_view data, BlaiseAst& ast) {
+    uint32_t counts[4];
+    size_t pos = 0;
+
+    if (!Read(data, pos, counts, 4))
+        return false;
+
+    // Checked against the data size before anything is allocated
+    if (counts[0] > data.size() / sizeof(AstNode) || counts[1] > data.size() / sizeof(AstNodeId)
+        || counts[2] > data.size() / sizeof(uint32_t))
+        return false;
+
+    std::vector<uint32_t> lengths(counts[2]);
+
+    ast.nodes_.resize(counts[0]);
+    ast.children_.resize(counts[1]);
+    ast.root_ = counts[3];
+
+    if (!Read(data, pos, ast.nodes_.data(), counts[0]) || !Read(data, pos, ast.children_.data(), counts[1])
+        || !Read(data, pos, lengths.data(), counts[2]))
+        return false;
+
+    ast.strings_.clear();
+    ast.strings_.reserve(counts[2]);
+
+    for (uint32_t length : lengths) {
+        if (length > data.size() - pos)
+            return false;
+
+        ast.strings_.emplace_back(data.substr(pos, length));
+        pos += length;
+    }
+
+    if (pos != data.size() || ast.root_ >= ast.nodes_.size())
+        return false;
+
+    for (AstNodeId id = 0; id < ast.nodes_.size(); id++) {
+        const AstNode& node = ast.nodes_[id];
+
+        if (node.kind >= AST_NODE_KIND::LAZY_BODY || node.operation > BLAISE_OP_ID::GEQUAL
+            || node.text >= ast.strings_.size() || node.first_child > ast.children_.size()
+            || node.child_count > ast.children_.size() - node.first_child)
+            return false;
+
+        for (size_t i = 0; i < node.child_count; i++)
+            if (ast.Child(node, i) >= id)
+                return false;
+    }
+
+    return true;
+}
+
+AstNodeId BlaiseAst::Root() const {
+    return root_;
+}
+
+const AstNode& BlaiseAst::Node(AstNodeId id) const {
+    return nodes_[id];
+}
+
+AstNodeId BlaiseAst::Id(const AstNode& node) const {
+    return &node - nodes_.data();
+}
+
+AstNodeId BlaiseAst::Child(const AstNode& node, size_t index) const {
+    return children_[node.first_child + index];
+}
+
+const std::string& BlaiseAst::Text(const AstNode& node) const {
+    return strings_[node.text];
+}
+
+SourcePosition BlaiseAst::Position(const AstNode& node) const {
+    return { node.line, node.column };
+}
+
+SourceRange BlaiseAst::Range(const AstNode& node) const {
+    return ranges_[node.first_child];
+}
+
+size_t BlaiseAst::Footprint() const {
+    size_t size = sizeof(BlaiseAst) + nodes_.capacity() * sizeof(AstNode) + children_.capacity() * sizeof(AstNodeId)
+                  + strings_.capacity() * sizeof(std::string) + ranges_.capacity() * sizeof(SourceRange);
+
+    for (const std::string& str : strings_)
+        size += HeapSize(str);
+
+    return size;
+}
+
+std::any BlaiseAstVisitor::Visit(const BlaiseAst& ast) {
+    ast_ = &ast;
+    return visit(ast.Root());
+}
+
+std::any BlaiseAstVisitor::visit(AstNodeId id) {
+    const AstNode& node = ast_->Node(id);
+
+    switch (node.kind) {
+        case AST_NODE_KIND::PROGRAM:             return visitProgram(node);
+        case AST_NODE_KIND::IMPORT_STMT:         return visitImportStmt(node);
+        case AST_NODE_KIND::FUNCTION_DEFINITION: return visitFunctionDefinition(node);
+        case AST_NODE_KIND::FUNCTION_CALL:       return visitFunctionCall(node);
+        case AST_NODE_KIND::CODE_BLOCK:          return visitCodeBlock(node);
+        case AST_NODE_KIND::RETURN_STMT:         return visitReturnStmt(node);
+        case AST_NODE_KIND::WRITELN_STMT:        return visitWritelnStmt(node);
+        case AST_NODE_KIND::IF_STMT:             return visitIfStmt(node);
+        case AST_NODE_KIND::LOOP_STMT:           return visitLoopStmt(node);
+        case AST_NODE_KIND::ASSIGN_STMT:         return visitAssignStmt(node);
+        case AST_NODE_KIND::INDEX_ASSIGN_STMT:   return visitIndexAssignStmt(node);
+        case AST_NODE_KIND::EXPR_OPERATION:      return visitExprOperation(node);
+        case AST_NODE_KIND::EXPR_UNARY_MINUS:    return visitExprUnaryMinusOperation(node);
+        case AST_NODE_KIND::EXPR_UNARY_PLUS:     return visitExprUnaryPlusOperation(node);
+        case AST_NODE_KIND::OPERAND_EXPR:        return visitOperandExpr(node);
+        case AST_NODE_KIND::OPERAND_BOOLEAN:     return visitOperandBoolean(node);
+        case AST_NODE_KIND::OPERAND_INT:         return visitOperandInt(node);
+        case AST_NODE_KIND::OPERAND_DOUBLE:      return visitOperandDouble(node);
+        case AST_NODE_KIND::OPERAND_CHAR:        return visitOperandChar(node);
+        case AST_NODE_KIND::OPERAND_STRING:      return visitOperandString(node);
+        case AST_NODE_KIND::OPERAND_ID:          return visitOperandId(node);
+        case AST_NODE_KIND::OPERAND_ARRAY:       return visitOperandArray(node);
+        case AST_NODE_KIND::OPERAND_INDEX:       return visitOperandIndex(node);
+        case AST_NODE_KIND::PARAMETER:
+        case AST_NODE_KIND::LAZY_BODY:
+        case AST_NODE_KIND::KIND_COUNT:          break;
+    }
+
+    throw std::invalid_argument("Unexpected AST node");
+}
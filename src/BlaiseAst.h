@@ -0,0 +1,172 @@
+#pragma once
+
+#include <any>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "BlaiseClasses.h"
+#include "BlaiseSource.h"
+#include "antlr/BlaiseParser.h"
+
+enum class AST_NODE_KIND : uint8_t {
+    PROGRAM,                // children: statements
+    IMPORT_STMT,            // text: module path without the quotes
+    FUNCTION_DEFINITION,    // text: name, children: parameters, body
+    PARAMETER,              // text: name
+    FUNCTION_CALL,          // text: name, children: arguments
+    CODE_BLOCK,             // children: statements
+    RETURN_STMT,            // children: expr
+    WRITELN_STMT,           // children: expr
+    IF_STMT,                // children: expr, then stmt[, else stmt]
+    LOOP_STMT,              // children: expr[, stmt]
+    ASSIGN_STMT,            // text: variable, children: expr
+    INDEX_ASSIGN_STMT,      // text: variable, children: index expr, expr
+    EXPR_OPERATION,         // operation, children: operand, expr
+    EXPR_UNARY_MINUS,       // children: operand
+    EXPR_UNARY_PLUS,        // children: operand
+    OPERAND_EXPR,           // children: expr in parentheses
+    OPERAND_BOOLEAN,        // text: literal as written
+    OPERAND_INT,
+    OPERAND_DOUBLE,
+    OPERAND_CHAR,
+    OPERAND_STRING,
+    OPERAND_ID,             // text: variable
+    OPERAND_ARRAY,          // children: elements
+    OPERAND_INDEX,          // text: variable, children: index expr
+    LAZY_BODY,              // unparsed function body, see BlaiseAst::Range
+
+    KIND_COUNT
+};
+
+struct AstNode {
+    AST_NODE_KIND kind;
+    BLAISE_OP_ID operation;     // EXPR_OPERATION only
+    uint32_t text;              // index in the string pool
+    uint32_t first_child;       // index in the child list
+    uint32_t child_count;
+    uint32_t line;
+    uint32_t column;
+};
+
+// Compact form of a parsed program. Nodes live in one vector and refer to
+// their children by index through a second one, names and literals are
+// interned once in a string pool. Unlike the ANTLR parse tree it keeps no
+// tokens, no rule contexts for single child rules like stmt or operand,
+// and nothing of the input, so the parse tree and token stream can be
+// freed once the program is lowered.
+class BlaiseAst {
+    friend class AstBuilder;
+
+    std::vector<AstNode> nodes_;
+    std::vector<AstNodeId> children_;
+    std::vector<std::string> strings_;
+    std::vector<SourceRange> ranges_;
+    AstNodeId root_ = 0;
+
+public:
+    // Changes whenever the node layout or the lowering does, so that
+    // programs serialized by another version are not loaded
+    static constexpr uint32_t FORMAT_VERSION = 3;
+
+    // Function bodies found in lazy_bodies become LAZY_BODY nodes
+    static BlaiseAst Build(BlaiseParser::ProgramContext *program, const LazyBodies *lazy_bodies = nullptr);
+
+    // Program made of a single top-level statement
+    static BlaiseAst Build(BlaiseParser::StmtContext *stmt);
+
+    // Program made of the top-level statements of parts, in order. The
+    // result is the same as building the concatenated source at once.
+    // Parts must not have LAZY_BODY nodes.
+    static BlaiseAst Join(const std::vector<BlaiseAst>& parts);
+
+    // Appends the node, child and string arrays to out as they are in
+    // memory, only readable by the same build
+    void Serialize(std::string& out) const;
+
+    // Reads what Serialize wrote. Every index has to stay in bounds and
+    // every child has to precede its parent, otherwise data is rejected
+    // as corrupt and false is returned. LAZY_BODY nodes refer to a source
+    // that is not stored, they are rejected too.
+    static bool Deserialize(std::string_view data, BlaiseAst& ast);
+
+    AstNodeId Root() const;
+
+    const AstNode& Node(AstNodeId id) const;
+
+    AstNodeId Id(const AstNode& node) const;
+
+    AstNodeId Child(const AstNode& node, size_t index) const;
+
+    const std::string& Text(const AstNode& node) const;
+
+    SourcePosition Position(const AstNode& node) const;
+
+    // Where the body of a LAZY_BODY node is in the source
+    SourceRange Range(const AstNode& node) const;
+
+    // Bytes the program takes, with its arrays and the pooled strings
+    size_t Footprint() const;
+};
+
+// Visits BlaiseAst nodes the way BlaiseBaseVisitor visits parse tree
+// nodes: visit() dispatches on the node kind.
+class BlaiseAstVisitor {
+protected:
+    const BlaiseAst *ast_ = nullptr;
+
+public:
+    virtual ~BlaiseAstVisitor() = default;
+
+    // Visits the whole program, ast has to outlive the visitor
+    std::any Visit(const BlaiseAst& ast);
+
+    std::any visit(AstNodeId id);
+
+    virtual std::any visitProgram(const AstNode& node) = 0;
+
+    virtual std::any visitImportStmt(const AstNode& node) = 0;
+
+    virtual std::any visitFunctionDefinition(const AstNode& node) = 0;
+
+    virtual std::any visitFunctionCall(const AstNode& node) = 0;
+
+    virtual std::any visitCodeBlock(const AstNode& node) = 0;
+
+    virtual std::any visitReturnStmt(const AstNode& node) = 0;
+
+    virtual std::any visitWritelnStmt(const AstNode& node) = 0;
+
+    virtual std::any visitIfStmt(const AstNode& node) = 0;
+
+    virtual std::any visitLoopStmt(const AstNode& node) = 0;
+
+    virtual std::any visitAssignStmt(const AstNode& node) = 0;
+
+    virtual std::any visitIndexAssignStmt(const AstNode& node) = 0;
+
+    virtual std::any visitExprOperation(const AstNode& node) = 0;
+
+    virtual std::any visitExprUnaryMinusOperation(const AstNode& node) = 0;
+
+    virtual std::any visitExprUnaryPlusOperation(const AstNode& node) = 0;
+
+    virtual std::any visitOperandExpr(const AstNode& node) = 0;
+
+    virtual std::any visitOperandBoolean(const AstNode& node) = 0;
+
+    virtual std::any visitOperandInt(const AstNode& node) = 0;
+
+    virtual std::any visitOperandDouble(const AstNode& node) = 0;
+
+    virtual std::any visitOperandChar(const AstNode& node) = 0;
+
+    virtual std::any visitOperandString(const AstNode& node) = 0;
+
+    virtual std::any visitOperandId(const AstNode& node) = 0;
+
+    virtual std::any visitOperandArray(const AstNode& node) = 0;
+
+    virtual std::any visitOperandIndex(const AstNode& node) = 0;
+};
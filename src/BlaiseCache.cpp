@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include "BlaiseCache.h"
+#include "BlaiseSource.h"
+
+namespace {
+
+constexpr char MAGIC[8] = { 'B', 'L', 'S', 'A', 'S', 'T', '\0', '\0' };
+
+// Identifies the binary that wrote an entry. Node layout and lowering can
+// change without anyone bumping FORMAT_VERSION, a rebuild must not trust
+// entries of the previous build.
+constexpr char BUILD[] = __DATE__ " " __TIME__;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t node_size;
+    uint64_t build;
+    uint64_t source_hash;
+    uint64_t source_size;
+    uint64_t payload_size;
+    uint64_t payload_hash;
+};
+
+uint64_t BuildHash() {
+    static const uint64_t hash = HashBytes(BUILD);
+    return hash;
+}
+
+}
+
+BlaiseCache::BlaiseCache(std::string directory) : directory_(std::move(directory)) {}
+
+std::string BlaiseCache::DefaultDirectory() {
+    if (const char *dir = std::getenv("BLAISE_CACHE_DIR"))
+        return dir;
+
+    if (const char *dir = std::getenv("XDG_CACHE_HOME"))
+        return std::string(dir) + "/blaise";
+
+    if (const char *dir = std::getenv("HOME"))
+        return std::string(dir) + "/.cache/blaise";
+
+    return "";
+}
+
+std::string BlaiseCache::Path(uint64_t key) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.ast", static_cast<unsigned long long>(key));
+
+    return directory_ + "/" + name;
+}
+
+bool BlaiseCache::Load(std::string_view source, BlaiseAst& ast) const {
+    if (directory_.empty())
+        return false;
+
+    uint64_t source_hash = HashBytes(source);
+    MappedFile file(Path(source_hash ^ BuildHash()));
+
+    if (!file.IsOpen())
+        return false;
+
+    std::string_view data = file.Data();
+    Header header;
+
+    if (data.size() < sizeof(header))
+        return false;
+
+    std::memcpy(&header, data.data(), sizeof(header));
+    data.remove_prefix(sizeof(header));
+
+    // Two sources may share a file name, the header tells them apart
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != BlaiseAst::FORMAT_VERSION
+        || header.node_size != sizeof(AstNode) || header.build != BuildHash()
+        || header.source_hash != source_hash || header.source_size != source.size()
+        || header.payload_size != data.size() || header.payload_hash != HashBytes(data))
+        return false;
+
+    if (!BlaiseAst::Deserialize(data, ast))
+        return false;
+
+    // The modification time tells Evict() when the entry was used last
+    std::error_code error;
+    std::filesystem::last_write_time(Path(source_hash ^ BuildHash()),
+                                     std::filesystem::file_time_type::clock::now(), error);
+
+    return true;
+}
+
+void BlaiseCache::Evict() const {
+    struct Entry {
+        std::filesystem::file_time_type used;
+        uintmax_t size;
+        std::filesystem::path path;
+    };
+
+    std::vector<Entry> entries;
+    uintmax_t total = 0;
+    std::error_code error;
+
+    for (std::filesystem::directory_iterator iter(directory_, error), end; !error && iter != end;
+         iter.increment(error)) {
+        if (iter->path().extension() != ".ast")
+            continue;
+
+        std::error_code stat_error;
+        Entry entry{ iter->last_write_time(stat_error), iter->file_size(stat_error), iter->path() };
+
+        if (stat_error)
+            continue;
+
+        total += entry.size;
+        entries.push_back(std::move(entry));
+    }
+
+    if (total <= MAX_BYTES)
+        return;
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& lhs, const Entry& rhs) {
+        return lhs.used < rhs.used;
+    });
+
+    // Another run may have removed an entry already, it still counts as gone
+    for (size_t i = 0; i < entries.size() && total > MAX_BYTES; i++) {
+        std::filesystem::remove(entries[i].path, error);
+        total -= entries[i].size;
+    }
+}
+
+void BlaiseCache::Store(std::string_view source, const BlaiseAst& ast) const {
+    if (directory_.empty())
+        return;
+
+    std::error_code error;
+    std::filesystem::create_directories(directory_, error);
+
+    if (error)
+        return;
+
+    Header header = {};
+    std::string payload;
+
+    ast.Serialize(payload);
+
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = BlaiseAst::FORMAT_VERSION;
+    header.node_size = sizeof(AstNode);
+    header.build = BuildHash();
+    header.source_hash = HashBytes(source);
+    header.source_size = source.size();
+    header.payload_size = payload.size();
+    header.payload_hash = HashBytes(payload);
+
+    // Written aside and renamed, so that a concurrent run never maps a
+    // half written entry. Threads of a batch may store the same entry.
+    std::string path = Path(header.source_hash ^ header.build);
+    std::string temp = path + ".tmp." + std::to_string(getpid()) + "."
+                       + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+    {
+        std::ofstream out(temp, std::ios::binary);
+
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(payload.data(), payload.size());
+
+        if (!out.good()) {
+            out.close();
+            std::filesystem::remove(temp, error);
+            return;
+        }
+    }
+
+    std::filesystem::rename(temp, path, error);
+
+    if (error) {
+        std::filesystem::remove(temp, error);
+        return;
+    }
+
+    Evict();
+}
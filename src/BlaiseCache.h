@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "BlaiseAst.h"
+
+// On-disk cache of lowered programs. An entry is named after a hash of the
+// source text and the blaise build, so editing the file or rebuilding
+// blaise simply misses. Entries are mapped on load and checked before use:
+// anything truncated, corrupt or written by another build is ignored and
+// the program is parsed again. Once the entries take more than MAX_BYTES,
+// the ones used least recently are removed.
+class BlaiseCache {
+    std::string directory_;
+
+    std::string Path(uint64_t key) const;
+
+    // Removes the entries used least recently until the rest fit into
+    // MAX_BYTES
+    void Evict() const;
+
+public:
+    static constexpr uintmax_t MAX_BYTES = 512ull << 20;
+
+    explicit BlaiseCache(std::string directory);
+
+    // $BLAISE_CACHE_DIR, else $XDG_CACHE_HOME/blaise, else ~/.cache/blaise.
+    // Empty if none of them is set.
+    static std::string DefaultDirectory();
+
+    // Fills ast from the entry for source, returns false on a miss
+    bool Load(std::string_view source, BlaiseAst& ast) const;
+
+    // Writes the entry for source. Failures are ignored, the cache is only
+    // an optimization.
+    void Store(std::string_view source, const BlaiseAst& ast) const;
+};
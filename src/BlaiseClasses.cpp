@@ -1,8 +1,11 @@
 #include <any>
+#include <functional>
 #include <stdexcept>
 #include <typeinfo>
 #include <utility>
 
+#include "BlaiseArray.h"
+#include "BlaiseMap.h"
 #include "BlaiseClasses.h"
 #include "Util.h"
 
@@ -30,6 +33,10 @@
         return BlaiseVariable(tmp$$var); \
     }
 
+#define ARRAY_OPERATION_BLOCK(__operand1, __operand2, __op_id)                      \
+    if (__operand1.Is<BlaiseArray>() || __operand2.Is<BlaiseArray>())                \
+        return ArrayOperation(__op_id, __operand1, __operand2);
+
 #define ANY_IS(__val, __type) \
     (__val.type() == typeid(__type))
 
@@ -82,6 +89,12 @@ std::string BlaiseVariable::AnyValueToString(const std::any& value) {
         any_case$$(char)
             out << std::any_cast<char>(value);
 
+        any_case$$(BlaiseArray)
+            out << std::any_cast<const BlaiseArray&>(value).ToString();
+
+        any_case$$(BlaiseMap)
+            out << std::any_cast<const BlaiseMap&>(value).ToString();
+
         any_case_default$$
             out << "Something else";
 
@@ -90,10 +103,35 @@ std::string BlaiseVariable::AnyValueToString(const std::any& value) {
     return out.str();
 }
 
+size_t HeapSize(const std::string& str) {
+    const char *begin = reinterpret_cast<const char *>(&str);
+
+    if (!std::less<const char *>()(str.data(), begin) && std::less<const char *>()(str.data(), begin + sizeof(str)))
+        return 0;
+
+    return str.capacity() + 1;
+}
+
 std::string BlaiseVariable::ToString() const {
     return AnyValueToString(value_);
 }
 
+size_t BlaiseVariable::Footprint() const {
+    return sizeof(BlaiseVariable) + HeapSize(name_) + ValueFootprint(value_);
+}
+
+size_t BlaiseVariable::ValueFootprint(const std::any& value) {
+    // Too big for the buffer of std::any, which allocates them
+    if (ANY_IS(value, std::string))
+        return sizeof(std::string) + HeapSize(*std::any_cast<std::string>(&value));
+    if (ANY_IS(value, BlaiseArray))
+        return sizeof(BlaiseArray) + std::any_cast<BlaiseArray>(&value)->Footprint();
+    if (ANY_IS(value, BlaiseMap))
+        return sizeof(BlaiseMap) + std::any_cast<BlaiseMap>(&value)->Footprint();
+
+    return 0;
+}
+
 
 const std::string& BlaiseVariable::Name() const {
     return name_;
@@ -163,10 +201,35 @@ BlaiseVariable::CastToOneType(const BlaiseVariable& lhs, const BlaiseVariable& r
         return { std::move(var1), std::move(var2) };
     }
 
+    // Arrays take numbers as they are, see ArrayOperation
+    if (lhs.value_.type() == typeid(BlaiseArray) || rhs.value_.type() == typeid(BlaiseArray))
+        return std::make_pair(lhs, rhs);
+
     throw std::invalid_argument(NO_VIABLE_CONVERSION(lhs.value_.type().name(),
                                                      rhs.value_.type().name()));
 }
 
+BlaiseVariable BlaiseVariable::ArrayOperation(BLAISE_OP_ID op, const BlaiseVariable& lhs,
+                                              const BlaiseVariable& rhs) {
+    auto number = [&](const BlaiseVariable& var) {
+        if (var.Is<int>())
+            return static_cast<double>(var.Value<int>());
+        if (var.Is<double>())
+            return var.Value<double>();
+
+        throw std::invalid_argument(InvalidOperationForTypesMsg(lhs.Type(), rhs.Type()));
+    };
+
+    if (!lhs.Is<BlaiseArray>())
+        return BlaiseVariable(BlaiseArray::Apply(op, number(lhs), std::any_cast<const BlaiseArray&>(rhs.value_)));
+
+    if (!rhs.Is<BlaiseArray>())
+        return BlaiseVariable(BlaiseArray::Apply(op, std::any_cast<const BlaiseArray&>(lhs.value_), number(rhs)));
+
+    return BlaiseVariable(BlaiseArray::Apply(op, std::any_cast<const BlaiseArray&>(lhs.value_),
+                                             std::any_cast<const BlaiseArray&>(rhs.value_)));
+}
+
 bool BlaiseVariable::operator==(const std::string& str) const {
     return str == name_;
 }
@@ -184,6 +247,7 @@ BlaiseVariable& BlaiseVariable::Assign(const BlaiseVariable& var) {
 BlaiseVariable BlaiseVariable::operator+(const BlaiseVariable& var) const {
     auto [var1, var2] = CastToOneType(*this, var);
 
+    ARRAY_OPERATION_BLOCK(var1, var2, BLAISE_OP_ID::PLUS);
     OPERATION_BLOCK(var1, var2, +, int);
     OPERATION_BLOCK(var1, var2, +, bool);
     OPERATION_BLOCK(var1, var2, +, double);
@@ -195,7 +259,8 @@ BlaiseVariable BlaiseVariable::operator+(const BlaiseVariable& var) const {
 BlaiseVariable BlaiseVariable::operator-(const BlaiseVariable& var) const {
     auto [var1, var2] = CastToOneType(*this, var);
 
-    OPERATION_BLOCK(var1, var1, -, int);
+    ARRAY_OPERATION_BLOCK(var1, var2, BLAISE_OP_ID::MINUS);
+    OPERATION_BLOCK(var1, var2, -, int);
     OPERATION_BLOCK(var1, var2, -, double);
 
     throw std::invalid_argument(InvalidOperationForTypesMsg(var1.Type(), var2.Type()));
@@ -204,7 +269,8 @@ BlaiseVariable BlaiseVariable::operator-(const BlaiseVariable& var) const {
 BlaiseVariable BlaiseVariable::operator*(const BlaiseVariable& var) const {
     auto [var1, var2] = CastToOneType(*this, var);
 
-    OPERATION_BLOCK(var1, var1, *, int);
+    ARRAY_OPERATION_BLOCK(var1, var2, BLAISE_OP_ID::MUL);
+    OPERATION_BLOCK(var1, var2, *, int);
     OPERATION_BLOCK(var1, var2, *, double);
 
     throw std::invalid_argument(InvalidOperationForTypesMsg(var1.Type(), var2.Type()));
@@ -213,7 +279,8 @@ BlaiseVariable BlaiseVariable::operator*(const BlaiseVariable& var) const {
 BlaiseVariable BlaiseVariable::operator/(const BlaiseVariable& var) const {
     auto [var1, var2] = CastToOneType(*this, var);
 
-    OPERATION_BLOCK(var1, var1, /, int);
+    ARRAY_OPERATION_BLOCK(var1, var2, BLAISE_OP_ID::DIV);
+    OPERATION_BLOCK(var1, var2, /, int);
     OPERATION_BLOCK(var1, var2, /, double);
 
     throw std::invalid_argument(InvalidOperationForTypesMsg(var1.Type(), var2.Type()));
@@ -222,6 +289,7 @@ BlaiseVariable BlaiseVariable::operator/(const BlaiseVariable& var) const {
 BlaiseVariable BlaiseVariable::operator==(const BlaiseVariable& var) const {
     auto [var1, var2] = CastToOneType(*this, var);
 
+    ARRAY_OPERATION_BLOCK(var1, var2, BLAISE_OP_ID::EQUAL);
     BOOLEAN_LOGIC_BLOCK(var1, var2, ==, int);
     BOOLEAN_LOGIC_BLOCK(var1, var2, ==, double);
     BOOLEAN_LOGIC_BLOCK(var1, var2, ==, char);
@@ -232,6 +300,8 @@ BlaiseVariable BlaiseVariable::operator==(const BlaiseVariable& var) const {
 }
 
 BlaiseVariable BlaiseVariable::operator!=(const BlaiseVariable& var) const {
+    ARRAY_OPERATION_BLOCK((*this), var, BLAISE_OP_ID::NEQUAL);
+
     bool result = !std::any_cast<bool>((*this == var).value_);
     return BlaiseVariable(result);
 }
@@ -239,6 +309,7 @@ BlaiseVariable BlaiseVariable::operator!=(const BlaiseVariable& var) const {
 BlaiseVariable BlaiseVariable::operator<(const BlaiseVariable& var) const {
     auto [var1, var2] = CastToOneType(*this, var);
 
+    ARRAY_OPERATION_BLOCK(var1, var2, BLAISE_OP_ID::LESS);
     BOOLEAN_LOGIC_BLOCK(var1, var2, <, int);
     BOOLEAN_LOGIC_BLOCK(var1, var2, <, double);
     BOOLEAN_LOGIC_BLOCK(var1, var2, <, char);
@@ -249,6 +320,7 @@ BlaiseVariable BlaiseVariable::operator<(const BlaiseVariable& var) const {
 BlaiseVariable BlaiseVariable::operator<=(const BlaiseVariable& var) const {
     auto [var1, var2] = CastToOneType(*this, var);
 
+    ARRAY_OPERATION_BLOCK(var1, var2, BLAISE_OP_ID::LEQUAL);
 
     BOOLEAN_LOGIC_BLOCK(var1, var2, <=, int);
     BOOLEAN_LOGIC_BLOCK(var1, var2, <=, double);
@@ -260,6 +332,7 @@ BlaiseVariable BlaiseVariable::operator<=(const BlaiseVariable& var) const {
 BlaiseVariable BlaiseVariable::operator>(const BlaiseVariable& var) const {
     auto [var1, var2] = CastToOneType(*this, var);
 
+    ARRAY_OPERATION_BLOCK(var1, var2, BLAISE_OP_ID::GREATER);
     BOOLEAN_LOGIC_BLOCK(var1, var2, >, int);
     BOOLEAN_LOGIC_BLOCK(var1, var2, >, double);
     BOOLEAN_LOGIC_BLOCK(var1, var2, >, char);
@@ -270,6 +343,7 @@ BlaiseVariable BlaiseVariable::operator>(const BlaiseVariable& var) const {
 BlaiseVariable BlaiseVariable::operator>=(const BlaiseVariable& var) const {
     auto [var1, var2] = CastToOneType(*this, var);
 
+    ARRAY_OPERATION_BLOCK(var1, var2, BLAISE_OP_ID::GEQUAL);
     BOOLEAN_LOGIC_BLOCK(var1, var2, >=, int);
     BOOLEAN_LOGIC_BLOCK(var1, var2, >=, double);
     BOOLEAN_LOGIC_BLOCK(var1, var2, >=, char);
@@ -284,6 +358,8 @@ BlaiseVariable BlaiseVariable::operator+() const {
     } else if (value_.type() == typeid(int)) {
         int result = std::any_cast<int>(value_);
         return BlaiseVariable(+result);
+    } else if (value_.type() == typeid(BlaiseArray)) {
+        return *this;
     }
 
     throw std::invalid_argument("Invalid operation for type " + std::string(value_.type().name()));
@@ -296,6 +372,8 @@ BlaiseVariable BlaiseVariable::operator-() const {
     } else if (value_.type() == typeid(int)) {
         int result = std::any_cast<int>(value_);
         return BlaiseVariable(-result);
+    } else if (value_.type() == typeid(BlaiseArray)) {
+        return BlaiseVariable(BlaiseArray::Apply(BLAISE_OP_ID::MUL, -1.0, std::any_cast<const BlaiseArray&>(value_)));
     }
 
     throw std::invalid_argument("Invalid operation for type " + std::string(value_.type().name()));
@@ -313,14 +391,42 @@ const ArgsList& BlaiseFunction::Args() const {
     return args_;
 }
 
-void BlaiseFunction::SetBlock(BlaiseParser::StmtContext *block) {
-    block_ = block;
+void BlaiseFunction::SetDefinition(const BlaiseAst *ast, AstNodeId definition) {
+    ast_ = ast;
+    definition_ = definition;
+}
+
+size_t BlaiseFunction::Footprint() const {
+    size_t size = sizeof(BlaiseFunction) + HeapSize(name_);
+
+    // A list node links to both neighbours
+    for (const BlaiseVariable& arg : args_)
+        size += 2 * sizeof(void *) + arg.Footprint();
+
+    return size;
 }
 
 bool BlaiseFunction::IsDefined() const {
-    return block_ != nullptr;
+    return definition_ != UNDEFINED;
+}
+
+AstNodeId BlaiseFunction::Definition() const {
+    return definition_;
+}
+
+const BlaiseAst *BlaiseFunction::Ast() const {
+    return ast_;
+}
+
+SourcePosition SourcePosition::Of(const antlr4::ParserRuleContext *context) {
+    const antlr4::Token *start = context->getStart();
+
+    if (start == nullptr)
+        return {};
+
+    return { start->getLine(), start->getCharPositionInLine() + 1 };
 }
 
-BlaiseParser::StmtContext *BlaiseFunction::Block() const {
-    return block_;
+bool SourcePosition::operator<(const SourcePosition& other) const {
+    return line != other.line ? line < other.line : column < other.column;
 }
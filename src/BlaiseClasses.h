@@ -1,10 +1,17 @@
 #pragma once
 
+#include <cstdint>
 #include <list>
 #include <typeinfo>
 
 #include "antlr/BlaiseParser.h"
 
+class BlaiseAst;
+
+// Bytes str keeps on the heap, 0 if it is short enough to be stored in
+// the string itself
+size_t HeapSize(const std::string& str);
+
 enum class BLAISE_OP_ID {
     PLUS,
     MINUS,
@@ -50,11 +57,22 @@ public:
 
     const std::any& Value() const;
 
+    // The value, to be changed in place. It has to be a T.
+    template<typename T>
+    T& ValueRef();
+
     BlaiseVariable& SetName(const std::string& name);
     BlaiseVariable& SetValue(const std::any& value);
 
     std::string ToString() const;
 
+    // Bytes the variable takes, itself and what its name and value keep
+    // on the heap
+    size_t Footprint() const;
+
+    // Bytes value keeps on the heap
+    static size_t ValueFootprint(const std::any& value);
+
     BlaiseVariable& operator=(const BlaiseVariable& var) = default;
 
     bool operator==(const std::string& str) const;
@@ -78,6 +96,8 @@ private:
     static std::string AnyValueToString(const std::any& any);
     static std::pair<BlaiseVariable, BlaiseVariable> CastToOneType(const BlaiseVariable& lhs,
                                                                    const BlaiseVariable& rhs);
+    // op of an array and an array or a number, element by element
+    static BlaiseVariable ArrayOperation(BLAISE_OP_ID op, const BlaiseVariable& lhs, const BlaiseVariable& rhs);
     std::string name_;
     std::any value_;
 };
@@ -93,8 +113,16 @@ T BlaiseVariable::Value() const {
     return std::any_cast<T>(value_);
 }
 
+template<typename T>
+T& BlaiseVariable::ValueRef() {
+    return std::any_cast<T&>(value_);
+}
+
 using ArgsList = std::list<BlaiseVariable>;
 
+// Index of a node in a BlaiseAst
+using AstNodeId = uint32_t;
+
 class BlaiseFunction {
 public:
     BlaiseFunction(const std::string& name,
@@ -103,28 +131,51 @@ public:
 
     BlaiseFunction(const std::string& name,
                    const ArgsList& args,
-                   BlaiseParser::StmtContext *block)
-                : name_(name), args_(args), block_(block) {}
+                   const BlaiseAst *ast,
+                   AstNodeId definition)
+                : name_(name), args_(args), ast_(ast), definition_(definition) {}
 
     const std::string& Name() const;
 
     const ArgsList& Args() const;
 
-    BlaiseParser::StmtContext *Block() const;
+    // FUNCTION_DEFINITION node, its last child is the body
+    AstNodeId Definition() const;
+
+    // AST the definition belongs to. Differs from the one being run when
+    // the function was defined by an earlier REPL input.
+    const BlaiseAst *Ast() const;
 
     bool IsDefined() const;
 
-    void SetBlock(BlaiseParser::StmtContext *block);
+    void SetDefinition(const BlaiseAst *ast, AstNodeId definition);
+
+    // Bytes the function takes, with its name and parameter list
+    size_t Footprint() const;
 
     bool operator==(const std::string& str) const;
 private:
+    static constexpr AstNodeId UNDEFINED = UINT32_MAX;
+
     std::string name_;
     ArgsList args_;
-    BlaiseParser::StmtContext *block_ = nullptr;
+    const BlaiseAst *ast_ = nullptr;
+    AstNodeId definition_ = UNDEFINED;
 };
 
 class BlaiseBlock {
 public:
     std::deque<BlaiseVariable> variables;
     std::deque<BlaiseFunction> functions;
-};
\ No newline at end of file
+};
+
+// Line and column (both starting at 1) of the first token of a parse tree
+// node. Profiles use it to find the same node again in another run.
+struct SourcePosition {
+    size_t line = 0;
+    size_t column = 0;
+
+    static SourcePosition Of(const antlr4::ParserRuleContext *context);
+
+    bool operator<(const SourcePosition& other) const;
+};
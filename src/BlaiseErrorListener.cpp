@@ -6,6 +6,6 @@ void BlaiseErrorListener::syntaxError(antlr4::Recognizer *recognizer,
                      size_t charPositionInLine,
                      const std::string &msg,
                      std::exception_ptr e) {
-    std::cerr << "Syntax error at line " << line << ":" << charPositionInLine
-              << ": " << msg << std::endl;
+    out_ << "Syntax error at line " << line << ":" << charPositionInLine
+         << ": " << msg << std::endl;
 };
\ No newline at end of file
@@ -1,12 +1,18 @@
+#include <iostream>
+
 #include "BaseErrorListener.h"
 #include "antlr4-runtime.h"
 
 class BlaiseErrorListener : public antlr4::BaseErrorListener {
+    std::ostream& out_;
+
 public:
+    explicit BlaiseErrorListener(std::ostream& out = std::cerr) : out_(out) {}
+
     void syntaxError(antlr4::Recognizer *recognizer,
                      antlr4::Token *offendingSymbol,
                      size_t line,
                      size_t charPositionInLine,
                      const std::string &msg,
                      std::exception_ptr e) override;
-};
\ No newline at end of file
+};
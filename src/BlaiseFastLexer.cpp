@@ -0,0 +1,369 @@
+#include <cstdint>
+#include <cstring>
+
+#include "BlaiseFastLexer.h"
+#include "antlr/BlaiseLexer.h"
+
+namespace {
+
+constexpr uint64_t ONES = 0x0101010101010101ull;
+constexpr uint64_t HIGHS = 0x8080808080808080ull;
+
+// Word-at-a-time scanning reads bytes in memory order from the low end
+// of the word. Big-endian targets take the byte loops only.
+constexpr bool SWAR = __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+
+uint64_t Load(const char *p) {
+    uint64_t word;
+    std::memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+// 0x80 in every byte of word that is equal to byte, 0 in the others
+uint64_t BytesEqual(uint64_t word, unsigned char byte) {
+    uint64_t x = word ^ (ONES * byte);
+    return ~(((x & ~HIGHS) + ~HIGHS) | x | ~HIGHS);
+}
+
+// 0x80 in every UTF-8 continuation byte (10xxxxxx) of word
+uint64_t Continuations(uint64_t word) {
+    return word & ~(word << 1) & HIGHS;
+}
+
+size_t FirstByte(uint64_t mask) {
+    return __builtin_ctzll(mask) / 8;
+}
+
+size_t LastByte(uint64_t mask) {
+    return (63 - __builtin_clzll(mask)) / 8;
+}
+
+bool IsSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+bool IsDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+bool IsIdStart(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+bool IsIdPart(char c) {
+    return IsIdStart(c) || IsDigit(c);
+}
+
+// Same escaping as antlr4::Lexer::getErrorDisplay
+std::string ErrorDisplay(const std::string& text) {
+    std::string display;
+
+    for (char c : text) {
+        switch (c) {
+            case '\n': display += "\\n"; break;
+            case '\t': display += "\\t"; break;
+            case '\r': display += "\\r"; break;
+            default: display += c; break;
+        }
+    }
+
+    return display;
+}
+
+}
+
+BlaiseFastLexer::TokenTypes::TokenTypes() {
+    antlr4::ANTLRInputStream empty;
+    BlaiseLexer lexer(&empty);
+    const antlr4::dfa::Vocabulary& vocabulary = lexer.getVocabulary();
+
+    for (size_t type = antlr4::Token::MIN_USER_TOKEN_TYPE; type <= vocabulary.getMaxTokenType(); type++) {
+        std::string literal(vocabulary.getLiteralName(type));
+
+        if (literal.size() < 3)
+            continue;
+
+        literal = literal.substr(1, literal.size() - 2);
+
+        if (literal.size() == 1)
+            single[static_cast<unsigned char>(literal[0]) % 128] = type;
+        else
+            words[literal] = type;
+
+        if (literal.size() == 2)
+            starts_pair[static_cast<unsigned char>(literal[0]) % 128] = true;
+    }
+
+    words["true"] = BlaiseLexer::BOOLEAN;
+    words["false"] = BlaiseLexer::BOOLEAN;
+}
+
+const BlaiseFastLexer::TokenTypes& BlaiseFastLexer::Types() {
+    static const TokenTypes types;
+    return types;
+}
+
+BlaiseFastLexer::BlaiseFastLexer(std::string_view source, std::string source_name)
+    : source_(source), source_name_(std::move(source_name)) {}
+
+void BlaiseFastLexer::addErrorListener(antlr4::ANTLRErrorListener *listener) {
+    listeners_.push_back(listener);
+}
+
+void BlaiseFastLexer::removeErrorListeners() {
+    listeners_.clear();
+}
+
+size_t BlaiseFastLexer::CodePointSize(size_t pos) const {
+    unsigned char lead = source_[pos];
+    size_t size = lead < 0x80 ? 1 : lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 1;
+
+    return std::min(size, source_.size() - pos);
+}
+
+size_t BlaiseFastLexer::SkipSpace(size_t pos) const {
+    const char *data = source_.data();
+
+    for (; SWAR && pos + 8 <= source_.size(); pos += 8) {
+        uint64_t word = Load(data + pos);
+        uint64_t space = BytesEqual(word, ' ') | BytesEqual(word, '\t') | BytesEqual(word, '\n')
+                         | BytesEqual(word, '\r');
+
+        if (space != HIGHS)
+            return pos + FirstByte(~space & HIGHS);
+    }
+
+    while (pos < source_.size() && IsSpace(data[pos]))
+        pos++;
+
+    return pos;
+}
+
+size_t BlaiseFastLexer::SkipDigits(size_t pos) const {
+    while (pos < source_.size() && IsDigit(source_[pos]))
+        pos++;
+
+    return pos;
+}
+
+size_t BlaiseFastLexer::FindLineEnd(size_t pos) const {
+    const char *data = source_.data();
+
+    for (; SWAR && pos + 8 <= source_.size(); pos += 8) {
+        uint64_t word = Load(data + pos);
+        uint64_t end = BytesEqual(word, '\n') | BytesEqual(word, '\r');
+
+        if (end != 0)
+            return pos + FirstByte(end);
+    }
+
+    while (pos < source_.size() && data[pos] != '\n' && data[pos] != '\r')
+        pos++;
+
+    return pos;
+}
+
+size_t BlaiseFastLexer::FindCommentEnd(size_t pos) const {
+    const char *data = source_.data();
+
+    while (pos < source_.size()) {
+        const void *star = std::memchr(data + pos, '*', source_.size() - pos);
+
+        if (star == nullptr)
+            break;
+
+        pos = static_cast<const char *>(star) - data + 1;
+
+        if (pos < source_.size() && data[pos] == '/')
+            return pos + 1;
+    }
+
+    return std::string::npos;
+}
+
+void BlaiseFastLexer::Advance(size_t end) {
+    const char *data = source_.data();
+    size_t newlines = 0;
+    size_t continuations = 0;
+    size_t last_newline = 0;
+    size_t pos = pos_;
+
+    for (; SWAR && pos + 8 <= end; pos += 8) {
+        uint64_t word = Load(data + pos);
+        uint64_t newline = BytesEqual(word, '\n');
+
+        if (newline != 0) {
+            newlines += __builtin_popcountll(newline);
+            last_newline = pos + LastByte(newline);
+        }
+
+        continuations += __builtin_popcountll(Continuations(word));
+    }
+
+    for (; pos < end; pos++) {
+        if (data[pos] == '\n') {
+            newlines++;
+            last_newline = pos;
+        }
+
+        continuations += (data[pos] & 0xC0) == 0x80;
+    }
+
+    index_ += end - pos_ - continuations;
+
+    if (newlines == 0) {
+        column_ += end - pos_ - continuations;
+    } else {
+        line_ += newlines;
+        column_ = 0;
+
+        for (pos = last_newline + 1; pos < end; pos++)
+            column_ += (data[pos] & 0xC0) != 0x80;
+    }
+
+    pos_ = end;
+}
+
+std::unique_ptr<antlr4::Token> BlaiseFastLexer::Emit(size_t type, size_t start, size_t start_index,
+                                                     size_t line, size_t column) {
+    return factory_->create({ this, nullptr }, type, std::string(source_.substr(start, pos_ - start)),
+                            antlr4::Token::DEFAULT_CHANNEL, start_index, index_ - 1, line, column);
+}
+
+void BlaiseFastLexer::Fail(size_t start, size_t failed, size_t line, size_t column) {
+    size_t end = failed < source_.size() ? failed + CodePointSize(failed) : source_.size();
+    std::string message = "token recognition error at: '" + ErrorDisplay(std::string(source_.substr(start, end - start))) + "'";
+
+    for (antlr4::ANTLRErrorListener *listener : listeners_)
+        listener->syntaxError(nullptr, nullptr, line, column, message, nullptr);
+
+    Advance(end);
+}
+
+std::unique_ptr<antlr4::Token> BlaiseFastLexer::nextToken() {
+    const TokenTypes& types = Types();
+    const char *data = source_.data();
+    size_t size = source_.size();
+
+    while (pos_ < size) {
+        size_t start = pos_;
+        size_t start_index = index_;
+        size_t line = line_;
+        size_t column = column_;
+        char c = data[pos_];
+        char next = pos_ + 1 < size ? data[pos_ + 1] : '\0';
+        size_t comment_end;
+
+        if (IsSpace(c)) {
+            Advance(SkipSpace(pos_));
+        } else if (c == ';') {
+            Advance(pos_ + 1);
+        } else if (c == '/' && next == '/') {
+            Advance(FindLineEnd(pos_ + 2));
+        } else if (c == '/' && next == '*' && (comment_end = FindCommentEnd(pos_ + 2)) != std::string::npos) {
+            Advance(comment_end);
+        } else if (IsIdStart(c)) {
+            size_t end = pos_ + 1;
+
+            while (end < size && IsIdPart(data[end]))
+                end++;
+
+            auto word = types.words.find(std::string(source_.substr(pos_, end - pos_)));
+
+            Advance(end);
+            return Emit(word == types.words.end() ? BlaiseLexer::IDENTIFIER : word->second,
+                        start, start_index, line, column);
+        } else if (IsDigit(c)) {
+            size_t end = SkipDigits(pos_);
+            size_t type = BlaiseLexer::INT;
+
+            // The longest match wins, an incomplete fraction or exponent
+            // is left for the next token
+            if (end + 1 < size && data[end] == '.' && IsDigit(data[end + 1])) {
+                end = SkipDigits(end + 1);
+                type = BlaiseLexer::DOUBLE;
+            } else if (end + 2 < size && data[end] == 'e'
+                       && (data[end + 1] == '+' || data[end + 1] == '|' || data[end + 1] == '-')
+                       && IsDigit(data[end + 2])) {
+                end = SkipDigits(end + 2);
+                type = BlaiseLexer::DOUBLE;
+            }
+
+            Advance(end);
+            return Emit(type, start, start_index, line, column);
+        } else if (c == '"') {
+            const void *quote = std::memchr(data + pos_ + 1, '"', size - pos_ - 1);
+
+            if (quote == nullptr) {
+                Fail(pos_, size, line, column);
+                continue;
+            }
+
+            Advance(static_cast<const char *>(quote) - data + 1);
+            return Emit(BlaiseLexer::STRING, start, start_index, line, column);
+        } else if (c == '\'') {
+            size_t quote = pos_ + 1 < size ? pos_ + 1 + CodePointSize(pos_ + 1) : size;
+
+            if (quote >= size || data[quote] != '\'') {
+                Fail(pos_, quote, line, column);
+                continue;
+            }
+
+            Advance(quote + 1);
+            return Emit(BlaiseLexer::CHAR, start, start_index, line, column);
+        } else {
+            unsigned char ascii = static_cast<unsigned char>(c) < 128 ? c : 0;
+            auto pair = types.words.end();
+
+            if (types.starts_pair[ascii] && pos_ + 1 < size)
+                pair = types.words.find(std::string{ c, next });
+
+            if (pair != types.words.end()) {
+                Advance(pos_ + 2);
+                return Emit(pair->second, start, start_index, line, column);
+            }
+
+            size_t type = types.single[ascii];
+
+            if (type != 0) {
+                Advance(pos_ + 1);
+                return Emit(type, start, start_index, line, column);
+            }
+
+            // '!' only starts "!=", the generated lexer gives up on the
+            // character after it
+            Fail(pos_, c == '!' ? pos_ + 1 : pos_, line, column);
+        }
+    }
+
+    return factory_->create({ this, nullptr }, antlr4::Token::EOF, "<EOF>", antlr4::Token::DEFAULT_CHANNEL,
+                            index_, index_ - 1, line_, column_);
+}
+
+size_t BlaiseFastLexer::getLine() const {
+    return line_;
+}
+
+void BlaiseFastLexer::setLine(size_t line) {
+    line_ = line;
+}
+
+void BlaiseFastLexer::setCharPositionInLine(size_t column) {
+    column_ = column;
+}
+
+size_t BlaiseFastLexer::getCharPositionInLine() {
+    return column_;
+}
+
+antlr4::CharStream *BlaiseFastLexer::getInputStream() {
+    return nullptr;
+}
+
+std::string BlaiseFastLexer::getSourceName() {
+    return source_name_;
+}
+
+antlr4::TokenFactory<antlr4::CommonToken> *BlaiseFastLexer::getTokenFactory() {
+    return factory_;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "antlr4-runtime.h"
+
+// Hand-written equivalent of the generated BlaiseLexer. It produces the
+// same token types, texts and positions and recovers from errors the same
+// way, but skips whitespace, comments and string bodies a machine word or
+// a memchr at a time instead of running every character through the
+// lexer DFA. Works on UTF-8 bytes; token indexes and columns are still
+// counted in code points, like ANTLRInputStream does.
+class BlaiseFastLexer : public antlr4::TokenSource {
+    // Token types of the grammar literals, taken from the vocabulary of
+    // the generated lexer so that implicit T__N tokens stay in sync
+    struct TokenTypes {
+        size_t single[128] = {};                            // one character literals
+        bool starts_pair[128] = {};                         // first characters of two character literals
+        std::unordered_map<std::string, size_t> words;      // longer literals and keywords
+
+        TokenTypes();
+    };
+
+    static const TokenTypes& Types();
+
+    std::string_view source_;
+    std::string source_name_;
+
+    size_t pos_ = 0;        // in bytes
+    size_t index_ = 0;      // in code points
+    size_t line_ = 1;
+    size_t column_ = 0;
+
+    antlr4::TokenFactory<antlr4::CommonToken> *factory_ = antlr4::CommonTokenFactory::DEFAULT.get();
+    std::vector<antlr4::ANTLRErrorListener *> listeners_{ &antlr4::ConsoleErrorListener::INSTANCE };
+
+private:
+
+    size_t CodePointSize(size_t pos) const;
+
+    size_t SkipSpace(size_t pos) const;
+
+    size_t SkipDigits(size_t pos) const;
+
+    size_t FindLineEnd(size_t pos) const;
+
+    size_t FindCommentEnd(size_t pos) const;
+
+    // Moves to byte end, keeping line, column and code point index
+    void Advance(size_t end);
+
+    std::unique_ptr<antlr4::Token> Emit(size_t type, size_t start, size_t start_index, size_t line, size_t column);
+
+    // Reports a token recognition error for the bytes from start up to
+    // and including the character the lexer failed on, and skips them
+    void Fail(size_t start, size_t failed, size_t line, size_t column);
+
+public:
+
+    // source is not copied and has to outlive the lexer
+    explicit BlaiseFastLexer(std::string_view source, std::string source_name = "<unknown>");
+
+    void addErrorListener(antlr4::ANTLRErrorListener *listener);
+
+    void removeErrorListeners();
+
+    virtual std::unique_ptr<antlr4::Token> nextToken() override;
+
+    virtual size_t getLine() const override;
+
+    // Position of the first character, for a source that starts in the
+    // middle of a file
+    void setLine(size_t line);
+
+    void setCharPositionInLine(size_t column);
+
+    virtual size_t getCharPositionInLine() override;
+
+    // Tokens carry their own text, there is no CharStream behind them
+    virtual antlr4::CharStream *getInputStream() override;
+
+    virtual std::string getSourceName() override;
+
+    virtual antlr4::TokenFactory<antlr4::CommonToken> *getTokenFactory() override;
+};
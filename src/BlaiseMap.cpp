@@ -0,0 +1,291 @@
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "BlaiseMap.h"
+#include "BlaiseSource.h"
+
+namespace {
+
+constexpr size_t GROUP = 16;
+constexpr size_t MIN_CAPACITY = GROUP;
+
+// Control bytes of slots that are not full. Both are negative, full
+// slots keep 7 bits of the hash.
+constexpr int8_t EMPTY = -128;
+constexpr int8_t DELETED = -2;
+
+int8_t HashBits(uint64_t hash) {
+    return static_cast<int8_t>(hash & 0x7F);
+}
+
+// Bit i is set where byte i of the group is byte
+uint32_t Match(const int8_t *group, int8_t byte) {
+#if defined(__SSE2__)
+    __m128i control = _mm_loadu_si128(reinterpret_cast<const __m128i *>(group));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(control, _mm_set1_epi8(byte)));
+#else
+    uint32_t mask = 0;
+
+    for (size_t i = 0; i < GROUP; i++)
+        mask |= static_cast<uint32_t>(group[i] == byte) << i;
+
+    return mask;
+#endif
+}
+
+// Bit i is set where slot i of the group is empty or deleted
+uint32_t MatchFree(const int8_t *group) {
+#if defined(__SSE2__)
+    return _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(group)));
+#else
+    uint32_t mask = 0;
+
+    for (size_t i = 0; i < GROUP; i++)
+        mask |= static_cast<uint32_t>(group[i] < 0) << i;
+
+    return mask;
+#endif
+}
+
+// Groups of the probe sequence of hash, triangular so that every group
+// comes up once the count of groups is a power of 2
+class Probe {
+public:
+    Probe(uint64_t hash, size_t groups) : mask_(groups - 1), group_((hash >> 7) & mask_) {}
+
+    size_t Offset() const {
+        return group_ * GROUP;
+    }
+
+    void Next() {
+        group_ = (group_ + ++step_) & mask_;
+    }
+
+private:
+    size_t mask_;
+    size_t group_;
+    size_t step_ = 0;
+};
+
+// Finalizer of MurmurHash3: every bit of the key changes half of the
+// bits of the hash, the low ones included
+uint64_t Mix(uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+
+    return hash;
+}
+
+}
+
+BlaiseMap::Table::Table(size_t capacity)
+    : control(capacity, EMPTY), slots(capacity), growth_left(capacity - capacity / 8) {}
+
+size_t BlaiseMap::Table::Find(const KeyView& key, uint64_t hash) const {
+    for (Probe probe(hash, control.size() / GROUP);; probe.Next()) {
+        const int8_t *group = &control[probe.Offset()];
+
+        for (uint32_t match = Match(group, HashBits(hash)); match; match &= match - 1) {
+            size_t slot = probe.Offset() + __builtin_ctz(match);
+
+            if (ViewOf(slots[slot].key) == key)
+                return slot;
+        }
+
+        // A probe for the key would have stopped here when it was put
+        if (Match(group, EMPTY))
+            return NOT_FOUND;
+    }
+}
+
+size_t BlaiseMap::Table::FreeSlot(uint64_t hash) const {
+    for (Probe probe(hash, control.size() / GROUP);; probe.Next()) {
+        uint32_t free = MatchFree(&control[probe.Offset()]);
+
+        if (free)
+            return probe.Offset() + __builtin_ctz(free);
+    }
+}
+
+void BlaiseMap::Table::Rehash(size_t capacity) {
+    Table table(capacity);
+
+    for (size_t i = 0; i < slots.size(); i++) {
+        if (control[i] < 0)
+            continue;
+
+        uint64_t hash = Hash(ViewOf(slots[i].key));
+        size_t slot = table.FreeSlot(hash);
+
+        table.control[slot] = HashBits(hash);
+        table.slots[slot] = std::move(slots[i]);
+    }
+
+    table.size = size;
+    table.growth_left -= size;
+    table.heap = heap;
+
+    *this = std::move(table);
+}
+
+size_t BlaiseMap::Size() const {
+    return table_ ? table_->size : 0;
+}
+
+BlaiseMap::KeyView BlaiseMap::ViewOf(const BlaiseVariable& key) {
+    if (key.Is<int>())
+        return std::any_cast<int>(key.Value());
+    if (key.Is<char>())
+        return std::any_cast<char>(key.Value());
+    if (key.Is<std::string>())
+        return std::string_view(*std::any_cast<std::string>(&key.Value()));
+
+    throw std::invalid_argument("Map keys must be ints, chars or strings");
+}
+
+BlaiseMap::KeyView BlaiseMap::ViewOf(const Key& key) {
+    if (const std::string *str = std::get_if<std::string>(&key))
+        return std::string_view(*str);
+
+    return std::holds_alternative<int>(key) ? KeyView(std::get<int>(key)) : KeyView(std::get<char>(key));
+}
+
+BlaiseMap::Key BlaiseMap::KeyOf(const KeyView& view) {
+    if (const std::string_view *str = std::get_if<std::string_view>(&view))
+        return std::string(*str);
+
+    return std::holds_alternative<int>(view) ? Key(std::get<int>(view)) : Key(std::get<char>(view));
+}
+
+uint64_t BlaiseMap::Hash(const KeyView& key) {
+    if (const std::string_view *str = std::get_if<std::string_view>(&key))
+        return Mix(HashBytes(*str));
+
+    // The type is hashed as well, so that 65 and 'A' do not collide
+    if (const int *number = std::get_if<int>(&key))
+        return Mix(static_cast<uint32_t>(*number));
+
+    return Mix(static_cast<unsigned char>(std::get<char>(key)) | (1ull << 32));
+}
+
+size_t BlaiseMap::SlotHeap(const Slot& slot) {
+    const std::string *str = std::get_if<std::string>(&slot.key);
+
+    return (str ? HeapSize(*str) : 0) + BlaiseVariable::ValueFootprint(slot.value);
+}
+
+BlaiseMap::Table& BlaiseMap::Writable() {
+    if (!table_)
+        table_ = std::make_shared<Table>(MIN_CAPACITY);
+    else if (table_.use_count() > 1)
+        table_ = std::make_shared<Table>(*table_);
+
+    return *table_;
+}
+
+const std::any *BlaiseMap::Find(const BlaiseVariable& key) const {
+    KeyView view = ViewOf(key);
+
+    if (!table_)
+        return nullptr;
+
+    size_t slot = table_->Find(view, Hash(view));
+
+    return slot == NOT_FOUND ? nullptr : &table_->slots[slot].value;
+}
+
+void BlaiseMap::Put(const BlaiseVariable& key, const std::any& value) {
+    KeyView view = ViewOf(key);
+    uint64_t hash = Hash(view);
+    size_t slot = table_ ? table_->Find(view, hash) : NOT_FOUND;
+    Table& table = Writable();
+
+    if (slot != NOT_FOUND) {
+        table.heap -= SlotHeap(table.slots[slot]);
+        table.slots[slot].value = value;
+        table.heap += SlotHeap(table.slots[slot]);
+
+        return;
+    }
+
+    // Out of empty slots: the table grows when at least half of the
+    // slots taken are full, otherwise the deleted ones are cleared
+    if (table.growth_left == 0) {
+        size_t capacity = table.slots.size();
+        bool grow = table.size * 2 >= capacity - capacity / 8;
+
+        table.Rehash(grow ? capacity * 2 : capacity);
+    }
+
+    slot = table.FreeSlot(hash);
+
+    if (table.control[slot] == EMPTY)
+        table.growth_left--;
+
+    table.control[slot] = HashBits(hash);
+    table.slots[slot].key = KeyOf(view);
+    table.slots[slot].value = value;
+    table.size++;
+    table.heap += SlotHeap(table.slots[slot]);
+}
+
+bool BlaiseMap::Erase(const BlaiseVariable& key) {
+    KeyView view = ViewOf(key);
+    size_t slot = table_ ? table_->Find(view, Hash(view)) : NOT_FOUND;
+
+    if (slot == NOT_FOUND)
+        return false;
+
+    Table& table = Writable();
+    const int8_t *group = &table.control[slot / GROUP * GROUP];
+
+    // No probe went past a group with an empty slot, so the slot can be
+    // empty again instead of deleted
+    if (Match(group, EMPTY)) {
+        table.control[slot] = EMPTY;
+        table.growth_left++;
+    } else {
+        table.control[slot] = DELETED;
+    }
+
+    table.heap -= SlotHeap(table.slots[slot]);
+    table.slots[slot] = Slot();
+    table.size--;
+
+    return true;
+}
+
+std::string BlaiseMap::ToString() const {
+    std::ostringstream out;
+    bool first = true;
+
+    out << "{";
+
+    for (size_t i = 0; table_ && i < table_->slots.size(); i++) {
+        if (table_->control[i] < 0)
+            continue;
+
+        out << (first ? "" : ", ");
+        std::visit([&](const auto& key) { out << key; }, table_->slots[i].key);
+        out << ": " << BlaiseVariable(table_->slots[i].value).ToString();
+        first = false;
+    }
+
+    out << "}";
+
+    return out.str();
+}
+
+size_t BlaiseMap::Footprint() const {
+    if (!table_)
+        return 0;
+
+    return sizeof(Table) + table_->control.capacity() + table_->slots.capacity() * sizeof(Slot) + table_->heap;
+}
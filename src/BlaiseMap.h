@@ -0,0 +1,88 @@
+#pragma once
+
+#include <any>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include "BlaiseClasses.h"
+
+// Value of a map variable: keys that are ints, chars or strings, values
+// of any type. Copies share the table until one of them changes it, like
+// BlaiseArray.
+//
+// The table is open addressing in the style of Swiss tables: a byte of
+// control per slot, with 7 bits of the hash of a full slot, probed 16
+// slots at a time, so that a lookup compares keys only where those bits
+// match and the slots themselves are a flat array.
+class BlaiseMap {
+public:
+    size_t Size() const;
+
+    // Keys have to be ints, chars or strings, the functions taking one
+    // throw std::invalid_argument otherwise
+
+    // Value of key, nullptr if the map has none
+    const std::any *Find(const BlaiseVariable& key) const;
+
+    void Put(const BlaiseVariable& key, const std::any& value);
+
+    // Whether there was such a key
+    bool Erase(const BlaiseVariable& key);
+
+    std::string ToString() const;
+
+    // Bytes of the table, the keys and the values. Every copy sharing
+    // them counts them again.
+    size_t Footprint() const;
+
+private:
+    using Key = std::variant<int, char, std::string>;
+    using KeyView = std::variant<int, char, std::string_view>;
+
+    struct Slot {
+        Key key;
+        std::any value;
+    };
+
+    struct Table {
+        explicit Table(size_t capacity);
+
+        // Slot of key, NOT_FOUND if there is none
+        size_t Find(const KeyView& key, uint64_t hash) const;
+
+        // First slot on the probe sequence of hash that is empty or
+        // deleted
+        size_t FreeSlot(uint64_t hash) const;
+
+        // Into a table of capacity slots, leaving no deleted ones
+        void Rehash(size_t capacity);
+
+        std::vector<int8_t> control;
+        std::vector<Slot> slots;
+        size_t size = 0;
+
+        // Inserts into empty slots left before the table is too full
+        size_t growth_left = 0;
+
+        // What the keys and values keep on the heap
+        size_t heap = 0;
+    };
+
+    static constexpr size_t NOT_FOUND = SIZE_MAX;
+
+    static KeyView ViewOf(const BlaiseVariable& key);
+    static KeyView ViewOf(const Key& key);
+    static Key KeyOf(const KeyView& view);
+    static uint64_t Hash(const KeyView& key);
+    static size_t SlotHeap(const Slot& slot);
+
+    // The table, copied first if another map shares it
+    Table& Writable();
+
+    std::shared_ptr<Table> table_;
+};
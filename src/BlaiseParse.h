@@ -0,0 +1,37 @@
+#pragma once
+
+#include <memory>
+
+#include "antlr4-runtime.h"
+#include "antlr/BlaiseParser.h"
+
+// SLL prediction never looks at the full parser call stack, so it is much
+// cheaper than LL, and it accepts every valid program except for rare
+// inputs that need full context to choose an alternative. Parse in SLL
+// first, bailing out at the first error instead of recovering, and only
+// parse again in LL with error reporting when that fails. rule is the
+// start rule, program or stmt.
+template<typename Context>
+Context *ParseRule(BlaiseParser& parser, antlr4::CommonTokenStream& tokens, antlr4::ANTLRErrorListener& errlistener,
+                   bool& retried, Context *(BlaiseParser::*rule)()) {
+    auto *interpreter = parser.getInterpreter<antlr4::atn::ParserATNSimulator>();
+
+    parser.removeErrorListeners();
+    parser.setErrorHandler(std::make_shared<antlr4::BailErrorStrategy>());
+    interpreter->setPredictionMode(antlr4::atn::PredictionMode::SLL);
+    retried = false;
+
+    try {
+        return (parser.*rule)();
+    } catch (const antlr4::ParseCancellationException&) {
+        retried = true;
+    }
+
+    tokens.seek(0);
+    parser.reset();
+    parser.addErrorListener(&errlistener);
+    parser.setErrorHandler(std::make_shared<antlr4::DefaultErrorStrategy>());
+    interpreter->setPredictionMode(antlr4::atn::PredictionMode::LL);
+
+    return (parser.*rule)();
+}
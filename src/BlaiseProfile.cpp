@@ -0,0 +1,221 @@
+#include <cctype>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+#include "BlaiseProfile.h"
+
+namespace {
+
+// Just enough JSON for profiles: objects, arrays, strings and unsigned
+// integers, read in a single pass with callbacks per member and element.
+class JsonReader {
+private:
+
+    std::string text_;
+    size_t pos_ = 0;
+
+private:
+
+    [[noreturn]] void Fail(const std::string& what) const {
+        throw std::invalid_argument("Invalid profile: " + what + " at offset " + std::to_string(pos_));
+    }
+
+    char Peek() {
+        while (pos_ < text_.size() && std::isspace(static_cast<unsigned char>(text_[pos_])))
+            pos_++;
+
+        return pos_ < text_.size() ? text_[pos_] : '\0';
+    }
+
+    void Expect(char c) {
+        if (Peek() != c)
+            Fail(std::string("expected '") + c + "'");
+
+        pos_++;
+    }
+
+    bool Accept(char c) {
+        if (Peek() != c)
+            return false;
+
+        pos_++;
+        return true;
+    }
+
+public:
+
+    explicit JsonReader(std::istream& in)
+        : text_(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()) {}
+
+    void Object(const std::function<void(const std::string&)>& member) {
+        Expect('{');
+
+        if (Accept('}'))
+            return;
+
+        do {
+            std::string key = String();
+            Expect(':');
+            member(key);
+        } while (Accept(','));
+
+        Expect('}');
+    }
+
+    void Array(const std::function<void()>& element) {
+        Expect('[');
+
+        if (Accept(']'))
+            return;
+
+        do {
+            element();
+        } while (Accept(','));
+
+        Expect(']');
+    }
+
+    std::string String() {
+        std::string str;
+
+        Expect('"');
+
+        while (pos_ < text_.size() && text_[pos_] != '"') {
+            if (text_[pos_] == '\\' && pos_ + 1 < text_.size())
+                pos_++;
+
+            str += text_[pos_++];
+        }
+
+        Expect('"');
+
+        return str;
+    }
+
+    size_t Number() {
+        if (!std::isdigit(static_cast<unsigned char>(Peek())))
+            Fail("expected a number");
+
+        size_t value = 0;
+
+        while (pos_ < text_.size() && std::isdigit(static_cast<unsigned char>(text_[pos_])))
+            value = value * 10 + (text_[pos_++] - '0');
+
+        return value;
+    }
+
+    void Skip() {
+        switch (Peek()) {
+            case '{': Object([&](const std::string&) { Skip(); }); break;
+            case '[': Array([&]() { Skip(); });                    break;
+            case '"': String();                                    break;
+            default:  Number();                                    break;
+        }
+    }
+
+    void End() {
+        if (Peek() != '\0')
+            Fail("unexpected trailing data");
+    }
+};
+
+// Reads an array of entries. The position members are common to all
+// entries, the remaining ones are handled by field.
+template<typename Entry>
+void ReadEntries(JsonReader& reader, std::map<SourcePosition, Entry>& entries,
+                 const std::function<void(Entry&, const std::string&, JsonReader&)>& field) {
+    reader.Array([&]() {
+        SourcePosition position;
+        Entry entry;
+
+        reader.Object([&](const std::string& key) {
+            if (key == "line")
+                position.line = reader.Number();
+            else if (key == "column")
+                position.column = reader.Number();
+            else
+                field(entry, key, reader);
+        });
+
+        entries[position] = entry;
+    });
+}
+
+void WritePosition(std::ostream& out, const SourcePosition& position) {
+    out << "{ \"line\": " << position.line << ", \"column\": " << position.column;
+}
+
+} // namespace
+
+void BlaiseProfile::Save(std::ostream& out) const {
+    const char *separator = "";
+
+    out << "{\n  \"functions\": [";
+
+    for (const auto& [position, function] : functions) {
+        out << separator << "\n    ";
+        WritePosition(out, position);
+        out << ", \"name\": \"" << function.name << "\", \"calls\": " << function.calls << " }";
+        separator = ",";
+    }
+
+    out << (functions.empty() ? "]" : "\n  ]") << ",\n  \"loops\": [";
+    separator = "";
+
+    for (const auto& [position, loop] : loops) {
+        out << separator << "\n    ";
+        WritePosition(out, position);
+        out << ", \"entries\": " << loop.entries << ", \"iterations\": " << loop.iterations << " }";
+        separator = ",";
+    }
+
+    out << (loops.empty() ? "]" : "\n  ]") << ",\n  \"branches\": [";
+    separator = "";
+
+    for (const auto& [position, branch] : branches) {
+        out << separator << "\n    ";
+        WritePosition(out, position);
+        out << ", \"taken\": " << branch.taken << ", \"not_taken\": " << branch.not_taken << " }";
+        separator = ",";
+    }
+
+    out << (branches.empty() ? "]" : "\n  ]") << "\n}" << std::endl;
+}
+
+BlaiseProfile BlaiseProfile::Load(std::istream& in) {
+    BlaiseProfile profile;
+    JsonReader reader(in);
+
+    reader.Object([&](const std::string& section) {
+        if (section == "functions") {
+            ReadEntries<FunctionProfile>(reader, profile.functions,
+                [](FunctionProfile& function, const std::string& key, JsonReader& reader) {
+                    if (key == "name")          function.name = reader.String();
+                    else if (key == "calls")    function.calls = reader.Number();
+                    else                        reader.Skip();
+                });
+        } else if (section == "loops") {
+            ReadEntries<LoopProfile>(reader, profile.loops,
+                [](LoopProfile& loop, const std::string& key, JsonReader& reader) {
+                    if (key == "entries")           loop.entries = reader.Number();
+                    else if (key == "iterations")   loop.iterations = reader.Number();
+                    else                            reader.Skip();
+                });
+        } else if (section == "branches") {
+            ReadEntries<BranchProfile>(reader, profile.branches,
+                [](BranchProfile& branch, const std::string& key, JsonReader& reader) {
+                    if (key == "taken")             branch.taken = reader.Number();
+                    else if (key == "not_taken")    branch.not_taken = reader.Number();
+                    else                            reader.Skip();
+                });
+        } else {
+            reader.Skip();
+        }
+    });
+
+    reader.End();
+
+    return profile;
+}
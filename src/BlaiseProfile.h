@@ -0,0 +1,43 @@
+#pragma once
+
+#include <istream>
+#include <map>
+#include <ostream>
+#include <string>
+
+#include "BlaiseClasses.h"
+
+struct FunctionProfile {
+    std::string name;
+    size_t calls = 0;
+};
+
+struct LoopProfile {
+    size_t entries = 0;         // times the loop statement was reached
+    size_t iterations = 0;      // times its body ran, over all entries
+};
+
+struct BranchProfile {
+    size_t taken = 0;           // condition was true
+    size_t not_taken = 0;
+};
+
+// Execution counts recorded by InterpreterVisitor and consumed by
+// TacOptimizer. Entries are keyed by the source position of the function
+// definition, loop or if statement, which both the interpreter and the
+// TAC lowering see in the same parse tree.
+//
+// Stored as JSON:
+//   { "functions": [ { "line": 1, "column": 1, "name": "f", "calls": 10 } ],
+//     "loops":     [ { "line": 4, "column": 5, "entries": 1, "iterations": 99 } ],
+//     "branches":  [ { "line": 6, "column": 9, "taken": 90, "not_taken": 9 } ] }
+class BlaiseProfile {
+public:
+    std::map<SourcePosition, FunctionProfile> functions;
+    std::map<SourcePosition, LoopProfile> loops;
+    std::map<SourcePosition, BranchProfile> branches;
+
+    void Save(std::ostream& out) const;
+
+    static BlaiseProfile Load(std::istream& in);
+};
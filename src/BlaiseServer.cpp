@@ -0,0 +1,482 @@
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "BlaiseServer.h"
+
+namespace {
+
+// Larger requests are dropped unread
+constexpr uint32_t MAX_REQUEST_SIZE = 1 << 20;
+
+// Clients send the request right after they connect. A connection that
+// stays silent this long while the request is read is dropped, so that
+// it cannot hold up the others, which the daemon reads one after another.
+constexpr int REQUEST_TIMEOUT_MS = 2000;
+
+// Wakes the poll of the daemon on SIGCHLD, SIGINT and SIGTERM
+int signal_pipe[2] = { -1, -1 };
+volatile sig_atomic_t stopping = 0;
+
+void OnSignal(int signal) {
+    int saved_errno = errno;
+    char byte = 0;
+
+    if (signal != SIGCHLD)
+        stopping = 1;
+
+    if (write(signal_pipe[1], &byte, 1) < 0) {
+        // The pipe is full, the daemon wakes up anyway
+    }
+
+    errno = saved_errno;
+}
+
+bool Address(const std::string& path, sockaddr_un& address) {
+    if (path.size() >= sizeof(address.sun_path))
+        return false;
+
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    return true;
+}
+
+int Connect(const std::string& path) {
+    sockaddr_un address;
+
+    if (!Address(path, address))
+        return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd < 0)
+        return -1;
+
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+bool WriteAll(int fd, const void *data, size_t size) {
+    const char *bytes = static_cast<const char *>(data);
+
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+
+        if (written < 0 && errno == EINTR)
+            continue;
+
+        if (written <= 0)
+            return false;
+
+        bytes += written;
+        size -= written;
+    }
+
+    return true;
+}
+
+bool ReadAll(int fd, void *data, size_t size) {
+    char *bytes = static_cast<char *>(data);
+
+    while (size > 0) {
+        ssize_t got = read(fd, bytes, size);
+
+        if (got < 0 && errno == EINTR)
+            continue;
+
+        if (got <= 0)
+            return false;
+
+        bytes += got;
+        size -= got;
+    }
+
+    return true;
+}
+
+bool SameUser(int fd) {
+#ifdef __APPLE__
+    uid_t uid;
+    gid_t gid;
+
+    return getpeereid(fd, &uid, &gid) == 0 && uid == getuid();
+#else
+    ucred credentials;
+    socklen_t length = sizeof(credentials);
+
+    return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) == 0 && credentials.uid == getuid();
+#endif
+}
+
+// A request is the size of the rest, which goes together with the three
+// file descriptors, then the directory and the arguments, each ended by
+// '\0'
+bool SendRequest(int fd, const std::string& payload) {
+    uint32_t size = payload.size();
+    int fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    iovec iov = { &size, sizeof(size) };
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+    msghdr message = {};
+
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(fds));
+    std::memcpy(CMSG_DATA(header), fds, sizeof(fds));
+
+    ssize_t sent;
+
+    do {
+        sent = sendmsg(fd, &message, 0);
+    } while (sent < 0 && errno == EINTR);
+
+    return sent == sizeof(size) && WriteAll(fd, payload.data(), payload.size());
+}
+
+void CloseFds(ServerRequest& request) {
+    for (int& fd : request.fds) {
+        if (fd > STDERR_FILENO)
+            close(fd);
+
+        fd = -1;
+    }
+}
+
+bool ReceiveRequest(int fd, ServerRequest& request) {
+    uint32_t size = 0;
+    iovec iov = { &size, sizeof(size) };
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(request.fds))] = {};
+    msghdr message = {};
+
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t got;
+
+    do {
+        got = recvmsg(fd, &message, 0);
+    } while (got < 0 && errno == EINTR);
+
+    if (got < 0)
+        return false;
+
+    // Descriptors are taken over first, so that every failure closes them
+    for (cmsghdr *header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header)) {
+        if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS)
+            continue;
+
+        size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const unsigned char *data = CMSG_DATA(header);
+
+        for (size_t i = 0; i < count; i++) {
+            int received;
+            std::memcpy(&received, data + i * sizeof(int), sizeof(int));
+
+            if (count == 3)
+                request.fds[i] = received;
+            else
+                close(received);
+        }
+    }
+
+    if (got != sizeof(size) || (message.msg_flags & MSG_CTRUNC) || request.fds[0] < 0 || size > MAX_REQUEST_SIZE)
+        return false;
+
+    std::string payload(size, '\0');
+
+    if (!ReadAll(fd, payload.data(), size))
+        return false;
+
+    for (size_t begin = 0; begin < payload.size(); ) {
+        size_t end = payload.find('\0', begin);
+
+        if (end == std::string::npos)
+            return false;
+
+        if (begin == 0)
+            request.directory = payload.substr(0, end);
+        else
+            request.args.push_back(payload.substr(begin, end - begin));
+
+        begin = end + 1;
+    }
+
+    return !request.directory.empty();
+}
+
+struct Run {
+    int connection;
+    bool stopped = false;
+};
+
+void SendStatus(int connection, int status) {
+    int32_t code = status;
+
+    WriteAll(connection, &code, sizeof(code));
+    close(connection);
+}
+
+// Sends the exit status of finished runs to their clients
+void Reap(std::unordered_map<pid_t, Run>& runs, bool wait) {
+    int status;
+    pid_t pid;
+
+    while ((pid = waitpid(-1, &status, wait ? 0 : WNOHANG)) > 0) {
+        auto run = runs.find(pid);
+
+        if (run == runs.end())
+            continue;
+
+        // As a shell reports it
+        SendStatus(run->second.connection, WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status));
+        runs.erase(run);
+    }
+}
+
+// Runs job in a child with the streams of the client. Returns its pid, or
+// -1 if it could not be started.
+pid_t Start(const std::function<int()>& job, ServerRequest& request, int listener, int connection,
+            const std::unordered_map<pid_t, Run>& runs) {
+    pid_t pid = fork();
+
+    if (pid != 0)
+        return pid;
+
+    signal(SIGCHLD, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGPIPE, SIG_DFL);
+
+    close(listener);
+    close(connection);
+    close(signal_pipe[0]);
+    close(signal_pipe[1]);
+
+    for (const auto& [other, run] : runs)
+        close(run.connection);
+
+    for (int i = 0; i < 3; i++)
+        dup2(request.fds[i], i);
+
+    CloseFds(request);
+
+    int status = job();
+
+    std::cout.flush();
+    std::cerr.flush();
+    _exit(status & 0xFF);
+}
+
+// Prepares a request with the stdout and stderr of the client, and starts
+// its run if it needs one
+void Handle(int connection, int listener, const BlaiseServer::Prepare& prepare,
+            std::unordered_map<pid_t, Run>& runs) {
+    ServerRequest request;
+    timeval timeout = { REQUEST_TIMEOUT_MS / 1000, REQUEST_TIMEOUT_MS % 1000 * 1000 };
+
+    if (!SameUser(connection) || setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0
+        || !ReceiveRequest(connection, request)) {
+        CloseFds(request);
+        close(connection);
+        return;
+    }
+
+    std::function<int()> job;
+    int status = 1;
+    bool started = false;
+    int saved_out = dup(STDOUT_FILENO);
+    int saved_err = dup(STDERR_FILENO);
+
+    std::cout.flush();
+    std::cerr.flush();
+    dup2(request.fds[1], STDOUT_FILENO);
+    dup2(request.fds[2], STDERR_FILENO);
+
+    try {
+        if (chdir(request.directory.c_str()) == 0)
+            status = prepare(request, job);
+        else
+            std::cerr << "Cannot change to " << request.directory << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        job = nullptr;
+    }
+
+    if (job) {
+        pid_t pid = Start(job, request, listener, connection, runs);
+        started = pid > 0;
+
+        if (started)
+            runs.emplace(pid, Run{ connection });
+        else
+            std::cerr << "Cannot start the run: " << std::strerror(errno) << std::endl;
+    }
+
+    std::cout.flush();
+    std::cerr.flush();
+    dup2(saved_out, STDOUT_FILENO);
+    dup2(saved_err, STDERR_FILENO);
+    close(saved_out);
+    close(saved_err);
+    CloseFds(request);
+
+    if (!started)
+        SendStatus(connection, status);
+}
+
+}
+
+int BlaiseServer::Serve(const std::string& path, const Prepare& prepare) {
+    sockaddr_un address;
+
+    if (!Address(path, address)) {
+        std::cerr << "Socket path is too long: " << path << std::endl;
+        return 1;
+    }
+
+    // A socket file that nobody answers on is left over from a daemon
+    // that did not exit cleanly
+    if (int running = Connect(path); running >= 0) {
+        close(running);
+        std::cerr << "A server is already listening on " << path << std::endl;
+        return 1;
+    }
+
+    unlink(path.c_str());
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    // Only the owner may connect, a run has all of their rights
+    mode_t mask = umask(0077);
+    bool bound = listener >= 0 && bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+    umask(mask);
+
+    if (!bound || listen(listener, SOMAXCONN) != 0 || pipe(signal_pipe) != 0) {
+        std::cerr << "Cannot listen on " << path << ": " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+
+    for (int fd : signal_pipe)
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    // No SA_RESTART, so that poll returns on every signal
+    struct sigaction action = {};
+    action.sa_handler = OnSignal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGCHLD, &action, nullptr);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    // A client that went away must not kill the daemon
+    signal(SIGPIPE, SIG_IGN);
+
+    std::unordered_map<pid_t, Run> runs;
+
+    while (!stopping) {
+        std::vector<pollfd> fds = { { listener, POLLIN, 0 }, { signal_pipe[0], POLLIN, 0 } };
+        std::vector<pid_t> pids;
+
+        for (const auto& [pid, run] : runs) {
+            if (!run.stopped) {
+                fds.push_back({ run.connection, POLLIN, 0 });
+                pids.push_back(pid);
+            }
+        }
+
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR)
+                continue;
+
+            std::cerr << "poll failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+
+        if (fds[1].revents) {
+            char buffer[64];
+
+            while (read(signal_pipe[0], buffer, sizeof(buffer)) > 0) {}
+
+            Reap(runs, false);
+        }
+
+        // Clients only wait for the status, a readable connection means
+        // that the client went away and its run is not wanted anymore
+        for (size_t i = 2; i < fds.size(); i++) {
+            if (fds[i].revents && runs.count(pids[i - 2])) {
+                kill(pids[i - 2], SIGTERM);
+                runs[pids[i - 2]].stopped = true;
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int connection = accept(listener, nullptr, nullptr);
+
+            if (connection >= 0)
+                Handle(connection, listener, prepare, runs);
+        }
+    }
+
+    close(listener);
+    unlink(path.c_str());
+
+    // Runs in progress are finished, their clients wait for them
+    Reap(runs, true);
+
+    return 0;
+}
+
+std::optional<int> BlaiseServer::Call(const std::string& path, const std::vector<std::string>& args) {
+    int fd = Connect(path);
+
+    if (fd < 0)
+        return std::nullopt;
+
+    std::error_code error;
+    std::string payload = std::filesystem::current_path(error).string();
+    payload += '\0';
+
+    for (const std::string& arg : args) {
+        payload += arg;
+        payload += '\0';
+    }
+
+    // The daemon may go away while the status is awaited
+    signal(SIGPIPE, SIG_IGN);
+
+    int32_t status;
+    bool done = SendRequest(fd, payload) && ReadAll(fd, &status, sizeof(status));
+
+    close(fd);
+
+    if (!done) {
+        std::cerr << "Lost the connection to the server on " << path << std::endl;
+        return 1;
+    }
+
+    return status;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+// One run asked for by a client: its arguments and working directory.
+// The client's stdin, stdout and stderr come along as file descriptors.
+struct ServerRequest {
+    std::string directory;
+    std::vector<std::string> args;      // argv without the program name
+    int fds[3] = { -1, -1, -1 };
+};
+
+// Local daemon that runs blaise commands for clients connected to a Unix
+// socket, so that a run does not pay for process start and for warming
+// up the ANTLR caches. Requests are prepared one at a time in the daemon
+// itself, which is where parsing should happen for the caches to stay
+// warm, and then run in a forked child that writes straight to the
+// streams of the client. The client gets the exit status of the child.
+class BlaiseServer {
+public:
+    // Prepares request in the daemon, in the directory of the client and
+    // with stdout and stderr going to it. Either sets job to what the
+    // child has to run, or returns the exit status for the client.
+    using Prepare = std::function<int(const ServerRequest& request, std::function<int()>& job)>;
+
+    // Listens on path until SIGINT or SIGTERM. Only connections of the
+    // same user are served. Returns the exit status of the daemon.
+    static int Serve(const std::string& path, const Prepare& prepare);
+
+    // Runs args on the daemon listening on path, with the streams of this
+    // process. Returns the exit status of the run, or nothing if there is
+    // no daemon to connect to.
+    static std::optional<int> Call(const std::string& path, const std::vector<std::string>& args);
+};
@@ -0,0 +1,298 @@
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "BlaiseSnapshot.h"
+#include "BlaiseSource.h"
+
+namespace {
+
+constexpr char MAGIC[8] = { 'B', 'L', 'S', 'S', 'N', 'A', 'P', '\0' };
+
+constexpr uint32_t VERSION = 1;
+
+enum class ValueType : uint32_t {
+    NOTHING,
+    INT,
+    DOUBLE,
+    BOOLEAN,
+    CHAR,
+    STRING,
+
+    TYPE_COUNT
+};
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t variable_count;
+    uint64_t statements;        // top-level statements that had run
+    uint64_t prefix_size;       // bytes of the source they span
+    uint64_t prefix_hash;
+    uint32_t function_count;
+    uint32_t reserved;
+    uint64_t strings_size;
+    uint64_t payload_hash;
+};
+
+// Strings are given by offset and size in the pool
+struct VariableRecord {
+    uint32_t name;
+    uint32_t name_size;
+    ValueType type;
+    uint32_t size;              // STRING only
+    uint64_t value;             // the bits of the value, the offset of a STRING
+};
+
+struct FunctionRecord {
+    uint32_t name;
+    uint32_t name_size;
+    uint64_t statement;         // index of the defining top-level statement
+};
+
+// Byte offset of position in source. Lines are counted at '\n' and
+// columns in code points, both from 1, the way the lexer counts them.
+size_t Offset(std::string_view source, SourcePosition position) {
+    size_t pos = 0;
+
+    for (size_t line = 1; line < position.line; line++) {
+        pos = source.find('\n', pos);
+
+        if (pos == std::string_view::npos)
+            return source.size();
+
+        pos++;
+    }
+
+    for (size_t column = 1; column < position.column && pos < source.size(); column++) {
+        pos++;
+
+        while (pos < source.size() && (source[pos] & 0xC0) == 0x80)
+            pos++;
+    }
+
+    return pos;
+}
+
+// Bytes of source before the first statement that had not run
+size_t PrefixSize(std::string_view source, const BlaiseAst& ast, size_t statements) {
+    const AstNode& root = ast.Node(ast.Root());
+
+    if (statements >= root.child_count)
+        return source.size();
+
+    return Offset(source, ast.Position(ast.Node(ast.Child(root, statements))));
+}
+
+template<typename T>
+uint64_t Bits(T value) {
+    uint64_t bits = 0;
+    std::memcpy(&bits, &value, sizeof(value));
+    return bits;
+}
+
+template<typename T>
+T FromBits(uint64_t bits) {
+    T value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+bool InPool(uint64_t offset, uint64_t size, uint64_t pool_size) {
+    return offset <= pool_size && size <= pool_size - offset;
+}
+
+}
+
+size_t BlaiseSnapshot::StatementsUpTo(const BlaiseAst& ast, size_t line) {
+    const AstNode& root = ast.Node(ast.Root());
+    size_t statements = 0;
+
+    while (statements < root.child_count && ast.Node(ast.Child(root, statements)).line <= line)
+        statements++;
+
+    return statements;
+}
+
+void BlaiseSnapshot::Save(const std::string& path, std::string_view source, const BlaiseAst& ast, size_t statements,
+                          const InterpreterVisitor& interpreter) {
+    const AstNode& root = ast.Node(ast.Root());
+    std::vector<VariableRecord> variables;
+    std::vector<FunctionRecord> functions;
+    std::string strings;
+
+    auto add_string = [&](const std::string& str, uint32_t& offset, uint32_t& size) {
+        offset = strings.size();
+        size = str.size();
+        strings += str;
+    };
+
+    for (const BlaiseVariable& var : interpreter.gl_block->variables) {
+        VariableRecord& record = variables.emplace_back();
+        const std::any& value = var.Value();
+
+        record = {};
+        add_string(var.Name(), record.name, record.name_size);
+
+        if (!value.has_value()) {
+            record.type = ValueType::NOTHING;
+        } else if (var.Is<int>()) {
+            record.type = ValueType::INT;
+            record.value = Bits(var.Value<int>());
+        } else if (var.Is<double>()) {
+            record.type = ValueType::DOUBLE;
+            record.value = Bits(var.Value<double>());
+        } else if (var.Is<bool>()) {
+            record.type = ValueType::BOOLEAN;
+            record.value = var.Value<bool>();
+        } else if (var.Is<char>()) {
+            record.type = ValueType::CHAR;
+            record.value = Bits(var.Value<char>());
+        } else if (var.Is<std::string>()) {
+            uint32_t offset;
+
+            record.type = ValueType::STRING;
+            add_string(var.Value<std::string>(), offset, record.size);
+            record.value = offset;
+        } else {
+            throw BlaiseSnapshotError("Variable " + var.Name() + " cannot be stored in a snapshot");
+        }
+    }
+
+    for (const BlaiseFunction& func : interpreter.gl_block->functions) {
+        FunctionRecord& record = functions.emplace_back();
+
+        record = {};
+        add_string(func.Name(), record.name, record.name_size);
+        record.statement = statements;
+
+        for (size_t i = 0; i < statements && func.Ast() == &ast; i++) {
+            if (ast.Child(root, i) == func.Definition())
+                record.statement = i;
+        }
+
+        if (record.statement == statements)
+            throw BlaiseSnapshotError("Function " + func.Name() + " is not defined by a top-level statement");
+    }
+
+    std::string payload;
+    payload.append(reinterpret_cast<const char *>(variables.data()), variables.size() * sizeof(VariableRecord));
+    payload.append(reinterpret_cast<const char *>(functions.data()), functions.size() * sizeof(FunctionRecord));
+    payload += strings;
+
+    size_t prefix_size = PrefixSize(source, ast, statements);
+    Header header = {};
+
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.variable_count = variables.size();
+    header.statements = statements;
+    header.prefix_size = prefix_size;
+    header.prefix_hash = HashBytes(source.substr(0, prefix_size));
+    header.function_count = functions.size();
+    header.strings_size = strings.size();
+    header.payload_hash = HashBytes(payload);
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(payload.data(), payload.size());
+    out.close();
+
+    if (!out.good())
+        throw BlaiseSnapshotError("Cannot write " + path);
+}
+
+size_t BlaiseSnapshot::Restore(const std::string& path, std::string_view source, const BlaiseAst& ast,
+                               InterpreterVisitor& interpreter) {
+    MappedFile file(path);
+
+    if (!file.IsOpen())
+        throw BlaiseSnapshotError("Cannot open " + path);
+
+    std::string_view data = file.Data();
+    Header header;
+
+    if (data.size() < sizeof(header))
+        throw BlaiseSnapshotError(path + " is not a snapshot");
+
+    std::memcpy(&header, data.data(), sizeof(header));
+    data.remove_prefix(sizeof(header));
+
+    uint64_t records_size = uint64_t(header.variable_count) * sizeof(VariableRecord)
+                            + uint64_t(header.function_count) * sizeof(FunctionRecord);
+
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION
+        || records_size > data.size() || header.strings_size != data.size() - records_size
+        || header.payload_hash != HashBytes(data))
+        throw BlaiseSnapshotError(path + " is not a snapshot or is corrupt");
+
+    const AstNode& root = ast.Node(ast.Root());
+
+    if (header.statements > root.child_count || header.prefix_size > source.size()
+        || PrefixSize(source, ast, header.statements) != header.prefix_size
+        || HashBytes(source.substr(0, header.prefix_size)) != header.prefix_hash)
+        throw BlaiseSnapshotError(path + " was taken of another program");
+
+    std::vector<VariableRecord> variables(header.variable_count);
+    std::vector<FunctionRecord> functions(header.function_count);
+    const char *records = data.data();
+
+    std::memcpy(variables.data(), records, variables.size() * sizeof(VariableRecord));
+    std::memcpy(functions.data(), records + variables.size() * sizeof(VariableRecord),
+                functions.size() * sizeof(FunctionRecord));
+
+    std::string_view strings = data.substr(records_size);
+
+    // Everything is checked before the interpreter is touched
+    for (const VariableRecord& record : variables) {
+        if (!InPool(record.name, record.name_size, strings.size()) || record.type >= ValueType::TYPE_COUNT
+            || (record.type == ValueType::STRING && !InPool(record.value, record.size, strings.size())))
+            throw BlaiseSnapshotError(path + " is corrupt");
+    }
+
+    for (const FunctionRecord& record : functions) {
+        if (!InPool(record.name, record.name_size, strings.size()) || record.statement >= header.statements)
+            throw BlaiseSnapshotError(path + " is corrupt");
+
+        const AstNode& definition = ast.Node(ast.Child(root, record.statement));
+
+        if (definition.kind != AST_NODE_KIND::FUNCTION_DEFINITION
+            || ast.Text(definition) != strings.substr(record.name, record.name_size))
+            throw BlaiseSnapshotError(path + " was taken of another program");
+    }
+
+    for (const VariableRecord& record : variables) {
+        std::any value;
+
+        switch (record.type) {
+            case ValueType::NOTHING: break;
+            case ValueType::INT:     value = FromBits<int>(record.value); break;
+            case ValueType::DOUBLE:  value = FromBits<double>(record.value); break;
+            case ValueType::BOOLEAN: value = record.value != 0; break;
+            case ValueType::CHAR:    value = FromBits<char>(record.value); break;
+            case ValueType::STRING:  value = std::string(strings.substr(record.value, record.size)); break;
+            default: break;
+        }
+
+        interpreter.AddGlobal(std::string(strings.substr(record.name, record.name_size)), value);
+    }
+
+    std::vector<bool> rerun(header.statements, false);
+
+    for (const FunctionRecord& record : functions)
+        rerun[record.statement] = true;
+
+    // Imported functions are not stored, imports that had run bind them
+    // again from the modules as they are now
+    for (size_t i = 0; i < header.statements; i++)
+        if (ast.Node(ast.Child(root, i)).kind == AST_NODE_KIND::IMPORT_STMT)
+            rerun[i] = true;
+
+    // Running a definition or an import again only defines functions
+    for (size_t i = 0; i < header.statements; i++)
+        if (rerun[i])
+            interpreter.RunStatements(ast, i, i + 1);
+
+    return header.statements;
+}
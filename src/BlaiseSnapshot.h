@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "BlaiseAst.h"
+#include "InterpreterVisitor.h"
+
+// A snapshot that cannot be written, read or used for the program
+class BlaiseSnapshotError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Global variables and functions of an interpreter that has run the first
+// top-level statements of a program, so that a later run can start right
+// after them. Variables are stored by value, functions by the statement
+// that defined or imported them, and the snapshot only fits a source that
+// starts with the same bytes as the one it was taken of, up to the first
+// statement that had not run. The file is a header, fixed size records
+// and a string pool, read from a mapping and checked before anything is
+// restored.
+class BlaiseSnapshot {
+public:
+    // Number of top-level statements of ast that start on line or before
+    static size_t StatementsUpTo(const BlaiseAst& ast, size_t line);
+
+    // Writes the globals of interpreter, which has run the first
+    // statements top-level statements of ast, parsed from source
+    static void Save(const std::string& path, std::string_view source, const BlaiseAst& ast, size_t statements,
+                     const InterpreterVisitor& interpreter);
+
+    // Restores what Save wrote for a source that starts the same way into
+    // interpreter, which has not run anything yet. Returns the number of
+    // top-level statements to skip. interpreter is left untouched if the
+    // snapshot does not fit.
+    static size_t Restore(const std::string& path, std::string_view source, const BlaiseAst& ast,
+                          InterpreterVisitor& interpreter);
+};
@@ -0,0 +1,539 @@
+#include <algorithm>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "BlaiseSource.h"
+#include "antlr/BlaiseLexer.h"
+
+namespace {
+
+bool IsContinuation(char byte) {
+    return (byte & 0xC0) == 0x80;
+}
+
+// Token type of a grammar literal, taken from the vocabulary of the
+// generated lexer so that implicit T__N types stay in sync
+size_t LiteralType(const std::string& literal) {
+    antlr4::ANTLRInputStream empty;
+    BlaiseLexer lexer(&empty);
+    const antlr4::dfa::Vocabulary& vocabulary = lexer.getVocabulary();
+
+    for (size_t type = antlr4::Token::MIN_USER_TOKEN_TYPE; type <= vocabulary.getMaxTokenType(); type++)
+        if (vocabulary.getLiteralName(type) == "'" + literal + "'")
+            return type;
+
+    return antlr4::Token::INVALID_TYPE;
+}
+
+struct HeaderTypes {
+    size_t open = LiteralType("(");
+    size_t close = LiteralType(")");
+    size_t comma = LiteralType(",");
+    size_t begin = LiteralType("begin");
+    size_t end = LiteralType("end");
+};
+
+const HeaderTypes& Types() {
+    static const HeaderTypes types;
+    return types;
+}
+
+}
+
+uint64_t HashBytes(std::string_view data, uint64_t hash) {
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+MappedFile::MappedFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+
+    if (fd < 0)
+        return;
+
+    struct stat info;
+
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+        size_ = info.st_size;
+        open_ = true;
+
+        // mmap refuses empty mappings, an empty file is just empty data
+        if (size_ > 0) {
+            void *data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (data == MAP_FAILED) {
+                size_ = 0;
+                open_ = false;
+            } else {
+                madvise(data, size_, MADV_SEQUENTIAL);
+                data_ = static_cast<const char *>(data);
+            }
+        }
+    }
+
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (data_ != nullptr)
+        munmap(const_cast<char *>(data_), size_);
+}
+
+bool MappedFile::IsOpen() const {
+    return open_;
+}
+
+std::string_view MappedFile::Data() const {
+    return std::string_view(data_ == nullptr ? "" : data_, size_);
+}
+
+void SlidingTokenStream::DropConsumed() {
+    _tokens.erase(_tokens.begin(), _tokens.begin() + _p);
+    _p = 0;
+
+    for (size_t i = 0; i < _tokens.size(); i++)
+        if (auto *token = dynamic_cast<antlr4::WritableToken *>(_tokens[i].get()))
+            token->setTokenIndex(i);
+}
+
+void MappedFile::Release(size_t begin, size_t end) {
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+
+    begin = begin / page_size * page_size;
+    end = std::min(end, size_) / page_size * page_size;
+
+    if (data_ != nullptr && begin < end)
+        madvise(const_cast<char *>(data_) + begin, end - begin, MADV_DONTNEED);
+}
+
+LazyBodyTokenSource::LazyBodyTokenSource(antlr4::TokenSource& source, std::string_view data)
+    : source_(source), data_(data) {}
+
+const LazyBodies& LazyBodyTokenSource::Bodies() const {
+    return bodies_;
+}
+
+size_t LazyBodyTokenSource::Offset(size_t index) {
+    for (; index_ < index && offset_ < data_.size(); index_++) {
+        offset_++;
+
+        while (offset_ < data_.size() && IsContinuation(data_[offset_]))
+            offset_++;
+    }
+
+    return offset_;
+}
+
+// function name ( [param {, param}] ), from state 1 after function to 5
+// after the closing parenthesis
+void LazyBodyTokenSource::Match(size_t type) {
+    const HeaderTypes& types = Types();
+
+    switch (header_) {
+        case 1:  header_ = type == BlaiseLexer::IDENTIFIER ? 2 : 0;                             break;
+        case 2:  header_ = type == types.open ? 3 : 0;                                          break;
+        case 3:  header_ = type == BlaiseLexer::IDENTIFIER ? 4 : type == types.close ? 5 : 0;   break;
+        case 4:  header_ = type == types.comma ? 6 : type == types.close ? 5 : 0;               break;
+        case 6:  header_ = type == BlaiseLexer::IDENTIFIER ? 4 : 0;                             break;
+        default: header_ = 0;                                                                   break;
+    }
+
+    if (header_ == 0 && type == BlaiseLexer::FUNCTION)
+        header_ = 1;
+}
+
+std::unique_ptr<antlr4::Token> LazyBodyTokenSource::SkipBody(std::unique_ptr<antlr4::Token> begin) {
+    const HeaderTypes& types = Types();
+    std::vector<std::unique_ptr<antlr4::Token>> body;
+
+    for (size_t depth = 1; depth > 0; ) {
+        std::unique_ptr<antlr4::Token> token = source_.nextToken();
+        size_t type = token->getType();
+
+        depth += type == types.begin;
+        depth -= type == types.end;
+        body.push_back(std::move(token));
+
+        if (type == antlr4::Token::EOF) {
+            for (auto& skipped : body)
+                pending_.push_back(std::move(skipped));
+
+            return begin;
+        }
+    }
+
+    SourceRange range{ Offset(begin->getStartIndex()), Offset(body.back()->getStopIndex() + 1) };
+
+    bodies_.emplace(begin->getStartIndex(), range);
+    pending_.push_back(std::move(body.back()));
+
+    return begin;
+}
+
+std::unique_ptr<antlr4::Token> LazyBodyTokenSource::nextToken() {
+    if (!pending_.empty()) {
+        std::unique_ptr<antlr4::Token> token = std::move(pending_.front());
+        pending_.pop_front();
+        return token;
+    }
+
+    std::unique_ptr<antlr4::Token> token = source_.nextToken();
+
+    if (header_ == 5 && token->getType() == Types().begin) {
+        header_ = 0;
+        return SkipBody(std::move(token));
+    }
+
+    Match(token->getType());
+
+    return token;
+}
+
+size_t LazyBodyTokenSource::getLine() const {
+    return source_.getLine();
+}
+
+size_t LazyBodyTokenSource::getCharPositionInLine() {
+    return source_.getCharPositionInLine();
+}
+
+antlr4::CharStream *LazyBodyTokenSource::getInputStream() {
+    return source_.getInputStream();
+}
+
+std::string LazyBodyTokenSource::getSourceName() {
+    return source_.getSourceName();
+}
+
+antlr4::TokenFactory<antlr4::CommonToken> *LazyBodyTokenSource::getTokenFactory() {
+    return source_.getTokenFactory();
+}
+
+// A code point starts at every byte that is not a UTF-8 continuation
+// byte, and at the start of the input. Malformed sequences decode to
+// their lead byte, ANTLRInputStream would reject them.
+MappedCharStream::MappedCharStream(std::string_view data, std::string name)
+    : data_(data), name_(std::move(name)) {
+    for (char byte : data_) {
+        ascii_ &= static_cast<unsigned char>(byte) < 0x80;
+        size_ += !IsContinuation(byte);
+    }
+
+    if (!data_.empty() && IsContinuation(data_[0]))
+        size_++;
+}
+
+size_t MappedCharStream::Next(size_t pos) const {
+    pos++;
+
+    while (pos < data_.size() && IsContinuation(data_[pos]))
+        pos++;
+
+    return pos;
+}
+
+size_t MappedCharStream::Previous(size_t pos) const {
+    pos--;
+
+    while (pos > 0 && IsContinuation(data_[pos]))
+        pos--;
+
+    return pos;
+}
+
+size_t MappedCharStream::Decode(size_t pos) const {
+    unsigned char lead = data_[pos];
+    size_t end = Next(pos);
+    size_t length = end - pos;
+    size_t expected = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 1;
+
+    if (length != expected)
+        return lead;
+
+    size_t code_point = length == 1 ? lead : lead & (0x7F >> length);
+
+    for (pos++; pos < end; pos++)
+        code_point = (code_point << 6) | (data_[pos] & 0x3F);
+
+    return code_point;
+}
+
+size_t MappedCharStream::Offset(size_t index) const {
+    if (ascii_)
+        return index;
+
+    size_t from = index_;
+    size_t pos = pos_;
+
+    if ((text_index_ > index ? text_index_ - index : index - text_index_)
+        < (index_ > index ? index_ - index : index - index_)) {
+        from = text_index_;
+        pos = text_pos_;
+    }
+
+    for (size_t i = from; i < index; i++)
+        pos = Next(pos);
+
+    for (size_t i = from; i > index; i--)
+        pos = Previous(pos);
+
+    return pos;
+}
+
+void MappedCharStream::consume() {
+    if (index_ >= size_)
+        throw antlr4::IllegalStateException("cannot consume EOF");
+
+    pos_ = ascii_ ? pos_ + 1 : Next(pos_);
+    index_++;
+}
+
+size_t MappedCharStream::LA(ssize_t i) {
+    if (i == 0)
+        return 0;
+
+    // LA(1) is the current character, LA(-1) the previous one
+    ssize_t target = static_cast<ssize_t>(index_) + (i > 0 ? i - 1 : i);
+
+    if (target < 0 || target >= static_cast<ssize_t>(size_))
+        return EOF;
+
+    if (ascii_)
+        return static_cast<unsigned char>(data_[target]);
+
+    return Decode(Offset(target));
+}
+
+ssize_t MappedCharStream::mark() {
+    return -1;
+}
+
+void MappedCharStream::release(ssize_t marker) {}
+
+size_t MappedCharStream::index() {
+    return index_;
+}
+
+void MappedCharStream::seek(size_t index) {
+    index = std::min(index, size_);
+    pos_ = Offset(index);
+    index_ = index;
+}
+
+size_t MappedCharStream::size() {
+    return size_;
+}
+
+std::string MappedCharStream::getSourceName() const {
+    return name_.empty() ? "<unknown>" : name_;
+}
+
+std::string MappedCharStream::getText(const antlr4::misc::Interval& interval) {
+    if (interval.a < 0 || interval.b < interval.a || static_cast<size_t>(interval.a) >= size_)
+        return "";
+
+    size_t stop = std::min(static_cast<size_t>(interval.b), size_ - 1);
+    size_t start = Offset(interval.a);
+    size_t end = stop + 1;
+
+    // stop is found walking from start, the next text walks from stop
+    if (!ascii_) {
+        text_index_ = interval.a;
+        text_pos_ = start;
+        text_pos_ = Offset(stop);
+        text_index_ = stop;
+        end = Next(text_pos_);
+    }
+
+    return std::string(data_.substr(start, end - start));
+}
+
+std::string MappedCharStream::toString() const {
+    return std::string(data_);
+}
+
+namespace {
+
+// What SplitTopLevel needs to know of a token
+enum class ScanToken {
+    OTHER,
+    VALUE,          // literal
+    IDENTIFIER,
+    FUNCTION,
+    LOOP,
+    IF,
+    BEGIN,
+    END,
+    STATEMENT,      // writeln, return, import
+    OPEN,
+    CLOSE,
+    HEADER_CLOSE,   // closes the parameters of a function or a loop condition
+};
+
+ScanToken Keyword(std::string_view word) {
+    static const std::unordered_map<std::string_view, ScanToken> keywords = {
+        { "function", ScanToken::FUNCTION }, { "loop", ScanToken::LOOP },       { "if", ScanToken::IF },
+        { "begin", ScanToken::BEGIN },       { "end", ScanToken::END },         { "writeln", ScanToken::STATEMENT },
+        { "return", ScanToken::STATEMENT },  { "true", ScanToken::VALUE },      { "false", ScanToken::VALUE },
+        { "then", ScanToken::OTHER },        { "else", ScanToken::OTHER },      { "returns", ScanToken::OTHER },
+        { "import", ScanToken::STATEMENT },
+    };
+
+    auto iter = keywords.find(word);
+
+    return iter == keywords.end() ? ScanToken::IDENTIFIER : iter->second;
+}
+
+bool EndsStatement(ScanToken token) {
+    return token == ScanToken::VALUE || token == ScanToken::IDENTIFIER || token == ScanToken::END
+           || token == ScanToken::CLOSE;
+}
+
+// Signs and parentheses are left out, they would continue an expression
+bool StartsStatement(ScanToken token) {
+    return token == ScanToken::VALUE || token == ScanToken::IDENTIFIER || token == ScanToken::FUNCTION
+           || token == ScanToken::LOOP || token == ScanToken::IF || token == ScanToken::BEGIN
+           || token == ScanToken::STATEMENT;
+}
+
+bool IsWordStart(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+bool IsDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+}
+
+std::vector<SourceChunk> SplitTopLevel(std::string_view source, size_t parts) {
+    std::vector<SourceChunk> chunks(1);
+    const size_t size = source.size();
+    size_t line = 1;
+    size_t line_start = 0;
+    size_t depth = 0;
+    std::vector<bool> parens;   // open parentheses, true for headers
+    ScanToken last = ScanToken::OTHER;
+    ScanToken before_last = ScanToken::OTHER;
+
+    // Moves the line count over the bytes of a multi-line token
+    auto lines = [&](size_t begin, size_t end) {
+        for (const char *c = source.data() + begin;
+             (c = static_cast<const char *>(std::memchr(c, '\n', source.data() + end - c))) != nullptr; c++) {
+            line++;
+            line_start = c - source.data() + 1;
+        }
+    };
+
+    for (size_t pos = 0; pos < size && chunks.size() < parts; ) {
+        char c = source[pos];
+        char next = pos + 1 < size ? source[pos + 1] : '\0';
+        size_t start = pos;
+        ScanToken token = ScanToken::OTHER;
+
+        if (c == '\n') {
+            line++;
+            line_start = ++pos;
+            continue;
+        } else if (c == ' ' || c == '\t' || c == '\r' || c == ';') {
+            pos++;
+            continue;
+        } else if (c == '/' && next == '/') {
+            pos = std::min(source.find('\n', pos), size);
+            continue;
+        } else if (c == '/' && next == '*') {
+            size_t close = source.find("*/", pos + 2);
+
+            if (close == std::string_view::npos)
+                break;
+
+            lines(pos, close);
+            pos = close + 2;
+            continue;
+        } else if (c == '"') {
+            size_t close = source.find('"', pos + 1);
+
+            if (close == std::string_view::npos)
+                break;
+
+            lines(pos, close);
+            pos = close + 1;
+            token = ScanToken::VALUE;
+        } else if (c == '\'') {
+            // One code point between the quotes, or a stray quote
+            size_t close = pos + 2;
+
+            while (close < size && IsContinuation(source[close]))
+                close++;
+
+            if (close >= size || source[close] != '\'')
+                break;
+
+            lines(pos, close);
+            pos = close + 1;
+            token = ScanToken::VALUE;
+        } else if (IsWordStart(c)) {
+            while (pos < size && (IsWordStart(source[pos]) || IsDigit(source[pos])))
+                pos++;
+
+            token = Keyword(source.substr(start, pos - start));
+        } else if (IsDigit(c)) {
+            while (pos < size && (IsDigit(source[pos]) || source[pos] == '.' || source[pos] == 'e'
+                                  || ((source[pos] == '+' || source[pos] == '-') && source[pos - 1] == 'e')))
+                pos++;
+
+            token = ScanToken::VALUE;
+        } else if (c == '(') {
+            pos++;
+            token = ScanToken::OPEN;
+        } else if (c == ')') {
+            if (parens.empty())
+                break;
+
+            pos++;
+            token = parens.back() ? ScanToken::HEADER_CLOSE : ScanToken::CLOSE;
+        } else {
+            pos++;
+        }
+
+        if (start >= chunks.size() * size / parts && depth == 0 && parens.empty() && EndsStatement(last)
+            && StartsStatement(token)) {
+            size_t column = 0;
+
+            for (size_t i = line_start; i < start; i++)
+                column += !IsContinuation(source[i]);
+
+            chunks.back().range.end = start;
+            chunks.push_back({ { start, size }, line, column });
+        }
+
+        if (token == ScanToken::OPEN) {
+            parens.push_back((last == ScanToken::IDENTIFIER && before_last == ScanToken::FUNCTION)
+                             || (last == ScanToken::IF && before_last == ScanToken::LOOP));
+        } else if (token == ScanToken::HEADER_CLOSE || token == ScanToken::CLOSE) {
+            parens.pop_back();
+        } else if (token == ScanToken::BEGIN) {
+            depth++;
+        } else if (token == ScanToken::END) {
+            if (depth == 0)
+                break;
+
+            depth--;
+        }
+
+        before_last = last;
+        last = token;
+    }
+
+    chunks.back().range.end = size;
+
+    return chunks;
+}
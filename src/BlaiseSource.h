@@ -0,0 +1,175 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "antlr4-runtime.h"
+
+// FNV-1a, 64 bit
+uint64_t HashBytes(std::string_view data, uint64_t hash = 0xcbf29ce484222325ull);
+
+// Bytes of the source between two offsets
+struct SourceRange {
+    size_t begin = 0;
+    size_t end = 0;
+};
+
+// Function bodies left out of the parse, by the start index of their
+// begin token
+using LazyBodies = std::unordered_map<size_t, SourceRange>;
+
+// Read-only memory mapping of a whole source file. Pages are loaded by
+// the kernel on first access and can be dropped again under memory
+// pressure, nothing is copied onto the heap.
+class MappedFile {
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+    bool open_ = false;
+
+public:
+    explicit MappedFile(const std::string& path);
+
+    MappedFile(const MappedFile&) = delete;
+
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile();
+
+    bool IsOpen() const;
+
+    std::string_view Data() const;
+
+    // Gives the pages between the byte offsets begin and end back to the
+    // kernel, so that a file read front to back does not stay resident as
+    // a whole. They are read from the file again if touched later.
+    void Release(size_t begin, size_t end);
+};
+
+// CommonTokenStream that forgets the tokens of statements already parsed,
+// so that a program parsed one statement at a time does not keep all of
+// its tokens. Index 0 is always the first token not yet dropped.
+class SlidingTokenStream : public antlr4::CommonTokenStream {
+public:
+    using antlr4::CommonTokenStream::CommonTokenStream;
+
+    // Drops the tokens before the current one. Parse trees built so far
+    // point to them and must not be used any more.
+    void DropConsumed();
+};
+
+// Pre-parser for lazy function bodies. Passes the tokens of source on,
+// except for everything between begin and its matching end when a
+// function body is a block: the parser sees an empty block, and the byte
+// range of the body is kept so that it can be parsed on first call. A
+// body without its end is passed on whole, for the parser to report.
+class LazyBodyTokenSource : public antlr4::TokenSource {
+    antlr4::TokenSource& source_;
+    std::string_view data_;
+    LazyBodies bodies_;
+    std::deque<std::unique_ptr<antlr4::Token>> pending_;
+    size_t header_ = 0;     // tokens of "function name(params)" seen so far
+
+    size_t index_ = 0;      // in code points
+    size_t offset_ = 0;     // byte offset of index_
+
+    // Byte offset of code point index, which only ever moves forward
+    size_t Offset(size_t index);
+
+    // Moves the state of the function header along with token type
+    void Match(size_t type);
+
+    std::unique_ptr<antlr4::Token> SkipBody(std::unique_ptr<antlr4::Token> begin);
+
+public:
+    // data is the source the lexer reads
+    LazyBodyTokenSource(antlr4::TokenSource& source, std::string_view data);
+
+    const LazyBodies& Bodies() const;
+
+    virtual std::unique_ptr<antlr4::Token> nextToken() override;
+
+    virtual size_t getLine() const override;
+
+    virtual size_t getCharPositionInLine() override;
+
+    virtual antlr4::CharStream *getInputStream() override;
+
+    virtual std::string getSourceName() override;
+
+    virtual antlr4::TokenFactory<antlr4::CommonToken> *getTokenFactory() override;
+};
+
+// CharStream over UTF-8 bytes that decodes code points on demand instead
+// of converting the whole input to UTF-32 up front like ANTLRInputStream.
+// Pure ASCII input, the usual case, is indexed directly by byte; other
+// input moves a byte cursor along with the code point index, which is
+// cheap because the lexer only ever looks a few characters around it.
+class MappedCharStream : public antlr4::CharStream {
+    std::string_view data_;
+    std::string name_;
+    size_t size_ = 0;       // in code points
+    bool ascii_ = true;
+
+    size_t index_ = 0;      // in code points
+    size_t pos_ = 0;        // byte offset of index_
+
+    // Where the last getText ended. Token texts are read long after the
+    // lexer has moved on, mostly in order, so they walk from here.
+    size_t text_index_ = 0;
+    size_t text_pos_ = 0;
+
+    size_t Next(size_t pos) const;
+
+    size_t Previous(size_t pos) const;
+
+    size_t Decode(size_t pos) const;
+
+    // Byte offset of code point index, walking from the cursor or the end
+    // of the last text, whichever is closer
+    size_t Offset(size_t index) const;
+
+public:
+    MappedCharStream(std::string_view data, std::string name);
+
+    virtual void consume() override;
+
+    virtual size_t LA(ssize_t i) override;
+
+    virtual ssize_t mark() override;
+
+    virtual void release(ssize_t marker) override;
+
+    virtual size_t index() override;
+
+    virtual void seek(size_t index) override;
+
+    virtual size_t size() override;
+
+    virtual std::string getSourceName() const override;
+
+    virtual std::string getText(const antlr4::misc::Interval& interval) override;
+
+    virtual std::string toString() const override;
+};
+
+// Part of a source that holds whole top-level statements, with the
+// position of its first character as the lexer counts it
+struct SourceChunk {
+    SourceRange range;
+    size_t line = 1;
+    size_t column = 0;      // in code points
+};
+
+// Splits source into at most parts chunks of about the same size that can
+// be parsed on their own. A cut is only made before a token that starts a
+// statement, outside of begin/end and parentheses, right after a token
+// that can end one and not after the header of a function, if or loop,
+// so that the grammar cannot read the statement on either side as going
+// on. Strings and comments are skipped. Anything the scan does not
+// understand, like an unterminated string, ends the splitting there and
+// leaves the rest in the last chunk.
+std::vector<SourceChunk> SplitTopLevel(std::string_view source, size_t parts);
@@ -4,18 +4,162 @@
 #include <stdexcept>
 #include <string>
 #include <typeinfo>
+#include <unordered_map>
 #include <utility>
 
 #include "InterpreterVisitor.h"
+#include "BlaiseArray.h"
+#include "BlaiseMap.h"
 #include "BlaiseClasses.h"
-#include "antlr/BlaiseParser.h"
 #include "Util.h"
 
-InterpreterVisitor::InterpreterVisitor() {
+InterpreterVisitor::InterpreterVisitor(std::ostream& out) : out_(out) {
     stack_frames.emplace_back();
     gl_block = &stack_frames.back();
 }
 
+void InterpreterVisitor::SetProfile(BlaiseProfile *profile) {
+    profile_ = profile;
+}
+
+void InterpreterVisitor::SetReplaceDefinitions(bool replace) {
+    replace_definitions_ = replace;
+}
+
+void InterpreterVisitor::SetBodyParser(BodyParser parser) {
+    body_parser_ = std::move(parser);
+}
+
+void InterpreterVisitor::SetModuleLoader(ModuleLoader loader) {
+    module_loader_ = std::move(loader);
+}
+
+void InterpreterVisitor::SetLimits(uint64_t max_steps, std::chrono::milliseconds timeout) {
+    max_steps_ = max_steps;
+    timeout_ = timeout;
+    deadline_ = Clock::now() + timeout;
+    steps_ = 0;
+    fuel_ = fuel_given_ = 0;
+
+    Refuel();
+}
+
+void InterpreterVisitor::Refuel() {
+    steps_ += fuel_given_ - fuel_;
+
+    if (max_steps_ != 0 && steps_ > max_steps_)
+        throw BlaiseLimitError("Step limit of " + std::to_string(max_steps_) + " exceeded");
+
+    if (timeout_.count() != 0 && Clock::now() >= deadline_)
+        throw BlaiseLimitError("Time limit of " + std::to_string(timeout_.count()) + " ms exceeded");
+
+    uint64_t fuel = timeout_.count() != 0 ? CLOCK_INTERVAL : UINT64_MAX;
+
+    if (max_steps_ != 0)
+        fuel = std::min(fuel, max_steps_ + 1 - steps_);
+
+    fuel_ = fuel_given_ = fuel;
+}
+
+void InterpreterVisitor::CountMemory(size_t max_bytes) {
+    count_memory_ = true;
+    max_memory_ = max_bytes;
+    memory_ = MemoryUsage();
+    trees_.clear();
+
+    // What the frames hold already
+    for (const BlaiseBlock& frame : stack_frames) {
+        Hold(&MemoryUsage::frames, FRAME_BYTES);
+
+        for (const BlaiseVariable& var : frame.variables)
+            Hold(&MemoryUsage::values, var.Footprint());
+
+        for (const BlaiseFunction& func : frame.functions)
+            Hold(&MemoryUsage::values, func.Footprint());
+    }
+
+    for (const auto& [_, func] : module_functions_)
+        Hold(&MemoryUsage::values, func.Footprint());
+
+    peak_memory_ = memory_;
+}
+
+MemoryUsage InterpreterVisitor::PeakMemory() const {
+    return peak_memory_;
+}
+
+void InterpreterVisitor::Hold(size_t MemoryUsage::*counter, size_t bytes) {
+    memory_.*counter += bytes;
+
+    if (memory_.Total() <= peak_memory_.Total())
+        return;
+
+    peak_memory_ = memory_;
+
+    if (max_memory_ != 0 && memory_.Total() > max_memory_)
+        throw BlaiseLimitError("Memory limit of " + std::to_string(max_memory_ >> 20) + " MB exceeded");
+}
+
+void InterpreterVisitor::HoldTree(const BlaiseAst& ast) {
+    if (!count_memory_)
+        return;
+
+    auto [tree, added] = trees_.try_emplace(&ast, 0);
+
+    if (added) {
+        tree->second = ast.Footprint();
+        Hold(&MemoryUsage::trees, tree->second);
+    }
+}
+
+void InterpreterVisitor::ReleaseTree(const BlaiseAst& ast) {
+    auto tree = trees_.find(&ast);
+
+    if (tree != trees_.end()) {
+        Drop(&MemoryUsage::trees, tree->second);
+        trees_.erase(tree);
+    }
+}
+
+BlaiseBlock& InterpreterVisitor::PushFrame() {
+    BlaiseBlock& frame = stack_frames.emplace_back();
+
+    if (count_memory_)
+        Hold(&MemoryUsage::frames, FRAME_BYTES);
+
+    return frame;
+}
+
+void InterpreterVisitor::PopFrame() {
+    if (count_memory_) {
+        const BlaiseBlock& frame = stack_frames.back();
+
+        Drop(&MemoryUsage::frames, FRAME_BYTES);
+
+        for (const BlaiseVariable& var : frame.variables)
+            Drop(&MemoryUsage::values, var.Footprint());
+
+        for (const BlaiseFunction& func : frame.functions)
+            Drop(&MemoryUsage::values, func.Footprint());
+    }
+
+    stack_frames.pop_back();
+}
+
+void InterpreterVisitor::UnwindFrames() {
+    while (stack_frames.size() > 1)
+        PopFrame();
+}
+
+BlaiseVariable& InterpreterVisitor::AddGlobal(const std::string& name, const std::any& value) {
+    BlaiseVariable& var = gl_block->variables.emplace_back(name, value);
+
+    if (count_memory_)
+        Hold(&MemoryUsage::values, var.Footprint());
+
+    return var;
+}
+
 std::string InterpreterVisitor::StringToUpper(std::string str) {
     std::transform(str.begin(), str.end(), str.begin(), toupper);
     return str;
@@ -55,37 +199,250 @@ InterpreterVisitor::FindFunctionAndBlock(const std::string& str) {
         }
     }
 
-    throw std::invalid_argument("Function " + str + " has not been defined!");
+    auto module_func = module_functions_.find(str);
+
+    if (module_func != module_functions_.end())
+        return std::make_pair(&module_func->second, gl_block);
+
+    return std::make_pair(nullptr, nullptr);
+}
+
+double InterpreterVisitor::ElementValue(const BlaiseVariable& var) {
+    if (var.Is<double>())
+        return var.Value<double>();
+
+    if (var.Is<int>())
+        return var.Value<int>();
+
+    throw std::invalid_argument("Array elements must be numbers");
+}
+
+BlaiseVariable& InterpreterVisitor::FindIndexed(const std::string& id) {
+    auto [varptr, _] = FindVarAndBlock(id);
+
+    if (varptr == nullptr)
+        throw std::invalid_argument("Variable " + id + " has not been defined!");
+
+    if (!varptr->Is<BlaiseArray>() && !varptr->Is<BlaiseMap>())
+        throw std::invalid_argument("Variable " + id + " is not an array or a map");
+
+    return *varptr;
+}
+
+BlaiseVariable InterpreterVisitor::CallBuiltin(const AstNode& call) {
+    static const std::unordered_map<std::string, size_t> ARG_COUNTS = {
+        { "len", 1 }, { "sum", 1 }, { "min", 1 }, { "max", 1 }, { "array", 2 },
+        { "map", 0 }, { "contains", 2 }, { "delete", 2 },
+    };
+
+    const std::string& id = ast_->Text(call);
+    auto arg_count = ARG_COUNTS.find(id);
+
+    if (arg_count == ARG_COUNTS.end())
+        throw std::invalid_argument("Function " + id + " has not been defined!");
+
+    if (call.child_count != arg_count->second)
+        throw std::invalid_argument("Wrong amount of aguments for function " + id);
+
+    if (id == "map")
+        return BlaiseVariable(BlaiseMap());
+
+    if (id == "delete")
+        return DeleteKey(call);
+
+    BlaiseVariable arg = std::any_cast<BlaiseVariable>(visit(ast_->Child(call, 0)));
+
+    if (id == "array") {
+        BlaiseVariable value = std::any_cast<BlaiseVariable>(visit(ast_->Child(call, 1)));
+
+        if (!arg.Is<int>() || arg.Value<int>() < 0)
+            throw std::invalid_argument("Length of an array must be a non-negative int");
+
+        // The elements only count once the array is assigned, too late
+        // to keep array(2000000000, 0) from taking the memory first
+        size_t bytes = static_cast<size_t>(arg.Value<int>()) * sizeof(double);
+
+        if (max_memory_ != 0 && memory_.Total() + bytes > max_memory_)
+            throw BlaiseLimitError("Memory limit of " + std::to_string(max_memory_ >> 20) + " MB exceeded");
+
+        return BlaiseVariable(BlaiseArray(arg.Value<int>(), ElementValue(value)));
+    }
+
+    if (id == "contains") {
+        BlaiseVariable key = std::any_cast<BlaiseVariable>(visit(ast_->Child(call, 1)));
+
+        if (!arg.Is<BlaiseMap>())
+            throw std::invalid_argument("Function contains takes a map");
+
+        return BlaiseVariable(std::any_cast<const BlaiseMap&>(arg.Value()).Find(key) != nullptr);
+    }
+
+    if (id == "len" && arg.Is<BlaiseMap>())
+        return BlaiseVariable(static_cast<int>(std::any_cast<const BlaiseMap&>(arg.Value()).Size()));
+
+    if (!arg.Is<BlaiseArray>())
+        throw std::invalid_argument("Function " + id + " takes an array");
+
+    const BlaiseArray& array = std::any_cast<const BlaiseArray&>(arg.Value());
+
+    if (id == "len")
+        return BlaiseVariable(static_cast<int>(array.Size()));
+
+    if (id == "sum")
+        return BlaiseVariable(array.Sum());
+
+    return BlaiseVariable(id == "min" ? array.Min() : array.Max());
+}
+
+BlaiseVariable InterpreterVisitor::DeleteKey(const AstNode& call) {
+    const AstNode& map = ast_->Node(ast_->Child(call, 0));
+
+    if (map.kind != AST_NODE_KIND::OPERAND_ID)
+        throw std::invalid_argument("Function delete takes a map variable");
+
+    BlaiseVariable key = std::any_cast<BlaiseVariable>(visit(ast_->Child(call, 1)));
+    BlaiseVariable& var = FindIndexed(ast_->Text(map));
+
+    if (!var.Is<BlaiseMap>())
+        throw std::invalid_argument("Function delete takes a map variable");
+
+    if (!count_memory_)
+        return BlaiseVariable(var.ValueRef<BlaiseMap>().Erase(key));
+
+    Drop(&MemoryUsage::values, var.Footprint());
+    bool erased = var.ValueRef<BlaiseMap>().Erase(key);
+    Hold(&MemoryUsage::values, var.Footprint());
+
+    return BlaiseVariable(erased);
 }
 
 void InterpreterVisitor::DebugPrintStack() const {
-    DEBUG_OUT(0) << "==== Variables ====" << std::endl;
+    DEBUG_OUT(out_, 0) << "==== Variables ====" << std::endl;
     for (auto riter = stack_frames.rbegin(); riter != stack_frames.rend(); riter++) {
         for (auto id_riter = riter->variables.rbegin(); id_riter != riter->variables.rend(); id_riter++) {
-                DEBUG_OUT(0) << id_riter->Name() << ", type: " << id_riter->Type().name() << ", value = " << id_riter->ToString() << std::endl;
+                DEBUG_OUT(out_, 0) << id_riter->Name() << ", type: " << id_riter->Type().name() << ", value = " << id_riter->ToString() << std::endl;
         }
     }
 
-    DEBUG_OUT(0) << "==== Functions ====" << std::endl;
+    DEBUG_OUT(out_, 0) << "==== Functions ====" << std::endl;
     for (auto riter = stack_frames.rbegin(); riter != stack_frames.rend(); riter++) {
         for (auto id_riter = riter->functions.rbegin(); id_riter != riter->functions.rend(); id_riter++) {
-                DEBUG_OUT(0) << id_riter->Name() << std::endl;
+                DEBUG_OUT(out_, 0) << id_riter->Name() << std::endl;
         }
     }
 }
 
-BlaiseFunction& InterpreterVisitor::AddFunction(const std::string& name,
-                                                BlaiseParser::Param_listContext *paramlist) {
+ArgsList InterpreterVisitor::Parameters(const BlaiseAst& ast, const AstNode& definition) {
     ArgsList args;
 
-    if (paramlist)
-        args = std::move(std::any_cast<ArgsList>(visit(paramlist)));
+    // Parameters are checked from the last one, the way the grammar
+    // nests them
+    for (size_t i = definition.child_count - 1; i-- > 0; ) {
+        const std::string& id = ast.Text(ast.Node(ast.Child(definition, i)));
+        auto iter = std::find(args.begin(), args.end(), id);
 
-    BlaiseFunction& func = stack_frames.back().functions.emplace_back(name, args);
+        if (iter != args.end()) {
+            throw std::invalid_argument("Identifier " + id + " already is in the list.");
+        }
+
+        args.emplace_front(id);
+    }
+
+    return args;
+}
+
+BlaiseFunction& InterpreterVisitor::AddFunction(const AstNode& definition) {
+    BlaiseFunction& func = stack_frames.back().functions.emplace_back(ast_->Text(definition),
+                                                                      Parameters(*ast_, definition));
+
+    if (count_memory_)
+        Hold(&MemoryUsage::values, func.Footprint());
 
     return func;
 }
 
+// An import cycle ends at the module that is being bound already
+void InterpreterVisitor::BindModule(const BlaiseAst& module) {
+    std::vector<const BlaiseAst *> modules;
+    std::vector<std::string> functions;
+
+    try {
+        BindModule(module, modules, functions);
+    } catch (...) {
+        // Otherwise importing the module again, after fixing it, would
+        // find it bound and skip it
+        for (const std::string& id : functions) {
+            auto func = module_functions_.find(id);
+
+            if (count_memory_)
+                Drop(&MemoryUsage::values, func->second.Footprint());
+
+            module_functions_.erase(func);
+        }
+
+        for (const BlaiseAst *bound : modules) {
+            ReleaseTree(*bound);
+            modules_.erase(bound);
+        }
+
+        throw;
+    }
+}
+
+void InterpreterVisitor::BindModule(const BlaiseAst& module, std::vector<const BlaiseAst *>& modules,
+                                    std::vector<std::string>& functions) {
+    // Marked before its imports are, so that an import cycle ends here
+    if (!modules_.insert(&module).second)
+        return;
+
+    modules.push_back(&module);
+    HoldTree(module);
+
+    const AstNode& root = module.Node(module.Root());
+
+    for (size_t i = 0; i < root.child_count; i++) {
+        const AstNode& stmt = module.Node(module.Child(root, i));
+        const std::string& id = module.Text(stmt);
+
+        if (stmt.kind == AST_NODE_KIND::IMPORT_STMT) {
+            BindModule(module_loader_(module, id), modules, functions);
+            continue;
+        }
+
+        if (stmt.kind != AST_NODE_KIND::FUNCTION_DEFINITION)
+            throw std::invalid_argument("A module can only define functions and import modules");
+
+        auto global = std::find(gl_block->functions.begin(), gl_block->functions.end(), id);
+
+        if (global != gl_block->functions.end() || module_functions_.count(id))
+            throw std::invalid_argument("Function redefinition is not allowed. Function " + id + " is already defined.");
+
+        const BlaiseFunction& func = module_functions_.try_emplace(id, id, Parameters(module, stmt), &module,
+                                                                   module.Id(stmt)).first->second;
+        functions.push_back(id);
+
+        if (count_memory_)
+            Hold(&MemoryUsage::values, func.Footprint());
+    }
+}
+
+std::any InterpreterVisitor::VisitInNewFrame(AstNodeId stmt) {
+    PushFrame();
+
+    // We have to be ready to the fact that the stmt can
+    // be a return statement.
+    try {
+        std::any value = visit(stmt);
+        PopFrame();
+        return value;
+    } catch (const BlaiseVariable& ret) {
+        // cleanup the stack
+        PopFrame();
+        // propagate upwards
+        throw;
+    }
+}
+
 const std::type_info& InterpreterVisitor::StringToTypeId(const std::string& str) {
     if (str == "double") {
         return typeid(double);
@@ -104,26 +461,41 @@ const std::type_info& InterpreterVisitor::StringToTypeId(const std::string& str)
     throw std::invalid_argument("Invalid type identifier: " + str);
 }
 
-std::any InterpreterVisitor::visitProgram(BlaiseParser::ProgramContext *context) {
+std::any InterpreterVisitor::VisitStatements(const AstNode& program, size_t begin, size_t end) {
     std::any value;
     try {
-        value = visitChildren(context);
+        for (size_t i = begin; i < end; i++)
+            value = visit(ast_->Child(program, i));
     } catch (const BlaiseVariable& ret) {
         throw std::invalid_argument("Return statement is not allowed outside of functions");
     }
 
+    return value;
+}
+
+void InterpreterVisitor::RunStatements(const BlaiseAst& ast, size_t begin, size_t end) {
+    ast_ = &ast;
+    HoldTree(ast);
+    VisitStatements(ast.Node(ast.Root()), begin, end);
+}
+
+std::any InterpreterVisitor::visitProgram(const AstNode& node) {
+    HoldTree(*ast_);
+
+    std::any value = VisitStatements(node, 0, node.child_count);
+
     // Stack contents
     if (DEBUG >= 1) {
         for (const auto& var : gl_block->variables) {
-            std::cout << var.Type().name() << " " << var.Name() << " = "
+            out_ << var.Type().name() << " " << var.Name() << " = "
                       << var.ToString()
                       << std::endl;
         }
 
         for (const auto& func : gl_block->functions) {
-            std::cout << func.Name() << std::endl;
+            out_ << func.Name() << std::endl;
             for (const auto& arg : func.Args()) {
-                std::cout << arg.Name() << ": " << arg.Type().name() << std::endl;
+                out_ << arg.Name() << ": " << arg.Type().name() << std::endl;
             }
         }
     }
@@ -131,22 +503,45 @@ std::any InterpreterVisitor::visitProgram(BlaiseParser::ProgramContext *context)
     return value;
 }
 
-std::any InterpreterVisitor::visitStmt(BlaiseParser::StmtContext *context) {
-    // DebugPrintStack();
-    return visitChildren(context);
+std::any InterpreterVisitor::visitImportStmt(const AstNode& node) {
+    const std::string& path = ast_->Text(node);
+
+    // Imported functions are global, an import in a block or a function
+    // would look like it is scoped to it
+    if (stack_frames.size() != 1)
+        throw std::invalid_argument("Module " + path + " can only be imported at the top level");
+
+    if (!module_loader_)
+        throw std::invalid_argument("Module " + path + " cannot be imported here");
+
+    BindModule(module_loader_(*ast_, path));
+
+    return 0;
 }
 
-std::any InterpreterVisitor::visitFunctionDefinition(BlaiseParser::FunctionDefinitionContext *context) {
-    const std::string& id = context->IDENTIFIER()->toString();
+std::any InterpreterVisitor::visitFunctionDefinition(const AstNode& node) {
+    const std::string& id = ast_->Text(node);
+
+    if (stack_frames.size() == 1 && module_functions_.count(id))
+        throw std::invalid_argument("Function redefinition is not allowed. Function " + id + " is already defined.");
 
     auto iter = std::find(stack_frames.back().functions.begin(), stack_frames.back().functions.end(), id);
 
+    // Only at the top level, where no call can hold on to the old one
+    if (iter != stack_frames.back().functions.end() && replace_definitions_ && stack_frames.size() == 1) {
+        if (count_memory_)
+            Drop(&MemoryUsage::values, iter->Footprint());
+
+        stack_frames.back().functions.erase(iter);
+        iter = stack_frames.back().functions.end();
+    }
+
     if (iter == stack_frames.back().functions.end()) {
-        AddFunction(id, context->param_list());
+        AddFunction(node);
     }
 
     if (!stack_frames.back().functions.back().IsDefined()) {
-        stack_frames.back().functions.back().SetBlock(context->stmt());
+        stack_frames.back().functions.back().SetDefinition(ast_, ast_->Id(node));
     } else {
         throw std::invalid_argument("Function redefinition is not allowed. Function " + id + " is already defined.");
     }
@@ -154,139 +549,162 @@ std::any InterpreterVisitor::visitFunctionDefinition(BlaiseParser::FunctionDefin
     return 0;
 }
 
-std::any InterpreterVisitor::visitFunctionCall(BlaiseParser::FunctionCallContext *context) {
-    const std::string& id = context->IDENTIFIER()->toString();
+std::any InterpreterVisitor::visitFunctionCall(const AstNode& node) {
+    Safepoint();
+
+    const std::string& id = ast_->Text(node);
     ArgsList args;
     auto [funcptr, _] = FindFunctionAndBlock(id);
 
-    if (context->arg_list())
-        args = std::move(std::any_cast<ArgsList>(visit(context->arg_list())));
+    if (funcptr == nullptr)
+        return CallBuiltin(node);
+
+    for (size_t i = 0; i < node.child_count; i++)
+        args.push_back(std::any_cast<BlaiseVariable>(visit(ast_->Child(node, i))));
 
 
     if (args.size() != funcptr->Args().size()) {
         throw std::invalid_argument("Wrong amount of aguments for function " + funcptr->Name());
     }
 
+    // The body is run in the AST of its definition
+    const BlaiseAst *caller_ast = ast_;
+    ast_ = funcptr->Ast();
+
+    const AstNode& definition = ast_->Node(funcptr->Definition());
+
+    if (profile_) {
+        FunctionProfile& function = profile_->functions[ast_->Position(definition)];
+
+        function.name = id;
+        function.calls++;
+    }
+
+    AstNodeId body = ast_->Child(definition, definition.child_count - 1);
+
+    if (ast_->Node(body).kind == AST_NODE_KIND::LAZY_BODY) {
+        if (!body_parser_)
+            throw std::invalid_argument("Body of function " + id + " has not been parsed!");
+
+        ast_ = &body_parser_(*ast_, ast_->Node(body));
+        body = ast_->Child(ast_->Node(ast_->Root()), 0);
+        HoldTree(*ast_);
+    }
+
     auto aiter = args.begin();
     auto fiter = funcptr->Args().begin();
 
-    stack_frames.emplace_back();
+    PushFrame();
 
     for ( ;fiter != funcptr->Args().end(); fiter++, aiter++) {
         auto& var = stack_frames.back().variables.emplace_back(fiter->Name());
         var.Assign(*aiter);
+
+        if (count_memory_)
+            Hold(&MemoryUsage::values, var.Footprint());
     }
 
     try {
-        visit(funcptr->Block());
+        visit(body);
 
     } catch (const BlaiseVariable& var) {
 
-        stack_frames.pop_back();
+        PopFrame();
+        ast_ = caller_ast;
         return BlaiseVariable(var); // explicit copying to make my LSP shut up
     }
 
-    stack_frames.pop_back();
+    PopFrame();
+    ast_ = caller_ast;
     return BlaiseVariable();
 }
 
-std::any InterpreterVisitor::visitParamListComma(BlaiseParser::ParamListCommaContext *context) {
-    const std::string& id = context->IDENTIFIER()->toString();
-    auto args = std::any_cast<ArgsList>(visit(context->param_list()));
-    auto iter = std::find(args.begin(), args.end(), id);
-
-    if ( iter != args.end()) {
-        throw std::invalid_argument("Identifier " + id + " already is in the list.");
-    }
+std::any InterpreterVisitor::visitCodeBlock(const AstNode& node) {
+    PushFrame();
+    try {
+        std::any value;
 
-    args.emplace_front(id);
+        for (size_t i = 0; i < node.child_count; i++)
+            value = visit(ast_->Child(node, i));
 
-    return args;
+        PopFrame();
+        return value;
+    } catch (const BlaiseVariable& ret) {
+        PopFrame();
+        throw;
+    }
 }
 
-std::any InterpreterVisitor::visitParamListEnd(BlaiseParser::ParamListEndContext *context) {
-    const std::string& id = context->IDENTIFIER()->toString();
-
-    ArgsList args;
-    args.emplace_front(id);
+std::any InterpreterVisitor::visitAssignStmt(const AstNode& node) {
+    const std::string& id = ast_->Text(node);
+    auto [varptr, block] = FindVarAndBlock(id);
+    BlaiseVariable value = std::any_cast<BlaiseVariable>(visit(ast_->Child(node, 0)));
 
-    return args;
-}
+    // If there is no such variable
+    if (varptr == nullptr) {
+        const BlaiseVariable& var = stack_frames.back().variables.emplace_back(id, value.Value());
 
-std::any InterpreterVisitor::visitArgListComma(BlaiseParser::ArgListCommaContext *context) {
-    BlaiseVariable var;
+        if (count_memory_)
+            Hold(&MemoryUsage::values, var.Footprint());
 
-    if (context->IDENTIFIER()) {
-        auto [varptr, _] = FindVarAndBlock(context->IDENTIFIER()->toString());
-        var = *varptr;
-    } else if (context->expr()) {
-        var = std::move(std::any_cast<BlaiseVariable>(visit(context->expr())));
+        return var;
     }
 
-    ArgsList args = std::any_cast<ArgsList>(visit(context->arg_list()));
+    if (!count_memory_) {
+        varptr->Assign(value);
+        return *varptr;
+    }
 
-    args.push_front(var);
+    Drop(&MemoryUsage::values, varptr->Footprint());
+    varptr->Assign(value);
+    Hold(&MemoryUsage::values, varptr->Footprint());
 
-    return args;
+    return *varptr;
 }
 
-std::any InterpreterVisitor::visitArgListEnd(BlaiseParser::ArgListEndContext *context) {
-    BlaiseVariable var;
-
-    if (context->IDENTIFIER()) {
-        auto [varptr, _] = FindVarAndBlock(context->IDENTIFIER()->toString());
-        var = *varptr;
-    } else if (context->expr()) {
-        var = std::move(std::any_cast<BlaiseVariable>(visit(context->expr())));
-    }
-    ArgsList args;
-
-    args.push_front(var);
+std::any InterpreterVisitor::visitIndexAssignStmt(const AstNode& node) {
+    BlaiseVariable index = std::any_cast<BlaiseVariable>(visit(ast_->Child(node, 0)));
+    BlaiseVariable value = std::any_cast<BlaiseVariable>(visit(ast_->Child(node, 1)));
+    BlaiseVariable& var = FindIndexed(ast_->Text(node));
 
-    return args;
-}
+    if (var.Is<BlaiseMap>()) {
+        if (!count_memory_) {
+            var.ValueRef<BlaiseMap>().Put(index, value.Value());
+        } else {
+            Drop(&MemoryUsage::values, var.Footprint());
+            var.ValueRef<BlaiseMap>().Put(index, value.Value());
+            Hold(&MemoryUsage::values, var.Footprint());
+        }
 
-std::any InterpreterVisitor::visitCodeBlock(BlaiseParser::CodeBlockContext *context) {
-    stack_frames.emplace_back();
-    try {
-        std::any value = visitChildren(context);
-        stack_frames.pop_back();
+        // Not the map: a statement value that is kept around would make
+        // the next assignment copy it
         return value;
-    } catch (const BlaiseVariable& ret) {
-        stack_frames.pop_back();
-        throw;
     }
-}
 
-std::any InterpreterVisitor::visitAssignStmt(BlaiseParser::AssignStmtContext *context) {
-    const std::string& id = context->IDENTIFIER()->toString();
-    auto [varptr, block] = FindVarAndBlock(id);
-    BlaiseVariable value = std::any_cast<BlaiseVariable>(visit(context->expr()));
+    double element = ElementValue(value);
 
-    // If there is no such variable
-    if (varptr == nullptr) {
-        const BlaiseVariable& var = stack_frames.back().variables.emplace_back(id, value.Value());
-        return var;
-    }
+    if (!index.Is<int>())
+        throw std::invalid_argument("Array index must be an int");
 
-    varptr->Assign(value);
-    return *varptr;
+    var.ValueRef<BlaiseArray>().Set(index.Value<int>(), element);
+
+    return BlaiseVariable(element);
 }
 
-std::any InterpreterVisitor::visitWritelnStmt(BlaiseParser::WritelnStmtContext *context) {
-    BlaiseVariable var = std::any_cast<BlaiseVariable>(visit(context->expr()));
+std::any InterpreterVisitor::visitWritelnStmt(const AstNode& node) {
+    BlaiseVariable var = std::any_cast<BlaiseVariable>(visit(ast_->Child(node, 0)));
 
-    std::cout << (DEBUG ? "writeln: " : "") << var.ToString() << std::endl;
+    out_ << (DEBUG ? "writeln: " : "") << var.ToString() << std::endl;
 
     return var;
 }
 
-std::any InterpreterVisitor::visitReturnStmt(BlaiseParser::ReturnStmtContext *context) {
-    throw std::any_cast<BlaiseVariable>(visit(context->expr()));
+std::any InterpreterVisitor::visitReturnStmt(const AstNode& node) {
+    throw std::any_cast<BlaiseVariable>(visit(ast_->Child(node, 0)));
 }
 
-std::any InterpreterVisitor::visitIfStmtBlock(BlaiseParser::IfStmtBlockContext *context) {
-    BlaiseVariable var = std::any_cast<BlaiseVariable>(visit(context->expr()));
+std::any InterpreterVisitor::visitIfStmt(const AstNode& node) {
+    BlaiseVariable var = std::any_cast<BlaiseVariable>(visit(ast_->Child(node, 0)));
     bool condition;
 
     if (var.Is<bool>())
@@ -294,130 +712,116 @@ std::any InterpreterVisitor::visitIfStmtBlock(BlaiseParser::IfStmtBlockContext *
     else
         throw std::invalid_argument("If statement expression must be boolean!");
 
-    if (condition) {
-        stack_frames.emplace_back();
-
-        // We have to be ready to the fact that the stmt can
-        // be a return statement.
-        try {
-            std::any value = visit(context->stmt());
-            stack_frames.pop_back();
-            return value;
-        } catch (const BlaiseVariable& ret) {
-            // cleanup the stack
-            stack_frames.pop_back();
-            // propagate upwards
-            throw;
-        }
-
+    if (profile_) {
+        BranchProfile& branch = profile_->branches[ast_->Position(node)];
+        (condition ? branch.taken : branch.not_taken)++;
     }
 
-    if (context->else_stmt())
-        return visit(context->else_stmt());
+    if (condition)
+        return VisitInNewFrame(ast_->Child(node, 1));
 
-    return false;
-}
+    if (node.child_count > 2)
+        return VisitInNewFrame(ast_->Child(node, 2));
 
-std::any InterpreterVisitor::visitElseStmtBlock(BlaiseParser::ElseStmtBlockContext *context) {
-    stack_frames.emplace_back();
-
-    // Again, be ready for return statement
-    try {
-        std::any value = visitChildren(context);
-        stack_frames.pop_back();
-        return value;
-    } catch (const BlaiseVariable& var) {
-        stack_frames.pop_back();
-        throw;
-    }
+    return false;
 }
 
-std::any InterpreterVisitor::visitLoopStmt(BlaiseParser::LoopStmtContext *context) {
+std::any InterpreterVisitor::visitLoopStmt(const AstNode& node) {
     bool condition = false;
+    LoopProfile *loop = profile_ ? &profile_->loops[ast_->Position(node)] : nullptr;
 
+    if (loop)
+        loop->entries++;
 
     while (true) {
-        stack_frames.emplace_back();
-        BlaiseVariable var = std::move(std::any_cast<BlaiseVariable>(visit(context->expr())));
+        PushFrame();
+        BlaiseVariable var = std::move(std::any_cast<BlaiseVariable>(visit(ast_->Child(node, 0))));
 
         if (var.Is<bool>())
             condition = var.Value<bool>();
         else
             throw std::invalid_argument("Loop if statement expression must be boolean!");
 
-        if (!condition) break;
+        if (!condition) {
+            PopFrame();
+            break;
+        }
+
+        if (loop)
+            loop->iterations++;
 
         // Be ready for return statement
         try {
-            if (context->stmt())
-                visit(context->stmt());
+            if (node.child_count > 1)
+                visit(ast_->Child(node, 1));
 
         } catch (const BlaiseVariable& ret) {
 
-            stack_frames.pop_back();
+            PopFrame();
             throw;
         }
 
-        stack_frames.pop_back();
+        PopFrame();
+        Safepoint();
     }
 
 
     return condition;
 }
 
-std::any InterpreterVisitor::visitExprOperation(BlaiseParser::ExprOperationContext *context) {
-    BlaiseVariable operand = std::move(std::any_cast<BlaiseVariable>(visit(context->operand())));
-    BLAISE_OP_ID operator_ = std::move(std::any_cast<BLAISE_OP_ID>(visit(context->operator_())));
-    BlaiseVariable expr    = std::move(std::any_cast<BlaiseVariable>(visit(context->expr())));
+std::any InterpreterVisitor::visitExprOperation(const AstNode& node) {
+    BlaiseVariable operand = std::move(std::any_cast<BlaiseVariable>(visit(ast_->Child(node, 0))));
+    BLAISE_OP_ID operator_ = node.operation;
+    BlaiseVariable expr    = std::move(std::any_cast<BlaiseVariable>(visit(ast_->Child(node, 1))));
 
     switch (operator_) {
         case BLAISE_OP_ID::PLUS:
-            DEBUG_OUT(BLAISE_DEBUG_INTERNAL_INFO) << "PLUS" << std::endl;
+            DEBUG_OUT(out_, BLAISE_DEBUG_INTERNAL_INFO) << "PLUS" << std::endl;
 
             return operand + expr;
             break;
         case BLAISE_OP_ID::MINUS:
-            DEBUG_OUT(BLAISE_DEBUG_INTERNAL_INFO) << "MINUS" << std::endl;
+            DEBUG_OUT(out_, BLAISE_DEBUG_INTERNAL_INFO) << "MINUS" << std::endl;
 
             return operand - expr;
             break;
         case BLAISE_OP_ID::MUL:
-            DEBUG_OUT(BLAISE_DEBUG_INTERNAL_INFO) << "MUL" << std::endl;
+            DEBUG_OUT(out_, BLAISE_DEBUG_INTERNAL_INFO) << "MUL" << std::endl;
 
             return operand * expr;
             break;
         case BLAISE_OP_ID::DIV:
-            DEBUG_OUT(BLAISE_DEBUG_INTERNAL_INFO) << "DIV" << std::endl;
+            DEBUG_OUT(out_, BLAISE_DEBUG_INTERNAL_INFO) << "DIV" << std::endl;
 
             return operand / expr;
             break;
         case BLAISE_OP_ID::EQUAL:
-            DEBUG_OUT(BLAISE_DEBUG_INTERNAL_INFO) << "EQUAL" << std::endl;
+            DEBUG_OUT(out_, BLAISE_DEBUG_INTERNAL_INFO) << "EQUAL" << std::endl;
 
             return operand == expr;
             break;
         case BLAISE_OP_ID::NEQUAL:
-            DEBUG_OUT(BLAISE_DEBUG_INTERNAL_INFO) << "NEQUAL" << std::endl;
+            DEBUG_OUT(out_, BLAISE_DEBUG_INTERNAL_INFO) << "NEQUAL" << std::endl;
 
-            return operand == expr;
+            return operand != expr;
             break;
         case BLAISE_OP_ID::LESS:
-            DEBUG_OUT(BLAISE_DEBUG_INTERNAL_INFO) << "LESS" << std::endl;
+            DEBUG_OUT(out_, BLAISE_DEBUG_INTERNAL_INFO) << "LESS" << std::endl;
 
             return operand < expr;
             break;
         case BLAISE_OP_ID::LEQUAL:
-            DEBUG_OUT(BLAISE_DEBUG_INTERNAL_INFO) << "LEQUAL" << std::endl;
+            DEBUG_OUT(out_, BLAISE_DEBUG_INTERNAL_INFO) << "LEQUAL" << std::endl;
 
             return operand <= expr;
             break;
         case BLAISE_OP_ID::GREATER:
-            DEBUG_OUT(BLAISE_DEBUG_INTERNAL_INFO) << "GREATER" << std::endl;
+            DEBUG_OUT(out_, BLAISE_DEBUG_INTERNAL_INFO) << "GREATER" << std::endl;
 
             return operand > expr;
             break;
         case BLAISE_OP_ID::GEQUAL:
-            DEBUG_OUT(BLAISE_DEBUG_INTERNAL_INFO) << "GEQUAL" << std::endl;
+            DEBUG_OUT(out_, BLAISE_DEBUG_INTERNAL_INFO) << "GEQUAL" << std::endl;
 
             return operand >= expr;
             break;
@@ -426,104 +830,89 @@ std::any InterpreterVisitor::visitExprOperation(BlaiseParser::ExprOperationConte
     throw std::invalid_argument("Unknown operator encountered");
 }
 
-std::any InterpreterVisitor::visitExprUnaryMinusOperation(BlaiseParser::ExprUnaryMinusOperationContext *context) {
-    BlaiseVariable operand = std::any_cast<BlaiseVariable>(visit(context->operand()));
+std::any InterpreterVisitor::visitExprUnaryMinusOperation(const AstNode& node) {
+    BlaiseVariable operand = std::any_cast<BlaiseVariable>(visit(ast_->Child(node, 0)));
 
     return -operand;
 }
 
-std::any InterpreterVisitor::visitExprUnaryPlusOperation(BlaiseParser::ExprUnaryPlusOperationContext *context) {
-    BlaiseVariable operand = std::any_cast<BlaiseVariable>(visit(context->operand()));
+std::any InterpreterVisitor::visitExprUnaryPlusOperation(const AstNode& node) {
+    BlaiseVariable operand = std::any_cast<BlaiseVariable>(visit(ast_->Child(node, 0)));
 
     return +operand;
 }
 
-std::any InterpreterVisitor::visitExprOperand(BlaiseParser::ExprOperandContext *context) {
-    return visitChildren(context);
-}
-
-std::any InterpreterVisitor::visitOperandId(BlaiseParser::OperandIdContext *context) {
-    const std::string& str = context->IDENTIFIER()->toString();
+std::any InterpreterVisitor::visitOperandId(const AstNode& node) {
+    const std::string& str = ast_->Text(node);
 
     const auto [varptr, blockptr] = FindVarAndBlock(str);
 
+    if (varptr == nullptr)
+        throw std::invalid_argument("Variable " + str + " has not been defined!");
+
     return (*varptr);
 }
 
-std::any InterpreterVisitor::visitOperandInt(BlaiseParser::OperandIntContext *context) {
-    int value = std::stoi(context->INT()->toString());
-    return BlaiseVariable(value);
-}
+std::any InterpreterVisitor::visitOperandArray(const AstNode& node) {
+    std::vector<double> elements;
 
-std::any InterpreterVisitor::visitOperandDouble(BlaiseParser::OperandDoubleContext *context) {
-    double value = std::stod(context->DOUBLE()->toString());
-    return BlaiseVariable(value);
-}
+    elements.reserve(node.child_count);
 
-std::any InterpreterVisitor::visitOperandChar(BlaiseParser::OperandCharContext *context) {
-    std::string str = context->CHAR()->toString();
-    char value = str.at(1);
-    return BlaiseVariable(value);
-}
+    for (size_t i = 0; i < node.child_count; i++)
+        elements.push_back(ElementValue(std::any_cast<BlaiseVariable>(visit(ast_->Child(node, i)))));
 
-std::any InterpreterVisitor::visitOperandString(BlaiseParser::OperandStringContext *context) {
-    std::string full_str = context->STRING()->toString();
-    return BlaiseVariable(std::string(), std::string(full_str.begin() + 1, full_str.end() - 1));
+    return BlaiseVariable(BlaiseArray(elements));
 }
 
-std::any InterpreterVisitor::visitOperandFunctionCall(BlaiseParser::OperandFunctionCallContext *context) {
-    BlaiseVariable var = std::any_cast<BlaiseVariable>(visit(context->function_call()));
-    return var;
-}
+std::any InterpreterVisitor::visitOperandIndex(const AstNode& node) {
+    const std::string& id = ast_->Text(node);
+    BlaiseVariable index = std::any_cast<BlaiseVariable>(visit(ast_->Child(node, 0)));
+    const BlaiseVariable& var = FindIndexed(id);
 
-std::any InterpreterVisitor::visitOperandExpr(BlaiseParser::OperandExprContext *context) {
-    return visit(context->expr());
-}
+    if (var.Is<BlaiseMap>()) {
+        const std::any *value = std::any_cast<const BlaiseMap&>(var.Value()).Find(index);
 
-std::any InterpreterVisitor::visitOperandBoolean(BlaiseParser::OperandBooleanContext *context) {
-    std::string str = context->BOOLEAN()->toString();
-    if (str == "true") return BlaiseVariable(true);
-    else if (str == "false") return BlaiseVariable(false);
+        if (value == nullptr)
+            throw std::invalid_argument("Map " + id + " has no key " + index.ToString());
 
-    throw std::invalid_argument(str + " is not a valid boolean value.");
-}
+        return BlaiseVariable(*value);
+    }
 
-std::any InterpreterVisitor::visitOperatorPlus(BlaiseParser::OperatorPlusContext *context) {
-    return BLAISE_OP_ID::PLUS;
-}
+    if (!index.Is<int>())
+        throw std::invalid_argument("Array index must be an int");
 
-std::any InterpreterVisitor::visitOperatorMinus(BlaiseParser::OperatorMinusContext *context) {
-    return BLAISE_OP_ID::MINUS;
+    return BlaiseVariable(std::any_cast<const BlaiseArray&>(var.Value()).At(index.Value<int>()));
 }
 
-std::any InterpreterVisitor::visitOperatorAster(BlaiseParser::OperatorAsterContext *context) {
-    return BLAISE_OP_ID::MUL;
+std::any InterpreterVisitor::visitOperandInt(const AstNode& node) {
+    int value = std::stoi(ast_->Text(node));
+    return BlaiseVariable(value);
 }
 
-std::any InterpreterVisitor::visitOperatorSlash(BlaiseParser::OperatorSlashContext *context) {
-    return BLAISE_OP_ID::DIV;
+std::any InterpreterVisitor::visitOperandDouble(const AstNode& node) {
+    double value = std::stod(ast_->Text(node));
+    return BlaiseVariable(value);
 }
 
-std::any InterpreterVisitor::visitOperatorEqual(BlaiseParser::OperatorEqualContext *context) {
-    return BLAISE_OP_ID::EQUAL;
+std::any InterpreterVisitor::visitOperandChar(const AstNode& node) {
+    const std::string& str = ast_->Text(node);
+    char value = str.at(1);
+    return BlaiseVariable(value);
 }
 
-std::any InterpreterVisitor::visitOperatorNEqual(BlaiseParser::OperatorNEqualContext *context) {
-    return BLAISE_OP_ID::NEQUAL;
+std::any InterpreterVisitor::visitOperandString(const AstNode& node) {
+    const std::string& full_str = ast_->Text(node);
+    return BlaiseVariable(std::string(), std::string(full_str.begin() + 1, full_str.end() - 1));
 }
 
-std::any InterpreterVisitor::visitOperatorLess(BlaiseParser::OperatorLessContext *context) {
-    return BLAISE_OP_ID::LESS;
+std::any InterpreterVisitor::visitOperandExpr(const AstNode& node) {
+    return visit(ast_->Child(node, 0));
 }
 
-std::any InterpreterVisitor::visitOperatorLEqual(BlaiseParser::OperatorLEqualContext *context) {
-    return BLAISE_OP_ID::LEQUAL;
-}
+std::any InterpreterVisitor::visitOperandBoolean(const AstNode& node) {
+    const std::string& str = ast_->Text(node);
+    if (str == "true") return BlaiseVariable(true);
+    else if (str == "false") return BlaiseVariable(false);
 
-std::any InterpreterVisitor::visitOperatorGreater(BlaiseParser::OperatorGreaterContext *context) {
-    return BLAISE_OP_ID::GREATER;
+    throw std::invalid_argument(str + " is not a valid boolean value.");
 }
-
-std::any InterpreterVisitor::visitOperatorGEqual(BlaiseParser::OperatorGEqualContext *context) {
-    return BLAISE_OP_ID::GEQUAL;
-}
\ No newline at end of file
@@ -1,108 +1,258 @@
 #pragma once
 
+#include <chrono>
+#include <cstdint>
 #include <deque>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
 #include <string>
 #include <typeinfo>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
-#include "antlr/BlaiseBaseVisitor.h"
+#include "BlaiseAst.h"
 #include "BlaiseClasses.h"
-#include "antlr/BlaiseParser.h"
+#include "BlaiseProfile.h"
 
-class InterpreterVisitor : public BlaiseBaseVisitor {
+// A run stopped by the limits of InterpreterVisitor::SetLimits
+class BlaiseLimitError : public std::runtime_error {
 public:
+    using std::runtime_error::runtime_error;
+};
+
+// Bytes held by a run of InterpreterVisitor, see CountMemory
+struct MemoryUsage {
+    size_t values = 0;                  // variables and functions in the stack frames
+    size_t frames = 0;                  // the stack frames themselves
+    size_t trees = 0;                   // programs, modules and function bodies run
+
+    size_t Total() const {
+        return values + frames + trees;
+    }
+};
+
+class InterpreterVisitor : public BlaiseAstVisitor {
+public:
+    // Parses the body of a LAZY_BODY node into a program of one code
+    // block. The result has to live as long as the interpreter.
+    using BodyParser = std::function<const BlaiseAst&(const BlaiseAst& ast, const AstNode& body)>;
+
+    // Loads the module at path, imported by a statement of importer. The
+    // result has to live as long as the interpreter.
+    using ModuleLoader = std::function<const BlaiseAst&(const BlaiseAst& importer, const std::string& path)>;
+
     BlaiseBlock *gl_block;              // global block
 
     std::deque<BlaiseBlock> stack_frames;
 
 private:
+    std::ostream& out_;
+
+    BlaiseProfile *profile_ = nullptr;
+
+    bool replace_definitions_ = false;
+
+    BodyParser body_parser_;
+
+    ModuleLoader module_loader_;
+
+    // Modules whose functions have been bound
+    std::unordered_set<const BlaiseAst *> modules_;
+
+    // Functions of all imported modules, looked up after the stack frames
+    std::unordered_map<std::string, BlaiseFunction> module_functions_;
+
+    using Clock = std::chrono::steady_clock;
+
+    // Steps between two looks at the clock
+    static constexpr uint64_t CLOCK_INTERVAL = 1024;
+
+    // Steps left until the limits are checked again, out of the fuel_given_
+    // of the last check. Without limits it never runs out.
+    uint64_t fuel_ = UINT64_MAX;
+    uint64_t fuel_given_ = UINT64_MAX;
+    uint64_t steps_ = 0;                // steps before the last check
+    uint64_t max_steps_ = 0;
+    std::chrono::milliseconds timeout_{0};
+    Clock::time_point deadline_;
+
+    // An empty std::deque allocates a map of 8 pointers and a 512 byte
+    // chunk in libstdc++, a frame has two of them
+    static constexpr size_t FRAME_BYTES = sizeof(BlaiseBlock) + 2 * (8 * sizeof(void *) + 512);
+
+    bool count_memory_ = false;
+    size_t max_memory_ = 0;
+    MemoryUsage memory_;
+    MemoryUsage peak_memory_;           // memory_ when its total was highest
+
+    // Bytes each program being counted was charged
+    std::unordered_map<const BlaiseAst *, size_t> trees_;
+
     static const std::type_info& StringToTypeId(const std::string& str);
 
     static std::string StringToUpper(std::string str);
 
+    // An int or double var as an array element
+    static double ElementValue(const BlaiseVariable& var);
+
+    // Array or map var of the id, which has to be defined
+    BlaiseVariable& FindIndexed(const std::string& id);
+
+    // Runs a call of a built-in function: len, sum, min, max, array, map,
+    // contains or delete. They are only looked for when the program
+    // defines no function of the name.
+    BlaiseVariable CallBuiltin(const AstNode& call);
+
+    // delete(m, key), which changes the map variable m itself
+    BlaiseVariable DeleteKey(const AstNode& call);
+
     std::pair<BlaiseVariable *, BlaiseBlock *> FindVarAndBlock(const std::string& id);
 
     std::pair<BlaiseFunction *, BlaiseBlock *> FindFunctionAndBlock(const std::string& id);
 
-    BlaiseFunction& AddFunction(const std::string& name,
-                                BlaiseParser::Param_listContext *paramlist);
+    static ArgsList Parameters(const BlaiseAst& ast, const AstNode& definition);
 
-    void DebugPrintStack() const;
+    BlaiseFunction& AddFunction(const AstNode& definition);
 
-public:
-    InterpreterVisitor();
+    // Binds the functions of module and of the modules it imports, unless
+    // they are bound already. If that fails, nothing of it stays bound.
+    void BindModule(const BlaiseAst& module);
+
+    // BindModule, adds what it binds to modules and functions
+    void BindModule(const BlaiseAst& module, std::vector<const BlaiseAst *>& modules,
+                    std::vector<std::string>& functions);
+
+    // A loop iteration or a function call. Counts down only, the limits
+    // are checked when the fuel runs out.
+    void Safepoint() {
+        if (--fuel_ == 0)
+            Refuel();
+    }
 
-    virtual std::any visitProgram(BlaiseParser::ProgramContext *context) override;
+    // Throws BlaiseLimitError if a limit is hit, gives fuel up to the next
+    // check otherwise
+    void Refuel();
 
-    virtual std::any visitStmt(BlaiseParser::StmtContext *context) override;
+    // Adds bytes to counter of memory_, throws BlaiseLimitError if that
+    // goes over the memory limit. Only called when memory is counted.
+    void Hold(size_t MemoryUsage::*counter, size_t bytes);
 
-    virtual std::any visitFunctionDefinition(BlaiseParser::FunctionDefinitionContext *context) override;
+    void Drop(size_t MemoryUsage::*counter, size_t bytes) {
+        memory_.*counter -= bytes;
+    }
+
+    // Charges ast unless it is charged already
+    void HoldTree(const BlaiseAst& ast);
+
+    // Stack frames go through these two, to be counted
+    BlaiseBlock& PushFrame();
+    void PopFrame();
+
+    // Executes a statement in a scope of its own
+    std::any VisitInNewFrame(AstNodeId stmt);
+
+    // Runs the top-level statements begin to end of program
+    std::any VisitStatements(const AstNode& program, size_t begin, size_t end);
+
+    void DebugPrintStack() const;
+
+public:
+    // writeln writes to out
+    explicit InterpreterVisitor(std::ostream& out = std::cout);
 
-    virtual std::any visitFunctionCall(BlaiseParser::FunctionCallContext *context) override;
+    // Counts function calls, loop iterations and if branches into
+    // profile while the program runs. Pass nullptr to stop recording.
+    void SetProfile(BlaiseProfile *profile);
 
-    virtual std::any visitParamListComma(BlaiseParser::ParamListCommaContext *context) override;
+    // Lets a global function be defined again, replacing the previous
+    // definition instead of failing. Callers look functions up by name,
+    // so they pick up the new one on their next call.
+    void SetReplaceDefinitions(bool replace);
 
-    virtual std::any visitParamListEnd(BlaiseParser::ParamListEndContext *context) override;
+    // Called on every call of a function whose body was not parsed yet
+    void SetBodyParser(BodyParser parser);
 
-    virtual std::any visitArgListComma(BlaiseParser::ArgListCommaContext *context) override;
+    // Called by import statements, which fail without a loader. Each
+    // module is bound once, later imports of it do nothing.
+    void SetModuleLoader(ModuleLoader loader);
 
-    virtual std::any visitArgListEnd(BlaiseParser::ArgListEndContext *context) override;
+    // Stops the program with BlaiseLimitError at its step (loop iteration
+    // or function call) number max_steps + 1, or at the first step once
+    // timeout has passed from now. The clock is only read every few
+    // steps. 0 leaves a limit off.
+    void SetLimits(uint64_t max_steps, std::chrono::milliseconds timeout);
 
-    virtual std::any visitCodeBlock(BlaiseParser::CodeBlockContext *context) override;
+    // Counts the bytes held by variables and functions, stack frames and
+    // the programs run from now on, and stops the program with
+    // BlaiseLimitError when their total goes over max_bytes. Values are
+    // counted once they are stored, temporaries of expressions are not.
+    // 0 counts without a limit.
+    void CountMemory(size_t max_bytes);
 
-    virtual std::any visitAssignStmt(BlaiseParser::AssignStmtContext *ctx) override;
+    // Highest total reached since CountMemory, with its parts at the time
+    MemoryUsage PeakMemory() const;
 
-    virtual std::any visitReturnStmt(BlaiseParser::ReturnStmtContext *context) override;
+    // Stops counting ast, which is about to be freed
+    void ReleaseTree(const BlaiseAst& ast);
 
-    virtual std::any visitWritelnStmt(BlaiseParser::WritelnStmtContext *context) override;
+    // Defines a global variable. The caller makes sure it is not defined
+    // yet.
+    BlaiseVariable& AddGlobal(const std::string& name, const std::any& value);
 
-    virtual std::any visitIfStmtBlock(BlaiseParser::IfStmtBlockContext *context) override;
+    // Runs the top-level statements begin to end of ast, the ones before
+    // begin having run already. ast has to outlive the interpreter.
+    void RunStatements(const BlaiseAst& ast, size_t begin, size_t end);
 
-    virtual std::any visitElseStmtBlock(BlaiseParser::ElseStmtBlockContext *context) override;
+    // Pops every frame but the global one, which a call that failed
+    // leaves behind, and stops counting them and their variables
+    void UnwindFrames();
 
-    virtual std::any visitLoopStmt(BlaiseParser::LoopStmtContext *context) override;
+    virtual std::any visitProgram(const AstNode& node) override;
 
-    virtual std::any visitExprOperation(BlaiseParser::ExprOperationContext *context) override;
+    virtual std::any visitImportStmt(const AstNode& node) override;
 
-    virtual std::any visitExprUnaryMinusOperation(BlaiseParser::ExprUnaryMinusOperationContext *context) override;
+    virtual std::any visitFunctionDefinition(const AstNode& node) override;
 
-    virtual std::any visitExprUnaryPlusOperation(BlaiseParser::ExprUnaryPlusOperationContext *context) override;
+    virtual std::any visitFunctionCall(const AstNode& node) override;
 
-    virtual std::any visitExprOperand(BlaiseParser::ExprOperandContext *context) override;
+    virtual std::any visitCodeBlock(const AstNode& node) override;
 
-    virtual std::any visitOperandId(BlaiseParser::OperandIdContext *context) override;
+    virtual std::any visitAssignStmt(const AstNode& node) override;
 
-    virtual std::any visitOperandInt(BlaiseParser::OperandIntContext *context) override;
+    virtual std::any visitIndexAssignStmt(const AstNode& node) override;
 
-    virtual std::any visitOperandDouble(BlaiseParser::OperandDoubleContext *context) override;
+    virtual std::any visitReturnStmt(const AstNode& node) override;
 
-    virtual std::any visitOperandChar(BlaiseParser::OperandCharContext *context) override;
+    virtual std::any visitWritelnStmt(const AstNode& node) override;
 
-    virtual std::any visitOperandString(BlaiseParser::OperandStringContext *context) override;
+    virtual std::any visitIfStmt(const AstNode& node) override;
 
-    virtual std::any visitOperandBoolean(BlaiseParser::OperandBooleanContext *context) override;
+    virtual std::any visitLoopStmt(const AstNode& node) override;
 
-    virtual std::any visitOperandFunctionCall(BlaiseParser::OperandFunctionCallContext *context) override;
+    virtual std::any visitExprOperation(const AstNode& node) override;
 
-    virtual std::any visitOperandExpr(BlaiseParser::OperandExprContext *context) override;
+    virtual std::any visitExprUnaryMinusOperation(const AstNode& node) override;
 
-    virtual std::any visitOperatorPlus(BlaiseParser::OperatorPlusContext *context) override;
+    virtual std::any visitExprUnaryPlusOperation(const AstNode& node) override;
 
-    virtual std::any visitOperatorMinus(BlaiseParser::OperatorMinusContext *context) override;
+    virtual std::any visitOperandId(const AstNode& node) override;
 
-    virtual std::any visitOperatorAster(BlaiseParser::OperatorAsterContext *context) override;
+    virtual std::any visitOperandArray(const AstNode& node) override;
 
-    virtual std::any visitOperatorSlash(BlaiseParser::OperatorSlashContext *context) override;
+    virtual std::any visitOperandIndex(const AstNode& node) override;
 
-    virtual std::any visitOperatorEqual(BlaiseParser::OperatorEqualContext *context) override;
+    virtual std::any visitOperandInt(const AstNode& node) override;
 
-    virtual std::any visitOperatorNEqual(BlaiseParser::OperatorNEqualContext *context) override;
+    virtual std::any visitOperandDouble(const AstNode& node) override;
 
-    virtual std::any visitOperatorLess(BlaiseParser::OperatorLessContext *context) override;
+    virtual std::any visitOperandChar(const AstNode& node) override;
 
-    virtual std::any visitOperatorLEqual(BlaiseParser::OperatorLEqualContext *context) override;
+    virtual std::any visitOperandString(const AstNode& node) override;
 
-    virtual std::any visitOperatorGreater(BlaiseParser::OperatorGreaterContext *context) override;
+    virtual std::any visitOperandBoolean(const AstNode& node) override;
 
-    virtual std::any visitOperatorGEqual(BlaiseParser::OperatorGEqualContext *context) override;
+    virtual std::any visitOperandExpr(const AstNode& node) override;
 
 };
\ No newline at end of file
@@ -0,0 +1,1011 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iterator>
+#include <string>
+#include <utility>
+
+#include "TacAsmEmitter.h"
+
+// Type tags of bl_value, see src/runtime/BlaiseRuntime.h
+enum RUNTIME_TYPE_TAG {
+    TAG_NONE = 0,
+    TAG_INT = 1,
+    TAG_DOUBLE = 2,
+    TAG_BOOL = 3,
+    TAG_CHAR = 4,
+    TAG_STRING = 5,
+    TAG_UNASSIGNED = 6,
+};
+
+static const std::pair<const char *, const char *> ALLOCATABLE_GPRS[] = {
+    { "%rbx", "%ebx" },
+    { "%r12", "%r12d" },
+    { "%r13", "%r13d" },
+    { "%r14", "%r14d" },
+    { "%r15", "%r15d" },
+};
+
+static const char *ALLOCATABLE_XMMS[] = {
+    "%xmm8", "%xmm9", "%xmm10", "%xmm11", "%xmm12", "%xmm13", "%xmm14", "%xmm15",
+};
+
+static std::string Low32(const std::string& reg) {
+    static const std::map<std::string, std::string> names = {
+        { "%rax", "%eax" }, { "%rcx", "%ecx" }, { "%rdx", "%edx" },
+        { "%rsi", "%esi" }, { "%rdi", "%edi" }, { "%r8", "%r8d" },
+    };
+
+    return names.at(reg);
+}
+
+static int TypeTag(TAC_TYPE_ID type) {
+    switch (type) {
+        case TAC_TYPE_ID::INT:      return TAG_INT;
+        case TAC_TYPE_ID::DOUBLE:   return TAG_DOUBLE;
+        case TAC_TYPE_ID::BOOL:     return TAG_BOOL;
+        case TAC_TYPE_ID::CHAR:     return TAG_CHAR;
+        case TAC_TYPE_ID::STRING:   return TAG_STRING;
+        default:                    break;
+    }
+
+    return TAG_NONE;
+}
+
+static bool IsIntegerClass(TAC_TYPE_ID type) {
+    return type == TAC_TYPE_ID::INT || type == TAC_TYPE_ID::BOOL || type == TAC_TYPE_ID::CHAR;
+}
+
+static const char *IntCondition(BLAISE_OP_ID op) {
+    switch (op) {
+        case BLAISE_OP_ID::EQUAL:   return "e";
+        case BLAISE_OP_ID::NEQUAL:  return "ne";
+        case BLAISE_OP_ID::LESS:    return "l";
+        case BLAISE_OP_ID::LEQUAL:  return "le";
+        case BLAISE_OP_ID::GREATER: return "g";
+        case BLAISE_OP_ID::GEQUAL:  return "ge";
+        default:                    break;
+    }
+
+    return "e";
+}
+
+static std::string AsmString(const std::string& text) {
+    std::ostringstream out;
+
+    for (char c : text) {
+        unsigned char code = static_cast<unsigned char>(c);
+
+        if (c == '\\' || c == '"')
+            out << '\\' << c;
+        else if (code >= 0x20 && code < 0x7f)
+            out << c;
+        else
+            out << '\\' << std::oct << std::setw(3) << std::setfill('0')
+                << static_cast<unsigned>(code) << std::dec;
+    }
+
+    return '"' + out.str() + '"';
+}
+
+std::string AsmLocation::At(int displacement) const {
+    if (kind != MEMORY)
+        return text;
+
+    int disp = offset + displacement;
+
+    if (text.empty())
+        return std::to_string(disp) + "(%rbp)";
+
+    return text + (disp ? "+" + std::to_string(disp) : "") + "(%rip)";
+}
+
+TacProgram TacAsmEmitter::Prepare(TacProgram program) {
+    SplitTemporaries(program);
+    return program;
+}
+
+TacAsmEmitter::TacAsmEmitter(TacProgram program)
+                : program_(Prepare(std::move(program))), types_(program_) {
+    frames_.resize(program_.functions.size());
+
+    for (size_t f = 0; f < program_.functions.size(); f++) {
+        const TacFunction& func = program_.functions[f];
+
+        for (size_t pc = 0; pc < func.code.size(); pc++) {
+            if (func.code[pc].op == TAC_OP_ID::CALL && types_.functions[f].reachable[pc])
+                dispatchers_.insert({ func.code[pc].label, func.code[pc].count });
+        }
+
+        AllocateRegisters(f);
+        LayoutFrame(f);
+    }
+}
+
+TAC_TYPE_ID TacAsmEmitter::Repr(TAC_TYPE_ID type) const {
+    return TacTypeInference::Representation(type);
+}
+
+TAC_TYPE_ID TacAsmEmitter::ReprOf(size_t function, const TacOperand& operand) const {
+    return Repr(types_.TypeOf(function, operand));
+}
+
+bool TacAsmEmitter::IsNativeBinary(size_t function, const TacInstruction& instr) const {
+    TAC_TYPE_ID lhs = ReprOf(function, instr.arg1);
+    TAC_TYPE_ID rhs = ReprOf(function, instr.arg2);
+
+    return lhs != TAC_TYPE_ID::DYNAMIC && rhs != TAC_TYPE_ID::DYNAMIC
+        && TacTypeInference::IsNative(TacTypeInference::BinaryResult(instr.operation, lhs, rhs));
+}
+
+// Whether the code for an instruction may call out, clobbering the
+// caller-saved registers.
+bool TacAsmEmitter::MayCall(size_t function, size_t pc) const {
+    const TacInstruction& instr = program_.functions[function].code[pc];
+    bool dynamic_result = ReprOf(function, instr.result) == TAC_TYPE_ID::DYNAMIC;
+
+    switch (instr.op) {
+        case TAC_OP_ID::COPY:
+            return dynamic_result;
+        case TAC_OP_ID::BINARY:
+            return dynamic_result || !IsNativeBinary(function, instr);
+        case TAC_OP_ID::UNARY_MINUS:
+        case TAC_OP_ID::UNARY_PLUS: {
+            TAC_TYPE_ID type = ReprOf(function, instr.arg1);
+            return dynamic_result || (type != TAC_TYPE_ID::INT && type != TAC_TYPE_ID::DOUBLE);
+        }
+        case TAC_OP_ID::GOTO:
+        case TAC_OP_ID::PARAM:
+        case TAC_OP_ID::CHECK:
+        case TAC_OP_ID::ASSIGNED:
+        case TAC_OP_ID::SWAP:
+        case TAC_OP_ID::DEFINE:
+        case TAC_OP_ID::UNDEFINE:
+            return false;
+        case TAC_OP_ID::IF_FALSE_GOTO:
+        case TAC_OP_ID::LOOP_FALSE_GOTO:
+        case TAC_OP_ID::IF_TRUE_GOTO:
+        case TAC_OP_ID::LOOP_TRUE_GOTO:
+            return types_.TypeOf(function, instr.arg1) != TAC_TYPE_ID::BOOL;
+        default:
+            break;
+    }
+
+    return true;
+}
+
+// Linear scan over the temps, which are numbered in order of definition
+// and live from their definition to their last use within a statement.
+void TacAsmEmitter::AllocateRegisters(size_t function) {
+    static constexpr size_t UNDEFINED = static_cast<size_t>(-1);
+
+    const TacFunction& func = program_.functions[function];
+    const TacFunctionTypes& types = types_.functions[function];
+    Frame& frame = frames_[function];
+
+    std::vector<size_t> def(func.temp_count, UNDEFINED);
+    std::vector<size_t> last(func.temp_count, 0);
+    std::vector<size_t> calls_before(func.code.size() + 1, 0);
+
+    for (size_t pc = 0; pc < func.code.size(); pc++) {
+        const TacInstruction& instr = func.code[pc];
+        bool reachable = types.reachable[pc];
+
+        calls_before[pc + 1] = calls_before[pc] + (reachable && MayCall(function, pc));
+
+        if (!reachable)
+            continue;
+
+        for (const TacOperand *arg : { &instr.arg1, &instr.arg2 }) {
+            if (arg->kind == TAC_OPERAND_KIND::TEMP)
+                last[arg->index] = std::max(last[arg->index], pc);
+        }
+
+        if (instr.result.kind == TAC_OPERAND_KIND::TEMP && def[instr.result.index] == UNDEFINED)
+            def[instr.result.index] = pc;
+    }
+
+    std::vector<bool> gpr_busy(std::size(ALLOCATABLE_GPRS), false);
+    std::vector<bool> gpr_used(std::size(ALLOCATABLE_GPRS), false);
+    std::vector<bool> xmm_busy(std::size(ALLOCATABLE_XMMS), false);
+    std::vector<std::pair<size_t, size_t>> active;      // last use, temp
+
+    frame.registers.assign(func.temp_count, "");
+
+    for (size_t t = 0; t < func.temp_count; t++) {
+        if (def[t] == UNDEFINED)
+            continue;
+
+        last[t] = std::max(last[t], def[t]);
+
+        for (auto it = active.begin(); it != active.end();) {
+            if (it->first > def[t]) {
+                ++it;
+                continue;
+            }
+
+            const std::string& reg = frame.registers[it->second];
+
+            for (size_t r = 0; r < std::size(ALLOCATABLE_GPRS); r++)
+                if (reg == ALLOCATABLE_GPRS[r].second) gpr_busy[r] = false;
+            for (size_t r = 0; r < std::size(ALLOCATABLE_XMMS); r++)
+                if (reg == ALLOCATABLE_XMMS[r]) xmm_busy[r] = false;
+
+            it = active.erase(it);
+        }
+
+        TAC_TYPE_ID type = Repr(types.temps[t]);
+
+        if (IsIntegerClass(type)) {
+            for (size_t r = 0; r < std::size(ALLOCATABLE_GPRS); r++) {
+                if (gpr_busy[r])
+                    continue;
+
+                gpr_busy[r] = gpr_used[r] = true;
+                frame.registers[t] = ALLOCATABLE_GPRS[r].second;
+                break;
+            }
+        } else if (type == TAC_TYPE_ID::DOUBLE && calls_before[last[t]] == calls_before[def[t] + 1]) {
+            for (size_t r = 0; r < std::size(ALLOCATABLE_XMMS); r++) {
+                if (xmm_busy[r])
+                    continue;
+
+                xmm_busy[r] = true;
+                frame.registers[t] = ALLOCATABLE_XMMS[r];
+                break;
+            }
+        }
+
+        if (!frame.registers[t].empty())
+            active.push_back({ last[t], t });
+    }
+
+    for (size_t r = 0; r < std::size(ALLOCATABLE_GPRS); r++) {
+        if (gpr_used[r])
+            frame.saved.push_back(ALLOCATABLE_GPRS[r].first);
+    }
+}
+
+// Frame layout, from %rbp down: saved callee-saved registers, then one
+// 16 byte slot per local, spilled temp and pending call argument, a
+// scratch slot and the return value. Parameters are above %rbp, where
+// the caller left them.
+void TacAsmEmitter::LayoutFrame(size_t function) {
+    const TacFunction& func = program_.functions[function];
+    const TacFunctionTypes& types = types_.functions[function];
+    Frame& frame = frames_[function];
+    int slots = 0;
+
+    auto next = [&]() {
+        return -static_cast<int>(8 * frame.saved.size() + 16 * ++slots);
+    };
+
+    frame.locals.assign(func.locals.size(), 0);
+    for (size_t i = 0; i < func.locals.size(); i++)
+        frame.locals[i] = i < func.param_count ? static_cast<int>(16 + 16 * i) : next();
+
+    frame.temps.assign(func.temp_count, 0);
+    for (size_t t = 0; t < func.temp_count; t++) {
+        if (frame.registers[t].empty())
+            frame.temps[t] = next();
+    }
+
+    for (size_t pc = 0; pc < func.code.size(); pc++) {
+        if (func.code[pc].op == TAC_OP_ID::PARAM && types.reachable[pc])
+            frame.params[pc] = next();
+    }
+
+    frame.scratch = next();
+    frame.ret = next();
+    frame.size = 16 * slots;
+
+    if ((8 * frame.saved.size() + frame.size) % 16)
+        frame.size += 8;
+}
+
+std::string TacAsmEmitter::Message(const std::string& text) const {
+    auto it = messages_.find(text);
+
+    if (it == messages_.end())
+        it = messages_.emplace(text, ".LM" + std::to_string(messages_.size())).first;
+
+    return it->second;
+}
+
+std::string TacAsmEmitter::NewLabel() const {
+    return ".LL" + std::to_string(local_labels_++);
+}
+
+AsmLocation TacAsmEmitter::Slot(int offset) const {
+    return { AsmLocation::MEMORY, "", offset };
+}
+
+AsmLocation TacAsmEmitter::Locate(size_t function, const TacOperand& operand) const {
+    const Frame& frame = frames_[function];
+
+    switch (operand.kind) {
+        case TAC_OPERAND_KIND::CONSTANT: {
+            const BlaiseVariable& value = program_.constants[operand.index];
+
+            if (value.Is<int>())
+                return { AsmLocation::IMMEDIATE, "$" + std::to_string(value.Value<int>()) };
+            if (value.Is<bool>())
+                return { AsmLocation::IMMEDIATE, value.Value<bool>() ? "$1" : "$0" };
+            if (value.Is<char>())
+                return { AsmLocation::IMMEDIATE, "$" + std::to_string(static_cast<int>(value.Value<char>())) };
+            if (value.Is<double>())
+                return { AsmLocation::MEMORY, ".LD" + std::to_string(operand.index) };
+
+            return { AsmLocation::MEMORY, "bl_k" + std::to_string(operand.index) };
+        }
+        case TAC_OPERAND_KIND::GLOBAL:
+            return { AsmLocation::MEMORY, "g_" + program_.globals[operand.index] };
+        case TAC_OPERAND_KIND::LOCAL:
+            return Slot(frame.locals[operand.index]);
+        case TAC_OPERAND_KIND::TEMP:
+            if (!frame.registers[operand.index].empty())
+                return { AsmLocation::REGISTER, frame.registers[operand.index] };
+            return Slot(frame.temps[operand.index]);
+        case TAC_OPERAND_KIND::NONE:
+            break;
+    }
+
+    return { AsmLocation::IMMEDIATE, "$0" };
+}
+
+void TacAsmEmitter::LoadInt(std::ostream& out, const AsmLocation& from, const std::string& reg) const {
+    out << "    movl " << from.At() << ", " << reg << "\n";
+}
+
+void TacAsmEmitter::LoadDouble(std::ostream& out, size_t function, const TacOperand& operand,
+                               const std::string& reg) const {
+    AsmLocation from = Locate(function, operand);
+
+    if (ReprOf(function, operand) == TAC_TYPE_ID::DOUBLE) {
+        out << "    " << (from.kind == AsmLocation::REGISTER ? "movapd " : "movsd ")
+            << from.At() << ", " << reg << "\n";
+    } else if (from.kind == AsmLocation::IMMEDIATE) {
+        LoadInt(out, from, "%eax");
+        out << "    cvtsi2sdl %eax, " << reg << "\n";
+    } else {
+        out << "    cvtsi2sdl " << from.At() << ", " << reg << "\n";
+    }
+}
+
+void TacAsmEmitter::LoadDynamic(std::ostream& out, size_t function, const TacOperand& operand,
+                                const std::string& type_reg, const std::string& payload_reg) const {
+    TAC_TYPE_ID repr = ReprOf(function, operand);
+    AsmLocation from = Locate(function, operand);
+
+    if (operand.kind == TAC_OPERAND_KIND::NONE) {
+        out << "    xorl " << Low32(type_reg) << ", " << Low32(type_reg) << "\n"
+            << "    xorl " << Low32(payload_reg) << ", " << Low32(payload_reg) << "\n";
+    } else if (repr == TAC_TYPE_ID::DYNAMIC) {
+        out << "    movq " << from.At() << ", " << type_reg << "\n"
+            << "    movq " << from.At(8) << ", " << payload_reg << "\n";
+    } else {
+        out << "    movl $" << TypeTag(repr) << ", " << Low32(type_reg) << "\n";
+
+        if (repr == TAC_TYPE_ID::DOUBLE)
+            out << "    movq " << from.At() << ", " << payload_reg << "\n";
+        else
+            LoadInt(out, from, Low32(payload_reg));
+    }
+}
+
+// Takes a reference to the value in %rax:%rdx.
+void TacAsmEmitter::Retain(std::ostream& out) const {
+    std::string skip = NewLabel();
+
+    out << "    cmpl $" << TAG_STRING << ", %eax\n"
+        << "    jne " << skip << "\n"
+        << "    incq (%rdx)\n"
+        << skip << ":\n";
+}
+
+void TacAsmEmitter::Release(std::ostream& out, const AsmLocation& slot) const {
+    std::string skip = NewLabel();
+
+    out << "    cmpl $" << TAG_STRING << ", " << slot.At() << "\n"
+        << "    jne " << skip << "\n"
+        << "    movl $" << TAG_STRING << ", %edi\n"
+        << "    movq " << slot.At(8) << ", %rsi\n"
+        << "    call bl_release\n"
+        << skip << ":\n";
+}
+
+// Stores the value produced by the previous instructions: integer class
+// values in %eax, doubles in %xmm0, dynamic values in %rax:%rdx.
+void TacAsmEmitter::StoreValue(std::ostream& out, size_t function, const AsmLocation& dst,
+                               TAC_TYPE_ID dst_repr, TAC_TYPE_ID value_repr) const {
+    const Frame& frame = frames_[function];
+
+    if (dst_repr == TAC_TYPE_ID::DYNAMIC) {
+        AsmLocation scratch = Slot(frame.scratch);
+
+        if (value_repr == TAC_TYPE_ID::DOUBLE)
+            out << "    movq %xmm0, %rdx\n";
+        else if (value_repr != TAC_TYPE_ID::DYNAMIC)
+            out << "    movl %eax, %edx\n";
+
+        if (value_repr != TAC_TYPE_ID::DYNAMIC)
+            out << "    movl $" << TypeTag(value_repr) << ", %eax\n";
+
+        out << "    movq %rax, " << scratch.At() << "\n"
+            << "    movq %rdx, " << scratch.At(8) << "\n";
+        Release(out, dst);
+        out << "    movq " << scratch.At() << ", %rax\n"
+            << "    movq %rax, " << dst.At() << "\n"
+            << "    movq " << scratch.At(8) << ", %rax\n"
+            << "    movq %rax, " << dst.At(8) << "\n";
+        return;
+    }
+
+    if (value_repr == TAC_TYPE_ID::DYNAMIC) {
+        switch (dst_repr) {
+            case TAC_TYPE_ID::DOUBLE:   out << "    movq %rdx, %xmm0\n"; break;
+            case TAC_TYPE_ID::BOOL:     out << "    movzbl %dl, %eax\n"; break;
+            case TAC_TYPE_ID::CHAR:     out << "    movsbl %dl, %eax\n"; break;
+            default:                    out << "    movl %edx, %eax\n"; break;
+        }
+
+        value_repr = dst_repr;
+    }
+
+    if (dst_repr == TAC_TYPE_ID::DOUBLE) {
+        if (value_repr != TAC_TYPE_ID::DOUBLE)
+            out << "    cvtsi2sdl %eax, %xmm0\n";
+
+        out << "    " << (dst.kind == AsmLocation::REGISTER ? "movapd" : "movsd")
+            << " %xmm0, " << dst.At() << "\n";
+    } else {
+        out << "    movl %eax, " << dst.At() << "\n";
+    }
+}
+
+void TacAsmEmitter::Store(std::ostream& out, size_t function, const TacOperand& dst,
+                          TAC_TYPE_ID value_repr) const {
+    StoreValue(out, function, Locate(function, dst), ReprOf(function, dst), value_repr);
+}
+
+// Loads an operand into the value registers of the given representation,
+// taking a new reference if it is a dynamic value.
+void TacAsmEmitter::LoadOwned(std::ostream& out, size_t function, const TacOperand& operand,
+                              TAC_TYPE_ID repr) const {
+    TAC_TYPE_ID from = ReprOf(function, operand);
+
+    if (repr == TAC_TYPE_ID::DYNAMIC) {
+        LoadDynamic(out, function, operand, "%rax", "%rdx");
+
+        if (from == TAC_TYPE_ID::DYNAMIC && operand.kind != TAC_OPERAND_KIND::NONE)
+            Retain(out);
+    } else if (repr == TAC_TYPE_ID::DOUBLE) {
+        LoadDouble(out, function, operand, "%xmm0");
+    } else {
+        LoadInt(out, Locate(function, operand), "%eax");
+    }
+}
+
+void TacAsmEmitter::Fail(std::ostream& out, const std::string& message) const {
+    out << "    leaq " << Message(message) << "(%rip), %rdi\n"
+        << "    call bl_fail\n";
+}
+
+std::string TacAsmEmitter::FunctionLabel(size_t function) const {
+    if (function == TacProgram::MAIN_FUNCTION)
+        return "main";
+
+    return "f" + std::to_string(function) + "_" + program_.functions[function].name;
+}
+
+std::string TacAsmEmitter::DispatcherLabel(size_t name_id, size_t count) const {
+    return "bl_call_" + program_.function_names[name_id] + "_" + std::to_string(count);
+}
+
+void TacAsmEmitter::EmitBinary(std::ostream& out, size_t function, const TacInstruction& instr) const {
+    static const char *ARITHMETIC[] = { "add", "sub", "mul", "div" };
+
+    TAC_TYPE_ID lhs = ReprOf(function, instr.arg1);
+    TAC_TYPE_ID rhs = ReprOf(function, instr.arg2);
+    size_t op = static_cast<size_t>(instr.operation);
+    bool arithmetic = op <= static_cast<size_t>(BLAISE_OP_ID::DIV);
+
+    if (!IsNativeBinary(function, instr)) {
+        LoadDynamic(out, function, instr.arg1, "%rsi", "%rdx");
+        LoadDynamic(out, function, instr.arg2, "%rcx", "%r8");
+        out << "    movl $" << op << ", %edi\n"
+            << "    call bl_binary\n";
+        Store(out, function, instr.result, TAC_TYPE_ID::DYNAMIC);
+        return;
+    }
+
+    TAC_TYPE_ID common = lhs == rhs ? lhs : TAC_TYPE_ID::DOUBLE;
+
+    if (common == TAC_TYPE_ID::DOUBLE) {
+        LoadDouble(out, function, instr.arg1, "%xmm0");
+        LoadDouble(out, function, instr.arg2, "%xmm1");
+
+        if (arithmetic) {
+            out << "    " << ARITHMETIC[op] << "sd %xmm1, %xmm0\n";
+            Store(out, function, instr.result, TAC_TYPE_ID::DOUBLE);
+            return;
+        }
+
+        // ucomisd reports unordered as ZF = PF = CF = 1, so NaN compares
+        // false for everything except !=.
+        switch (instr.operation) {
+            case BLAISE_OP_ID::EQUAL:
+                out << "    ucomisd %xmm1, %xmm0\n    sete %al\n    setnp %cl\n    andb %cl, %al\n";
+                break;
+            case BLAISE_OP_ID::NEQUAL:
+                out << "    ucomisd %xmm1, %xmm0\n    setne %al\n    setp %cl\n    orb %cl, %al\n";
+                break;
+            case BLAISE_OP_ID::LESS:
+                out << "    ucomisd %xmm0, %xmm1\n    seta %al\n";
+                break;
+            case BLAISE_OP_ID::LEQUAL:
+                out << "    ucomisd %xmm0, %xmm1\n    setae %al\n";
+                break;
+            case BLAISE_OP_ID::GREATER:
+                out << "    ucomisd %xmm1, %xmm0\n    seta %al\n";
+                break;
+            default:
+                out << "    ucomisd %xmm1, %xmm0\n    setae %al\n";
+                break;
+        }
+
+        out << "    movzbl %al, %eax\n";
+        Store(out, function, instr.result, TAC_TYPE_ID::BOOL);
+        return;
+    }
+
+    // The right operand is used in place, idiv being the only
+    // instruction here that cannot take an immediate.
+    std::string rhs_text = Locate(function, instr.arg2).At();
+
+    LoadInt(out, Locate(function, instr.arg1), "%eax");
+
+    switch (instr.operation) {
+        case BLAISE_OP_ID::PLUS:
+            out << (common == TAC_TYPE_ID::BOOL ? "    orl " : "    addl ") << rhs_text << ", %eax\n";
+            break;
+        case BLAISE_OP_ID::MINUS:
+            out << "    subl " << rhs_text << ", %eax\n";
+            break;
+        case BLAISE_OP_ID::MUL:
+            out << "    imull " << rhs_text << ", %eax\n";
+            break;
+        case BLAISE_OP_ID::DIV:
+            LoadInt(out, Locate(function, instr.arg2), "%ecx");
+            out << "    cltd\n    idivl %ecx\n";
+            break;
+        default:
+            out << "    cmpl " << rhs_text << ", %eax\n"
+                << "    set" << IntCondition(instr.operation) << " %al\n"
+                << "    movzbl %al, %eax\n";
+            break;
+    }
+
+    Store(out, function, instr.result, arithmetic ? common : TAC_TYPE_ID::BOOL);
+}
+
+void TacAsmEmitter::EmitInstruction(std::ostream& out, size_t function, size_t pc) const {
+    const TacFunction& func = program_.functions[function];
+    const TacFunctionTypes& types = types_.functions[function];
+    const Frame& frame = frames_[function];
+    const TacInstruction& instr = func.code[pc];
+    const std::string prefix = ".L" + FunctionLabel(function) + "_";
+
+    switch (instr.op) {
+        case TAC_OP_ID::COPY: {
+            TAC_TYPE_ID repr = ReprOf(function, instr.result);
+
+            LoadOwned(out, function, instr.arg1, repr);
+            Store(out, function, instr.result, repr);
+            break;
+        }
+        case TAC_OP_ID::BINARY:
+            EmitBinary(out, function, instr);
+            break;
+        case TAC_OP_ID::UNARY_MINUS:
+        case TAC_OP_ID::UNARY_PLUS: {
+            TAC_TYPE_ID type = ReprOf(function, instr.arg1);
+            bool minus = instr.op == TAC_OP_ID::UNARY_MINUS;
+
+            if (type == TAC_TYPE_ID::INT) {
+                LoadInt(out, Locate(function, instr.arg1), "%eax");
+                if (minus)
+                    out << "    negl %eax\n";
+            } else if (type == TAC_TYPE_ID::DOUBLE) {
+                LoadDouble(out, function, instr.arg1, "%xmm0");
+                if (minus)
+                    out << "    movq %xmm0, %rax\n    btcq $63, %rax\n    movq %rax, %xmm0\n";
+            } else {
+                LoadDynamic(out, function, instr.arg1, "%rdi", "%rsi");
+                out << "    call " << (minus ? "bl_unary_minus" : "bl_unary_plus") << "\n";
+            }
+
+            Store(out, function, instr.result, type);
+            break;
+        }
+        case TAC_OP_ID::GOTO:
+            out << "    jmp " << prefix << instr.label << "\n";
+            break;
+        case TAC_OP_ID::IF_FALSE_GOTO:
+        case TAC_OP_ID::LOOP_FALSE_GOTO:
+        case TAC_OP_ID::IF_TRUE_GOTO:
+        case TAC_OP_ID::LOOP_TRUE_GOTO: {
+            TAC_TYPE_ID type = types_.TypeOf(function, instr.arg1);
+            bool is_if = instr.op == TAC_OP_ID::IF_FALSE_GOTO || instr.op == TAC_OP_ID::IF_TRUE_GOTO;
+            bool on_false = instr.op == TAC_OP_ID::IF_FALSE_GOTO || instr.op == TAC_OP_ID::LOOP_FALSE_GOTO;
+            std::string message = is_if
+                                ? "If statement expression must be boolean!"
+                                : "Loop if statement expression must be boolean!";
+
+            if (type == TAC_TYPE_ID::BOOL) {
+                LoadInt(out, Locate(function, instr.arg1), "%eax");
+                out << "    testl %eax, %eax\n";
+            } else if (TacTypeInference::IsNative(type) || type == TAC_TYPE_ID::STRING) {
+                Fail(out, message);
+                break;
+            } else {
+                LoadDynamic(out, function, instr.arg1, "%rdi", "%rsi");
+                out << "    leaq " << Message(message) << "(%rip), %rdx\n"
+                    << "    call bl_truth\n"
+                    << "    testb %al, %al\n";
+            }
+
+            out << (on_false ? "    je " : "    jne ") << prefix << instr.label << "\n";
+            break;
+        }
+        case TAC_OP_ID::PARAM: {
+            const auto& [call, index] = types.param_call[pc];
+            TAC_TYPE_ID repr = Repr(types_.params[func.code[call].label][index]);
+            AsmLocation slot = Slot(frame.params.at(pc));
+
+            LoadOwned(out, function, instr.arg1, repr);
+
+            if (repr == TAC_TYPE_ID::DOUBLE)
+                out << "    movsd %xmm0, " << slot.At() << "\n";
+            else if (repr != TAC_TYPE_ID::DYNAMIC)
+                out << "    movl %eax, " << slot.At() << "\n";
+            else
+                out << "    movq %rax, " << slot.At() << "\n"
+                    << "    movq %rdx, " << slot.At(8) << "\n";
+            break;
+        }
+        case TAC_OP_ID::CALL: {
+            const std::vector<size_t>& args = types.call_params[pc];
+
+            if (!args.empty())
+                out << "    subq $" << 16 * args.size() << ", %rsp\n";
+
+            for (size_t i = 0; i < args.size(); i++) {
+                AsmLocation slot = Slot(frame.params.at(args[i]));
+
+                out << "    movq " << slot.At() << ", %rax\n"
+                    << "    movq %rax, " << 16 * i << "(%rsp)\n"
+                    << "    movq " << slot.At(8) << ", %rax\n"
+                    << "    movq %rax, " << 16 * i + 8 << "(%rsp)\n";
+            }
+
+            out << "    call " << DispatcherLabel(instr.label, instr.count) << "\n";
+
+            if (!args.empty())
+                out << "    addq $" << 16 * args.size() << ", %rsp\n";
+
+            Store(out, function, instr.result, Repr(types_.returns[instr.label]));
+            break;
+        }
+        case TAC_OP_ID::RETURN: {
+            if (function == TacProgram::MAIN_FUNCTION) {
+                Fail(out, "Return statement is not allowed outside of functions");
+                break;
+            }
+
+            TAC_TYPE_ID repr = Repr(types_.returns[func.name_id]);
+            AsmLocation slot = Slot(frame.ret);
+
+            LoadOwned(out, function, instr.arg1, repr);
+
+            if (repr == TAC_TYPE_ID::DOUBLE)
+                out << "    movsd %xmm0, " << slot.At() << "\n";
+            else if (repr != TAC_TYPE_ID::DYNAMIC)
+                out << "    movl %eax, " << slot.At() << "\n";
+            else
+                out << "    movq %rax, " << slot.At() << "\n"
+                    << "    movq %rdx, " << slot.At(8) << "\n";
+
+            out << "    jmp " << prefix << "exit\n";
+            break;
+        }
+        case TAC_OP_ID::WRITELN: {
+            TAC_TYPE_ID type = ReprOf(function, instr.arg1);
+
+            if (type == TAC_TYPE_ID::DOUBLE) {
+                LoadDouble(out, function, instr.arg1, "%xmm0");
+                out << "    call bl_writeln_double\n";
+            } else if (type == TAC_TYPE_ID::DYNAMIC) {
+                LoadDynamic(out, function, instr.arg1, "%rdi", "%rsi");
+                out << "    call bl_writeln\n";
+            } else {
+                LoadInt(out, Locate(function, instr.arg1), "%edi");
+                out << "    call bl_writeln_"
+                    << (type == TAC_TYPE_ID::INT ? "int" : type == TAC_TYPE_ID::BOOL ? "bool" : "char")
+                    << "\n";
+            }
+            break;
+        }
+        case TAC_OP_ID::CHECK: {
+            const std::string& name = instr.arg1.kind == TAC_OPERAND_KIND::GLOBAL
+                                    ? program_.globals[instr.arg1.index]
+                                    : func.locals[instr.arg1.index];
+            std::string skip = NewLabel();
+
+            out << "    cmpl $" << TAG_UNASSIGNED << ", " << Locate(function, instr.arg1).At() << "\n"
+                << "    jne " << skip << "\n";
+            Fail(out, "Variable " + name + " has not been defined!");
+            out << skip << ":\n";
+            break;
+        }
+        case TAC_OP_ID::ASSIGNED:
+            if (ReprOf(function, instr.arg1) == TAC_TYPE_ID::DYNAMIC)
+                out << "    cmpl $" << TAG_UNASSIGNED << ", " << Locate(function, instr.arg1).At() << "\n"
+                    << "    setne %al\n"
+                    << "    movzbl %al, %eax\n";
+            else
+                out << "    movl $1, %eax\n";
+
+            Store(out, function, instr.result, TAC_TYPE_ID::BOOL);
+            break;
+        case TAC_OP_ID::UNSET: {
+            AsmLocation slot = Locate(function, instr.result);
+            std::string skip = NewLabel();
+
+            if (instr.arg1.kind != TAC_OPERAND_KIND::NONE) {
+                LoadInt(out, Locate(function, instr.arg1), "%eax");
+                out << "    testl %eax, %eax\n"
+                    << "    jne " << skip << "\n";
+            }
+
+            Release(out, slot);
+            out << "    movl $" << TAG_UNASSIGNED << ", " << slot.At() << "\n"
+                << skip << ":\n";
+            break;
+        }
+        case TAC_OP_ID::SWAP: {
+            AsmLocation lhs = Locate(function, instr.result);
+            AsmLocation rhs = Locate(function, instr.arg1);
+
+            out << "    movq " << lhs.At() << ", %rax\n"
+                << "    movq " << lhs.At(8) << ", %rdx\n"
+                << "    movq " << rhs.At() << ", %rcx\n"
+                << "    movq " << rhs.At(8) << ", %r8\n"
+                << "    movq %rcx, " << lhs.At() << "\n"
+                << "    movq %r8, " << lhs.At(8) << "\n"
+                << "    movq %rax, " << rhs.At() << "\n"
+                << "    movq %rdx, " << rhs.At(8) << "\n";
+            break;
+        }
+        case TAC_OP_ID::DEFINE: {
+            const TacFunction& defined = program_.functions[instr.label];
+
+            if (instr.result.kind != TAC_OPERAND_KIND::NONE) {
+                out << "    movl bl_body_" << defined.name << "(%rip), %eax\n";
+                Store(out, function, instr.result, TAC_TYPE_ID::INT);
+            }
+
+            out << "    movl $" << instr.label << ", bl_body_" << defined.name << "(%rip)\n";
+            break;
+        }
+        case TAC_OP_ID::UNDEFINE:
+            LoadInt(out, Locate(function, instr.arg1), "%eax");
+            out << "    movl %eax, bl_body_" << program_.functions[instr.label].name << "(%rip)\n";
+            break;
+        case TAC_OP_ID::FAIL:
+            Fail(out, program_.constants[instr.arg1.index].ToString());
+            break;
+        case TAC_OP_ID::ENTER:
+        case TAC_OP_ID::LEAVE:
+            break;
+        case TAC_OP_ID::HALT:
+            out << "    jmp " << prefix << "exit\n";
+            break;
+    }
+}
+
+void TacAsmEmitter::EmitFunction(std::ostream& out, size_t function) const {
+    const TacFunction& func = program_.functions[function];
+    const TacFunctionTypes& types = types_.functions[function];
+    const Frame& frame = frames_[function];
+    const std::string label = FunctionLabel(function);
+    const std::string prefix = ".L" + label + "_";
+    bool is_main = function == TacProgram::MAIN_FUNCTION;
+    std::set<size_t> targets;
+
+    for (size_t pc = 0; pc < func.code.size(); pc++) {
+        TAC_OP_ID op = func.code[pc].op;
+
+        if (types.reachable[pc] && (op == TAC_OP_ID::GOTO || op == TAC_OP_ID::IF_FALSE_GOTO
+                                    || op == TAC_OP_ID::LOOP_FALSE_GOTO || op == TAC_OP_ID::IF_TRUE_GOTO
+                                    || op == TAC_OP_ID::LOOP_TRUE_GOTO))
+            targets.insert(func.code[pc].label);
+    }
+
+    if (is_main)
+        out << "    .globl main\n"
+            << "    .type main, @function\n";
+
+    out << label << ":\n"
+        << "    pushq %rbp\n"
+        << "    movq %rsp, %rbp\n";
+
+    for (const auto& reg : frame.saved)
+        out << "    pushq " << reg << "\n";
+
+    if (frame.size)
+        out << "    subq $" << frame.size << ", %rsp\n";
+
+    // Dynamic slots start out without a value, so that assignments and
+    // the epilogue do not release garbage. Variables are unassigned
+    // until then, for CHECK.
+    for (size_t i = func.param_count; i < func.locals.size(); i++) {
+        if (Repr(types.locals[i]) == TAC_TYPE_ID::DYNAMIC)
+            out << "    movl $" << TAG_UNASSIGNED << ", " << Slot(frame.locals[i]).At() << "\n";
+    }
+
+    for (size_t i = 0; is_main && i < program_.globals.size(); i++) {
+        if (Repr(types_.globals[i]) == TAC_TYPE_ID::DYNAMIC)
+            out << "    movl $" << TAG_UNASSIGNED << ", g_" << program_.globals[i] << "(%rip)\n";
+    }
+
+    for (size_t t = 0; t < func.temp_count; t++) {
+        if (frame.registers[t].empty() && Repr(types.temps[t]) == TAC_TYPE_ID::DYNAMIC)
+            out << "    movl $" << TAG_NONE << ", " << Slot(frame.temps[t]).At() << "\n";
+    }
+
+    if (is_main) {
+        for (size_t i = 0; i < program_.constants.size(); i++) {
+            if (!program_.constants[i].Is<std::string>())
+                continue;
+
+            out << "    leaq .LS" << i << "(%rip), %rdi\n"
+                << "    movq $" << program_.constants[i].Value<std::string>().size() << ", %rsi\n"
+                << "    call bl_string_new\n"
+                << "    movq %rax, bl_k" << i << "(%rip)\n"
+                << "    movq %rdx, bl_k" << i << "+8(%rip)\n";
+        }
+    }
+
+    for (size_t pc = 0; pc < func.code.size(); pc++) {
+        if (targets.count(pc))
+            out << prefix << pc << ":\n";
+        if (types.reachable[pc])
+            EmitInstruction(out, function, pc);
+    }
+
+    out << prefix << "exit:\n";
+
+    for (size_t i = 0; i < func.locals.size(); i++) {
+        if (Repr(types.locals[i]) == TAC_TYPE_ID::DYNAMIC)
+            Release(out, Slot(frame.locals[i]));
+    }
+
+    for (size_t t = 0; t < func.temp_count; t++) {
+        if (frame.registers[t].empty() && Repr(types.temps[t]) == TAC_TYPE_ID::DYNAMIC)
+            Release(out, Slot(frame.temps[t]));
+    }
+
+    AsmLocation ret = Slot(frame.ret);
+    TAC_TYPE_ID repr = is_main ? TAC_TYPE_ID::INT : Repr(types_.returns[func.name_id]);
+
+    if (is_main)
+        out << "    xorl %eax, %eax\n";
+    else if (repr == TAC_TYPE_ID::DOUBLE)
+        out << "    movsd " << ret.At() << ", %xmm0\n";
+    else if (repr != TAC_TYPE_ID::DYNAMIC)
+        out << "    movl " << ret.At() << ", %eax\n";
+    else
+        out << "    movq " << ret.At() << ", %rax\n"
+            << "    movq " << ret.At(8) << ", %rdx\n";
+
+    out << "    leaq " << -static_cast<int>(8 * frame.saved.size()) << "(%rbp), %rsp\n";
+
+    for (auto it = frame.saved.rbegin(); it != frame.saved.rend(); ++it)
+        out << "    popq " << *it << "\n";
+
+    out << "    popq %rbp\n"
+        << "    ret\n\n";
+}
+
+// Dispatchers jump to the active definition with the caller's stack
+// untouched, so the callee finds its arguments right above the return
+// address.
+void TacAsmEmitter::EmitDispatcher(std::ostream& out, size_t name_id, size_t count) const {
+    const std::string& name = program_.function_names[name_id];
+    std::string label = DispatcherLabel(name_id, count);
+
+    out << label << ":\n"
+        << "    movl bl_body_" << name << "(%rip), %eax\n";
+
+    for (size_t f = 1; f < program_.functions.size(); f++) {
+        const TacFunction& func = program_.functions[f];
+
+        if (func.name_id != name_id)
+            continue;
+
+        out << "    cmpl $" << f << ", %eax\n"
+            << "    je " << (func.param_count == count ? FunctionLabel(f) : ".L" + label + "_arity") << "\n";
+    }
+
+    out << "    subq $8, %rsp\n";
+    Fail(out, "Function " + name + " has not been defined!");
+    out << ".L" << label << "_arity:\n"
+        << "    subq $8, %rsp\n";
+    Fail(out, "Wrong amount of aguments for function " + name);
+    out << "\n";
+}
+
+void TacAsmEmitter::Emit(std::ostream& out) const {
+    std::ostringstream text;
+
+    messages_.clear();
+    local_labels_ = 0;
+
+    for (size_t f = 1; f < program_.functions.size(); f++)
+        EmitFunction(text, f);
+
+    for (const auto& [name_id, count] : dispatchers_)
+        EmitDispatcher(text, name_id, count);
+
+    EmitFunction(text, TacProgram::MAIN_FUNCTION);
+
+    out << "# Generated by blaise comp --emit=asm\n"
+        << "    .text\n\n"
+        << text.str()
+        << "    .section .rodata\n";
+
+    for (size_t i = 0; i < program_.constants.size(); i++) {
+        const BlaiseVariable& value = program_.constants[i];
+
+        if (value.Is<double>()) {
+            double number = value.Value<double>();
+            uint64_t bits;
+            std::memcpy(&bits, &number, sizeof(bits));
+
+            out << "    .align 8\n"
+                << ".LD" << i << ":\n"
+                << "    .quad " << bits << "\n";
+        } else if (value.Is<std::string>()) {
+            out << ".LS" << i << ":\n"
+                << "    .ascii " << AsmString(value.Value<std::string>()) << "\n";
+        }
+    }
+
+    for (const auto& [message, label] : messages_)
+        out << label << ":\n"
+            << "    .asciz " << AsmString(message) << "\n";
+
+    out << "\n    .data\n"
+        << "    .align 4\n";
+
+    for (const auto& name : program_.function_names)
+        out << "bl_body_" << name << ":\n"
+            << "    .long -1\n";
+
+    out << "\n    .bss\n"
+        << "    .align 16\n";
+
+    for (size_t i = 0; i < program_.constants.size(); i++) {
+        if (program_.constants[i].Is<std::string>())
+            out << "bl_k" << i << ":\n"
+                << "    .zero 16\n";
+    }
+
+    for (const auto& name : program_.globals)
+        out << "g_" << name << ":\n"
+            << "    .zero 16\n";
+
+    out << "\n    .section .note.GNU-stack,\"\",@progbits\n";
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <map>
+#include <ostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "TacProgram.h"
+#include "TacTypes.h"
+
+// Where an operand lives: an immediate, a register allocated to a temp,
+// a global symbol or a slot of the current stack frame. Memory operands
+// of dynamic type hold a bl_value: the type tag at offset 0 and the
+// payload at offset 8.
+struct AsmLocation {
+    enum KIND { IMMEDIATE, REGISTER, MEMORY } kind = IMMEDIATE;
+    std::string text;       // "$5", "%ebx", symbol name or empty for the frame
+    int offset = 0;
+
+    std::string At(int displacement = 0) const;
+};
+
+// Translates a TacProgram into x86-64 assembly for the GNU assembler
+// (AT&T syntax, System V ABI). Natively typed temps are kept in
+// registers by a linear scan allocator: integers in callee-saved
+// registers, doubles in xmm8-xmm15 while no call happens during their
+// lifetime. Everything else lives in memory. Strings, dynamically typed
+// operations and writeln call into libblaisert.a (src/runtime).
+//
+// Blaise functions take their arguments on the stack, 16 bytes per
+// argument, and are reached through a dispatcher per name and argument
+// count that checks which definition is active.
+class TacAsmEmitter {
+private:
+
+    struct Frame {
+        std::vector<int> locals;
+        std::vector<int> temps;
+        std::map<size_t, int> params;       // PARAM pc -> argument slot
+        std::vector<std::string> registers; // temp -> register, empty if in memory
+        std::vector<std::string> saved;     // callee-saved registers in use
+        int scratch = 0;
+        int ret = 0;
+        int size = 0;
+    };
+
+    TacProgram program_;
+    TacTypeInference types_;
+    std::set<std::pair<size_t, size_t>> dispatchers_;   // function name id, argument count
+    std::vector<Frame> frames_;
+
+    mutable std::map<std::string, std::string> messages_;
+    mutable size_t local_labels_ = 0;
+
+private:
+
+    static TacProgram Prepare(TacProgram program);
+
+    TAC_TYPE_ID Repr(TAC_TYPE_ID type) const;
+
+    TAC_TYPE_ID ReprOf(size_t function, const TacOperand& operand) const;
+
+    bool MayCall(size_t function, size_t pc) const;
+
+    bool IsNativeBinary(size_t function, const TacInstruction& instr) const;
+
+    void AllocateRegisters(size_t function);
+
+    void LayoutFrame(size_t function);
+
+    std::string Message(const std::string& text) const;
+
+    std::string NewLabel() const;
+
+    AsmLocation Locate(size_t function, const TacOperand& operand) const;
+
+    AsmLocation Slot(int offset) const;
+
+    void LoadInt(std::ostream& out, const AsmLocation& from, const std::string& reg) const;
+
+    void LoadDouble(std::ostream& out, size_t function, const TacOperand& operand,
+                    const std::string& reg) const;
+
+    void LoadDynamic(std::ostream& out, size_t function, const TacOperand& operand,
+                     const std::string& type_reg, const std::string& payload_reg) const;
+
+    void Retain(std::ostream& out) const;
+
+    void Release(std::ostream& out, const AsmLocation& slot) const;
+
+    void StoreValue(std::ostream& out, size_t function, const AsmLocation& dst,
+                    TAC_TYPE_ID dst_repr, TAC_TYPE_ID value_repr) const;
+
+    void Store(std::ostream& out, size_t function, const TacOperand& dst, TAC_TYPE_ID value_repr) const;
+
+    void LoadOwned(std::ostream& out, size_t function, const TacOperand& operand, TAC_TYPE_ID repr) const;
+
+    void Fail(std::ostream& out, const std::string& message) const;
+
+    std::string FunctionLabel(size_t function) const;
+
+    std::string DispatcherLabel(size_t name_id, size_t count) const;
+
+    void EmitBinary(std::ostream& out, size_t function, const TacInstruction& instr) const;
+
+    void EmitInstruction(std::ostream& out, size_t function, size_t pc) const;
+
+    void EmitFunction(std::ostream& out, size_t function) const;
+
+    void EmitDispatcher(std::ostream& out, size_t name_id, size_t count) const;
+
+public:
+
+    explicit TacAsmEmitter(TacProgram program);
+
+    void Emit(std::ostream& out) const;
+};
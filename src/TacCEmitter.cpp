@@ -0,0 +1,527 @@
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <utility>
+
+#include "TacCEmitter.h"
+
+static const char *RuntimeOperation(BLAISE_OP_ID op) {
+    switch (op) {
+        case BLAISE_OP_ID::PLUS:    return "BL_PLUS";
+        case BLAISE_OP_ID::MINUS:   return "BL_MINUS";
+        case BLAISE_OP_ID::MUL:     return "BL_MUL";
+        case BLAISE_OP_ID::DIV:     return "BL_DIV";
+        case BLAISE_OP_ID::EQUAL:   return "BL_EQUAL";
+        case BLAISE_OP_ID::NEQUAL:  return "BL_NEQUAL";
+        case BLAISE_OP_ID::LESS:    return "BL_LESS";
+        case BLAISE_OP_ID::LEQUAL:  return "BL_LEQUAL";
+        case BLAISE_OP_ID::GREATER: return "BL_GREATER";
+        case BLAISE_OP_ID::GEQUAL:  return "BL_GEQUAL";
+    }
+
+    return "BL_PLUS";
+}
+
+static const char *NativeOperation(BLAISE_OP_ID op) {
+    switch (op) {
+        case BLAISE_OP_ID::PLUS:    return " + ";
+        case BLAISE_OP_ID::MINUS:   return " - ";
+        case BLAISE_OP_ID::MUL:     return " * ";
+        case BLAISE_OP_ID::DIV:     return " / ";
+        case BLAISE_OP_ID::EQUAL:   return " == ";
+        case BLAISE_OP_ID::NEQUAL:  return " != ";
+        case BLAISE_OP_ID::LESS:    return " < ";
+        case BLAISE_OP_ID::LEQUAL:  return " <= ";
+        case BLAISE_OP_ID::GREATER: return " > ";
+        case BLAISE_OP_ID::GEQUAL:  return " >= ";
+    }
+
+    return " ? ";
+}
+
+static const char *TypeSuffix(TAC_TYPE_ID type) {
+    switch (type) {
+        case TAC_TYPE_ID::INT:      return "int";
+        case TAC_TYPE_ID::DOUBLE:   return "double";
+        case TAC_TYPE_ID::BOOL:     return "bool";
+        case TAC_TYPE_ID::CHAR:     return "char";
+        default:                    break;
+    }
+
+    return "value";
+}
+
+static std::string EscapeChar(char c, char quote) {
+    unsigned char code = static_cast<unsigned char>(c);
+
+    if (c == '\\' || c == quote || c == '?')
+        return std::string("\\") + c;
+    if (code >= 0x20 && code < 0x7f)
+        return std::string(1, c);
+
+    std::ostringstream out;
+    out << '\\' << std::oct << std::setw(3) << std::setfill('0') << static_cast<unsigned>(code);
+    return out.str();
+}
+
+static std::string DoubleLiteral(double value) {
+    std::ostringstream out;
+    out << std::setprecision(17) << value;
+
+    std::string text = out.str();
+    if (text.find_first_of(".en") == std::string::npos)
+        text += ".0";
+
+    return text;
+}
+
+TacProgram TacCEmitter::Prepare(TacProgram program) {
+    SplitTemporaries(program);
+    return program;
+}
+
+TacCEmitter::TacCEmitter(TacProgram program)
+                : program_(Prepare(std::move(program))), types_(program_) {
+    for (size_t f = 0; f < program_.functions.size(); f++) {
+        const TacFunction& func = program_.functions[f];
+
+        for (size_t pc = 0; pc < func.code.size(); pc++) {
+            if (func.code[pc].op == TAC_OP_ID::CALL && types_.functions[f].reachable[pc])
+                dispatchers_.insert({ func.code[pc].label, func.code[pc].count });
+        }
+    }
+}
+
+TAC_TYPE_ID TacCEmitter::Repr(TAC_TYPE_ID type) const {
+    return TacTypeInference::Representation(type);
+}
+
+TAC_TYPE_ID TacCEmitter::ReprOf(size_t function, const TacOperand& operand) const {
+    return Repr(types_.TypeOf(function, operand));
+}
+
+std::string TacCEmitter::CType(TAC_TYPE_ID type) const {
+    switch (Repr(type)) {
+        case TAC_TYPE_ID::INT:      return "int";
+        case TAC_TYPE_ID::DOUBLE:   return "double";
+        case TAC_TYPE_ID::BOOL:     return "bool";
+        case TAC_TYPE_ID::CHAR:     return "char";
+        default:                    break;
+    }
+
+    return "bl_value";
+}
+
+std::string TacCEmitter::Initializer(TAC_TYPE_ID type) const {
+    switch (Repr(type)) {
+        case TAC_TYPE_ID::INT:      return "0";
+        case TAC_TYPE_ID::DOUBLE:   return "0.0";
+        case TAC_TYPE_ID::BOOL:     return "false";
+        case TAC_TYPE_ID::CHAR:     return "0";
+        default:                    break;
+    }
+
+    return "BL_NONE_VALUE";
+}
+
+std::string TacCEmitter::Name(size_t function, const TacOperand& operand) const {
+    switch (operand.kind) {
+        case TAC_OPERAND_KIND::CONSTANT: {
+            const BlaiseVariable& value = program_.constants[operand.index];
+
+            if (value.Is<int>())
+                return std::to_string(value.Value<int>());
+            if (value.Is<double>())
+                return DoubleLiteral(value.Value<double>());
+            if (value.Is<bool>())
+                return value.Value<bool>() ? "true" : "false";
+            if (value.Is<char>())
+                return "'" + EscapeChar(value.Value<char>(), '\'') + "'";
+
+            return "bl_k" + std::to_string(operand.index);
+        }
+        case TAC_OPERAND_KIND::GLOBAL:
+            return "g_" + program_.globals[operand.index];
+        case TAC_OPERAND_KIND::LOCAL:
+            return "l_" + program_.functions[function].locals[operand.index];
+        case TAC_OPERAND_KIND::TEMP:
+            return "t" + std::to_string(operand.index);
+        case TAC_OPERAND_KIND::NONE:
+            break;
+    }
+
+    return "BL_NONE_VALUE";
+}
+
+std::string TacCEmitter::Convert(const std::string& expr, TAC_TYPE_ID from, TAC_TYPE_ID to) const {
+    if (from == to)
+        return expr;
+    if (to == TAC_TYPE_ID::DYNAMIC)
+        return std::string("bl_") + TypeSuffix(from) + "(" + expr + ")";
+    if (from == TAC_TYPE_ID::DYNAMIC)
+        return std::string("bl_as_") + TypeSuffix(to) + "(" + expr + ")";
+
+    return "(" + CType(to) + ") " + expr;
+}
+
+std::string TacCEmitter::Value(size_t function, const TacOperand& operand, TAC_TYPE_ID to) const {
+    return Convert(Name(function, operand), ReprOf(function, operand), to);
+}
+
+std::string TacCEmitter::Owned(size_t function, const TacOperand& operand, TAC_TYPE_ID to) const {
+    if (to == TAC_TYPE_ID::DYNAMIC && ReprOf(function, operand) == TAC_TYPE_ID::DYNAMIC
+            && operand.kind != TAC_OPERAND_KIND::NONE)
+        return "bl_retain(" + Name(function, operand) + ")";
+
+    return Value(function, operand, to);
+}
+
+// expr yields a value of the given type, owned by the caller if it is
+// not native.
+std::string TacCEmitter::Store(size_t function, const TacOperand& dst, TAC_TYPE_ID type,
+                               const std::string& expr) const {
+    TAC_TYPE_ID dst_repr = ReprOf(function, dst);
+    std::string value = Convert(expr, Repr(type), dst_repr);
+
+    if (dst_repr == TAC_TYPE_ID::DYNAMIC)
+        return "bl_set(&" + Name(function, dst) + ", " + value + ");";
+
+    return Name(function, dst) + " = " + value + ";";
+}
+
+std::string TacCEmitter::FunctionName(size_t function) const {
+    return "f" + std::to_string(function) + "_" + program_.functions[function].name;
+}
+
+std::string TacCEmitter::DispatcherName(size_t name_id, size_t count) const {
+    return "bl_call_" + program_.function_names[name_id] + "_" + std::to_string(count);
+}
+
+std::string TacCEmitter::DispatcherSignature(size_t name_id, size_t count) const {
+    std::string signature = "static " + CType(types_.returns[name_id]) + " "
+                          + DispatcherName(name_id, count) + "(";
+
+    for (size_t i = 0; i < count; i++)
+        signature += (i ? ", " : "") + CType(types_.params[name_id][i]) + " a" + std::to_string(i);
+
+    return signature + (count ? ")" : "void)");
+}
+
+std::string TacCEmitter::FunctionSignature(size_t function) const {
+    const TacFunction& func = program_.functions[function];
+    std::string signature = "static " + CType(types_.returns[func.name_id]) + " "
+                          + FunctionName(function) + "(";
+
+    for (size_t i = 0; i < func.param_count; i++)
+        signature += (i ? ", " : "") + CType(types_.functions[function].locals[i])
+                   + " l_" + func.locals[i];
+
+    return signature + (func.param_count ? ")" : "void)");
+}
+
+void TacCEmitter::EmitDispatcher(std::ostream& out, size_t name_id, size_t count) const {
+    const std::string& name = program_.function_names[name_id];
+    std::string args;
+
+    for (size_t i = 0; i < count; i++)
+        args += (i ? ", a" : "a") + std::to_string(i);
+
+    out << DispatcherSignature(name_id, count) << " {\n"
+        << "    switch (bl_body_" << name << ") {\n";
+
+    for (size_t f = 1; f < program_.functions.size(); f++) {
+        const TacFunction& func = program_.functions[f];
+
+        if (func.name_id != name_id)
+            continue;
+
+        out << "        case " << f << ": ";
+
+        if (func.param_count == count)
+            out << "return " << FunctionName(f) << "(" << args << ");\n";
+        else
+            out << "bl_fail(\"Wrong amount of aguments for function " << name << "\");\n";
+    }
+
+    out << "        default: bl_fail(\"Function " << name << " has not been defined!\");\n"
+        << "    }\n"
+        << "}\n\n";
+}
+
+void TacCEmitter::EmitInstruction(std::ostream& out, size_t function, size_t pc) const {
+    const TacFunction& func = program_.functions[function];
+    const TacFunctionTypes& types = types_.functions[function];
+    const TacInstruction& instr = func.code[pc];
+
+    out << "    ";
+
+    switch (instr.op) {
+        case TAC_OP_ID::COPY: {
+            TAC_TYPE_ID repr = ReprOf(function, instr.result);
+            out << Store(function, instr.result, repr, Owned(function, instr.arg1, repr));
+            break;
+        }
+        case TAC_OP_ID::BINARY: {
+            TAC_TYPE_ID lhs = ReprOf(function, instr.arg1);
+            TAC_TYPE_ID rhs = ReprOf(function, instr.arg2);
+            TAC_TYPE_ID result = TacTypeInference::BinaryResult(instr.operation, lhs, rhs);
+
+            if (TacTypeInference::IsNative(result) && lhs != TAC_TYPE_ID::DYNAMIC
+                    && rhs != TAC_TYPE_ID::DYNAMIC) {
+                TAC_TYPE_ID common = lhs == rhs ? lhs : TAC_TYPE_ID::DOUBLE;
+                std::string expr = Value(function, instr.arg1, common)
+                                 + NativeOperation(instr.operation)
+                                 + Value(function, instr.arg2, common);
+
+                if (common == TAC_TYPE_ID::BOOL && instr.operation == BLAISE_OP_ID::PLUS)
+                    expr = Name(function, instr.arg1) + " || " + Name(function, instr.arg2);
+
+                out << Store(function, instr.result, result, "(" + expr + ")");
+            } else {
+                out << Store(function, instr.result, TAC_TYPE_ID::DYNAMIC,
+                             std::string("bl_binary(") + RuntimeOperation(instr.operation) + ", "
+                             + Value(function, instr.arg1, TAC_TYPE_ID::DYNAMIC) + ", "
+                             + Value(function, instr.arg2, TAC_TYPE_ID::DYNAMIC) + ")");
+            }
+            break;
+        }
+        case TAC_OP_ID::UNARY_MINUS:
+        case TAC_OP_ID::UNARY_PLUS: {
+            TAC_TYPE_ID type = ReprOf(function, instr.arg1);
+            bool minus = instr.op == TAC_OP_ID::UNARY_MINUS;
+
+            if (type == TAC_TYPE_ID::INT || type == TAC_TYPE_ID::DOUBLE)
+                out << Store(function, instr.result, type,
+                             (minus ? "(-" : "(") + Name(function, instr.arg1) + ")");
+            else
+                out << Store(function, instr.result, TAC_TYPE_ID::DYNAMIC,
+                             std::string(minus ? "bl_unary_minus(" : "bl_unary_plus(")
+                             + Value(function, instr.arg1, TAC_TYPE_ID::DYNAMIC) + ")");
+            break;
+        }
+        case TAC_OP_ID::GOTO:
+            out << "goto L" << instr.label << ";";
+            break;
+        case TAC_OP_ID::IF_FALSE_GOTO:
+        case TAC_OP_ID::LOOP_FALSE_GOTO:
+        case TAC_OP_ID::IF_TRUE_GOTO:
+        case TAC_OP_ID::LOOP_TRUE_GOTO: {
+            TAC_TYPE_ID type = types_.TypeOf(function, instr.arg1);
+            bool is_if = instr.op == TAC_OP_ID::IF_FALSE_GOTO || instr.op == TAC_OP_ID::IF_TRUE_GOTO;
+            const char *negate = instr.op == TAC_OP_ID::IF_FALSE_GOTO
+                              || instr.op == TAC_OP_ID::LOOP_FALSE_GOTO ? "!" : "";
+            std::string message = is_if
+                                ? "\"If statement expression must be boolean!\""
+                                : "\"Loop if statement expression must be boolean!\"";
+
+            if (type == TAC_TYPE_ID::BOOL)
+                out << "if (" << negate << Name(function, instr.arg1) << ") goto L" << instr.label << ";";
+            else if (TacTypeInference::IsNative(type) || type == TAC_TYPE_ID::STRING)
+                out << "bl_fail(" << message << ");";
+            else
+                out << "if (" << negate << "bl_truth(" << Name(function, instr.arg1) << ", " << message
+                    << ")) goto L" << instr.label << ";";
+            break;
+        }
+        case TAC_OP_ID::PARAM: {
+            const auto& [call, index] = types.param_call[pc];
+            TAC_TYPE_ID type = Repr(types_.params[func.code[call].label][index]);
+
+            out << "p" << pc << " = " << Owned(function, instr.arg1, type) << ";";
+            break;
+        }
+        case TAC_OP_ID::CALL: {
+            std::string expr = DispatcherName(instr.label, instr.count) + "(";
+
+            for (size_t i = 0; i < types.call_params[pc].size(); i++)
+                expr += (i ? ", p" : "p") + std::to_string(types.call_params[pc][i]);
+
+            out << Store(function, instr.result, types_.returns[instr.label], expr + ")");
+            break;
+        }
+        case TAC_OP_ID::RETURN:
+            if (function == TacProgram::MAIN_FUNCTION) {
+                out << "bl_fail(\"Return statement is not allowed outside of functions\");";
+            } else {
+                out << "bl_ret = " << Owned(function, instr.arg1, Repr(types_.returns[func.name_id]))
+                    << "; goto bl_exit;";
+            }
+            break;
+        case TAC_OP_ID::WRITELN: {
+            TAC_TYPE_ID type = ReprOf(function, instr.arg1);
+
+            out << "bl_writeln" << (type == TAC_TYPE_ID::DYNAMIC ? "" : std::string("_") + TypeSuffix(type))
+                << "(" << Name(function, instr.arg1) << ");";
+            break;
+        }
+        case TAC_OP_ID::CHECK: {
+            const std::string& name = instr.arg1.kind == TAC_OPERAND_KIND::GLOBAL
+                                    ? program_.globals[instr.arg1.index]
+                                    : func.locals[instr.arg1.index];
+
+            out << "bl_check(" << Name(function, instr.arg1) << ", \"" << name << "\");";
+            break;
+        }
+        case TAC_OP_ID::ASSIGNED:
+            out << Store(function, instr.result, TAC_TYPE_ID::BOOL,
+                         ReprOf(function, instr.arg1) == TAC_TYPE_ID::DYNAMIC
+                         ? "(" + Name(function, instr.arg1) + ".type != BL_UNASSIGNED)" : "true");
+            break;
+        case TAC_OP_ID::UNSET:
+            if (instr.arg1.kind != TAC_OPERAND_KIND::NONE)
+                out << "if (!" << Name(function, instr.arg1) << ") ";
+
+            out << "bl_set(&" << Name(function, instr.result) << ", BL_UNASSIGNED_VALUE);";
+            break;
+        case TAC_OP_ID::SWAP:
+            out << "{ " << CType(types_.TypeOf(function, instr.result)) << " bl_swap = "
+                << Name(function, instr.result) << "; " << Name(function, instr.result) << " = "
+                << Name(function, instr.arg1) << "; " << Name(function, instr.arg1) << " = bl_swap; }";
+            break;
+        case TAC_OP_ID::DEFINE: {
+            const TacFunction& defined = program_.functions[instr.label];
+
+            if (instr.result.kind != TAC_OPERAND_KIND::NONE)
+                out << Name(function, instr.result) << " = bl_body_" << defined.name << ";\n    ";
+
+            out << "bl_body_" << defined.name << " = " << instr.label << ";";
+            break;
+        }
+        case TAC_OP_ID::UNDEFINE:
+            out << "bl_body_" << program_.functions[instr.label].name << " = " << Name(function, instr.arg1) << ";";
+            break;
+        case TAC_OP_ID::FAIL: {
+            std::string literal;
+
+            for (char c : program_.constants[instr.arg1.index].ToString())
+                literal += EscapeChar(c, '"');
+
+            out << "bl_fail(\"" << literal << "\");";
+            break;
+        }
+        case TAC_OP_ID::ENTER:
+        case TAC_OP_ID::LEAVE:
+            break;
+        case TAC_OP_ID::HALT:
+            out << "goto bl_exit;";
+            break;
+    }
+
+    out << "\n";
+}
+
+void TacCEmitter::EmitFunction(std::ostream& out, size_t function) const {
+    const TacFunction& func = program_.functions[function];
+    const TacFunctionTypes& types = types_.functions[function];
+    bool is_main = function == TacProgram::MAIN_FUNCTION;
+    std::set<size_t> labels;
+
+    for (size_t pc = 0; pc < func.code.size(); pc++) {
+        TAC_OP_ID op = func.code[pc].op;
+
+        if (types.reachable[pc] && (op == TAC_OP_ID::GOTO || op == TAC_OP_ID::IF_FALSE_GOTO
+                                    || op == TAC_OP_ID::LOOP_FALSE_GOTO || op == TAC_OP_ID::IF_TRUE_GOTO
+                                    || op == TAC_OP_ID::LOOP_TRUE_GOTO))
+            labels.insert(func.code[pc].label);
+    }
+
+    if (is_main) {
+        out << "int main(void) {\n"
+            << "    int bl_ret = 0;\n";
+
+        for (size_t i = 0; i < program_.constants.size(); i++) {
+            const BlaiseVariable& value = program_.constants[i];
+
+            if (!value.Is<std::string>())
+                continue;
+
+            const std::string& text = value.Value<std::string>();
+            std::string literal;
+
+            for (char c : text)
+                literal += EscapeChar(c, '"');
+
+            out << "    bl_k" << i << " = bl_string_new(\"" << literal << "\", " << text.size() << ");\n";
+        }
+    } else {
+        out << FunctionSignature(function) << " {\n"
+            << "    " << CType(types_.returns[func.name_id]) << " bl_ret = "
+            << Initializer(types_.returns[func.name_id]) << ";\n";
+    }
+
+    // Dynamic variables start out unassigned for bl_check()
+    for (size_t i = func.param_count; i < func.locals.size(); i++)
+        out << "    " << CType(types.locals[i]) << " l_" << func.locals[i] << " = "
+            << (Repr(types.locals[i]) == TAC_TYPE_ID::DYNAMIC
+                ? "BL_UNASSIGNED_INIT" : Initializer(types.locals[i])) << ";\n";
+
+    for (size_t i = 0; i < func.temp_count; i++)
+        out << "    " << CType(types.temps[i]) << " t" << i << " = " << Initializer(types.temps[i]) << ";\n";
+
+    for (size_t pc = 0; pc < func.code.size(); pc++) {
+        if (func.code[pc].op != TAC_OP_ID::PARAM || !types.reachable[pc])
+            continue;
+
+        const auto& [call, index] = types.param_call[pc];
+        out << "    " << CType(types_.params[func.code[call].label][index]) << " p" << pc << ";\n";
+    }
+
+    out << "\n";
+
+    for (size_t pc = 0; pc <= func.code.size(); pc++) {
+        if (labels.count(pc))
+            out << "L" << pc << ":;\n";
+        if (pc < func.code.size() && types.reachable[pc])
+            EmitInstruction(out, function, pc);
+    }
+
+    out << "bl_exit:\n";
+
+    for (size_t i = 0; i < func.locals.size(); i++) {
+        if (Repr(types.locals[i]) == TAC_TYPE_ID::DYNAMIC)
+            out << "    bl_release(l_" << func.locals[i] << ");\n";
+    }
+
+    for (size_t i = 0; i < func.temp_count; i++) {
+        if (Repr(types.temps[i]) == TAC_TYPE_ID::DYNAMIC)
+            out << "    bl_release(t" << i << ");\n";
+    }
+
+    out << "    return bl_ret;\n"
+        << "}\n\n";
+}
+
+void TacCEmitter::Emit(std::ostream& out) const {
+    out << "/* Generated by blaise comp --emit=c */\n"
+        << "#include \"BlaiseRuntime.h\"\n\n";
+
+    for (size_t i = 0; i < program_.constants.size(); i++) {
+        if (program_.constants[i].Is<std::string>())
+            out << "static bl_value bl_k" << i << ";\n";
+    }
+
+    for (size_t i = 0; i < program_.globals.size(); i++)
+        out << "static " << CType(types_.globals[i]) << " g_" << program_.globals[i]
+            << (Repr(types_.globals[i]) == TAC_TYPE_ID::DYNAMIC ? " = BL_UNASSIGNED_INIT" : "") << ";\n";
+
+    for (const auto& name : program_.function_names)
+        out << "static int bl_body_" << name << " = -1;\n";
+
+    out << "\n";
+
+    for (const auto& [name_id, count] : dispatchers_)
+        out << DispatcherSignature(name_id, count) << ";\n";
+
+    for (size_t f = 1; f < program_.functions.size(); f++)
+        out << FunctionSignature(f) << ";\n";
+
+    out << "\n";
+
+    for (size_t f = 1; f < program_.functions.size(); f++)
+        EmitFunction(out, f);
+
+    for (const auto& [name_id, count] : dispatchers_)
+        EmitDispatcher(out, name_id, count);
+
+    EmitFunction(out, TacProgram::MAIN_FUNCTION);
+}
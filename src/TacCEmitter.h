@@ -0,0 +1,65 @@
+#pragma once
+
+#include <ostream>
+#include <set>
+#include <string>
+#include <utility>
+
+#include "TacProgram.h"
+#include "TacTypes.h"
+
+// Translates a TacProgram into a C translation unit built on top of
+// src/runtime/BlaiseRuntime.h. Slots that TacTypeInference proves to hold
+// a single type become native C variables, the rest are bl_value. Every
+// Blaise function becomes a C function; calls go through a dispatcher per
+// name and argument count, which checks which definition is active.
+class TacCEmitter {
+private:
+
+    TacProgram program_;
+    TacTypeInference types_;
+    std::set<std::pair<size_t, size_t>> dispatchers_;   // function name id, argument count
+
+private:
+
+    static TacProgram Prepare(TacProgram program);
+
+    TAC_TYPE_ID Repr(TAC_TYPE_ID type) const;
+
+    TAC_TYPE_ID ReprOf(size_t function, const TacOperand& operand) const;
+
+    std::string CType(TAC_TYPE_ID type) const;
+
+    std::string Initializer(TAC_TYPE_ID type) const;
+
+    std::string Name(size_t function, const TacOperand& operand) const;
+
+    std::string Convert(const std::string& expr, TAC_TYPE_ID from, TAC_TYPE_ID to) const;
+
+    std::string Value(size_t function, const TacOperand& operand, TAC_TYPE_ID to) const;
+
+    std::string Owned(size_t function, const TacOperand& operand, TAC_TYPE_ID to) const;
+
+    std::string Store(size_t function, const TacOperand& dst, TAC_TYPE_ID type,
+                      const std::string& expr) const;
+
+    std::string FunctionName(size_t function) const;
+
+    std::string DispatcherName(size_t name_id, size_t count) const;
+
+    std::string DispatcherSignature(size_t name_id, size_t count) const;
+
+    std::string FunctionSignature(size_t function) const;
+
+    void EmitDispatcher(std::ostream& out, size_t name_id, size_t count) const;
+
+    void EmitInstruction(std::ostream& out, size_t function, size_t pc) const;
+
+    void EmitFunction(std::ostream& out, size_t function) const;
+
+public:
+
+    explicit TacCEmitter(TacProgram program);
+
+    void Emit(std::ostream& out) const;
+};
@@ -1,10 +1,17 @@
 #include "TacCompilerVisitor.h"
 #include "BlaiseClasses.h"
 #include "Util.h"
-#include "antlr/BlaiseParser.h"
+#include <algorithm>
 #include <any>
+#include <cctype>
 #include <clocale>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <utility>
 
 #define NEWLINE_IF(__condition) \
@@ -12,6 +19,11 @@
 
 using TranslationData = std::pair<std::string, std::string>;
 
+static const char *OperatorText(BLAISE_OP_ID operation) {
+    static const char *texts[] = { "+", "-", "*", "/", "==", "!=", "<", "<=", ">", ">=" };
+    return texts[static_cast<size_t>(operation)];
+}
+
 std::string TacCompilerVisitor::GetTempVariableName() const {
     return tmp_name_ + std::to_string(tmp_counter_++);
 }
@@ -35,85 +47,261 @@ std::string TacCompilerVisitor::InsertTemporaryVariables(const std::string& last
     return ret + dep_iter->Name() + dep_iter->Value<TemporaryVariableInfo>().expr;
 }
 
-std::any TacCompilerVisitor::visitProgram(BlaiseParser::ProgramContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
+TacCompilerVisitor::TacCompilerVisitor(std::ostream& out, size_t jobs) : out_(out), jobs_(std::max<size_t>(jobs, 1)) {}
+
+TacCompilerVisitor::TacCompilerVisitor(std::ostream& out, const std::string& tmp_name)
+    : tmp_name_(tmp_name), out_(out) {}
+
+std::string TacCompilerVisitor::ExprText(AstNodeId expr) const {
+    const AstNode& node = ast_->Node(expr);
+    std::string text;
+
+    switch (node.kind) {
+        case AST_NODE_KIND::EXPR_OPERATION:
+            return ExprText(ast_->Child(node, 0)) + OperatorText(node.operation)
+                   + ExprText(ast_->Child(node, 1));
+        case AST_NODE_KIND::EXPR_UNARY_MINUS:
+            return "-" + ExprText(ast_->Child(node, 0));
+        case AST_NODE_KIND::EXPR_UNARY_PLUS:
+            return "+" + ExprText(ast_->Child(node, 0));
+        case AST_NODE_KIND::OPERAND_EXPR:
+            return "(" + ExprText(ast_->Child(node, 0)) + ")";
+        case AST_NODE_KIND::FUNCTION_CALL:
+            for (size_t i = 0; i < node.child_count; i++)
+                text += (i > 0 ? "," : "") + ExprText(ast_->Child(node, i));
+
+            return ast_->Text(node) + "(" + text + ")";
+        default:
+            return EscapedText(node);
+    }
+}
 
-    std::string ret;
-    for (auto stmt : context->stmt()) {
-        TranslationData data = std::any_cast<TranslationData>(visit(stmt));
-        ret += data.first + NEWLINE_IF(!data.first.empty() && !data.second.empty()) + data.second + NEWLINE_IF(!data.second.empty());
+std::string TacCompilerVisitor::EscapedText(const AstNode& node) const {
+    const std::string& text = ast_->Text(node);
+
+    if (tmp_name_[0] != unit_tmp_marker_ || text.find(unit_tmp_marker_) == std::string::npos)
+        return text;
+
+    std::string escaped;
+
+    for (char c : text) {
+        escaped += c;
+
+        if (c == unit_tmp_marker_)
+            escaped += c;
     }
 
-    return ret;
+    return escaped;
 }
 
-std::any TacCompilerVisitor::visitStmt(BlaiseParser::StmtContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
-    std::string ret;
-    TranslationData data;
+void TacCompilerVisitor::CompileStatement(AstNodeId stmt) {
+    TranslationData data = std::any_cast<TranslationData>(visit(stmt));
+    out_ << data.first << NEWLINE_IF(!data.first.empty() && !data.second.empty())
+         << data.second << NEWLINE_IF(!data.second.empty());
+
+    // Temporaries are only referenced from the statement that
+    // declared them.
+    block_.variables.clear();
+}
+
+void TacCompilerVisitor::WriteRenumbered(const std::string& text, size_t first_tmp) {
+    size_t begin = 0;
+    size_t marker;
+
+    while ((marker = text.find(unit_tmp_marker_, begin)) != std::string::npos) {
+        size_t end = marker + 1;
+        size_t index = 0;
+
+        // A doubled marker is one of a literal
+        if (end < text.size() && text[end] == unit_tmp_marker_) {
+            out_.write(text.data() + begin, end - begin);
+            begin = end + 1;
+            continue;
+        }
+
+        while (end < text.size() && std::isdigit(static_cast<unsigned char>(text[end])))
+            index = index * 10 + (text[end++] - '0');
+
+        out_.write(text.data() + begin, marker - begin);
+        out_ << tmp_name_ << first_tmp + index;
+        begin = end;
+    }
+
+    out_.write(text.data() + begin, text.size() - begin);
+}
+
+// Workers take statements in source order, but stay at most a few
+// statements per job ahead of the writer, which keeps the number of
+// buffered translations bounded.
+void TacCompilerVisitor::CompileParallel(const AstNode& program) {
+    struct Unit {
+        std::string text;
+        size_t temps = 0;
+        std::exception_ptr error;
+        bool done = false;
+    };
+
+    const size_t window = jobs_ * 4;
+    std::vector<AstNodeId> stmts;
+
+    for (size_t i = 0; i < program.child_count; i++)
+        stmts.push_back(ast_->Child(program, i));
+
+    std::vector<Unit> units(stmts.size());
+    std::mutex mutex;
+    std::condition_variable unit_done;
+    std::condition_variable unit_written;
+    size_t next = 0;
+    size_t written = 0;
+    bool failed = false;
+
+    auto worker = [&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        while (true) {
+            unit_written.wait(lock, [&]() { return failed || next >= stmts.size() || next < written + window; });
+
+            if (failed || next >= stmts.size())
+                return;
+
+            size_t index = next++;
+            lock.unlock();
+
+            std::ostringstream buffer;
+            TacCompilerVisitor compiler(buffer, std::string(1, unit_tmp_marker_));
+            Unit unit;
+
+            compiler.ast_ = ast_;
+
+            try {
+                compiler.CompileStatement(stmts[index]);
+                unit.text = buffer.str();
+                unit.temps = compiler.tmp_counter_;
+            } catch (...) {
+                unit.error = std::current_exception();
+            }
+
+            unit.done = true;
+
+            lock.lock();
+            units[index] = std::move(unit);
+            unit_done.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+
+    for (size_t i = 0; i < std::min(jobs_, stmts.size()); i++)
+        threads.emplace_back(worker);
+
+    std::exception_ptr error;
+
+    for (size_t i = 0; i < stmts.size() && !error; i++) {
+        Unit unit;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            unit_done.wait(lock, [&]() { return units[i].done; });
+            unit = std::move(units[i]);
+            units[i] = Unit();
+            written = i + 1;
+            failed = unit.error != nullptr;
+            unit_written.notify_all();
+        }
 
-    for (auto child : context->children) {
-        if (child->getText() == ";") continue;
+        error = unit.error;
 
-        data = std::any_cast<TranslationData>(visit(child));
-        break;
+        if (!error) {
+            WriteRenumbered(unit.text, tmp_counter_);
+            tmp_counter_ += unit.temps;
+        }
     }
 
-    return TranslationData(data.first, data.second);
+    for (std::thread& thread : threads)
+        thread.join();
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+std::any TacCompilerVisitor::visitProgram(const AstNode& node) {
+    DEBUG_BEGIN(out_, BLAISE_BEGIN_COUT);
+
+    if (jobs_ > 1) {
+        CompileParallel(node);
+    } else {
+        for (size_t i = 0; i < node.child_count; i++)
+            CompileStatement(ast_->Child(node, i));
+    }
+
+    out_.flush();
+
+    return {};
 }
 
-std::any TacCompilerVisitor::visitFunctionDefinition(BlaiseParser::FunctionDefinitionContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
-    TranslationData stmt_data = std::any_cast<TranslationData>(visit(context->stmt()));
+// The functions of imported modules are joined into the program before
+// it is compiled, nothing is left to translate
+std::any TacCompilerVisitor::visitImportStmt(const AstNode& node) {
+    DEBUG_BEGIN(out_, BLAISE_BEGIN_COUT);
+    return TranslationData();
+}
+
+std::any TacCompilerVisitor::visitFunctionDefinition(const AstNode& node) {
+    DEBUG_BEGIN(out_, BLAISE_BEGIN_COUT);
+    TranslationData stmt_data = std::any_cast<TranslationData>(visit(ast_->Child(node, node.child_count - 1)));
+    std::string params;
+
+    for (size_t i = 0; i + 1 < node.child_count; i++)
+        params += (i > 0 ? ", " : "") + ast_->Text(ast_->Node(ast_->Child(node, i)));
 
-    return TranslationData("", context->FUNCTION()->toString() + " " + context->IDENTIFIER()->toString() + '('
-           + (context->param_list() ? std::any_cast<std::string>(visit(context->param_list())) : "")
+    return TranslationData("", "function " + ast_->Text(node) + '('
+           + params
            + ')'
            + stmt_data.first + stmt_data.second);
 }
 
-std::any TacCompilerVisitor::visitFunctionCall(BlaiseParser::FunctionCallContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
+std::any TacCompilerVisitor::visitFunctionCall(const AstNode& node) {
+    DEBUG_BEGIN(out_, BLAISE_BEGIN_COUT);
     std::string expr_str;
     std::string dependencies;
 
-    if (context->arg_list()) {
-        auto ret = std::any_cast<std::pair<std::string, std::string>>(visit(context->arg_list()));
+    if (node.child_count > 0) {
+        auto ret = std::any_cast<std::pair<std::string, std::string>>(ArgList(node, 0));
         dependencies = ret.first;
         expr_str = ret.second;
     }
 
     return TranslationData(std::move(dependencies),
-                           std::move(context->IDENTIFIER()->toString()
+                           std::move(ast_->Text(node)
                                     + '('
                                     + (expr_str)
                                     + ')'));
 }
 
-std::any TacCompilerVisitor::visitParamListComma(BlaiseParser::ParamListCommaContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
-    return context->IDENTIFIER()->toString() + ", " + std::any_cast<std::string>(visit(context->param_list()));
-}
+std::any TacCompilerVisitor::ArgList(const AstNode& call, size_t index) {
+    DEBUG_BEGIN(out_, BLAISE_BEGIN_COUT);
+    const AstNode& arg = ast_->Node(ast_->Child(call, index));
 
-std::any TacCompilerVisitor::visitParamListEnd(BlaiseParser::ParamListEndContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
-    return context->IDENTIFIER()->toString();
-}
+    if (index + 1 == call.child_count) {
+        if (arg.kind == AST_NODE_KIND::OPERAND_ID)
+            return TranslationData("", ast_->Text(arg));
+
+        TranslationData expr_data = std::any_cast<TranslationData>(visit(ast_->Child(call, index)));
+        return expr_data;
+    }
 
-std::any TacCompilerVisitor::visitArgListComma(BlaiseParser::ArgListCommaContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
     std::string ret;
     TranslationData expr_data;
     std::string dependencies;
 
-    auto [dependencies_next, expr_str_next] = std::any_cast<TranslationData>(visit(context->arg_list()));
+    auto [dependencies_next, expr_str_next] = std::any_cast<TranslationData>(ArgList(call, index + 1));
 
     dependencies += (dependencies_next.empty() ? "" : dependencies_next + ";\n");
 
-    if (context->IDENTIFIER())
-        ret += context->IDENTIFIER()->toString() + ", " + expr_str_next;
+    if (arg.kind == AST_NODE_KIND::OPERAND_ID)
+        ret += ast_->Text(arg) + ", " + expr_str_next;
     else {
-        expr_data = std::any_cast<TranslationData>(visit(context->expr()));
+        expr_data = std::any_cast<TranslationData>(visit(ast_->Child(call, index)));
         dependencies += InsertTemporaryVariables(expr_data.second);
         ret += expr_data.second + ", " + expr_str_next;
     }
@@ -121,21 +309,12 @@ std::any TacCompilerVisitor::visitArgListComma(BlaiseParser::ArgListCommaContext
     return TranslationData(std::move(dependencies), std::move(ret));
 }
 
-std::any TacCompilerVisitor::visitArgListEnd(BlaiseParser::ArgListEndContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
-    if (context->IDENTIFIER())
-        return TranslationData("", context->IDENTIFIER()->toString());
-
-    TranslationData expr_data = std::any_cast<TranslationData>(visit(context->expr()));
-    return expr_data;
-}
-
-std::any TacCompilerVisitor::visitCodeBlock(BlaiseParser::CodeBlockContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
+std::any TacCompilerVisitor::visitCodeBlock(const AstNode& node) {
+    DEBUG_BEGIN(out_, BLAISE_BEGIN_COUT);
     std::string ret = "begin\n";
 
-    for (auto stmt : context->stmt()) {
-        TranslationData data = std::any_cast<TranslationData>(visit(stmt));
+    for (size_t i = 0; i < node.child_count; i++) {
+        TranslationData data = std::any_cast<TranslationData>(visit(ast_->Child(node, i)));
         ret += data.first  + NEWLINE_IF(!data.first.empty())
             +  data.second + NEWLINE_IF(!data.second.empty());
     }
@@ -143,10 +322,10 @@ std::any TacCompilerVisitor::visitCodeBlock(BlaiseParser::CodeBlockContext *cont
     return TranslationData("", ret + "end");
 }
 
-std::any TacCompilerVisitor::visitReturnStmt(BlaiseParser::ReturnStmtContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
+std::any TacCompilerVisitor::visitReturnStmt(const AstNode& node) {
+    DEBUG_BEGIN(out_, BLAISE_BEGIN_COUT);
 
-    TranslationData expr_data = std::any_cast<TranslationData>(visit(context->expr()));
+    TranslationData expr_data = std::any_cast<TranslationData>(visit(ast_->Child(node, 0)));
     std::string insertions = InsertTemporaryVariables(expr_data.second);
     std::string dependencies = expr_data.first + NEWLINE_IF(!insertions.empty() && !expr_data.first.empty())
                              + insertions;
@@ -154,10 +333,10 @@ std::any TacCompilerVisitor::visitReturnStmt(BlaiseParser::ReturnStmtContext *co
     return TranslationData(dependencies, "return " + expr_data.second);
 }
 
-std::any TacCompilerVisitor::visitWritelnStmt(BlaiseParser::WritelnStmtContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
+std::any TacCompilerVisitor::visitWritelnStmt(const AstNode& node) {
+    DEBUG_BEGIN(out_, BLAISE_BEGIN_COUT);
 
-    TranslationData expr_data = std::any_cast<TranslationData>(visit(context->expr()));
+    TranslationData expr_data = std::any_cast<TranslationData>(visit(ast_->Child(node, 0)));
 
     std::string insertions = InsertTemporaryVariables(expr_data.second);
 
@@ -167,15 +346,17 @@ std::any TacCompilerVisitor::visitWritelnStmt(BlaiseParser::WritelnStmtContext *
                              "writeln(" + expr_data.second + ')');
 }
 
-std::any TacCompilerVisitor::visitIfStmtBlock(BlaiseParser::IfStmtBlockContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
+std::any TacCompilerVisitor::visitIfStmt(const AstNode& node) {
+    DEBUG_BEGIN(out_, BLAISE_BEGIN_COUT);
     std::string ret;
-    TranslationData expr_data = std::any_cast<TranslationData>(visit(context->expr()));
-    TranslationData stmt_data = std::any_cast<TranslationData>(visit(context->stmt()));
+    TranslationData expr_data = std::any_cast<TranslationData>(visit(ast_->Child(node, 0)));
+    TranslationData stmt_data = std::any_cast<TranslationData>(visit(ast_->Child(node, 1)));
     TranslationData else_data;
 
-    if (context->else_stmt())
-        else_data = std::any_cast<TranslationData>(visit(context->else_stmt()));
+    if (node.child_count > 2) {
+        else_data = std::any_cast<TranslationData>(visit(ast_->Child(node, 2)));
+        else_data.second = "else " + else_data.second;
+    }
 
     std::string dependencies = InsertTemporaryVariables(expr_data.second);
 
@@ -190,18 +371,11 @@ std::any TacCompilerVisitor::visitIfStmtBlock(BlaiseParser::IfStmtBlockContext *
     return TranslationData(dependencies, ret);
 }
 
-std::any TacCompilerVisitor::visitElseStmtBlock(BlaiseParser::ElseStmtBlockContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
-    TranslationData data = std::any_cast<TranslationData>(visit(context->stmt()));
-
-    return TranslationData(data.first, "else " + data.second);
-}
-
-std::any TacCompilerVisitor::visitLoopStmt(BlaiseParser::LoopStmtContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
-    std::string expr_str = context->expr()->getText();
-    TranslationData data = (context->stmt() ? std::any_cast<TranslationData>(visit(context->stmt()))
-                                            : TranslationData());
+std::any TacCompilerVisitor::visitLoopStmt(const AstNode& node) {
+    DEBUG_BEGIN(out_, BLAISE_BEGIN_COUT);
+    std::string expr_str = ExprText(ast_->Child(node, 0));
+    TranslationData data = (node.child_count > 1 ? std::any_cast<TranslationData>(visit(ast_->Child(node, 1)))
+                                                 : TranslationData());
 
 
     return TranslationData(data.first, "loop if (" + expr_str
@@ -210,23 +384,23 @@ std::any TacCompilerVisitor::visitLoopStmt(BlaiseParser::LoopStmtContext *contex
                              : ";"));
 }
 
-std::any TacCompilerVisitor::visitAssignStmt(BlaiseParser::AssignStmtContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
-    std::any expr = visit(context->expr());
+std::any TacCompilerVisitor::visitAssignStmt(const AstNode& node) {
+    DEBUG_BEGIN(out_, BLAISE_BEGIN_COUT);
+    std::any expr = visit(ast_->Child(node, 0));
     TranslationData expr_data = std::any_cast<TranslationData>(expr);
     std::string insertions = InsertTemporaryVariables(expr_data.second);
 
     return TranslationData(expr_data.first
                            + NEWLINE_IF(!insertions.empty() && !expr_data.first.empty())
                            + insertions,
-                             std::string(context->IDENTIFIER()->toString() + " = " + expr_data.second));
+                             std::string(ast_->Text(node) + " = " + expr_data.second));
 }
 
-std::any TacCompilerVisitor::visitExprOperation(BlaiseParser::ExprOperationContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
-    const TranslationData operand_data = std::any_cast<TranslationData>(visit(context->operand()));
-    const std::string& operator_str = std::any_cast<std::string>(visit(context->operator_()));
-    const TranslationData expr_data = std::any_cast<TranslationData>(visit(context->expr()));
+std::any TacCompilerVisitor::visitExprOperation(const AstNode& node) {
+    DEBUG_BEGIN(out_, BLAISE_BEGIN_COUT);
+    const TranslationData operand_data = std::any_cast<TranslationData>(visit(ast_->Child(node, 0)));
+    const std::string operator_str = std::string(" ") + OperatorText(node.operation) + " ";
+    const TranslationData expr_data = std::any_cast<TranslationData>(visit(ast_->Child(node, 1)));
 
     std::list<BlaiseVariable *> dependencies;
 
@@ -249,121 +423,72 @@ std::any TacCompilerVisitor::visitExprOperation(BlaiseParser::ExprOperationConte
                             block_.variables.back().Name());
 }
 
-std::any TacCompilerVisitor::visitExprUnaryMinusOperation(BlaiseParser::ExprUnaryMinusOperationContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
-    TranslationData op_data = std::any_cast<TranslationData>(visit(context->operand()));
-    const std::string& operator_str = context->MINUS()->toString();
+std::any TacCompilerVisitor::visitExprUnaryMinusOperation(const AstNode& node) {
+    DEBUG_BEGIN(out_, BLAISE_BEGIN_COUT);
+    TranslationData op_data = std::any_cast<TranslationData>(visit(ast_->Child(node, 0)));
 
     block_.variables.emplace_back(GetTempVariableName(),
-            TemporaryVariableInfo{ " = " + operator_str + op_data.second, {} }
+            TemporaryVariableInfo{ " = -" + op_data.second, {} }
         );
 
     return TranslationData(op_data.first, block_.variables.back().Name());
 }
 
-std::any TacCompilerVisitor::visitExprUnaryPlusOperation(BlaiseParser::ExprUnaryPlusOperationContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
-    TranslationData op_data = std::any_cast<TranslationData>(visit(context->operand()));
-    const std::string& operator_str = context->PLUS()->toString();
+std::any TacCompilerVisitor::visitExprUnaryPlusOperation(const AstNode& node) {
+    DEBUG_BEGIN(out_, BLAISE_BEGIN_COUT);
+    TranslationData op_data = std::any_cast<TranslationData>(visit(ast_->Child(node, 0)));
 
     block_.variables.emplace_back(GetTempVariableName(),
-            TemporaryVariableInfo{ " = " + operator_str + op_data.second, {} }
+            TemporaryVariableInfo{ " = +" + op_data.second, {} }
         );
 
     return TranslationData(op_data.first, block_.variables.back().Name());
 }
 
-std::any TacCompilerVisitor::visitExprOperand(BlaiseParser::ExprOperandContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
-    return visit(context->operand());
-}
-
-std::any TacCompilerVisitor::visitOperandBoolean(BlaiseParser::OperandBooleanContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
-    return TranslationData("", context->BOOLEAN()->toString());
-}
-
-std::any TacCompilerVisitor::visitOperandInt(BlaiseParser::OperandIntContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
-    return TranslationData("", context->INT()->toString());
-}
-
-std::any TacCompilerVisitor::visitOperandDouble(BlaiseParser::OperandDoubleContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
-    return TranslationData("", context->DOUBLE()->toString());
-}
-
-std::any TacCompilerVisitor::visitOperandChar(BlaiseParser::OperandCharContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
-    return TranslationData("", context->CHAR()->toString());
+std::any TacCompilerVisitor::visitOperandBoolean(const AstNode& node) {
+    DEBUG_BEGIN(out_, BLAISE_BEGIN_COUT);
+    return TranslationData("", ast_->Text(node));
 }
 
-std::any TacCompilerVisitor::visitOperandString(BlaiseParser::OperandStringContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
-    return TranslationData("", context->STRING()->toString());
+std::any TacCompilerVisitor::visitOperandInt(const AstNode& node) {
+    DEBUG_BEGIN(out_, BLAISE_BEGIN_COUT);
+    return TranslationData("", ast_->Text(node));
 }
 
-std::any TacCompilerVisitor::visitOperandId(BlaiseParser::OperandIdContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
-    return TranslationData("", context->IDENTIFIER()->toString());
+std::any TacCompilerVisitor::visitOperandDouble(const AstNode& node) {
+    DEBUG_BEGIN(out_, BLAISE_BEGIN_COUT);
+    return TranslationData("", ast_->Text(node));
 }
 
-std::any TacCompilerVisitor::visitOperandFunctionCall(BlaiseParser::OperandFunctionCallContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
-    return visit(context->function_call());
+std::any TacCompilerVisitor::visitOperandChar(const AstNode& node) {
+    DEBUG_BEGIN(out_, BLAISE_BEGIN_COUT);
+    return TranslationData("", EscapedText(node));
 }
 
-std::any TacCompilerVisitor::visitOperandExpr(BlaiseParser::OperandExprContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
-    return visit(context->expr());
+std::any TacCompilerVisitor::visitOperandString(const AstNode& node) {
+    DEBUG_BEGIN(out_, BLAISE_BEGIN_COUT);
+    return TranslationData("", EscapedText(node));
 }
 
-std::any TacCompilerVisitor::visitOperatorPlus(BlaiseParser::OperatorPlusContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
-    return std::string(" " + context->PLUS()->toString() + " ");
+std::any TacCompilerVisitor::visitOperandId(const AstNode& node) {
+    DEBUG_BEGIN(out_, BLAISE_BEGIN_COUT);
+    return TranslationData("", ast_->Text(node));
 }
 
-std::any TacCompilerVisitor::visitOperatorMinus(BlaiseParser::OperatorMinusContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
-    return std::string(" " + context->MINUS()->toString() + " ");
+// Arrays and maps live in the interpreter only
+std::any TacCompilerVisitor::visitIndexAssignStmt(const AstNode& node) {
+    throw std::invalid_argument("Arrays and maps are only supported by interp");
 }
 
-std::any TacCompilerVisitor::visitOperatorAster(BlaiseParser::OperatorAsterContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
-    return std::string(" " + context->ASTERISK()->toString() + " ");
+std::any TacCompilerVisitor::visitOperandArray(const AstNode& node) {
+    throw std::invalid_argument("Arrays are only supported by interp");
 }
 
-std::any TacCompilerVisitor::visitOperatorSlash(BlaiseParser::OperatorSlashContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
-    return std::string(" " + context->SLASH()->toString() + " ");
+std::any TacCompilerVisitor::visitOperandIndex(const AstNode& node) {
+    throw std::invalid_argument("Arrays and maps are only supported by interp");
 }
 
-std::any TacCompilerVisitor::visitOperatorEqual(BlaiseParser::OperatorEqualContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
-    return std::string(" " + context->EQUAL()->toString() + " ");
+std::any TacCompilerVisitor::visitOperandExpr(const AstNode& node) {
+    DEBUG_BEGIN(out_, BLAISE_BEGIN_COUT);
+    return visit(ast_->Child(node, 0));
 }
-
-std::any TacCompilerVisitor::visitOperatorNEqual(BlaiseParser::OperatorNEqualContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
-    return std::string(" " + context->NOT_EQUAL()->toString() + " ");
-}
-
-std::any TacCompilerVisitor::visitOperatorLess(BlaiseParser::OperatorLessContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
-    return std::string(" " + context->LESS()->toString() + " ");
-}
-
-std::any TacCompilerVisitor::visitOperatorLEqual(BlaiseParser::OperatorLEqualContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
-    return std::string(" " + context->LESS_OR_EQUAL()->toString() + " ");
-}
-
-std::any TacCompilerVisitor::visitOperatorGreater(BlaiseParser::OperatorGreaterContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
-    return std::string(" " + context->GREATER()->toString() + " ");
-}
-
-std::any TacCompilerVisitor::visitOperatorGEqual(BlaiseParser::OperatorGEqualContext *context) {
-    DEBUG_BEGIN(BLAISE_BEGIN_COUT);
-    return std::string(" " + context->GREATER_OR_EQUAL()->toString() + " ");
-}
\ No newline at end of file
@@ -1,9 +1,23 @@
 #pragma once
 
-#include "antlr/BlaiseBaseVisitor.h"
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "BlaiseAst.h"
 #include "BlaiseClasses.h"
 
-class TacCompilerVisitor : public BlaiseBaseVisitor {
+// Translates a program into textual TAC. Each top-level statement is
+// written to the output stream as soon as it is translated, and the
+// temporaries it declared are dropped, so memory use is bounded by the
+// largest single statement instead of the whole program.
+//
+// With more than one job, top-level statements (function definitions in
+// particular) are translated on a pool of threads, each by its own
+// visitor with its own temporaries. Their temporaries are numbered from
+// zero behind a marker and renumbered when the results are written in
+// source order, so the output is the same for any number of jobs.
+class TacCompilerVisitor : public BlaiseAstVisitor {
 private:
 
     struct TemporaryVariableInfo {
@@ -11,89 +25,87 @@ private:
         std::list<BlaiseVariable *> dependencies;
     };
 
+    static constexpr char unit_tmp_marker_ = '\x01';
+
     const std::string tmp_name_ = "__BlaiseCompilerTmp_t";
     mutable size_t tmp_counter_ = 0;
     BlaiseBlock block_;
+    std::ostream& out_;
+    size_t jobs_ = 1;
 
 private:
 
+    TacCompilerVisitor(std::ostream& out, const std::string& tmp_name);
+
     std::string GetTempVariableName() const;
 
     std::string InsertTemporaryVariables(const std::string& last_tmp);
 
-public:
-
-    virtual std::any visitProgram(BlaiseParser::ProgramContext *context) override;
-
-    virtual std::any visitStmt(BlaiseParser::StmtContext *context) override;
+    // Arguments of call from index on, in the order the nested arg_list
+    // rule of the grammar translated them: the rest of the list first
+    std::any ArgList(const AstNode& call, size_t index);
 
-    virtual std::any visitFunctionDefinition(BlaiseParser::FunctionDefinitionContext *context) override;
+    // Source text of an expression without whitespace, as in the input
+    std::string ExprText(AstNodeId expr) const;
 
-    virtual std::any visitFunctionCall(BlaiseParser::FunctionCallContext *context) override;
+    // Source text of node, with the temporary marker doubled when this
+    // compiles a statement for CompileParallel, so that a marker in a
+    // literal does not read as a temporary
+    std::string EscapedText(const AstNode& node) const;
 
-    virtual std::any visitParamListComma(BlaiseParser::ParamListCommaContext *context) override;
+    void CompileStatement(AstNodeId stmt);
 
-    virtual std::any visitParamListEnd(BlaiseParser::ParamListEndContext *context) override;
+    void CompileParallel(const AstNode& program);
 
-    virtual std::any visitArgListComma(BlaiseParser::ArgListCommaContext *context) override;
+    void WriteRenumbered(const std::string& text, size_t first_tmp);
 
-    virtual std::any visitArgListEnd(BlaiseParser::ArgListEndContext *context) override;
-
-    virtual std::any visitCodeBlock(BlaiseParser::CodeBlockContext *context) override;
-
-    virtual std::any visitReturnStmt(BlaiseParser::ReturnStmtContext *context) override;
-
-    virtual std::any visitWritelnStmt(BlaiseParser::WritelnStmtContext *context) override;
-
-    virtual std::any visitIfStmtBlock(BlaiseParser::IfStmtBlockContext *context) override;
-
-    virtual std::any visitElseStmtBlock(BlaiseParser::ElseStmtBlockContext *context) override;
+public:
 
-    virtual std::any visitLoopStmt(BlaiseParser::LoopStmtContext *context) override;
+    explicit TacCompilerVisitor(std::ostream& out, size_t jobs = 1);
 
-    virtual std::any visitAssignStmt(BlaiseParser::AssignStmtContext *context) override;
+    virtual std::any visitProgram(const AstNode& node) override;
 
-    virtual std::any visitExprOperation(BlaiseParser::ExprOperationContext *context) override;
+    virtual std::any visitImportStmt(const AstNode& node) override;
 
-    virtual std::any visitExprUnaryMinusOperation(BlaiseParser::ExprUnaryMinusOperationContext *context) override;
+    virtual std::any visitFunctionDefinition(const AstNode& node) override;
 
-    virtual std::any visitExprUnaryPlusOperation(BlaiseParser::ExprUnaryPlusOperationContext *context) override;
+    virtual std::any visitFunctionCall(const AstNode& node) override;
 
-    virtual std::any visitExprOperand(BlaiseParser::ExprOperandContext *context) override;
+    virtual std::any visitCodeBlock(const AstNode& node) override;
 
-    virtual std::any visitOperandBoolean(BlaiseParser::OperandBooleanContext *context) override;
+    virtual std::any visitReturnStmt(const AstNode& node) override;
 
-    virtual std::any visitOperandInt(BlaiseParser::OperandIntContext *context) override;
+    virtual std::any visitWritelnStmt(const AstNode& node) override;
 
-    virtual std::any visitOperandDouble(BlaiseParser::OperandDoubleContext *context) override;
+    virtual std::any visitIfStmt(const AstNode& node) override;
 
-    virtual std::any visitOperandChar(BlaiseParser::OperandCharContext *context) override;
+    virtual std::any visitLoopStmt(const AstNode& node) override;
 
-    virtual std::any visitOperandString(BlaiseParser::OperandStringContext *context) override;
+    virtual std::any visitAssignStmt(const AstNode& node) override;
 
-    virtual std::any visitOperandId(BlaiseParser::OperandIdContext *context) override;
+    virtual std::any visitIndexAssignStmt(const AstNode& node) override;
 
-    virtual std::any visitOperandFunctionCall(BlaiseParser::OperandFunctionCallContext *context) override;
+    virtual std::any visitExprOperation(const AstNode& node) override;
 
-    virtual std::any visitOperandExpr(BlaiseParser::OperandExprContext *context) override;
+    virtual std::any visitExprUnaryMinusOperation(const AstNode& node) override;
 
-    virtual std::any visitOperatorPlus(BlaiseParser::OperatorPlusContext *context) override;
+    virtual std::any visitExprUnaryPlusOperation(const AstNode& node) override;
 
-    virtual std::any visitOperatorMinus(BlaiseParser::OperatorMinusContext *context) override;
+    virtual std::any visitOperandBoolean(const AstNode& node) override;
 
-    virtual std::any visitOperatorAster(BlaiseParser::OperatorAsterContext *context) override;
+    virtual std::any visitOperandInt(const AstNode& node) override;
 
-    virtual std::any visitOperatorSlash(BlaiseParser::OperatorSlashContext *context) override;
+    virtual std::any visitOperandDouble(const AstNode& node) override;
 
-    virtual std::any visitOperatorEqual(BlaiseParser::OperatorEqualContext *context) override;
+    virtual std::any visitOperandChar(const AstNode& node) override;
 
-    virtual std::any visitOperatorNEqual(BlaiseParser::OperatorNEqualContext *context) override;
+    virtual std::any visitOperandString(const AstNode& node) override;
 
-    virtual std::any visitOperatorLess(BlaiseParser::OperatorLessContext *context) override;
+    virtual std::any visitOperandId(const AstNode& node) override;
 
-    virtual std::any visitOperatorLEqual(BlaiseParser::OperatorLEqualContext *context) override;
+    virtual std::any visitOperandArray(const AstNode& node) override;
 
-    virtual std::any visitOperatorGreater(BlaiseParser::OperatorGreaterContext *context) override;
+    virtual std::any visitOperandIndex(const AstNode& node) override;
 
-    virtual std::any visitOperatorGEqual(BlaiseParser::OperatorGEqualContext *context) override;
+    virtual std::any visitOperandExpr(const AstNode& node) override;
 };
\ No newline at end of file
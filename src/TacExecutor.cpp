@@ -0,0 +1,251 @@
+#include <any>
+#include <stdexcept>
+#include <string>
+
+#include "TacExecutor.h"
+#include "Util.h"
+
+static constexpr size_t NOT_DEFINED = static_cast<size_t>(-1);
+
+// Value of globals, and of the locals of functions that check them,
+// until they are assigned. Only CHECK and ASSIGNED instructions look for
+// it, the rest of the code never reads a slot that may still hold it.
+struct Unassigned {};
+
+static const BlaiseVariable UNASSIGNED{ std::any(Unassigned()) };
+
+TacExecutor::TacExecutor(const TacProgram& program, std::ostream& out)
+                : program_(program), out_(out) {}
+
+const BlaiseVariable& TacExecutor::Read(const TacOperand& operand) const {
+    static const BlaiseVariable nothing;
+
+    switch (operand.kind) {
+        case TAC_OPERAND_KIND::CONSTANT:
+            return program_.constants[operand.index];
+        case TAC_OPERAND_KIND::GLOBAL:
+            return globals_[operand.index];
+        case TAC_OPERAND_KIND::LOCAL:
+            return stack_[base_ + operand.index];
+        case TAC_OPERAND_KIND::TEMP:
+            return stack_[temp_base_ + operand.index];
+        case TAC_OPERAND_KIND::NONE:
+            break;
+    }
+
+    return nothing;
+}
+
+BlaiseVariable& TacExecutor::Write(const TacOperand& operand) {
+    switch (operand.kind) {
+        case TAC_OPERAND_KIND::GLOBAL:
+            return globals_[operand.index];
+        case TAC_OPERAND_KIND::LOCAL:
+            return stack_[base_ + operand.index];
+        case TAC_OPERAND_KIND::TEMP:
+            return stack_[temp_base_ + operand.index];
+        default:
+            break;
+    }
+
+    throw std::invalid_argument("Invalid TAC destination operand");
+}
+
+void TacExecutor::EnterFrame(const TacFunction& func) {
+    base_ = stack_.size();
+    temp_base_ = base_ + func.locals.size();
+
+    if (checks_locals_[&func - program_.functions.data()]) {
+        stack_.resize(base_ + func.param_count);
+        stack_.resize(temp_base_, UNASSIGNED);
+    }
+
+    stack_.resize(base_ + func.FrameSize());
+}
+
+void TacExecutor::Run() {
+    // writeln does not flush on every line, so make sure whatever was
+    // printed before a runtime error reaches the output.
+    try {
+        Execute();
+    } catch (...) {
+        out_.flush();
+        throw;
+    }
+
+    out_.flush();
+}
+
+void TacExecutor::Execute() {
+    globals_.clear();
+    stack_.clear();
+    args_.clear();
+    frames_.clear();
+
+    for (const auto& name : program_.globals)
+        globals_.emplace_back(name, UNASSIGNED.Value());
+
+    defined_.assign(program_.function_names.size(), NOT_DEFINED);
+    checks_locals_.assign(program_.functions.size(), false);
+
+    for (size_t f = 0; f < program_.functions.size(); f++) {
+        for (const TacInstruction& instr : program_.functions[f].code) {
+            if ((instr.op == TAC_OP_ID::CHECK || instr.op == TAC_OP_ID::ASSIGNED)
+                && instr.arg1.kind == TAC_OPERAND_KIND::LOCAL)
+                checks_locals_[f] = true;
+        }
+    }
+
+    const TacFunction *func = &program_.functions[TacProgram::MAIN_FUNCTION];
+    size_t pc = 0;
+
+    EnterFrame(*func);
+
+    while (true) {
+        const TacInstruction& instr = func->code[pc++];
+
+        switch (instr.op) {
+            case TAC_OP_ID::COPY:
+                Write(instr.result).Assign(Read(instr.arg1));
+                break;
+            case TAC_OP_ID::BINARY: {
+                const BlaiseVariable& lhs = Read(instr.arg1);
+                const BlaiseVariable& rhs = Read(instr.arg2);
+
+                switch (instr.operation) {
+                    case BLAISE_OP_ID::PLUS:    Write(instr.result).Assign(lhs + rhs);  break;
+                    case BLAISE_OP_ID::MINUS:   Write(instr.result).Assign(lhs - rhs);  break;
+                    case BLAISE_OP_ID::MUL:     Write(instr.result).Assign(lhs * rhs);  break;
+                    case BLAISE_OP_ID::DIV:     Write(instr.result).Assign(lhs / rhs);  break;
+                    case BLAISE_OP_ID::EQUAL:   Write(instr.result).Assign(lhs == rhs); break;
+                    case BLAISE_OP_ID::NEQUAL:  Write(instr.result).Assign(lhs != rhs); break;
+                    case BLAISE_OP_ID::LESS:    Write(instr.result).Assign(lhs < rhs);  break;
+                    case BLAISE_OP_ID::LEQUAL:  Write(instr.result).Assign(lhs <= rhs); break;
+                    case BLAISE_OP_ID::GREATER: Write(instr.result).Assign(lhs > rhs);  break;
+                    case BLAISE_OP_ID::GEQUAL:  Write(instr.result).Assign(lhs >= rhs); break;
+                }
+                break;
+            }
+            case TAC_OP_ID::UNARY_MINUS:
+                Write(instr.result).Assign(-Read(instr.arg1));
+                break;
+            case TAC_OP_ID::UNARY_PLUS:
+                Write(instr.result).Assign(+Read(instr.arg1));
+                break;
+            case TAC_OP_ID::GOTO:
+                pc = instr.label;
+                break;
+            case TAC_OP_ID::IF_FALSE_GOTO:
+            case TAC_OP_ID::IF_TRUE_GOTO: {
+                const BlaiseVariable& condition = Read(instr.arg1);
+
+                if (!condition.Is<bool>())
+                    throw std::invalid_argument("If statement expression must be boolean!");
+
+                if (condition.Value<bool>() == (instr.op == TAC_OP_ID::IF_TRUE_GOTO))
+                    pc = instr.label;
+                break;
+            }
+            case TAC_OP_ID::LOOP_FALSE_GOTO:
+            case TAC_OP_ID::LOOP_TRUE_GOTO: {
+                const BlaiseVariable& condition = Read(instr.arg1);
+
+                if (!condition.Is<bool>())
+                    throw std::invalid_argument("Loop if statement expression must be boolean!");
+
+                if (condition.Value<bool>() == (instr.op == TAC_OP_ID::LOOP_TRUE_GOTO))
+                    pc = instr.label;
+                break;
+            }
+            case TAC_OP_ID::PARAM:
+                args_.push_back(Read(instr.arg1));
+                break;
+            case TAC_OP_ID::CALL: {
+                const std::string& name = program_.function_names[instr.label];
+                size_t callee_id = defined_[instr.label];
+
+                if (callee_id == NOT_DEFINED)
+                    throw std::invalid_argument("Function " + name + " has not been defined!");
+
+                const TacFunction& callee = program_.functions[callee_id];
+
+                if (instr.count != callee.param_count)
+                    throw std::invalid_argument("Wrong amount of aguments for function " + name);
+
+                frames_.push_back({ func, pc, base_, instr.result });
+                EnterFrame(callee);
+
+                size_t first_arg = args_.size() - instr.count;
+                for (size_t i = 0; i < instr.count; i++)
+                    stack_[base_ + i].Assign(args_[first_arg + i]);
+                args_.resize(first_arg);
+
+                func = &callee;
+                pc = 0;
+                break;
+            }
+            case TAC_OP_ID::RETURN: {
+                if (frames_.empty())
+                    throw std::invalid_argument("Return statement is not allowed outside of functions");
+
+                BlaiseVariable value = Read(instr.arg1);
+                Frame caller = frames_.back();
+                frames_.pop_back();
+
+                stack_.resize(base_);
+                func = caller.func;
+                pc = caller.pc;
+                base_ = caller.base;
+                temp_base_ = base_ + func->locals.size();
+
+                Write(caller.result).Assign(value);
+                break;
+            }
+            case TAC_OP_ID::WRITELN:
+                out_ << (DEBUG ? "writeln: " : "") << Read(instr.arg1).ToString() << '\n';
+                break;
+            case TAC_OP_ID::CHECK:
+                if (Read(instr.arg1).Is<Unassigned>()) {
+                    const std::string& name = instr.arg1.kind == TAC_OPERAND_KIND::GLOBAL
+                                            ? program_.globals[instr.arg1.index]
+                                            : func->locals[instr.arg1.index];
+
+                    throw std::invalid_argument("Variable " + name + " has not been defined!");
+                }
+                break;
+            case TAC_OP_ID::ASSIGNED:
+                Write(instr.result).Assign(BlaiseVariable(!Read(instr.arg1).Is<Unassigned>()));
+                break;
+            case TAC_OP_ID::UNSET:
+                if (instr.arg1.kind == TAC_OPERAND_KIND::NONE || !Read(instr.arg1).Value<bool>())
+                    Write(instr.result).Assign(UNASSIGNED);
+                break;
+            case TAC_OP_ID::SWAP: {
+                BlaiseVariable value = Read(instr.result);
+
+                Write(instr.result).Assign(Read(instr.arg1));
+                Write(instr.arg1).Assign(value);
+                break;
+            }
+            case TAC_OP_ID::DEFINE: {
+                size_t name_id = program_.functions[instr.label].name_id;
+
+                if (instr.result.kind != TAC_OPERAND_KIND::NONE)
+                    Write(instr.result).Assign(BlaiseVariable(static_cast<int>(defined_[name_id])));
+
+                defined_[name_id] = instr.label;
+                break;
+            }
+            case TAC_OP_ID::UNDEFINE:
+                defined_[program_.functions[instr.label].name_id] = static_cast<size_t>(Read(instr.arg1).Value<int>());
+                break;
+            case TAC_OP_ID::FAIL:
+                throw std::invalid_argument(Read(instr.arg1).ToString());
+            case TAC_OP_ID::ENTER:
+            case TAC_OP_ID::LEAVE:
+                break;
+            case TAC_OP_ID::HALT:
+                return;
+        }
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <iostream>
+#include <ostream>
+#include <vector>
+
+#include "BlaiseClasses.h"
+#include "TacProgram.h"
+
+// Runs a TacProgram with a flat dispatch loop. Globals live in their own
+// slot table, every call pushes a frame of locals and temps onto a single
+// value stack, so calls do not recurse on the native stack.
+class TacExecutor {
+private:
+
+    struct Frame {
+        const TacFunction *func;
+        size_t pc;
+        size_t base;
+        TacOperand result;
+    };
+
+    const TacProgram& program_;
+    std::ostream& out_;
+
+    std::vector<BlaiseVariable> globals_;
+    std::vector<BlaiseVariable> stack_;
+    std::vector<BlaiseVariable> args_;
+    std::vector<Frame> frames_;
+    std::vector<size_t> defined_;       // function name id -> function index
+    std::vector<bool> checks_locals_;   // function index -> it checks whether a local is assigned
+
+    size_t base_ = 0;
+    size_t temp_base_ = 0;
+
+private:
+
+    const BlaiseVariable& Read(const TacOperand& operand) const;
+
+    BlaiseVariable& Write(const TacOperand& operand);
+
+    void EnterFrame(const TacFunction& func);
+
+    void Execute();
+
+public:
+
+    explicit TacExecutor(const TacProgram& program, std::ostream& out = std::cout);
+
+    void Run();
+};
@@ -0,0 +1,1091 @@
+#include <algorithm>
+#include <any>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "TacLoweringVisitor.h"
+#include "BlaiseClasses.h"
+#include "Util.h"
+
+using OperandList = std::vector<TacOperand>;
+
+TacFunction& TacLoweringVisitor::CurrentFunction() {
+    return program_.functions[scopes_.back().function];
+}
+
+TacOperand TacLoweringVisitor::NewTemp() {
+    FunctionScope& scope = scopes_.back();
+    TacFunction& func = CurrentFunction();
+    TacOperand temp{ TAC_OPERAND_KIND::TEMP, scope.temp_counter++ };
+
+    func.temp_count = std::max(func.temp_count, scope.temp_counter);
+
+    return temp;
+}
+
+TacOperand TacLoweringVisitor::NewLocal(TacFunction& func, const std::string& prefix) {
+    func.locals.push_back(prefix + std::to_string(func.locals.size()));
+    return { TAC_OPERAND_KIND::LOCAL, func.locals.size() - 1 };
+}
+
+TacOperand TacLoweringVisitor::ResolveVariable(const std::string& name) {
+    const FunctionScope& scope = scopes_.back();
+    auto local = scope.locals.find(name);
+
+    if (local != scope.locals.end())
+        return { TAC_OPERAND_KIND::LOCAL, local->second };
+
+    auto iter = std::find(program_.globals.begin(), program_.globals.end(), name);
+
+    if (iter != program_.globals.end())
+        return { TAC_OPERAND_KIND::GLOBAL, static_cast<size_t>(iter - program_.globals.begin()) };
+
+    program_.globals.push_back(name);
+    return { TAC_OPERAND_KIND::GLOBAL, program_.globals.size() - 1 };
+}
+
+TacOperand TacLoweringVisitor::AddConstant(const std::string& key, const BlaiseVariable& value) {
+    auto iter = constant_ids_.find(key);
+
+    if (iter != constant_ids_.end())
+        return { TAC_OPERAND_KIND::CONSTANT, iter->second };
+
+    program_.constants.push_back(value);
+    constant_ids_.emplace(key, program_.constants.size() - 1);
+
+    return { TAC_OPERAND_KIND::CONSTANT, program_.constants.size() - 1 };
+}
+
+size_t TacLoweringVisitor::FunctionNameId(const std::string& name) {
+    auto iter = std::find(program_.function_names.begin(), program_.function_names.end(), name);
+
+    if (iter != program_.function_names.end())
+        return iter - program_.function_names.begin();
+
+    program_.function_names.push_back(name);
+    return program_.function_names.size() - 1;
+}
+
+size_t TacLoweringVisitor::Emit(const TacInstruction& instr) {
+    CurrentFunction().code.push_back(instr);
+    return CurrentFunction().code.size() - 1;
+}
+
+void TacLoweringVisitor::CollectUnit(AstNodeId id, size_t unit) {
+    const AstNode& node = ast_->Node(id);
+
+    if (node.kind == AST_NODE_KIND::FUNCTION_DEFINITION) {
+        size_t function = units_.size();
+        Unit& defined = units_.emplace_back();
+
+        for (size_t i = 0; i + 1 < node.child_count; i++)
+            defined.params.push_back(ast_->Text(ast_->Node(ast_->Child(node, i))));
+
+        defined.binds.insert(defined.params.begin(), defined.params.end());
+        unit_of_[id] = function;
+        CollectUnit(ast_->Child(node, node.child_count - 1), function);
+
+        return;
+    }
+
+    Unit& current = units_[unit];
+    bool is_param = false;
+
+    switch (node.kind) {
+        case AST_NODE_KIND::ASSIGN_STMT:
+        case AST_NODE_KIND::INDEX_ASSIGN_STMT:
+            current.binds.insert(ast_->Text(node));
+            // fallthrough
+        case AST_NODE_KIND::OPERAND_ID:
+        case AST_NODE_KIND::OPERAND_INDEX:
+            is_param = std::find(current.params.begin(), current.params.end(), ast_->Text(node))
+                    != current.params.end();
+
+            if (!is_param)
+                current.uses.insert(ast_->Text(node));
+            break;
+        case AST_NODE_KIND::FUNCTION_CALL:
+            current.calls.insert(ast_->Text(node));
+            break;
+        default:
+            break;
+    }
+
+    for (size_t i = 0; i < node.child_count; i++)
+        CollectUnit(ast_->Child(node, i), unit);
+}
+
+// Calls are bound by name at run time, so a call may reach every
+// definition of the name.
+void TacLoweringVisitor::ResolveVisibility() {
+    std::map<std::string, std::vector<size_t>> definitions;
+    std::vector<std::vector<size_t>> callees(units_.size());
+    std::vector<std::vector<size_t>> callers(units_.size());
+
+    for (const auto& [id, unit] : unit_of_) {
+        if (unit != 0)
+            definitions[ast_->Text(ast_->Node(id))].push_back(unit);
+    }
+
+    for (size_t unit = 0; unit < units_.size(); unit++) {
+        for (const std::string& name : units_[unit].calls) {
+            auto iter = definitions.find(name);
+
+            if (iter == definitions.end())
+                continue;
+
+            for (size_t callee : iter->second) {
+                callees[unit].push_back(callee);
+                callers[callee].push_back(unit);
+            }
+        }
+    }
+
+    auto reached = [&](size_t from, const std::vector<std::vector<size_t>>& edges) {
+        std::vector<bool> seen(units_.size(), false);
+        std::vector<size_t> pending = edges[from];
+        std::vector<size_t> result;
+
+        while (!pending.empty()) {
+            size_t unit = pending.back();
+            pending.pop_back();
+
+            if (seen[unit])
+                continue;
+
+            seen[unit] = true;
+            result.push_back(unit);
+            pending.insert(pending.end(), edges[unit].begin(), edges[unit].end());
+        }
+
+        return result;
+    };
+
+    for (size_t unit = 0; unit < units_.size(); unit++) {
+        for (size_t callee : reached(unit, callees))
+            units_[unit].visible.insert(units_[callee].uses.begin(), units_[callee].uses.end());
+
+        for (size_t caller : reached(unit, callers))
+            units_[unit].bound.insert(units_[caller].binds.begin(), units_[caller].binds.end());
+    }
+}
+
+void TacLoweringVisitor::CollectLocals(AstNodeId id, FunctionScope& scope) {
+    const AstNode& node = ast_->Node(id);
+    const Unit& unit = units_[scope.unit];
+
+    if (node.kind == AST_NODE_KIND::FUNCTION_DEFINITION)
+        return;
+
+    if (node.kind == AST_NODE_KIND::ASSIGN_STMT) {
+        const std::string& name = ast_->Text(node);
+        TacFunction& func = program_.functions[scope.function];
+
+        if (unit.visible.count(name) == 0 && unit.bound.count(name) == 0 && scope.locals.count(name) == 0
+            && std::find(func.locals.begin(), func.locals.end(), name) == func.locals.end()) {
+            scope.locals.emplace(name, func.locals.size());
+            func.locals.push_back(name);
+        }
+    }
+
+    for (size_t i = 0; i < node.child_count; i++)
+        CollectLocals(ast_->Child(node, i), scope);
+}
+
+void TacLoweringVisitor::EnterBlock() {
+    FunctionScope& scope = scopes_.back();
+    TacInstruction enter{ TAC_OP_ID::ENTER };
+
+    enter.label = scope.frame_counter++;
+    Emit(enter);
+    scope.blocks.push_back({ enter.label });
+}
+
+void TacLoweringVisitor::LeaveBlock() {
+    BlockScope& block = scopes_.back().blocks.back();
+    TacInstruction leave{ TAC_OP_ID::LEAVE };
+
+    for (auto iter = block.defines.rbegin(); iter != block.defines.rend(); ++iter) {
+        TacInstruction undefine{ TAC_OP_ID::UNDEFINE };
+        undefine.label = iter->first;
+        undefine.arg1 = iter->second;
+        Emit(undefine);
+    }
+
+    leave.label = block.frame;
+    Emit(leave);
+    scopes_.back().blocks.pop_back();
+}
+
+void TacLoweringVisitor::VisitInFrame(AstNodeId stmt) {
+    if (ast_->Node(stmt).kind == AST_NODE_KIND::CODE_BLOCK) {
+        VisitStmt(stmt);
+        return;
+    }
+
+    EnterBlock();
+    VisitStmt(stmt);
+    LeaveBlock();
+}
+
+void TacLoweringVisitor::EmitReturn(const TacOperand& value) {
+    const FunctionScope& scope = scopes_.back();
+    TacInstruction ret{ TAC_OP_ID::RETURN };
+    ret.arg1 = value;
+
+    // Global slots are restored on the way out
+    if (value.kind == TAC_OPERAND_KIND::GLOBAL && scope.function != TacProgram::MAIN_FUNCTION) {
+        TacInstruction copy{ TAC_OP_ID::COPY };
+        copy.result = NewTemp();
+        copy.arg1 = value;
+        ret.arg1 = copy.result;
+        Emit(copy);
+    }
+
+    for (auto block = scope.blocks.rbegin(); block != scope.blocks.rend(); ++block) {
+        for (auto iter = block->defines.rbegin(); iter != block->defines.rend(); ++iter) {
+            TacInstruction undefine{ TAC_OP_ID::UNDEFINE };
+            undefine.label = iter->first;
+            undefine.arg1 = iter->second;
+            Emit(undefine);
+        }
+    }
+
+    for (auto iter = scope.swapped.rbegin(); iter != scope.swapped.rend(); ++iter) {
+        TacInstruction swap{ TAC_OP_ID::SWAP };
+        swap.result = { TAC_OPERAND_KIND::LOCAL, iter->first };
+        swap.arg1 = { TAC_OPERAND_KIND::GLOBAL, iter->second };
+        Emit(swap);
+    }
+
+    Emit(ret);
+}
+
+static bool IsJump(TAC_OP_ID op) {
+    return op == TAC_OP_ID::GOTO
+        || op == TAC_OP_ID::IF_FALSE_GOTO || op == TAC_OP_ID::LOOP_FALSE_GOTO
+        || op == TAC_OP_ID::IF_TRUE_GOTO  || op == TAC_OP_ID::LOOP_TRUE_GOTO;
+}
+
+static bool FallsThrough(TAC_OP_ID op) {
+    return op != TAC_OP_ID::GOTO && op != TAC_OP_ID::RETURN && op != TAC_OP_ID::HALT && op != TAC_OP_ID::FAIL;
+}
+
+// Instructions whose operands are values of the program, as opposed to
+// the bookkeeping of definitions and assignedness
+static bool IsValueOp(TAC_OP_ID op) {
+    switch (op) {
+        case TAC_OP_ID::COPY:
+        case TAC_OP_ID::BINARY:
+        case TAC_OP_ID::UNARY_MINUS:
+        case TAC_OP_ID::UNARY_PLUS:
+        case TAC_OP_ID::IF_FALSE_GOTO:
+        case TAC_OP_ID::LOOP_FALSE_GOTO:
+        case TAC_OP_ID::IF_TRUE_GOTO:
+        case TAC_OP_ID::LOOP_TRUE_GOTO:
+        case TAC_OP_ID::PARAM:
+        case TAC_OP_ID::CALL:
+        case TAC_OP_ID::RETURN:
+        case TAC_OP_ID::WRITELN:
+            return true;
+        default:
+            break;
+    }
+
+    return false;
+}
+
+static constexpr size_t NO_SLOT = static_cast<size_t>(-1);
+
+// Index of a variable operand among the globals followed by the locals
+static size_t SlotOf(const TacOperand& operand, size_t globals) {
+    if (operand.kind == TAC_OPERAND_KIND::GLOBAL)
+        return operand.index;
+    if (operand.kind == TAC_OPERAND_KIND::LOCAL)
+        return globals + operand.index;
+
+    return NO_SLOT;
+}
+
+static TacOperand SlotOperand(size_t slot, size_t globals) {
+    if (slot < globals)
+        return { TAC_OPERAND_KIND::GLOBAL, slot };
+
+    return { TAC_OPERAND_KIND::LOCAL, slot - globals };
+}
+
+TacLoweringVisitor::SLOT_STATE TacLoweringVisitor::Join(SLOT_STATE lhs, SLOT_STATE rhs) {
+    if (lhs == UNREACHED) return rhs;
+    if (rhs == UNREACHED) return lhs;
+    if (lhs == rhs) return lhs;
+
+    return MAYBE;
+}
+
+TacLoweringVisitor::Frames TacLoweringVisitor::FindFrames(const TacFunction& func) const {
+    static constexpr size_t NOWHERE = static_cast<size_t>(-1);
+
+    const size_t globals = program_.globals.size();
+    std::vector<std::set<size_t>> writes;
+    std::vector<size_t> open;
+    Frames frames;
+
+    for (size_t pc = 0; pc < func.code.size(); pc++) {
+        const TacInstruction& instr = func.code[pc];
+
+        if (instr.op == TAC_OP_ID::ENTER || instr.op == TAC_OP_ID::LEAVE) {
+            if (frames.enter.size() <= instr.label) {
+                frames.enter.resize(instr.label + 1, NOWHERE);
+                frames.leave.resize(instr.label + 1, NOWHERE);
+                writes.resize(instr.label + 1);
+            }
+
+            if (instr.op == TAC_OP_ID::ENTER) {
+                frames.enter[instr.label] = pc;
+                open.push_back(instr.label);
+            } else {
+                frames.leave[instr.label] = pc;
+                open.pop_back();
+            }
+        } else if (IsValueOp(instr.op) && SlotOf(instr.result, globals) != NO_SLOT) {
+            for (size_t frame : open)
+                writes[frame].insert(SlotOf(instr.result, globals));
+        }
+    }
+
+    for (const std::set<size_t>& slots : writes)
+        frames.writes.emplace_back(slots.begin(), slots.end());
+
+    return frames;
+}
+
+// A read that gets past its CHECK proves the slot assigned. Calls leave
+// the slots as they found them, LEAVE brings the slots written in the
+// frame back to their state at its ENTER.
+std::vector<TacLoweringVisitor::SlotStates> TacLoweringVisitor::FlowStates(const TacFunction& func,
+                                                                           const Frames& frames,
+                                                                           SlotStates entry) const {
+    const std::vector<TacInstruction>& code = func.code;
+    const size_t globals = program_.globals.size();
+    std::vector<SlotStates> states(code.size());
+    std::vector<size_t> pending = { 0 };
+
+    if (!code.empty())
+        states[0] = std::move(entry);
+
+    while (!pending.empty()) {
+        size_t pc = pending.back();
+        pending.pop_back();
+
+        if (pc >= code.size() || states[pc].empty())
+            continue;
+
+        const TacInstruction& instr = code[pc];
+        SlotStates out = states[pc];
+        std::vector<size_t> next;
+
+        if (IsValueOp(instr.op)) {
+            for (const TacOperand *operand : { &instr.arg1, &instr.arg2, &instr.result }) {
+                if (SlotOf(*operand, globals) != NO_SLOT)
+                    out[SlotOf(*operand, globals)] = ASSIGNED;
+            }
+        } else if (instr.op == TAC_OP_ID::SWAP) {
+            std::swap(out[SlotOf(instr.result, globals)], out[SlotOf(instr.arg1, globals)]);
+        } else if (instr.op == TAC_OP_ID::ENTER) {
+            // The states at LEAVE depend on this one
+            pending.push_back(frames.leave[instr.label]);
+        } else if (instr.op == TAC_OP_ID::LEAVE) {
+            const SlotStates& entered = states[frames.enter[instr.label]];
+
+            for (size_t slot : frames.writes[instr.label]) {
+                if (!entered.empty())
+                    out[slot] = entered[slot];
+            }
+        }
+
+        if (IsJump(instr.op))
+            next.push_back(instr.label);
+        if (FallsThrough(instr.op))
+            next.push_back(pc + 1);
+
+        for (size_t succ : next) {
+            if (succ >= code.size())
+                continue;
+
+            bool changed = states[succ].empty();
+
+            if (changed) {
+                states[succ] = out;
+            } else {
+                for (size_t i = 0; i < out.size(); i++) {
+                    SLOT_STATE joined = Join(states[succ][i], out[i]);
+
+                    if (joined != states[succ][i]) {
+                        states[succ][i] = joined;
+                        changed = true;
+                    }
+                }
+            }
+
+            if (changed)
+                pending.push_back(succ);
+        }
+    }
+
+    return states;
+}
+
+// A slot has to be unset on the way out if it may have been assigned
+// since a point where it may not have been. Where both can happen, a
+// flag taken on the way in tells them apart.
+void TacLoweringVisitor::Expand(TacFunction& func, const Frames& frames, const std::vector<SlotStates>& states,
+                                const SlotStates& entry) {
+    using Restores = std::vector<std::pair<TacOperand, TacOperand>>;   // slot, flag
+
+    const size_t globals = program_.globals.size();
+    const std::vector<TacInstruction> old = std::move(func.code);
+    std::vector<TacInstruction>& code = func.code;
+    std::vector<size_t> moved(old.size() + 1);
+    std::vector<Restores> restores(frames.enter.size());
+    Restores returns;
+
+    auto needs_restore = [](SLOT_STATE in, SLOT_STATE out) {
+        return (in == UNASSIGNED || in == MAYBE) && (out == ASSIGNED || out == MAYBE);
+    };
+
+    auto restore = [&](Restores& list, size_t slot, SLOT_STATE in) {
+        TacOperand flag;
+
+        if (in == MAYBE)
+            flag = NewLocal(func, "__BlaiseAssigned");
+
+        list.push_back({ SlotOperand(slot, globals), flag });
+    };
+
+    auto flags = [&](const Restores& list) {
+        for (const auto& [slot, flag] : list) {
+            if (flag.kind == TAC_OPERAND_KIND::NONE)
+                continue;
+
+            TacInstruction assigned{ TAC_OP_ID::ASSIGNED };
+            assigned.result = flag;
+            assigned.arg1 = slot;
+            code.push_back(assigned);
+        }
+    };
+
+    auto unsets = [&](const Restores& list) {
+        for (const auto& [slot, flag] : list) {
+            TacInstruction unset{ TAC_OP_ID::UNSET };
+            unset.result = slot;
+            unset.arg1 = flag;
+            code.push_back(unset);
+        }
+    };
+
+    if (&func != &program_.functions[TacProgram::MAIN_FUNCTION]) {
+        std::set<size_t> written;
+        std::set<size_t> swapped;
+
+        for (const TacInstruction& instr : old) {
+            if (IsValueOp(instr.op) && instr.result.kind == TAC_OPERAND_KIND::GLOBAL)
+                written.insert(instr.result.index);
+            if (instr.op == TAC_OP_ID::SWAP)
+                swapped.insert(instr.arg1.index);
+        }
+
+        for (size_t slot : written) {
+            bool needed = false;
+
+            for (size_t pc = 0; pc < old.size(); pc++) {
+                if (old[pc].op == TAC_OP_ID::RETURN && !states[pc].empty())
+                    needed = needed || needs_restore(entry[slot], states[pc][slot]);
+            }
+
+            if (needed && swapped.count(slot) == 0)
+                restore(returns, slot, entry[slot]);
+        }
+    }
+
+    for (size_t frame = 0; frame < frames.enter.size(); frame++) {
+        size_t enter = frames.enter[frame];
+        size_t leave = frames.leave[frame];
+
+        if (enter >= old.size() || leave >= old.size() || states[enter].empty() || states[leave].empty())
+            continue;
+
+        for (size_t slot : frames.writes[frame]) {
+            if (needs_restore(states[enter][slot], states[leave][slot]))
+                restore(restores[frame], slot, states[enter][slot]);
+        }
+    }
+
+    flags(returns);
+
+    for (size_t pc = 0; pc < old.size(); pc++) {
+        const TacInstruction& instr = old[pc];
+
+        // Jumps to the instruction run its checks as well
+        moved[pc] = code.size();
+
+        if (instr.op == TAC_OP_ID::ENTER) {
+            flags(restores[instr.label]);
+            continue;
+        }
+
+        if (instr.op == TAC_OP_ID::LEAVE) {
+            unsets(restores[instr.label]);
+            continue;
+        }
+
+        if (IsValueOp(instr.op) && !states[pc].empty()) {
+            SlotStates slots = states[pc];
+
+            for (const TacOperand& operand : { instr.arg1, instr.arg2 }) {
+                size_t slot = SlotOf(operand, globals);
+
+                if (slot == NO_SLOT || slots[slot] == ASSIGNED || slots[slot] == UNREACHED)
+                    continue;
+
+                TacInstruction check{ TAC_OP_ID::CHECK };
+                check.arg1 = operand;
+                code.push_back(check);
+                slots[slot] = ASSIGNED;
+            }
+        }
+
+        if (instr.op == TAC_OP_ID::RETURN)
+            unsets(returns);
+
+        code.push_back(instr);
+    }
+
+    moved[old.size()] = code.size();
+
+    for (TacInstruction& instr : code) {
+        if (IsJump(instr.op))
+            instr.label = moved[instr.label];
+    }
+}
+
+// Liveness of assignedness: a slot is observed by CHECK and ASSIGNED, by
+// calls of functions that observe it and, for globals, by the caller once
+// the function returns. An unset is dropped when no instruction observes
+// the slot before it is assigned again.
+void TacLoweringVisitor::DropUnobserved(TacFunction& func, const std::vector<std::vector<bool>>& observed_by) const {
+    const size_t globals = program_.globals.size();
+
+    while (std::any_of(func.code.begin(), func.code.end(), [](const TacInstruction& instr) {
+        return instr.op == TAC_OP_ID::UNSET;
+    })) {
+        const std::vector<TacInstruction>& code = func.code;
+        const size_t slots = globals + func.locals.size();
+        std::vector<std::vector<bool>> live(code.size() + 1, std::vector<bool>(slots, false));
+        bool changed = true;
+
+        while (changed) {
+            changed = false;
+
+            for (size_t pc = code.size(); pc-- > 0; ) {
+                const TacInstruction& instr = code[pc];
+                std::vector<bool> in(slots, false);
+
+                if (IsJump(instr.op))
+                    in = live[instr.label];
+
+                if (FallsThrough(instr.op)) {
+                    for (size_t i = 0; i < slots; i++)
+                        in[i] = in[i] || live[pc + 1][i];
+                }
+
+                size_t result = SlotOf(instr.result, globals);
+
+                if (instr.op == TAC_OP_ID::SWAP) {
+                    size_t other = SlotOf(instr.arg1, globals);
+                    bool result_live = in[result];
+
+                    in[result] = in[other];
+                    in[other] = result_live;
+                } else if (result != NO_SLOT && (IsValueOp(instr.op)
+                           || (instr.op == TAC_OP_ID::UNSET && instr.arg1.kind == TAC_OPERAND_KIND::NONE))) {
+                    in[result] = false;
+                }
+
+                if (instr.op == TAC_OP_ID::CHECK || instr.op == TAC_OP_ID::ASSIGNED) {
+                    in[SlotOf(instr.arg1, globals)] = true;
+                } else if (instr.op == TAC_OP_ID::CALL) {
+                    for (size_t i = 0; i < globals; i++)
+                        in[i] = in[i] || observed_by[instr.label][i];
+                } else if (instr.op == TAC_OP_ID::RETURN) {
+                    std::fill(in.begin(), in.begin() + globals, true);
+                }
+
+                if (in != live[pc]) {
+                    live[pc] = std::move(in);
+                    changed = true;
+                }
+            }
+        }
+
+        std::vector<bool> dropped(code.size(), false);
+        std::set<size_t> flags;
+
+        for (size_t pc = 0; pc < code.size(); pc++) {
+            if (code[pc].op != TAC_OP_ID::UNSET)
+                continue;
+
+            if (!live[pc + 1][SlotOf(code[pc].result, globals)])
+                dropped[pc] = true;
+            else if (code[pc].arg1.kind != TAC_OPERAND_KIND::NONE)
+                flags.insert(code[pc].arg1.index);
+        }
+
+        for (size_t pc = 0; pc < code.size(); pc++) {
+            if (code[pc].op == TAC_OP_ID::ASSIGNED && flags.count(code[pc].result.index) == 0)
+                dropped[pc] = true;
+        }
+
+        if (std::find(dropped.begin(), dropped.end(), true) == dropped.end())
+            break;
+
+        std::vector<TacInstruction> kept;
+        std::vector<size_t> moved(code.size() + 1);
+
+        for (size_t pc = 0; pc < code.size(); pc++) {
+            moved[pc] = kept.size();
+
+            if (!dropped[pc])
+                kept.push_back(code[pc]);
+        }
+
+        moved[code.size()] = kept.size();
+
+        for (TacInstruction& instr : kept) {
+            if (IsJump(instr.op))
+                instr.label = moved[instr.label];
+        }
+
+        func.code = std::move(kept);
+    }
+}
+
+// Functions run with the globals as they are at their calls, so the
+// state of a global on entry joins its states at all calls of the name,
+// until that settles.
+void TacLoweringVisitor::ResolveFrames() {
+    const size_t globals = program_.globals.size();
+    const size_t count = program_.functions.size();
+    std::vector<Frames> frames;
+    std::vector<SlotStates> entries(count, SlotStates(globals, UNREACHED));
+    std::vector<std::vector<SlotStates>> states(count);
+
+    entries[TacProgram::MAIN_FUNCTION].assign(globals, UNASSIGNED);
+
+    for (const TacFunction& func : program_.functions)
+        frames.push_back(FindFrames(func));
+
+    auto entry_of = [&](size_t f) {
+        const TacFunction& func = program_.functions[f];
+        SlotStates entry = entries[f];
+
+        for (size_t i = 0; i < func.locals.size(); i++)
+            entry.push_back(i < func.param_count ? ASSIGNED : UNASSIGNED);
+
+        return entry;
+    };
+
+    bool changed = true;
+
+    while (changed) {
+        changed = false;
+
+        for (size_t f = 0; f < count; f++)
+            states[f] = FlowStates(program_.functions[f], frames[f], entry_of(f));
+
+        for (size_t caller = 0; caller < count; caller++) {
+            const std::vector<TacInstruction>& code = program_.functions[caller].code;
+
+            for (size_t pc = 0; pc < code.size(); pc++) {
+                if (code[pc].op != TAC_OP_ID::CALL || states[caller][pc].empty())
+                    continue;
+
+                for (size_t f = TacProgram::MAIN_FUNCTION + 1; f < count; f++) {
+                    if (program_.functions[f].name_id != code[pc].label)
+                        continue;
+
+                    for (size_t i = 0; i < globals; i++) {
+                        SLOT_STATE joined = Join(entries[f][i], states[caller][pc][i]);
+
+                        if (joined != entries[f][i]) {
+                            entries[f][i] = joined;
+                            changed = true;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    for (size_t f = 0; f < count; f++)
+        Expand(program_.functions[f], frames[f], states[f], entry_of(f));
+
+    // Globals whose assignedness a call of the name may look at
+    std::vector<std::vector<bool>> observed_by(program_.function_names.size(), std::vector<bool>(globals, false));
+
+    changed = true;
+
+    while (changed) {
+        changed = false;
+
+        for (size_t f = TacProgram::MAIN_FUNCTION + 1; f < count; f++) {
+            const TacFunction& func = program_.functions[f];
+            std::vector<bool>& observed = observed_by[func.name_id];
+
+            for (const TacInstruction& instr : func.code) {
+                if ((instr.op == TAC_OP_ID::CHECK || instr.op == TAC_OP_ID::ASSIGNED)
+                    && instr.arg1.kind == TAC_OPERAND_KIND::GLOBAL && !observed[instr.arg1.index]) {
+                    observed[instr.arg1.index] = true;
+                    changed = true;
+                }
+
+                if (instr.op != TAC_OP_ID::CALL)
+                    continue;
+
+                for (size_t i = 0; i < globals; i++) {
+                    if (observed_by[instr.label][i] && !observed[i]) {
+                        observed[i] = true;
+                        changed = true;
+                    }
+                }
+            }
+        }
+    }
+
+    for (TacFunction& func : program_.functions)
+        DropUnobserved(func, observed_by);
+}
+
+void TacLoweringVisitor::VisitStmt(AstNodeId stmt) {
+    size_t temp_counter = scopes_.back().temp_counter;
+    visit(stmt);
+    scopes_.back().temp_counter = temp_counter;
+}
+
+std::any TacLoweringVisitor::visitProgram(const AstNode& node) {
+    DEBUG_BEGIN(std::cerr, BLAISE_BEGIN_COUT);
+
+    program_ = TacProgram();
+    units_.assign(1, Unit());
+    unit_of_.clear();
+    constant_ids_.clear();
+
+    unit_of_[ast_->Id(node)] = 0;
+    CollectUnit(ast_->Id(node), 0);
+    ResolveVisibility();
+
+    program_.functions.emplace_back();
+    scopes_.push_back({ TacProgram::MAIN_FUNCTION, 0, 0, 1, {}, {}, { { 0 } } });
+
+    for (size_t i = 0; i < node.child_count; i++)
+        VisitStmt(ast_->Child(node, i));
+
+    Emit({ TAC_OP_ID::HALT });
+    scopes_.pop_back();
+
+    ResolveFrames();
+
+    return std::move(program_);
+}
+
+// The functions of imported modules are joined into the program before
+// it is lowered
+std::any TacLoweringVisitor::visitImportStmt(const AstNode& node) {
+    DEBUG_BEGIN(std::cerr, BLAISE_BEGIN_COUT);
+    return std::any();
+}
+
+// Definitions are bound when the statement runs and undone when its
+// frame is left. Defining a name twice in the same frame fails there,
+// the way interp does.
+std::any TacLoweringVisitor::visitFunctionDefinition(const AstNode& node) {
+    DEBUG_BEGIN(std::cerr, BLAISE_BEGIN_COUT);
+    const std::string& id = ast_->Text(node);
+    AstNodeId body = ast_->Child(node, node.child_count - 1);
+    size_t function = program_.functions.size();
+
+    TacFunction& func = program_.functions.emplace_back();
+    func.name = id;
+    func.name_id = FunctionNameId(id);
+    func.position = ast_->Position(node);
+
+    // Parameters are checked from the last one, the way the grammar
+    // nests them
+    for (size_t i = node.child_count - 1; i-- > 0; ) {
+        const std::string& param = ast_->Text(ast_->Node(ast_->Child(node, i)));
+
+        if (std::find(func.locals.begin(), func.locals.end(), param) != func.locals.end()) {
+            throw std::invalid_argument("Identifier " + param + " already is in the list.");
+        }
+
+        func.locals.insert(func.locals.begin(), param);
+    }
+
+    func.param_count = func.locals.size();
+
+    scopes_.push_back({ function, 0, unit_of_.at(ast_->Id(node)), 1, {}, {}, { { 0 } } });
+    FunctionScope& scope = scopes_.back();
+
+    for (size_t i = 0; i < func.param_count; i++) {
+        if (units_[scope.unit].visible.count(func.locals[i]) == 0)
+            scope.locals.emplace(func.locals[i], i);
+        else
+            scope.swapped.push_back({ i, ResolveVariable(func.locals[i]).index });
+    }
+
+    CollectLocals(body, scope);
+
+    for (const auto& [param, global] : scope.swapped) {
+        TacInstruction swap{ TAC_OP_ID::SWAP };
+        swap.result = { TAC_OPERAND_KIND::LOCAL, param };
+        swap.arg1 = { TAC_OPERAND_KIND::GLOBAL, global };
+        Emit(swap);
+    }
+
+    // The body shares the frame of the parameters
+    if (ast_->Node(body).kind == AST_NODE_KIND::CODE_BLOCK) {
+        for (size_t i = 0; i < ast_->Node(body).child_count; i++)
+            VisitStmt(ast_->Child(ast_->Node(body), i));
+    } else {
+        VisitStmt(body);
+    }
+
+    EmitReturn(TacOperand());
+    scopes_.pop_back();
+
+    BlockScope& block = scopes_.back().blocks.back();
+
+    if (!block.functions.insert(id).second) {
+        TacInstruction fail{ TAC_OP_ID::FAIL };
+        std::string message = "Function redefinition is not allowed. Function " + id + " is already defined.";
+
+        fail.arg1 = AddConstant("m:" + message, BlaiseVariable(std::string(), message));
+        Emit(fail);
+
+        return std::any();
+    }
+
+    TacInstruction define{ TAC_OP_ID::DEFINE };
+    define.label = function;
+
+    // Top-level definitions are never undone
+    if (scopes_.back().function != TacProgram::MAIN_FUNCTION || scopes_.back().blocks.size() > 1) {
+        define.result = NewLocal(CurrentFunction(), "__BlaiseDefined");
+        block.defines.push_back({ function, define.result });
+    }
+
+    Emit(define);
+
+    return std::any();
+}
+
+std::any TacLoweringVisitor::visitFunctionCall(const AstNode& node) {
+    DEBUG_BEGIN(std::cerr, BLAISE_BEGIN_COUT);
+
+    // Every argument is pushed as soon as it is evaluated, nested calls
+    // consume their own params from the top of the argument stack.
+    for (size_t i = 0; i < node.child_count; i++) {
+        TacInstruction param{ TAC_OP_ID::PARAM };
+        param.arg1 = std::any_cast<TacOperand>(visit(ast_->Child(node, i)));
+        Emit(param);
+    }
+
+    TacInstruction call{ TAC_OP_ID::CALL };
+    call.result = NewTemp();
+    call.label = FunctionNameId(ast_->Text(node));
+    call.count = node.child_count;
+    Emit(call);
+
+    return call.result;
+}
+
+std::any TacLoweringVisitor::visitCodeBlock(const AstNode& node) {
+    DEBUG_BEGIN(std::cerr, BLAISE_BEGIN_COUT);
+    EnterBlock();
+
+    for (size_t i = 0; i < node.child_count; i++)
+        VisitStmt(ast_->Child(node, i));
+
+    LeaveBlock();
+
+    return std::any();
+}
+
+std::any TacLoweringVisitor::visitReturnStmt(const AstNode& node) {
+    DEBUG_BEGIN(std::cerr, BLAISE_BEGIN_COUT);
+    EmitReturn(std::any_cast<TacOperand>(visit(ast_->Child(node, 0))));
+
+    return std::any();
+}
+
+std::any TacLoweringVisitor::visitWritelnStmt(const AstNode& node) {
+    DEBUG_BEGIN(std::cerr, BLAISE_BEGIN_COUT);
+    TacInstruction writeln{ TAC_OP_ID::WRITELN };
+    writeln.arg1 = std::any_cast<TacOperand>(visit(ast_->Child(node, 0)));
+    Emit(writeln);
+
+    return std::any();
+}
+
+std::any TacLoweringVisitor::visitIfStmt(const AstNode& node) {
+    DEBUG_BEGIN(std::cerr, BLAISE_BEGIN_COUT);
+    TacInstruction branch{ TAC_OP_ID::IF_FALSE_GOTO };
+    branch.position = ast_->Position(node);
+    branch.arg1 = std::any_cast<TacOperand>(visit(ast_->Child(node, 0)));
+    size_t branch_pc = Emit(branch);
+
+    VisitInFrame(ast_->Child(node, 1));
+
+    if (node.child_count > 2) {
+        size_t skip_pc = Emit({ TAC_OP_ID::GOTO });
+        CurrentFunction().code[branch_pc].label = CurrentFunction().code.size();
+
+        VisitInFrame(ast_->Child(node, 2));
+        CurrentFunction().code[skip_pc].label = CurrentFunction().code.size();
+    } else {
+        CurrentFunction().code[branch_pc].label = CurrentFunction().code.size();
+    }
+
+    return std::any();
+}
+
+std::any TacLoweringVisitor::visitLoopStmt(const AstNode& node) {
+    DEBUG_BEGIN(std::cerr, BLAISE_BEGIN_COUT);
+    size_t head_pc = CurrentFunction().code.size();
+
+    TacInstruction branch{ TAC_OP_ID::LOOP_FALSE_GOTO };
+    branch.position = ast_->Position(node);
+    branch.arg1 = std::any_cast<TacOperand>(visit(ast_->Child(node, 0)));
+    size_t branch_pc = Emit(branch);
+
+    if (node.child_count > 1)
+        VisitInFrame(ast_->Child(node, 1));
+
+    TacInstruction back_edge{ TAC_OP_ID::GOTO };
+    back_edge.label = head_pc;
+    Emit(back_edge);
+
+    CurrentFunction().code[branch_pc].label = CurrentFunction().code.size();
+
+    return std::any();
+}
+
+std::any TacLoweringVisitor::visitAssignStmt(const AstNode& node) {
+    DEBUG_BEGIN(std::cerr, BLAISE_BEGIN_COUT);
+    TacOperand value = std::any_cast<TacOperand>(visit(ast_->Child(node, 0)));
+    TacOperand target = ResolveVariable(ast_->Text(node));
+    std::vector<TacInstruction>& code = CurrentFunction().code;
+
+    // Store the result of the last instruction directly instead of
+    // going through a temporary: t0 = a + b; x = t0 -> x = a + b
+    if (value.kind == TAC_OPERAND_KIND::TEMP && !code.empty() && code.back().result == value) {
+        code.back().result = target;
+        return std::any();
+    }
+
+    TacInstruction copy{ TAC_OP_ID::COPY };
+    copy.result = target;
+    copy.arg1 = value;
+    Emit(copy);
+
+    return std::any();
+}
+
+std::any TacLoweringVisitor::visitExprOperation(const AstNode& node) {
+    DEBUG_BEGIN(std::cerr, BLAISE_BEGIN_COUT);
+    TacInstruction binary{ TAC_OP_ID::BINARY };
+
+    binary.arg1 = std::any_cast<TacOperand>(visit(ast_->Child(node, 0)));
+    binary.operation = node.operation;
+    binary.arg2 = std::any_cast<TacOperand>(visit(ast_->Child(node, 1)));
+    binary.result = NewTemp();
+    Emit(binary);
+
+    return binary.result;
+}
+
+std::any TacLoweringVisitor::visitExprUnaryMinusOperation(const AstNode& node) {
+    DEBUG_BEGIN(std::cerr, BLAISE_BEGIN_COUT);
+    TacInstruction unary{ TAC_OP_ID::UNARY_MINUS };
+
+    unary.arg1 = std::any_cast<TacOperand>(visit(ast_->Child(node, 0)));
+    unary.result = NewTemp();
+    Emit(unary);
+
+    return unary.result;
+}
+
+std::any TacLoweringVisitor::visitExprUnaryPlusOperation(const AstNode& node) {
+    DEBUG_BEGIN(std::cerr, BLAISE_BEGIN_COUT);
+    TacInstruction unary{ TAC_OP_ID::UNARY_PLUS };
+
+    unary.arg1 = std::any_cast<TacOperand>(visit(ast_->Child(node, 0)));
+    unary.result = NewTemp();
+    Emit(unary);
+
+    return unary.result;
+}
+
+std::any TacLoweringVisitor::visitOperandBoolean(const AstNode& node) {
+    DEBUG_BEGIN(std::cerr, BLAISE_BEGIN_COUT);
+    const std::string& str = ast_->Text(node);
+    return AddConstant("b:" + str, BlaiseVariable(str == "true"));
+}
+
+std::any TacLoweringVisitor::visitOperandInt(const AstNode& node) {
+    DEBUG_BEGIN(std::cerr, BLAISE_BEGIN_COUT);
+    const std::string& str = ast_->Text(node);
+    return AddConstant("i:" + str, BlaiseVariable(std::stoi(str)));
+}
+
+std::any TacLoweringVisitor::visitOperandDouble(const AstNode& node) {
+    DEBUG_BEGIN(std::cerr, BLAISE_BEGIN_COUT);
+    const std::string& str = ast_->Text(node);
+    return AddConstant("d:" + str, BlaiseVariable(std::stod(str)));
+}
+
+std::any TacLoweringVisitor::visitOperandChar(const AstNode& node) {
+    DEBUG_BEGIN(std::cerr, BLAISE_BEGIN_COUT);
+    const std::string& str = ast_->Text(node);
+    return AddConstant("c:" + str, BlaiseVariable(str.at(1)));
+}
+
+std::any TacLoweringVisitor::visitOperandString(const AstNode& node) {
+    DEBUG_BEGIN(std::cerr, BLAISE_BEGIN_COUT);
+    const std::string& str = ast_->Text(node);
+    return AddConstant("s:" + str, BlaiseVariable(std::string(), std::string(str.begin() + 1, str.end() - 1)));
+}
+
+std::any TacLoweringVisitor::visitOperandId(const AstNode& node) {
+    DEBUG_BEGIN(std::cerr, BLAISE_BEGIN_COUT);
+    return ResolveVariable(ast_->Text(node));
+}
+
+// Arrays and maps live in the interpreter only
+std::any TacLoweringVisitor::visitIndexAssignStmt(const AstNode& node) {
+    throw std::invalid_argument("Arrays and maps are only supported by interp");
+}
+
+std::any TacLoweringVisitor::visitOperandArray(const AstNode& node) {
+    throw std::invalid_argument("Arrays are only supported by interp");
+}
+
+std::any TacLoweringVisitor::visitOperandIndex(const AstNode& node) {
+    throw std::invalid_argument("Arrays and maps are only supported by interp");
+}
+
+std::any TacLoweringVisitor::visitOperandExpr(const AstNode& node) {
+    DEBUG_BEGIN(std::cerr, BLAISE_BEGIN_COUT);
+    return visit(ast_->Child(node, 0));
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "BlaiseAst.h"
+#include "BlaiseClasses.h"
+#include "TacProgram.h"
+
+// Lowers the AST into a flat TacProgram with the scoping of interp,
+// where a name refers to the innermost binding on the whole call stack
+// and a binding lives until the frame that created it is left.
+//
+// Names get a slot statically. A variable of a function that no function
+// it calls can see, and that none of its callers can have bound, is a
+// local; every other name has one global slot shared by the program body
+// and all functions, since interp would find the same binding from all of
+// them. A parameter that functions it calls can see keeps the caller's
+// value of the global slot in its own one while the function runs.
+//
+// Leaving a block, an if branch, a loop iteration or a function unsets
+// the variables assigned in it that were not assigned when it was
+// entered, and undoes the functions it defined. Reads of variables that
+// are not assigned on every path leading to them are preceded by a
+// CHECK, which fails the way interp does when the variable has not been
+// assigned yet.
+class TacLoweringVisitor : public BlaiseAstVisitor {
+private:
+
+    // The program body or a function definition, as written
+    struct Unit {
+        std::vector<std::string> params;
+        std::set<std::string> uses;         // variables read or assigned, other than the parameters
+        std::set<std::string> binds;        // parameters and assigned variables
+        std::set<std::string> calls;        // names of called functions
+        std::set<std::string> visible;      // names a called function may refer to
+        std::set<std::string> bound;        // names a calling function may have bound
+    };
+
+    // Statements that leave together: a function body, a block, an if
+    // branch or a loop iteration
+    struct BlockScope {
+        size_t frame;
+        std::set<std::string> functions;
+        std::vector<std::pair<size_t, TacOperand>> defines;    // function, saved definition
+    };
+
+    struct FunctionScope {
+        size_t function;
+        size_t temp_counter;
+        size_t unit;
+        size_t frame_counter;
+        std::map<std::string, size_t> locals;
+        std::vector<std::pair<size_t, size_t>> swapped;         // parameter, global
+        std::vector<BlockScope> blocks;
+    };
+
+    // Assignedness of a slot at an instruction, on all paths reaching it
+    enum SLOT_STATE : uint8_t {
+        UNREACHED,
+        UNASSIGNED,
+        ASSIGNED,
+        MAYBE,
+    };
+
+    using SlotStates = std::vector<SLOT_STATE>;
+
+    // ENTER and LEAVE of each frame of a function, and the variable slots
+    // (the globals, then the locals) written between them
+    struct Frames {
+        std::vector<size_t> enter;
+        std::vector<size_t> leave;
+        std::vector<std::vector<size_t>> writes;
+    };
+
+    TacProgram program_;
+    std::vector<Unit> units_;
+    std::map<AstNodeId, size_t> unit_of_;
+    std::map<std::string, size_t> constant_ids_;
+    std::vector<FunctionScope> scopes_;
+
+private:
+
+    TacFunction& CurrentFunction();
+
+    TacOperand NewTemp();
+
+    // Slot of the function for state of its own, named after prefix
+    static TacOperand NewLocal(TacFunction& func, const std::string& prefix);
+
+    TacOperand ResolveVariable(const std::string& name);
+
+    TacOperand AddConstant(const std::string& key, const BlaiseVariable& value);
+
+    size_t FunctionNameId(const std::string& name);
+
+    size_t Emit(const TacInstruction& instr);
+
+    void CollectUnit(AstNodeId id, size_t unit);
+
+    // Fills visible and bound of every unit from the call graph
+    void ResolveVisibility();
+
+    // Variables assigned in the function body id that only the function
+    // itself can see, in order of appearance
+    void CollectLocals(AstNodeId id, FunctionScope& scope);
+
+    void EnterBlock();
+
+    void LeaveBlock();
+
+    // Runs stmt in a frame of its own, the way interp runs if branches
+    // and loop bodies. A block brings its own frame.
+    void VisitInFrame(AstNodeId stmt);
+
+    // Undoes the definitions of the function and restores its parameters
+    void EmitReturn(const TacOperand& value);
+
+    static SLOT_STATE Join(SLOT_STATE lhs, SLOT_STATE rhs);
+
+    Frames FindFrames(const TacFunction& func) const;
+
+    // For every instruction of func, the state of each slot (the globals,
+    // then the locals) when it runs, or nothing if it never does
+    std::vector<SlotStates> FlowStates(const TacFunction& func, const Frames& frames, SlotStates entry) const;
+
+    // Replaces ENTER and LEAVE by the code restoring the variables of
+    // the frame and adds CHECKs before reads
+    void Expand(TacFunction& func, const Frames& frames, const std::vector<SlotStates>& states,
+                const SlotStates& entry);
+
+    // Drops unsets no instruction can tell from leaving the slot as it
+    // is, so that the slot may keep a native type
+    void DropUnobserved(TacFunction& func, const std::vector<std::vector<bool>>& observed_by) const;
+
+    void ResolveFrames();
+
+    // Temporaries never outlive the statement that created them
+    void VisitStmt(AstNodeId stmt);
+
+public:
+
+    virtual std::any visitProgram(const AstNode& node) override;
+
+    virtual std::any visitImportStmt(const AstNode& node) override;
+
+    virtual std::any visitFunctionDefinition(const AstNode& node) override;
+
+    virtual std::any visitFunctionCall(const AstNode& node) override;
+
+    virtual std::any visitCodeBlock(const AstNode& node) override;
+
+    virtual std::any visitReturnStmt(const AstNode& node) override;
+
+    virtual std::any visitWritelnStmt(const AstNode& node) override;
+
+    virtual std::any visitIfStmt(const AstNode& node) override;
+
+    virtual std::any visitLoopStmt(const AstNode& node) override;
+
+    virtual std::any visitAssignStmt(const AstNode& node) override;
+
+    virtual std::any visitIndexAssignStmt(const AstNode& node) override;
+
+    virtual std::any visitExprOperation(const AstNode& node) override;
+
+    virtual std::any visitExprUnaryMinusOperation(const AstNode& node) override;
+
+    virtual std::any visitExprUnaryPlusOperation(const AstNode& node) override;
+
+    virtual std::any visitOperandBoolean(const AstNode& node) override;
+
+    virtual std::any visitOperandInt(const AstNode& node) override;
+
+    virtual std::any visitOperandDouble(const AstNode& node) override;
+
+    virtual std::any visitOperandChar(const AstNode& node) override;
+
+    virtual std::any visitOperandString(const AstNode& node) override;
+
+    virtual std::any visitOperandId(const AstNode& node) override;
+
+    virtual std::any visitOperandArray(const AstNode& node) override;
+
+    virtual std::any visitOperandIndex(const AstNode& node) override;
+
+    virtual std::any visitOperandExpr(const AstNode& node) override;
+};
@@ -0,0 +1,426 @@
+#include <algorithm>
+#include <string>
+
+#include "TacOptimizer.h"
+
+static bool IsJump(TAC_OP_ID op) {
+    return op == TAC_OP_ID::GOTO
+        || op == TAC_OP_ID::IF_FALSE_GOTO || op == TAC_OP_ID::LOOP_FALSE_GOTO
+        || op == TAC_OP_ID::IF_TRUE_GOTO  || op == TAC_OP_ID::LOOP_TRUE_GOTO;
+}
+
+size_t TacOptimizer::Relocation::Resolve(size_t pc) const {
+    while (alias[pc] != NONE)
+        pc = alias[pc];
+
+    return moved[pc];
+}
+
+TacOptimizer::TacOptimizer(const BlaiseProfile& profile) : profile_(profile) {}
+
+bool TacOptimizer::IsHotCallee(const TacFunction& callee) const {
+    auto iter = profile_.functions.find(callee.position);
+
+    if (iter == profile_.functions.end() || iter->second.name != callee.name
+        || iter->second.calls < INLINE_MIN_CALLS || callee.code.size() > INLINE_MAX_SIZE)
+        return false;
+
+    // A local checked for a value would keep the one of the previous call
+    return std::none_of(callee.code.begin(), callee.code.end(), [](const TacInstruction& instr) {
+        return instr.op == TAC_OP_ID::CALL || instr.op == TAC_OP_ID::DEFINE
+            || ((instr.op == TAC_OP_ID::CHECK || instr.op == TAC_OP_ID::ASSIGNED)
+                && instr.arg1.kind == TAC_OPERAND_KIND::LOCAL);
+    });
+}
+
+bool TacOptimizer::IsHotElse(const TacInstruction& branch) const {
+    auto iter = profile_.branches.find(branch.position);
+
+    return iter != profile_.branches.end() && iter->second.not_taken > iter->second.taken;
+}
+
+bool TacOptimizer::IsHotLoop(const TacInstruction& branch) const {
+    auto iter = profile_.loops.find(branch.position);
+
+    return iter != profile_.loops.end() && iter->second.iterations > iter->second.entries;
+}
+
+// A DEFINE runs on every path through its function if no jump skips over
+// it, in either direction. Only top-level definitions are never undone.
+void TacOptimizer::FindDefinitions(const TacProgram& program) {
+    std::vector<size_t> definition_count(program.function_names.size(), 0);
+
+    definitions_.assign(program.functions.size(), { NONE, NONE });
+    unconditional_.assign(program.functions.size(), false);
+    callee_of_name_.assign(program.function_names.size(), NONE);
+
+    for (size_t f = 0; f < program.functions.size(); f++) {
+        const std::vector<TacInstruction>& code = program.functions[f].code;
+        std::vector<int> crossing(code.size() + 1, 0);
+
+        for (size_t pc = 0; pc < code.size(); pc++) {
+            if (!IsJump(code[pc].op))
+                continue;
+
+            size_t low = std::min(pc, code[pc].label);
+            size_t high = std::max(pc, code[pc].label);
+
+            if (low + 1 < high) {
+                crossing[low + 1]++;
+                crossing[high]--;
+            }
+        }
+
+        int crossed = 0;
+
+        for (size_t pc = 0; pc < code.size(); pc++) {
+            crossed += crossing[pc];
+
+            if (code[pc].op != TAC_OP_ID::DEFINE)
+                continue;
+
+            size_t defined = code[pc].label;
+
+            definitions_[defined] = { f, pc };
+            unconditional_[defined] = crossed == 0 && code[pc].result.kind == TAC_OPERAND_KIND::NONE;
+            definition_count[program.functions[defined].name_id]++;
+            callee_of_name_[program.functions[defined].name_id] = defined;
+        }
+    }
+
+    for (size_t name = 0; name < definition_count.size(); name++) {
+        if (definition_count[name] != 1)
+            callee_of_name_[name] = NONE;
+    }
+}
+
+// Calls are bound by name when they run, so a call can only be replaced
+// by the body of the function if that function is the only definition of
+// the name and its definition is known to have run: it comes earlier in
+// the same function, or earlier than the definition of the caller.
+bool TacOptimizer::IsDefinedAt(size_t caller, size_t pc, size_t callee) const {
+    const auto& [function, define_pc] = definitions_[callee];
+
+    if (function == NONE || !unconditional_[callee])
+        return false;
+
+    if (function == caller)
+        return define_pc < pc;
+
+    const auto& [caller_function, caller_define_pc] = definitions_[caller];
+
+    return caller_function == function && define_pc < caller_define_pc;
+}
+
+// Whether the local is always assigned before it is read: its first
+// occurrence is a write that runs before any jump.
+bool TacOptimizer::IsAssignedFirst(const TacFunction& func, size_t local) {
+    const TacOperand operand{ TAC_OPERAND_KIND::LOCAL, local };
+
+    for (const TacInstruction& instr : func.code) {
+        if (instr.arg1 == operand || instr.arg2 == operand)
+            return false;
+        if (instr.result == operand)
+            return true;
+        if (IsJump(instr.op) || instr.op == TAC_OP_ID::RETURN)
+            return false;
+    }
+
+    return false;
+}
+
+// Every inlined call site gets its own copy of the callee locals and
+// temps in the caller frame. Arguments are copied into the parameter
+// slots where they used to be pushed, returns store into the result of
+// the call and jump past the inlined body.
+void TacOptimizer::Inline(TacProgram& program, size_t caller) const {
+    TacFunction& func = program.functions[caller];
+    const std::vector<TacInstruction>& code = func.code;
+
+    std::vector<size_t> callee_at(code.size(), NONE);
+    std::vector<size_t> local_base(code.size(), 0);
+    std::vector<size_t> temp_base(code.size(), 0);
+    std::vector<TacOperand> result_at(code.size());
+    std::vector<std::pair<size_t, size_t>> param_slot(code.size(), { NONE, 0 });  // call pc, index
+    std::vector<size_t> pending;
+    size_t sites = 0;
+
+    for (size_t pc = 0; pc < code.size(); pc++) {
+        const TacInstruction& instr = code[pc];
+
+        if (instr.op == TAC_OP_ID::PARAM) {
+            pending.push_back(pc);
+            continue;
+        }
+
+        if (instr.op != TAC_OP_ID::CALL)
+            continue;
+
+        size_t first = pending.size() - std::min(pending.size(), instr.count);
+        size_t callee = callee_of_name_[instr.label];
+
+        if (callee != NONE && callee != caller && pending.size() - first == instr.count
+            && instr.count == program.functions[callee].param_count
+            && IsHotCallee(program.functions[callee]) && IsDefinedAt(caller, pc, callee)) {
+            const TacFunction& body = program.functions[callee];
+
+            callee_at[pc] = callee;
+            local_base[pc] = func.locals.size();
+            temp_base[pc] = func.temp_count;
+
+            for (const std::string& local : body.locals) {
+                std::string name = body.name + "_" + std::to_string(sites) + "_" + local;
+
+                while (std::find(func.locals.begin(), func.locals.end(), name) != func.locals.end())
+                    name += "_";
+
+                func.locals.push_back(name);
+            }
+
+            // Temporaries are written once, so a callee with several
+            // returns passes its result through a local of the caller
+            size_t returns = std::count_if(body.code.begin(), body.code.end(), [](const TacInstruction& i) {
+                return i.op == TAC_OP_ID::RETURN;
+            });
+
+            result_at[pc] = instr.result;
+
+            if (returns > 1) {
+                std::string name = body.name + "_" + std::to_string(sites) + "_result";
+
+                while (std::find(func.locals.begin(), func.locals.end(), name) != func.locals.end())
+                    name += "_";
+
+                result_at[pc] = { TAC_OPERAND_KIND::LOCAL, func.locals.size() };
+                func.locals.push_back(name);
+            }
+
+            func.temp_count += body.temp_count;
+            sites++;
+
+            for (size_t i = first; i < pending.size(); i++)
+                param_slot[pending[i]] = { pc, i - first };
+        }
+
+        pending.resize(first);
+    }
+
+    if (sites == 0)
+        return;
+
+    std::vector<TacInstruction> out;
+    std::vector<size_t> jumps;      // jumps of the caller, labels still in old indices
+    Relocation relocation(code.size());
+
+    for (size_t pc = 0; pc < code.size(); pc++) {
+        const TacInstruction& instr = code[pc];
+
+        relocation.moved[pc] = out.size();
+
+        if (instr.op == TAC_OP_ID::PARAM && param_slot[pc].first != NONE) {
+            const auto& [call, index] = param_slot[pc];
+            TacInstruction copy{ TAC_OP_ID::COPY };
+
+            copy.result = { TAC_OPERAND_KIND::LOCAL, local_base[call] + index };
+            copy.arg1 = instr.arg1;
+            out.push_back(copy);
+            continue;
+        }
+
+        if (instr.op != TAC_OP_ID::CALL || callee_at[pc] == NONE) {
+            if (IsJump(instr.op))
+                jumps.push_back(out.size());
+
+            out.push_back(instr);
+            continue;
+        }
+
+        const TacFunction& body = program.functions[callee_at[pc]];
+
+        auto rename = [&](TacOperand operand) {
+            if (operand.kind == TAC_OPERAND_KIND::LOCAL)
+                operand.index += local_base[pc];
+            else if (operand.kind == TAC_OPERAND_KIND::TEMP)
+                operand.index += temp_base[pc];
+
+            return operand;
+        };
+
+        // A fresh frame starts with every local unset
+        for (size_t i = body.param_count; i < body.locals.size(); i++) {
+            if (IsAssignedFirst(body, i))
+                continue;
+
+            TacInstruction reset{ TAC_OP_ID::COPY };
+            reset.result = { TAC_OPERAND_KIND::LOCAL, local_base[pc] + i };
+            out.push_back(reset);
+        }
+
+        std::vector<size_t> at(body.code.size() + 1);
+        size_t next = out.size();
+
+        for (size_t i = 0; i < body.code.size(); i++) {
+            at[i] = next;
+            next += body.code[i].op == TAC_OP_ID::RETURN && i + 1 < body.code.size() ? 2 : 1;
+        }
+
+        at[body.code.size()] = next;
+
+        for (size_t i = 0; i < body.code.size(); i++) {
+            TacInstruction inlined = body.code[i];
+
+            inlined.result = rename(inlined.result);
+            inlined.arg1 = rename(inlined.arg1);
+            inlined.arg2 = rename(inlined.arg2);
+
+            if (inlined.op == TAC_OP_ID::RETURN) {
+                TacInstruction store{ TAC_OP_ID::COPY };
+                store.result = result_at[pc];
+                store.arg1 = inlined.arg1;
+                out.push_back(store);
+
+                if (i + 1 == body.code.size())
+                    continue;
+
+                inlined = TacInstruction{ TAC_OP_ID::GOTO };
+                inlined.label = at[body.code.size()];
+            } else if (IsJump(inlined.op)) {
+                inlined.label = at[inlined.label];
+            }
+
+            out.push_back(inlined);
+        }
+
+        if (result_at[pc].kind == TAC_OPERAND_KIND::LOCAL) {
+            TacInstruction load{ TAC_OP_ID::COPY };
+            load.result = instr.result;
+            load.arg1 = result_at[pc];
+            out.push_back(load);
+        }
+    }
+
+    relocation.moved[code.size()] = out.size();
+
+    for (size_t jump : jumps)
+        out[jump].label = relocation.Resolve(out[jump].label);
+
+    func.code = std::move(out);
+}
+
+// Rebuilds code[begin, end) into out, in old instruction indices for
+// jump labels. Structured if-else statements and loops are recognized by
+// the shape TacLoweringVisitor gives them:
+//   if:    iffalse c goto E; <then>; E-1: goto END; E: <else>; END:
+//   loop:  H: <condition>; L: iffalse c goto X; <body>; X-1: goto H; X:
+void TacOptimizer::Layout(const std::vector<TacInstruction>& code, const std::vector<std::optional<Loop>>& loops,
+                          size_t begin, size_t end, std::vector<TacInstruction>& out,
+                          Relocation& relocation) const {
+    size_t pc = begin;
+
+    while (pc < end) {
+        const TacInstruction& instr = code[pc];
+
+        // H: <condition>; iffalse c goto X; <body>; goto H  ->
+        //    goto C; B: <body>; C: <condition>; if c goto B
+        if (loops[pc] && loops[pc]->back_edge < end && IsHotLoop(code[loops[pc]->branch])) {
+            const Loop& loop = *loops[pc];
+            TacInstruction enter{ TAC_OP_ID::GOTO };
+
+            enter.label = pc;
+            out.push_back(enter);
+
+            Layout(code, loops, loop.branch + 1, loop.back_edge, out, relocation);
+            Layout(code, loops, pc, loop.branch, out, relocation);
+
+            TacInstruction repeat = code[loop.branch];
+            repeat.op = TAC_OP_ID::LOOP_TRUE_GOTO;
+            repeat.label = loop.branch + 1;
+            relocation.moved[loop.branch] = out.size();
+            out.push_back(repeat);
+
+            relocation.alias[loop.back_edge] = pc;
+            pc = loop.back_edge + 1;
+            continue;
+        }
+
+        // iffalse c goto E; <then>; goto END; E: <else>  ->
+        //    if c goto T; <else>; goto END; T: <then>
+        if (instr.op == TAC_OP_ID::IF_FALSE_GOTO && instr.label > pc + 1 && instr.label <= end) {
+            size_t else_pc = instr.label;
+            const TacInstruction& skip = code[else_pc - 1];
+
+            if (skip.op == TAC_OP_ID::GOTO && skip.label >= else_pc && skip.label <= end && IsHotElse(instr)) {
+                size_t end_pc = skip.label;
+                TacInstruction branch = instr;
+
+                branch.op = TAC_OP_ID::IF_TRUE_GOTO;
+                branch.label = pc + 1;
+                relocation.moved[pc] = out.size();
+                out.push_back(branch);
+
+                Layout(code, loops, else_pc, end_pc, out, relocation);
+
+                TacInstruction leave{ TAC_OP_ID::GOTO };
+                leave.label = end_pc;
+                out.push_back(leave);
+                relocation.alias[else_pc - 1] = end_pc;
+
+                Layout(code, loops, pc + 1, else_pc - 1, out, relocation);
+
+                pc = end_pc;
+                continue;
+            }
+        }
+
+        relocation.moved[pc] = out.size();
+        out.push_back(instr);
+        pc++;
+    }
+}
+
+void TacOptimizer::Layout(TacFunction& func) const {
+    const std::vector<TacInstruction>& code = func.code;
+    std::vector<std::optional<Loop>> loops(code.size());
+
+    for (size_t back_edge = 0; back_edge < code.size(); back_edge++) {
+        const TacInstruction& instr = code[back_edge];
+
+        if (instr.op != TAC_OP_ID::GOTO || instr.label >= back_edge || loops[instr.label])
+            continue;
+
+        // The condition is straight-line code up to the branch that
+        // leaves the loop right after the back edge.
+        for (size_t pc = instr.label; pc < back_edge; pc++) {
+            if (code[pc].op == TAC_OP_ID::LOOP_FALSE_GOTO && code[pc].label == back_edge + 1) {
+                loops[instr.label] = Loop{ pc, back_edge };
+                break;
+            }
+
+            if (IsJump(code[pc].op))
+                break;
+        }
+    }
+
+    std::vector<TacInstruction> out;
+    Relocation relocation(code.size());
+
+    Layout(code, loops, 0, code.size(), out, relocation);
+    relocation.moved[code.size()] = out.size();
+
+    for (TacInstruction& instr : out) {
+        if (IsJump(instr.op))
+            instr.label = relocation.Resolve(instr.label);
+    }
+
+    func.code = std::move(out);
+}
+
+void TacOptimizer::Optimize(TacProgram& program) {
+    FindDefinitions(program);
+
+    for (size_t f = 0; f < program.functions.size(); f++)
+        Inline(program, f);
+
+    for (TacFunction& func : program.functions)
+        Layout(func);
+}
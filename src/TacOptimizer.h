@@ -0,0 +1,80 @@
+#pragma once
+
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "BlaiseProfile.h"
+#include "TacProgram.h"
+
+// Profile-guided optimizations over a TacProgram, driven by a profile
+// that InterpreterVisitor recorded for the same source. Every
+// transformation keeps the behaviour of the program, runtime errors
+// included; the profile only decides where it pays off:
+//  - leaf functions of at most INLINE_MAX_SIZE instructions that were
+//    called at least INLINE_MIN_CALLS times are inlined at call sites
+//    that are known to run after their only definition;
+//  - if statements whose else branch ran more often than the then
+//    branch are laid out with the else branch first;
+//  - loops that iterated more than once per entry on average are
+//    rotated, so that an iteration runs one conditional jump instead of
+//    a conditional and an unconditional one.
+class TacOptimizer {
+public:
+    static constexpr size_t INLINE_MIN_CALLS = 16;
+    static constexpr size_t INLINE_MAX_SIZE = 32;
+
+private:
+
+    static constexpr size_t NONE = static_cast<size_t>(-1);
+
+    struct Loop {
+        size_t branch;      // LOOP_FALSE_GOTO after the condition
+        size_t back_edge;   // GOTO to the head of the loop
+    };
+
+    // Old instruction index -> index in the new code, for rewrites that
+    // move or drop instructions. Dropped jumps alias the instruction
+    // control continues with.
+    struct Relocation {
+        std::vector<size_t> moved;
+        std::vector<size_t> alias;
+
+        explicit Relocation(size_t size) : moved(size + 1, NONE), alias(size + 1, NONE) {}
+
+        size_t Resolve(size_t pc) const;
+    };
+
+    const BlaiseProfile& profile_;
+
+    std::vector<std::pair<size_t, size_t>> definitions_;    // function -> function and pc of its DEFINE
+    std::vector<bool> unconditional_;                       // function -> its DEFINE runs on every path
+    std::vector<size_t> callee_of_name_;                    // name id -> function, if defined once
+
+private:
+
+    bool IsHotCallee(const TacFunction& callee) const;
+
+    bool IsHotElse(const TacInstruction& branch) const;
+
+    bool IsHotLoop(const TacInstruction& branch) const;
+
+    void FindDefinitions(const TacProgram& program);
+
+    bool IsDefinedAt(size_t caller, size_t pc, size_t callee) const;
+
+    static bool IsAssignedFirst(const TacFunction& func, size_t local);
+
+    void Inline(TacProgram& program, size_t caller) const;
+
+    void Layout(const std::vector<TacInstruction>& code, const std::vector<std::optional<Loop>>& loops,
+                size_t begin, size_t end, std::vector<TacInstruction>& out, Relocation& relocation) const;
+
+    void Layout(TacFunction& func) const;
+
+public:
+
+    explicit TacOptimizer(const BlaiseProfile& profile);
+
+    void Optimize(TacProgram& program);
+};
@@ -0,0 +1,139 @@
+#include <string>
+
+#include "TacProgram.h"
+
+static const char *OperationToString(BLAISE_OP_ID op) {
+    switch (op) {
+        case BLAISE_OP_ID::PLUS:    return " + ";
+        case BLAISE_OP_ID::MINUS:   return " - ";
+        case BLAISE_OP_ID::MUL:     return " * ";
+        case BLAISE_OP_ID::DIV:     return " / ";
+        case BLAISE_OP_ID::EQUAL:   return " == ";
+        case BLAISE_OP_ID::NEQUAL:  return " != ";
+        case BLAISE_OP_ID::LESS:    return " < ";
+        case BLAISE_OP_ID::LEQUAL:  return " <= ";
+        case BLAISE_OP_ID::GREATER: return " > ";
+        case BLAISE_OP_ID::GEQUAL:  return " >= ";
+    }
+
+    return " ? ";
+}
+
+std::string TacProgram::OperandToString(const TacFunction& func, const TacOperand& operand) const {
+    switch (operand.kind) {
+        case TAC_OPERAND_KIND::NONE:
+            return "";
+        case TAC_OPERAND_KIND::CONSTANT: {
+            const BlaiseVariable& value = constants[operand.index];
+
+            if (value.Is<std::string>())
+                return '"' + value.ToString() + '"';
+            if (value.Is<char>())
+                return '\'' + value.ToString() + '\'';
+
+            return value.ToString();
+        }
+        case TAC_OPERAND_KIND::GLOBAL:
+            return globals[operand.index];
+        case TAC_OPERAND_KIND::LOCAL:
+            return func.locals[operand.index];
+        case TAC_OPERAND_KIND::TEMP:
+            return "t" + std::to_string(operand.index);
+    }
+
+    return "";
+}
+
+void TacProgram::Dump(std::ostream& out) const {
+    for (const auto& func : functions) {
+        if (&func == &functions[MAIN_FUNCTION]) {
+            out << "main:" << std::endl;
+        } else {
+            out << "function " << func.name << '(';
+
+            for (size_t i = 0; i < func.param_count; i++)
+                out << (i ? ", " : "") << func.locals[i];
+
+            out << "):" << std::endl;
+        }
+
+        for (size_t pc = 0; pc < func.code.size(); pc++) {
+            const TacInstruction& instr = func.code[pc];
+            const std::string result = OperandToString(func, instr.result);
+            const std::string arg1 = OperandToString(func, instr.arg1);
+            const std::string arg2 = OperandToString(func, instr.arg2);
+
+            out << "    " << pc << ": ";
+
+            switch (instr.op) {
+                case TAC_OP_ID::COPY:
+                    out << result << " = " << arg1;
+                    break;
+                case TAC_OP_ID::BINARY:
+                    out << result << " = " << arg1 << OperationToString(instr.operation) << arg2;
+                    break;
+                case TAC_OP_ID::UNARY_MINUS:
+                    out << result << " = -" << arg1;
+                    break;
+                case TAC_OP_ID::UNARY_PLUS:
+                    out << result << " = +" << arg1;
+                    break;
+                case TAC_OP_ID::GOTO:
+                    out << "goto " << instr.label;
+                    break;
+                case TAC_OP_ID::IF_FALSE_GOTO:
+                case TAC_OP_ID::LOOP_FALSE_GOTO:
+                    out << "iffalse " << arg1 << " goto " << instr.label;
+                    break;
+                case TAC_OP_ID::IF_TRUE_GOTO:
+                case TAC_OP_ID::LOOP_TRUE_GOTO:
+                    out << "if " << arg1 << " goto " << instr.label;
+                    break;
+                case TAC_OP_ID::PARAM:
+                    out << "param " << arg1;
+                    break;
+                case TAC_OP_ID::CALL:
+                    out << result << " = call " << function_names[instr.label] << ", " << instr.count;
+                    break;
+                case TAC_OP_ID::RETURN:
+                    out << "return " << arg1;
+                    break;
+                case TAC_OP_ID::WRITELN:
+                    out << "writeln " << arg1;
+                    break;
+                case TAC_OP_ID::CHECK:
+                    out << "check " << arg1;
+                    break;
+                case TAC_OP_ID::ASSIGNED:
+                    out << result << " = assigned " << arg1;
+                    break;
+                case TAC_OP_ID::UNSET:
+                    out << "unset " << result << (arg1.empty() ? "" : " unless " + arg1);
+                    break;
+                case TAC_OP_ID::SWAP:
+                    out << "swap " << result << ", " << arg1;
+                    break;
+                case TAC_OP_ID::DEFINE:
+                    out << (result.empty() ? "" : result + " = ") << "define " << functions[instr.label].name;
+                    break;
+                case TAC_OP_ID::UNDEFINE:
+                    out << "undefine " << functions[instr.label].name << ", " << arg1;
+                    break;
+                case TAC_OP_ID::FAIL:
+                    out << "fail " << arg1;
+                    break;
+                case TAC_OP_ID::ENTER:
+                    out << "enter " << instr.label;
+                    break;
+                case TAC_OP_ID::LEAVE:
+                    out << "leave " << instr.label;
+                    break;
+                case TAC_OP_ID::HALT:
+                    out << "halt";
+                    break;
+            }
+
+            out << std::endl;
+        }
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "BlaiseClasses.h"
+
+enum class TAC_OP_ID {
+    COPY,               // result = arg1
+    BINARY,             // result = arg1 <operation> arg2
+    UNARY_MINUS,        // result = -arg1
+    UNARY_PLUS,         // result = +arg1
+    GOTO,               // goto label
+    IF_FALSE_GOTO,      // if not arg1 goto label (if statement condition)
+    LOOP_FALSE_GOTO,    // if not arg1 goto label (loop if condition)
+    IF_TRUE_GOTO,       // if arg1 goto label (if statement condition)
+    LOOP_TRUE_GOTO,     // if arg1 goto label (loop if condition)
+    PARAM,              // param arg1
+    CALL,               // result = call function label with count params
+    RETURN,             // return arg1
+    WRITELN,            // writeln arg1
+    CHECK,              // fail unless variable arg1 has been assigned
+    ASSIGNED,           // result = whether variable arg1 has been assigned
+    UNSET,              // unassign variable result, unless arg1 is true
+    SWAP,               // exchange the values of variables result and arg1
+    DEFINE,             // result = active definition of the name, define function label
+    UNDEFINE,           // make arg1 the active definition of the name of function label again
+    FAIL,               // fail with the message arg1
+    ENTER,              // frame label begins, only until lowering is done
+    LEAVE,              // frame label ends, only until lowering is done
+    HALT,
+};
+
+enum class TAC_OPERAND_KIND {
+    NONE,
+    CONSTANT,
+    GLOBAL,
+    LOCAL,
+    TEMP,
+};
+
+struct TacOperand {
+    TAC_OPERAND_KIND kind = TAC_OPERAND_KIND::NONE;
+    size_t index = 0;
+
+    bool operator==(const TacOperand& other) const {
+        return kind == other.kind && index == other.index;
+    }
+};
+
+struct TacInstruction {
+    TAC_OP_ID op;
+    BLAISE_OP_ID operation = BLAISE_OP_ID::PLUS;
+    TacOperand result;
+    TacOperand arg1;
+    TacOperand arg2;
+    size_t label = 0;
+    size_t count = 0;
+    SourcePosition position;    // of the if or loop statement for branches
+};
+
+// A compilation unit of the flat TAC: the program body (function 0)
+// or a user-defined function. Locals are the parameters followed by
+// the variables first assigned inside the body and the slots lowering
+// keeps its own state in, temps follow the locals in the frame.
+struct TacFunction {
+    std::string name;
+    size_t name_id = 0;
+    SourcePosition position;
+    size_t param_count = 0;
+    std::vector<std::string> locals;
+    size_t temp_count = 0;
+    std::vector<TacInstruction> code;
+
+    size_t FrameSize() const { return locals.size() + temp_count; }
+};
+
+// Flat three-address program built by TacLoweringVisitor. Variables and
+// temporaries are resolved to indexed slots, control flow is expressed
+// with jumps to instruction indices of the enclosing function.
+class TacProgram {
+public:
+    static constexpr size_t MAIN_FUNCTION = 0;
+
+    std::vector<BlaiseVariable> constants;
+    std::vector<std::string> globals;
+    std::vector<std::string> function_names;
+    std::vector<TacFunction> functions;
+
+    std::string OperandToString(const TacFunction& func, const TacOperand& operand) const;
+
+    void Dump(std::ostream& out) const;
+};
@@ -0,0 +1,315 @@
+#include <algorithm>
+
+#include "TacTypes.h"
+
+static bool IsNumeric(TAC_TYPE_ID type) {
+    return type == TAC_TYPE_ID::INT || type == TAC_TYPE_ID::DOUBLE;
+}
+
+static TAC_TYPE_ID ConstantType(const BlaiseVariable& value) {
+    if (value.Is<int>())            return TAC_TYPE_ID::INT;
+    if (value.Is<double>())         return TAC_TYPE_ID::DOUBLE;
+    if (value.Is<bool>())           return TAC_TYPE_ID::BOOL;
+    if (value.Is<char>())           return TAC_TYPE_ID::CHAR;
+    if (value.Is<std::string>())    return TAC_TYPE_ID::STRING;
+
+    return TAC_TYPE_ID::DYNAMIC;
+}
+
+TAC_TYPE_ID TacTypeInference::Join(TAC_TYPE_ID lhs, TAC_TYPE_ID rhs) {
+    if (lhs == TAC_TYPE_ID::UNKNOWN) return rhs;
+    if (rhs == TAC_TYPE_ID::UNKNOWN) return lhs;
+    if (lhs == rhs) return lhs;
+
+    return TAC_TYPE_ID::DYNAMIC;
+}
+
+// Mirrors BlaiseVariable::CastToOneType and the operators built on it.
+// Combinations that fail at run time are DYNAMIC, so the error is
+// reported by the dynamic path.
+TAC_TYPE_ID TacTypeInference::BinaryResult(BLAISE_OP_ID operation, TAC_TYPE_ID lhs, TAC_TYPE_ID rhs) {
+    if (lhs == TAC_TYPE_ID::DYNAMIC || rhs == TAC_TYPE_ID::DYNAMIC)
+        return TAC_TYPE_ID::DYNAMIC;
+    if (lhs == TAC_TYPE_ID::UNKNOWN || rhs == TAC_TYPE_ID::UNKNOWN)
+        return TAC_TYPE_ID::UNKNOWN;
+
+    switch (operation) {
+        case BLAISE_OP_ID::PLUS:
+            if (lhs == TAC_TYPE_ID::STRING)
+                return TAC_TYPE_ID::STRING;
+            if (lhs == TAC_TYPE_ID::BOOL && rhs == TAC_TYPE_ID::BOOL)
+                return TAC_TYPE_ID::BOOL;
+            // fallthrough
+        case BLAISE_OP_ID::MINUS:
+        case BLAISE_OP_ID::MUL:
+        case BLAISE_OP_ID::DIV:
+            if (lhs == TAC_TYPE_ID::INT && rhs == TAC_TYPE_ID::INT)
+                return TAC_TYPE_ID::INT;
+            if (IsNumeric(lhs) && IsNumeric(rhs))
+                return TAC_TYPE_ID::DOUBLE;
+            break;
+        case BLAISE_OP_ID::EQUAL:
+        case BLAISE_OP_ID::NEQUAL:
+            if (lhs == TAC_TYPE_ID::STRING || lhs == rhs || (IsNumeric(lhs) && IsNumeric(rhs)))
+                return TAC_TYPE_ID::BOOL;
+            break;
+        case BLAISE_OP_ID::LESS:
+        case BLAISE_OP_ID::LEQUAL:
+        case BLAISE_OP_ID::GREATER:
+        case BLAISE_OP_ID::GEQUAL:
+            if ((IsNumeric(lhs) && IsNumeric(rhs)) || (lhs == TAC_TYPE_ID::CHAR && rhs == TAC_TYPE_ID::CHAR))
+                return TAC_TYPE_ID::BOOL;
+            break;
+    }
+
+    return TAC_TYPE_ID::DYNAMIC;
+}
+
+TAC_TYPE_ID TacTypeInference::UnaryResult(TAC_TYPE_ID type) {
+    if (type == TAC_TYPE_ID::UNKNOWN || IsNumeric(type))
+        return type;
+
+    return TAC_TYPE_ID::DYNAMIC;
+}
+
+bool TacTypeInference::IsNative(TAC_TYPE_ID type) {
+    return type == TAC_TYPE_ID::INT || type == TAC_TYPE_ID::DOUBLE
+        || type == TAC_TYPE_ID::BOOL || type == TAC_TYPE_ID::CHAR;
+}
+
+TAC_TYPE_ID TacTypeInference::Representation(TAC_TYPE_ID type) {
+    return IsNative(type) ? type : TAC_TYPE_ID::DYNAMIC;
+}
+
+TacTypeInference::TacTypeInference(const TacProgram& program) : program_(program) {
+    globals.assign(program.globals.size(), TAC_TYPE_ID::UNKNOWN);
+    returns.assign(program.function_names.size(), TAC_TYPE_ID::UNKNOWN);
+    params.resize(program.function_names.size());
+    functions.resize(program.functions.size());
+
+    for (size_t f = 0; f < program.functions.size(); f++) {
+        const TacFunction& func = program.functions[f];
+
+        functions[f].locals.assign(func.locals.size(), TAC_TYPE_ID::UNKNOWN);
+        functions[f].temps.assign(func.temp_count, TAC_TYPE_ID::UNKNOWN);
+
+        FindReachable(f);
+        MatchCalls(f);
+
+        if (f != TacProgram::MAIN_FUNCTION && params[func.name_id].size() < func.param_count)
+            params[func.name_id].resize(func.param_count, TAC_TYPE_ID::UNKNOWN);
+    }
+
+    do {
+        changed_ = false;
+
+        for (size_t f = 0; f < program.functions.size(); f++)
+            Propagate(f);
+    } while (changed_);
+}
+
+TAC_TYPE_ID TacTypeInference::TypeOf(size_t function, const TacOperand& operand) const {
+    switch (operand.kind) {
+        case TAC_OPERAND_KIND::CONSTANT:
+            return ConstantType(program_.constants[operand.index]);
+        case TAC_OPERAND_KIND::GLOBAL:
+            return globals[operand.index];
+        case TAC_OPERAND_KIND::LOCAL:
+            return functions[function].locals[operand.index];
+        case TAC_OPERAND_KIND::TEMP:
+            return functions[function].temps[operand.index];
+        case TAC_OPERAND_KIND::NONE:
+            break;
+    }
+
+    return TAC_TYPE_ID::DYNAMIC;
+}
+
+void TacTypeInference::Update(TAC_TYPE_ID& slot, TAC_TYPE_ID type) {
+    TAC_TYPE_ID joined = Join(slot, type);
+
+    if (joined != slot) {
+        slot = joined;
+        changed_ = true;
+    }
+}
+
+void TacTypeInference::Update(size_t function, const TacOperand& operand, TAC_TYPE_ID type) {
+    switch (operand.kind) {
+        case TAC_OPERAND_KIND::GLOBAL:
+            Update(globals[operand.index], type);
+            break;
+        case TAC_OPERAND_KIND::LOCAL:
+            Update(functions[function].locals[operand.index], type);
+            break;
+        case TAC_OPERAND_KIND::TEMP:
+            Update(functions[function].temps[operand.index], type);
+            break;
+        default:
+            break;
+    }
+}
+
+void TacTypeInference::FindReachable(size_t function) {
+    const std::vector<TacInstruction>& code = program_.functions[function].code;
+    std::vector<bool>& reachable = functions[function].reachable;
+    std::vector<size_t> pending = { 0 };
+
+    reachable.assign(code.size(), false);
+
+    while (!pending.empty()) {
+        size_t pc = pending.back();
+        pending.pop_back();
+
+        if (pc >= code.size() || reachable[pc])
+            continue;
+
+        reachable[pc] = true;
+
+        switch (code[pc].op) {
+            case TAC_OP_ID::GOTO:
+                pending.push_back(code[pc].label);
+                break;
+            case TAC_OP_ID::IF_FALSE_GOTO:
+            case TAC_OP_ID::LOOP_FALSE_GOTO:
+            case TAC_OP_ID::IF_TRUE_GOTO:
+            case TAC_OP_ID::LOOP_TRUE_GOTO:
+                pending.push_back(code[pc].label);
+                pending.push_back(pc + 1);
+                break;
+            case TAC_OP_ID::RETURN:
+            case TAC_OP_ID::FAIL:
+            case TAC_OP_ID::HALT:
+                break;
+            default:
+                pending.push_back(pc + 1);
+                break;
+        }
+    }
+}
+
+// Arguments are pushed right before the call that consumes them and
+// calls nest like brackets, so a stack pairs them up in one pass.
+void TacTypeInference::MatchCalls(size_t function) {
+    const std::vector<TacInstruction>& code = program_.functions[function].code;
+    TacFunctionTypes& types = functions[function];
+    std::vector<size_t> pending;
+
+    types.param_call.assign(code.size(), { 0, 0 });
+    types.call_params.assign(code.size(), {});
+
+    for (size_t pc = 0; pc < code.size(); pc++) {
+        if (code[pc].op == TAC_OP_ID::PARAM) {
+            pending.push_back(pc);
+        } else if (code[pc].op == TAC_OP_ID::CALL) {
+            size_t first = pending.size() - std::min(pending.size(), code[pc].count);
+
+            for (size_t i = first; i < pending.size(); i++) {
+                types.param_call[pending[i]] = { pc, i - first };
+                types.call_params[pc].push_back(pending[i]);
+            }
+
+            pending.resize(first);
+        }
+    }
+}
+
+void TacTypeInference::Propagate(size_t function) {
+    const TacFunction& func = program_.functions[function];
+
+    for (size_t pc = 0; pc < func.code.size(); pc++) {
+        const TacInstruction& instr = func.code[pc];
+
+        if (!functions[function].reachable[pc])
+            continue;
+
+        switch (instr.op) {
+            case TAC_OP_ID::COPY:
+                Update(function, instr.result, TypeOf(function, instr.arg1));
+                break;
+            case TAC_OP_ID::BINARY:
+                Update(function, instr.result, BinaryResult(instr.operation,
+                                                            TypeOf(function, instr.arg1),
+                                                            TypeOf(function, instr.arg2)));
+                break;
+            case TAC_OP_ID::UNARY_MINUS:
+            case TAC_OP_ID::UNARY_PLUS:
+                Update(function, instr.result, UnaryResult(TypeOf(function, instr.arg1)));
+                break;
+            case TAC_OP_ID::PARAM: {
+                const auto& [call, index] = functions[function].param_call[pc];
+                std::vector<TAC_TYPE_ID>& callee_params = params[func.code[call].label];
+
+                if (callee_params.size() <= index)
+                    callee_params.resize(index + 1, TAC_TYPE_ID::UNKNOWN);
+
+                Update(callee_params[index], TypeOf(function, instr.arg1));
+                break;
+            }
+            case TAC_OP_ID::CALL:
+                Update(function, instr.result, returns[instr.label]);
+                break;
+            case TAC_OP_ID::RETURN:
+                if (function != TacProgram::MAIN_FUNCTION)
+                    Update(returns[func.name_id], TypeOf(function, instr.arg1));
+                break;
+            case TAC_OP_ID::CHECK:
+                // The slot may hold no value yet, which takes a tagged one
+                Update(function, instr.arg1, TAC_TYPE_ID::DYNAMIC);
+                break;
+            case TAC_OP_ID::ASSIGNED:
+                Update(function, instr.result, TAC_TYPE_ID::BOOL);
+                Update(function, instr.arg1, TAC_TYPE_ID::DYNAMIC);
+                break;
+            case TAC_OP_ID::UNSET:
+                Update(function, instr.result, TAC_TYPE_ID::DYNAMIC);
+                break;
+            case TAC_OP_ID::SWAP:
+                // Either side may be unassigned
+                Update(function, instr.result, TAC_TYPE_ID::DYNAMIC);
+                Update(function, instr.arg1, TAC_TYPE_ID::DYNAMIC);
+                break;
+            case TAC_OP_ID::DEFINE:
+                Update(function, instr.result, TAC_TYPE_ID::INT);
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (function == TacProgram::MAIN_FUNCTION)
+        return;
+
+    // Parameters are locals of every definition at once: whatever the
+    // body assigns to them has to fit the slot the callers fill.
+    std::vector<TAC_TYPE_ID>& shared = params[func.name_id];
+
+    for (size_t i = 0; i < func.param_count; i++) {
+        Update(shared[i], functions[function].locals[i]);
+        Update(functions[function].locals[i], shared[i]);
+    }
+}
+
+void SplitTemporaries(TacProgram& program) {
+    for (TacFunction& func : program.functions) {
+        std::vector<size_t> current(func.temp_count, 0);
+        size_t next = 0;
+
+        auto rename = [&](TacOperand& operand) {
+            if (operand.kind == TAC_OPERAND_KIND::TEMP)
+                operand.index = current[operand.index];
+        };
+
+        for (TacInstruction& instr : func.code) {
+            rename(instr.arg1);
+            rename(instr.arg2);
+
+            if (instr.result.kind == TAC_OPERAND_KIND::TEMP) {
+                current[instr.result.index] = next;
+                instr.result.index = next++;
+            }
+        }
+
+        func.temp_count = next;
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include "TacProgram.h"
+
+// Static type of a TAC slot. UNKNOWN means that no value reaches the slot
+// (yet), DYNAMIC that values of different types, or no value at all, can.
+enum class TAC_TYPE_ID {
+    UNKNOWN,
+    INT,
+    DOUBLE,
+    BOOL,
+    CHAR,
+    STRING,
+    DYNAMIC,
+};
+
+struct TacFunctionTypes {
+    std::vector<TAC_TYPE_ID> locals;
+    std::vector<TAC_TYPE_ID> temps;
+    std::vector<bool> reachable;
+
+    // For every PARAM instruction, the CALL it belongs to and its position
+    // in the argument list; for every CALL, the PARAM instructions.
+    std::vector<std::pair<size_t, size_t>> param_call;
+    std::vector<std::vector<size_t>> call_params;
+};
+
+// Flow-insensitive type inference over a TacProgram. Every slot gets the
+// join of the types of all values stored into it, so a slot typed INT
+// only ever holds an int and can be kept in a native variable. Function
+// parameters and return values are shared by all definitions of the same
+// name, since calls are bound by name at run time.
+class TacTypeInference {
+private:
+
+    const TacProgram& program_;
+    bool changed_ = false;
+
+private:
+
+    void Update(size_t function, const TacOperand& operand, TAC_TYPE_ID type);
+
+    void Update(TAC_TYPE_ID& slot, TAC_TYPE_ID type);
+
+    void FindReachable(size_t function);
+
+    void MatchCalls(size_t function);
+
+    void Propagate(size_t function);
+
+public:
+
+    std::vector<TAC_TYPE_ID> globals;
+    std::vector<TacFunctionTypes> functions;
+    std::vector<TAC_TYPE_ID> returns;                 // per function name id
+    std::vector<std::vector<TAC_TYPE_ID>> params;     // per function name id
+
+    explicit TacTypeInference(const TacProgram& program);
+
+    TAC_TYPE_ID TypeOf(size_t function, const TacOperand& operand) const;
+
+    static TAC_TYPE_ID Join(TAC_TYPE_ID lhs, TAC_TYPE_ID rhs);
+
+    static TAC_TYPE_ID BinaryResult(BLAISE_OP_ID operation, TAC_TYPE_ID lhs, TAC_TYPE_ID rhs);
+
+    static TAC_TYPE_ID UnaryResult(TAC_TYPE_ID type);
+
+    // INT, DOUBLE, BOOL and CHAR values fit into native variables,
+    // strings and dynamically typed slots need a tagged value.
+    static bool IsNative(TAC_TYPE_ID type);
+
+    // How a slot of the given type is stored by the backends: its own
+    // type if it is native, DYNAMIC otherwise.
+    static TAC_TYPE_ID Representation(TAC_TYPE_ID type);
+};
+
+// Gives every write to a temporary its own temp slot. Lowering reuses
+// temps from one statement to the next, which would otherwise merge
+// unrelated types in TacTypeInference. Temps never live across a jump
+// except for the branch condition right before it, so renaming in code
+// order is exact.
+void SplitTemporaries(TacProgram& program);
@@ -12,11 +12,14 @@ enum blaise_debug_level {
 #define ON_DEBUG(__level) \
     if (DEBUG >= __level)
 
-#define DEBUG_BEGIN(__level) \
-    ON_DEBUG(__level) std::cout << "In function " << __func__ << std::endl
+// Debug output goes to the stream of the visitor, not to std::cout, so
+// that visitors running on different threads do not share one
 
-#define DEBUG__PRINT_VAL(__level, __val) \
-    ON_DEBUG(__level) std::cout << #__val << " = " << __val << std::endl
+#define DEBUG_BEGIN(__out, __level) \
+    ON_DEBUG(__level) (__out) << "In function " << __func__ << std::endl
 
-#define DEBUG_OUT(__level) \
-    ON_DEBUG(__level) std::cout << __func__ << ": "
\ No newline at end of file
+#define DEBUG__PRINT_VAL(__out, __level, __val) \
+    ON_DEBUG(__level) (__out) << #__val << " = " << __val << std::endl
+
+#define DEBUG_OUT(__out, __level) \
+    ON_DEBUG(__level) (__out) << __func__ << ": "
\ No newline at end of file
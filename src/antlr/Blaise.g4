@@ -2,7 +2,8 @@ grammar Blaise;
 
 program : (stmt)* EOF;
 
-stmt    : function_def
+stmt    : import_stmt
+        | function_def
         | function_call
         | block
         | expr
@@ -13,6 +14,9 @@ stmt    : function_def
         | writeln_stmt
         ;
 
+import_stmt     : 'import' STRING                                                           # ImportStmt
+                ;
+
 function_def    : FUNCTION IDENTIFIER '(' (param_list)? ')' stmt                            # FunctionDefinition
                 ;
 
@@ -46,6 +50,7 @@ loop_stmt       : 'loop' 'if' '(' expr ')' (stmt)?
                 ;
 
 assignment      : IDENTIFIER ASSIGN expr                                                    # AssignStmt
+                | IDENTIFIER '[' expr ']' ASSIGN expr                                       # IndexAssignStmt
                 ;
 
 expr            : operand operator expr                                                     # ExprOperation
@@ -59,6 +64,8 @@ operand         : BOOLEAN
                 | DOUBLE                                                                    # OperandDouble
                 | CHAR                                                                      # OperandChar
                 | STRING                                                                    # OperandString
+                | '[' (arg_list)? ']'                                                       # OperandArray
+                | IDENTIFIER '[' expr ']'                                                   # OperandIndex
                 | IDENTIFIER                                                                # OperandId
                 | function_call                                                             # OperandFunctionCall
                 | '(' expr ')'                                                              # OperandExpr
@@ -1,64 +1,1443 @@
+#include <algorithm>
 #include <any>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
 #include <antlr4-runtime.h>
 #include <stdexcept>
 #include "ANTLRInputStream.h"
 #include "CommonTokenStream.h"
+#include "BlaiseAst.h"
+#include "BlaiseCache.h"
+#include "BlaiseFastLexer.h"
+#include "BlaiseParse.h"
+#include "BlaiseServer.h"
+#include "BlaiseSnapshot.h"
+#include "BlaiseSource.h"
+#include "TacAsmEmitter.h"
+#include "TacCEmitter.h"
 #include "TacCompilerVisitor.h"
+#include "TacLoweringVisitor.h"
+#include "TacExecutor.h"
+#include "TacOptimizer.h"
 #include "antlr/BlaiseParser.h"
 #include "antlr/BlaiseLexer.h"
 
 #include "InterpreterVisitor.h"
 #include "BlaiseErrorListener.h"
 
-enum ARGV_POSITIONS {
-    IN_FILE = 2,
-    COMMAND = 1
+struct Options {
+    const char *command = nullptr;
+    const char *in_file = nullptr;
+    std::vector<const char *> in_files;     // in_file and the files after it
+    const char *out_file = nullptr;
+    std::string profile_in;
+    std::string profile_out;
+    std::string snapshot_out;
+    std::string restore;
+    size_t snapshot_after = 0;              // line, 0 if no snapshot is taken
+    uint64_t max_steps = 0;                 // 0 for no limit, as timeout
+    uint64_t timeout = 0;                   // ms
+    uint64_t max_memory = 0;                // MB
+    std::string emit = "tac";
+    std::string socket;
+    size_t jobs = 1;
+    bool time_phases = false;
+    bool memory_report = false;
+    bool parse_profile = false;
+    bool fast_lexer = false;
+    bool no_cache = false;
+    bool stream = false;
+    bool lazy_bodies = false;
 };
 
-int main(int argc, const char** argv) {
-    if (argc < 3) {
-        std::cout << "Usage: ./blaise [command] [input_file.bls]" << std::endl;
+// Exit status of a program stopped by --max-steps, --timeout or
+// --max-memory, the one timeout(1) uses
+constexpr int LIMIT_EXIT_STATUS = 124;
+
+// Reports the wall time of each phase and the peak resident set size at
+// its end to stderr as "phase <name> <ms> <peak KiB>", so that
+// bench/run.py can tell parsing, compilation and execution apart.
+class PhaseTimer {
+    using Clock = std::chrono::steady_clock;
+
+    bool enabled_;
+    Clock::time_point start_ = Clock::now();
+
+    static long PeakRss() {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+        return usage.ru_maxrss / 1024;      // bytes
+#else
+        return usage.ru_maxrss;             // KiB
+#endif
+    }
+
+public:
+    explicit PhaseTimer(bool enabled) : enabled_(enabled) {}
+
+    void Done(const char *phase) {
+        Clock::time_point now = Clock::now();
+
+        if (enabled_)
+            std::cerr << "phase " << phase << " "
+                      << std::chrono::duration<double, std::milli>(now - start_).count() << " "
+                      << PeakRss() << std::endl;
+
+        start_ = now;
+    }
+};
+
+// Applies --max-steps, --timeout and --max-memory to interpreter. Memory is
+// only counted if it is limited or reported.
+static void SetLimits(const Options& options, InterpreterVisitor& interpreter) {
+    interpreter.SetLimits(options.max_steps, std::chrono::milliseconds(options.timeout));
+
+    if (options.max_memory != 0 || options.memory_report)
+        interpreter.CountMemory(options.max_memory << 20);
+}
+
+// With --memory-report, prints the highest number of bytes the run held to
+// err as "memory peak <total> values <bytes> frames <bytes> trees <bytes>"
+static void ReportMemory(const Options& options, const InterpreterVisitor& interpreter, std::ostream& err) {
+    if (!options.memory_report)
+        return;
+
+    MemoryUsage peak = interpreter.PeakMemory();
+
+    err << "memory peak " << peak.Total() << " values " << peak.values << " frames " << peak.frames
+        << " trees " << peak.trees << std::endl;
+}
+
+static bool ParseOptions(int argc, const char** argv, Options& options) {
+    if (argc < 2)
+        return false;
+
+    options.command = argv[1];
+
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg.rfind("--emit=", 0) == 0)
+            options.emit = arg.substr(7);
+        else if (arg.rfind("--profile-in=", 0) == 0)
+            options.profile_in = arg.substr(13);
+        else if (arg.rfind("--profile-out=", 0) == 0)
+            options.profile_out = arg.substr(14);
+        else if (arg == "--fast-lexer")
+            options.fast_lexer = true;
+        else if (arg == "--no-cache")
+            options.no_cache = true;
+        else if (arg == "--stream")
+            options.stream = true;
+        else if (arg.rfind("--snapshot-after=", 0) == 0 && arg.size() > 17
+                 && arg.find_first_not_of("0123456789", 17) == std::string::npos)
+            options.snapshot_after = std::stoul(arg.substr(17));
+        else if (arg.rfind("--max-steps=", 0) == 0 && arg.size() > 12
+                 && arg.find_first_not_of("0123456789", 12) == std::string::npos)
+            options.max_steps = std::stoull(arg.substr(12));
+        else if (arg.rfind("--timeout=", 0) == 0 && arg.size() > 10
+                 && arg.find_first_not_of("0123456789", 10) == std::string::npos)
+            options.timeout = std::stoull(arg.substr(10));
+        else if (arg.rfind("--max-memory=", 0) == 0 && arg.size() > 13
+                 && arg.find_first_not_of("0123456789", 13) == std::string::npos)
+            options.max_memory = std::stoull(arg.substr(13));
+        else if (arg == "--memory-report")
+            options.memory_report = true;
+        else if (arg.rfind("--snapshot-out=", 0) == 0)
+            options.snapshot_out = arg.substr(15);
+        else if (arg.rfind("--restore=", 0) == 0)
+            options.restore = arg.substr(10);
+        else if (arg.rfind("--socket=", 0) == 0)
+            options.socket = arg.substr(9);
+        else if (arg == "--lazy-bodies")
+            options.lazy_bodies = true;
+        else if (arg == "--parse-profile")
+            options.parse_profile = true;
+        else if (arg == "--time-phases")
+            options.time_phases = true;
+        else if (arg == "-o" && i + 1 < argc)
+            options.out_file = argv[++i];
+        else if (arg == "-j")
+            options.jobs = std::max(std::thread::hardware_concurrency(), 1u);
+        else if (arg.rfind("-j", 0) == 0 && arg.find_first_not_of("0123456789", 2) == std::string::npos)
+            options.jobs = std::max(std::stoul(arg.substr(2)), 1ul);
+        else if (arg[0] != '-')
+            options.in_files.push_back(argv[i]);
+        else
+            return false;
+    }
+
+    if (!options.in_files.empty())
+        options.in_file = options.in_files[0];
+
+    // The REPL reads stdin, a file is only preloaded. The server gets its
+    // files from clients.
+    return options.in_file != nullptr || strcmp(options.command, "repl") == 0 ||
+           strcmp(options.command, "serve") == 0;
+}
+
+static void PrintUsage() {
+    std::cout << "Usage: ./blaise [command] [options] [input_file.bls...]\n"
+              << "Options: --emit=tac|c|asm, -o output_file, -j[N],\n"
+              << "         --profile-out=file (interp), --profile-in=file, --time-phases,\n"
+              << "         --parse-profile, --fast-lexer, --no-cache, --stream (interp),\n"
+              << "         --lazy-bodies (interp), --socket=path,\n"
+              << "         --snapshot-after=line --snapshot-out=file (interp), --restore=file (interp),\n"
+              << "         --max-steps=N --timeout=ms --max-memory=MB --memory-report (interp)\n"
+              << "Commands: comp, interp, exec-tac, lexcheck, repl, serve" << std::endl;
+}
+
+// Reports errors the way the default console listener does, to out
+class StreamErrorListener : public antlr4::BaseErrorListener {
+    std::ostream& out_;
+
+public:
+    size_t errors = 0;
+
+    explicit StreamErrorListener(std::ostream& out) : out_(out) {}
+
+    void syntaxError(antlr4::Recognizer *recognizer, antlr4::Token *offendingSymbol, size_t line,
+                     size_t charPositionInLine, const std::string &msg, std::exception_ptr e) override {
+        out_ << "line " << line << ":" << charPositionInLine << " " << msg << std::endl;
+        errors++;
+    }
+};
+
+// Keeps lexer errors, so that both lexers can be compared on them
+class CollectingErrorListener : public antlr4::BaseErrorListener {
+public:
+    std::vector<std::string> messages;
+
+    void syntaxError(antlr4::Recognizer *recognizer, antlr4::Token *offendingSymbol, size_t line,
+                     size_t charPositionInLine, const std::string &msg, std::exception_ptr e) override {
+        messages.push_back(std::to_string(line) + ":" + std::to_string(charPositionInLine) + " " + msg);
+    }
+};
+
+static std::string DescribeToken(const antlr4::Token& token) {
+    return std::to_string(token.getType()) + " '" + token.getText() + "' at " + std::to_string(token.getLine())
+           + ":" + std::to_string(token.getCharPositionInLine()) + " [" + std::to_string(token.getStartIndex())
+           + ", " + std::to_string(token.getStopIndex()) + "]";
+}
+
+static bool SameToken(const antlr4::Token& a, const antlr4::Token& b) {
+    return a.getType() == b.getType() && a.getText() == b.getText() && a.getLine() == b.getLine()
+           && a.getCharPositionInLine() == b.getCharPositionInLine() && a.getChannel() == b.getChannel()
+           && a.getStartIndex() == b.getStartIndex() && a.getStopIndex() == b.getStopIndex();
+}
+
+// Reads both token sources to the end and reports the first difference in
+// tokens or lexer errors.
+static bool SameTokens(antlr4::TokenSource& expected, const CollectingErrorListener& expected_errors,
+                       antlr4::TokenSource& actual, const CollectingErrorListener& actual_errors,
+                       const std::string& name) {
+    for (size_t count = 1;; count++) {
+        std::unique_ptr<antlr4::Token> expected_token = expected.nextToken();
+        std::unique_ptr<antlr4::Token> actual_token = actual.nextToken();
+
+        if (!SameToken(*expected_token, *actual_token)) {
+            std::cout << name << ": token " << count << " differs\n  expected: " << DescribeToken(*expected_token)
+                      << "\n  actual:   " << DescribeToken(*actual_token) << std::endl;
+            return false;
+        }
+
+        if (expected_token->getType() == antlr4::Token::EOF)
+            break;
+    }
+
+    if (expected_errors.messages == actual_errors.messages)
+        return true;
+
+    std::cout << name << ": lexer errors differ\n  expected:";
+
+    for (const std::string& message : expected_errors.messages)
+        std::cout << "\n    " << message;
+
+    std::cout << "\n  actual:";
+
+    for (const std::string& message : actual_errors.messages)
+        std::cout << "\n    " << message;
+
+    std::cout << std::endl;
+    return false;
+}
+
+// Checks the hand-written lexer and the generated lexer reading the mapped
+// file against the generated lexer reading an ANTLRInputStream.
+static int CheckLexers(std::string_view source) {
+    antlr4::ANTLRInputStream reference_input(source);
+    BlaiseLexer reference(&reference_input);
+    MappedCharStream mapped_input(source, "");
+    BlaiseLexer mapped(&mapped_input);
+    BlaiseFastLexer fast(source);
+    CollectingErrorListener reference_errors;
+    CollectingErrorListener mapped_errors;
+    CollectingErrorListener fast_errors;
+
+    reference.removeErrorListeners();
+    reference.addErrorListener(&reference_errors);
+    mapped.removeErrorListeners();
+    mapped.addErrorListener(&mapped_errors);
+    fast.removeErrorListeners();
+    fast.addErrorListener(&fast_errors);
+
+    if (!SameTokens(reference, reference_errors, mapped, mapped_errors, "mapped input"))
+        return 1;
+
+    // The reference lexer is at EOF now, start it over for the second run
+    reference_input.seek(0);
+    reference.reset();
+    reference_errors.messages.clear();
+
+    if (!SameTokens(reference, reference_errors, fast, fast_errors, "fast lexer"))
         return 1;
+
+    std::cout << "Tokens and " << fast_errors.messages.size() << " lexer errors match" << std::endl;
+    return 0;
+}
+
+// Prints ANTLR decision statistics, the most expensive decisions first.
+// Times are in milliseconds, lookahead in tokens.
+static void PrintParseProfile(BlaiseParser& parser, bool retried) {
+    antlr4::atn::ParseInfo info(parser.getInterpreter<antlr4::atn::ProfilingATNSimulator>());
+    std::vector<antlr4::atn::DecisionInfo> all = info.getDecisionInfo();
+    std::vector<const antlr4::atn::DecisionInfo *> decisions;
+
+    for (const antlr4::atn::DecisionInfo& d : all)
+        if (d.invocations > 0)
+            decisions.push_back(&d);
+
+    std::sort(decisions.begin(), decisions.end(), [](const antlr4::atn::DecisionInfo *a,
+                                                     const antlr4::atn::DecisionInfo *b) {
+        if (a->timeInPrediction != b->timeInPrediction)
+            return a->timeInPrediction > b->timeInPrediction;
+
+        return a->SLL_TotalLook + a->LL_TotalLook > b->SLL_TotalLook + b->LL_TotalLook;
+    });
+
+    std::cerr << "Parsed in " << (retried ? "SLL, then LL after an SLL failure" : "SLL") << "\n"
+              << "Prediction time " << info.getTotalTimeInPrediction() / 1e6 << " ms, lookahead "
+              << info.getTotalSLLLookaheadOps() << " SLL / " << info.getTotalLLLookaheadOps() << " LL\n"
+              << std::left << std::setw(20) << "rule" << std::right << std::setw(9) << "decision"
+              << std::setw(12) << "calls" << std::setw(11) << "time ms" << std::setw(12) << "SLL look"
+              << std::setw(9) << "SLL max" << std::setw(12) << "LL look" << std::setw(9) << "LL max"
+              << std::setw(11) << "fallbacks" << std::setw(8) << "ambig" << "\n";
+
+    for (const antlr4::atn::DecisionInfo *d : decisions) {
+        size_t rule = parser.getATN().getDecisionState(d->decision)->ruleIndex;
+
+        std::cerr << std::left << std::setw(20) << parser.getRuleNames()[rule] << std::right
+                  << std::setw(9) << d->decision << std::setw(12) << d->invocations
+                  << std::setw(11) << d->timeInPrediction / 1e6 << std::setw(12) << d->SLL_TotalLook
+                  << std::setw(9) << d->SLL_MaxLook << std::setw(12) << d->LL_TotalLook
+                  << std::setw(9) << d->LL_MaxLook << std::setw(11) << d->LL_Fallback
+                  << std::setw(8) << d->ambiguities.size() << "\n";
     }
-    std::ifstream infile(argv[IN_FILE]);
 
-    if (!infile.is_open())
+    std::cerr.flush();
+}
+
+// Lexer for source, a part of the input that starts at line and column
+// (in code points), so that tokens carry the positions of a full parse.
+// input has to read source. Lexer errors go to errors instead of the
+// console if it is given.
+static std::unique_ptr<antlr4::TokenSource> MakeLexer(const Options& options, MappedCharStream& input,
+                                                      std::string_view source, const std::string& name,
+                                                      size_t line = 1, size_t column = 0,
+                                                      antlr4::ANTLRErrorListener *errors = nullptr) {
+    auto setup = [&](auto& lexer) {
+        lexer.setLine(line);
+        lexer.setCharPositionInLine(column);
+
+        if (errors != nullptr) {
+            lexer.removeErrorListeners();
+            lexer.addErrorListener(errors);
+        }
+    };
+
+    if (options.fast_lexer) {
+        auto lexer = std::make_unique<BlaiseFastLexer>(source, name);
+        setup(*lexer);
+        return lexer;
+    }
+
+    auto lexer = std::make_unique<BlaiseLexer>(&input);
+    setup(*lexer);
+    return lexer;
+}
+
+// Files below this size are not worth starting threads for
+constexpr size_t PARALLEL_PARSE_MIN_SIZE = 1 << 20;
+
+// Parses one chunk of a split source into ast. Errors are only counted,
+// returns false if there were any.
+static bool ParseChunk(const Options& options, std::string_view source, const SourceChunk& chunk,
+                       BlaiseAst& ast) {
+    std::string_view text = source.substr(chunk.range.begin, chunk.range.end - chunk.range.begin);
+    MappedCharStream input(text, options.in_file);
+    CollectingErrorListener errors;
+    std::unique_ptr<antlr4::TokenSource> lexer = MakeLexer(options, input, text, options.in_file, chunk.line,
+                                                           chunk.column, &errors);
+    antlr4::CommonTokenStream tokens(lexer.get());
+    BlaiseParser parser(&tokens);
+    bool retried;
+    BlaiseParser::ProgramContext *program = ParseRule(parser, tokens, errors, retried, &BlaiseParser::program);
+
+    if (!errors.messages.empty() || parser.getNumberOfSyntaxErrors())
+        return false;
+
+    ast = BlaiseAst::Build(program);
+
+    return true;
+}
+
+// Splits source at top-level statements and parses the chunks on
+// options.jobs threads, each with a lexer and parser of its own, then
+// joins their ASTs in order. Returns false if the source could not be
+// split or a chunk had errors: the caller then parses the whole file as
+// usual, which reports the errors in order and with the usual recovery.
+static bool ParseChunks(const Options& options, std::string_view source, BlaiseAst& ast) {
+    std::vector<SourceChunk> chunks = SplitTopLevel(source, options.jobs);
+
+    if (chunks.size() < 2)
+        return false;
+
+    std::vector<BlaiseAst> parts(chunks.size());
+    std::vector<char> parsed(chunks.size(), false);
+    std::vector<std::thread> threads;
+
+    for (size_t i = 0; i < chunks.size(); i++) {
+        threads.emplace_back([&, i]() {
+            try {
+                parsed[i] = ParseChunk(options, source, chunks[i], parts[i]);
+            } catch (...) {
+                // Parsed again as a whole, which fails the same way
+            }
+        });
+    }
+
+    for (std::thread& thread : threads)
+        thread.join();
+
+    if (std::find(parsed.begin(), parsed.end(), false) != parsed.end())
+        return false;
+
+    ast = BlaiseAst::Join(parts);
+
+    return true;
+}
+
+// A function body deferred by --lazy-bodies that does not parse. It is
+// only found when the function is first called.
+class LazyBodySyntaxError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Parses the function bodies deferred by --lazy-bodies on their first
+// call. Owns the mapping of the input file, which the bodies are read
+// from while the program runs.
+class LazyBodyParser {
+    const Options& options_;
+    MappedFile file_;
+    std::unordered_map<const AstNode *, BlaiseAst> bodies_;
+
+public:
+    explicit LazyBodyParser(const Options& options) : options_(options), file_(options.in_file) {}
+
+    MappedFile& File() {
+        return file_;
+    }
+
+    const BlaiseAst& Parse(const BlaiseAst& ast, const AstNode& body) {
+        auto found = bodies_.find(&body);
+
+        if (found != bodies_.end())
+            return found->second;
+
+        SourceRange range = ast.Range(body);
+        SourcePosition position = ast.Position(body);
+        std::string_view source = file_.Data().substr(range.begin, range.end - range.begin);
+
+        // The lexer starts where the body is in the file, so that error
+        // messages and profiles show the same positions as a full parse
+        MappedCharStream input(source, options_.in_file);
+        std::unique_ptr<antlr4::TokenSource> lexer = MakeLexer(options_, input, source, options_.in_file,
+                                                               position.line, position.column - 1);
+        antlr4::CommonTokenStream tokens(lexer.get());
+        BlaiseErrorListener errlistener;
+        BlaiseParser parser(&tokens);
+        bool retried;
+        BlaiseParser::StmtContext *stmt = ParseRule(parser, tokens, errlistener, retried, &BlaiseParser::stmt);
+
+        if (parser.getNumberOfSyntaxErrors())
+            throw LazyBodySyntaxError("Parsing failed with " + std::to_string(parser.getNumberOfSyntaxErrors())
+                                      + " errors");
+
+        return bodies_.emplace(&body, BlaiseAst::Build(stmt)).first->second;
+    }
+};
+
+// Parses the input file and lowers the parse tree into ast. The mapping
+// of the file, the tokens and the parse tree are freed when it returns,
+// everything after parsing works on the AST only. Returns the exit code
+// of a failed parse or 0.
+//
+// With lazy, function bodies are only matched for begin and end, and
+// left to lazy to parse on their first call. Such an AST refers to the
+// source, it is never cached.
+//
+// Syntax errors are reported to err, the summary of a failed parse to out.
+// The lexer recovers from its errors, so a program with them still runs,
+// but it is not cached: the next run has to report them again. errors, if
+// given, is set to the number of lexer and parser errors.
+static int ParseSource(const Options& options, BlaiseAst& ast, LazyBodyParser *lazy = nullptr,
+                       std::ostream& out = std::cout, std::ostream& err = std::cerr, size_t *errors = nullptr) {
+    std::optional<MappedFile> own_file;
+    MappedFile& file = lazy ? lazy->File() : own_file.emplace(options.in_file);
+
+    if (!file.IsOpen())
         return -1;
 
-    antlr4::ANTLRInputStream input(infile);
+    if (errors != nullptr)
+        *errors = 0;
 
-    BlaiseLexer lexer(&input);
+    // --parse-profile is about the parser, it has to run even for a
+    // program that is in the cache
+    BlaiseCache cache(options.no_cache || options.parse_profile || lazy ? "" : BlaiseCache::DefaultDirectory());
 
-    antlr4::CommonTokenStream tokens(&lexer);
+    if (cache.Load(file.Data(), ast))
+        return 0;
 
-    BlaiseErrorListener errlistener;
+    // Lazy bodies are found in the token stream of the whole file, and
+    // --parse-profile is about a single parser
+    if (options.jobs > 1 && !lazy && !options.parse_profile && file.Data().size() >= PARALLEL_PARSE_MIN_SIZE
+        && ParseChunks(options, file.Data(), ast)) {
+        cache.Store(file.Data(), ast);
+        return 0;
+    }
+
+    // Both lexers read the mapped file in place, without copying it
+    MappedCharStream input(file.Data(), options.in_file);
+    StreamErrorListener lexer_errors(err);
+    std::unique_ptr<antlr4::TokenSource> lexer = MakeLexer(options, input, file.Data(), options.in_file, 1, 0,
+                                                           &lexer_errors);
+    std::optional<LazyBodyTokenSource> lazy_source;
+
+    if (lazy)
+        lazy_source.emplace(*lexer, file.Data());
+
+    antlr4::CommonTokenStream tokens(lazy_source ? &*lazy_source : lexer.get());
+
+    BlaiseErrorListener errlistener(err);
 
     BlaiseParser parser(&tokens);
 
-    parser.removeErrorListeners();
-    parser.addErrorListener(&errlistener);
+    if (options.parse_profile)
+        parser.setProfile(true);
+
+    bool retried;
+    BlaiseParser::ProgramContext* parse_result = ParseRule(parser, tokens, errlistener, retried,
+                                                           &BlaiseParser::program);
 
-    BlaiseParser::ProgramContext* parse_result = parser.program();
+    if (options.parse_profile)
+        PrintParseProfile(parser, retried);
+
+    if (errors != nullptr)
+        *errors = lexer_errors.errors + parser.getNumberOfSyntaxErrors();
 
     if (parser.getNumberOfSyntaxErrors()) {
-        std::cout << "Parsing failed with " << parser.getNumberOfSyntaxErrors()
-                  << " errors" << std::endl;
+        out << "Parsing failed with " << parser.getNumberOfSyntaxErrors()
+            << " errors" << std::endl;
+        return 1;
+    }
+
+    if (lazy) {
+        ast = BlaiseAst::Build(parse_result, &lazy_source->Bodies());
+
+        // Bodies page the parts they need in again
+        file.Release(0, file.Data().size());
+        return 0;
+    }
+
+    ast = BlaiseAst::Build(parse_result);
+
+    if (lexer_errors.errors == 0)
+        cache.Store(file.Data(), ast);
+
+    return 0;
+}
+
+// Modules imported by a program. Each one is parsed once per run, by
+// ParseSource, so that a module that has not changed since it was last
+// parsed is loaded from the cache. An import path is relative to the
+// directory of the file with the import, the input file for the program
+// itself and the REPL, the current directory without one.
+class ModuleLoader {
+    const Options& options_;
+    std::ostream& out_;
+    std::ostream& err_;
+    std::filesystem::path program_directory_;
+    std::unordered_map<std::string, BlaiseAst> modules_;    // by canonical path
+    std::unordered_map<const BlaiseAst *, std::filesystem::path> directories_;
+
+    // Imports of importer and of the modules they import, each module
+    // after the ones it imports and only once
+    void AddImports(const BlaiseAst& importer, std::unordered_set<const BlaiseAst *>& seen,
+                    std::vector<const BlaiseAst *>& order) {
+        const AstNode& root = importer.Node(importer.Root());
+
+        for (size_t i = 0; i < root.child_count; i++) {
+            const AstNode& stmt = importer.Node(importer.Child(root, i));
+
+            if (stmt.kind != AST_NODE_KIND::IMPORT_STMT)
+                continue;
+
+            const BlaiseAst& module = Load(importer, importer.Text(stmt));
+
+            if (seen.insert(&module).second) {
+                AddImports(module, seen, order);
+                order.push_back(&module);
+            }
+        }
+    }
+
+    // The interpreter only finds these once it runs into them
+    static void CheckImports(const BlaiseAst& ast, bool module) {
+        const AstNode& root = ast.Node(ast.Root());
+        std::unordered_set<AstNodeId> top_level;
+
+        for (size_t i = 0; i < root.child_count; i++) {
+            AstNodeId id = ast.Child(root, i);
+            AST_NODE_KIND kind = ast.Node(id).kind;
+
+            if (module && kind != AST_NODE_KIND::IMPORT_STMT && kind != AST_NODE_KIND::FUNCTION_DEFINITION)
+                throw std::invalid_argument("A module can only define functions and import modules");
+
+            top_level.insert(id);
+        }
+
+        for (AstNodeId id = 0; id < ast.Root(); id++) {
+            const AstNode& node = ast.Node(id);
+
+            if (node.kind == AST_NODE_KIND::IMPORT_STMT && top_level.count(id) == 0)
+                throw std::invalid_argument("Module " + ast.Text(node) + " can only be imported at the top level");
+        }
+    }
+
+public:
+    // Syntax errors of modules go to err, the summary of a failed parse to out
+    explicit ModuleLoader(const Options& options, std::ostream& out = std::cout, std::ostream& err = std::cerr)
+        : options_(options), out_(out), err_(err) {
+        if (options.in_file != nullptr)
+            program_directory_ = std::filesystem::path(options.in_file).parent_path();
+    }
+
+    // Whether ast has import statements, at the top level or not
+    static bool Imports(const BlaiseAst& ast) {
+        for (AstNodeId id = 0; id < ast.Root(); id++)
+            if (ast.Node(id).kind == AST_NODE_KIND::IMPORT_STMT)
+                return true;
+
+        return false;
+    }
+
+    // Throws std::invalid_argument if the module cannot be read or parsed
+    const BlaiseAst& Load(const BlaiseAst& importer, const std::string& path) {
+        auto directory = directories_.find(&importer);
+        std::filesystem::path file = (directory != directories_.end() ? directory->second : program_directory_) / path;
+        std::error_code error;
+        std::string key = std::filesystem::weakly_canonical(file, error).string();
+
+        if (error)
+            key = file.lexically_normal().string();
+
+        auto found = modules_.find(key);
+
+        if (found != modules_.end())
+            return found->second;
+
+        std::string name = file.string();
+        Options module_options = options_;
+        BlaiseAst ast;
+
+        module_options.in_file = name.c_str();
+        module_options.in_files = { module_options.in_file };
+        module_options.parse_profile = false;
+
+        int status = ParseSource(module_options, ast, nullptr, out_, err_);
+
+        if (status == -1)
+            throw std::invalid_argument("Cannot open module " + name);
+
+        if (status != 0)
+            throw std::invalid_argument("Module " + name + " has syntax errors");
+
+        BlaiseAst& module = modules_.emplace(key, std::move(ast)).first->second;
+        directories_.emplace(&module, file.parent_path());
+
+        return module;
+    }
+
+    // The program with the functions of the modules it imports, directly
+    // or not, in front of it, for the compilers, which see a single AST.
+    // Fails the way the interpreter would on imports that are not at the
+    // top level, modules that do more than define functions and global
+    // functions defined twice.
+    BlaiseAst Join(const BlaiseAst& program) {
+        std::unordered_set<const BlaiseAst *> seen;
+        std::vector<const BlaiseAst *> order;
+        std::unordered_set<std::string> functions;
+        std::vector<BlaiseAst> parts;
+
+        CheckImports(program, false);
+        AddImports(program, seen, order);
+        order.push_back(&program);
+
+        for (const BlaiseAst *part : order) {
+            const AstNode& root = part->Node(part->Root());
+
+            if (part != &program)
+                CheckImports(*part, true);
+
+            for (size_t i = 0; i < root.child_count; i++) {
+                const AstNode& stmt = part->Node(part->Child(root, i));
+
+                if (stmt.kind == AST_NODE_KIND::FUNCTION_DEFINITION && !functions.insert(part->Text(stmt)).second)
+                    throw std::invalid_argument("Function redefinition is not allowed. Function "
+                                                + part->Text(stmt) + " is already defined.");
+            }
+
+            parts.push_back(*part);
+        }
+
+        return BlaiseAst::Join(parts);
+    }
+};
+
+// Parses and runs the program one top-level statement at a time. Each
+// statement runs as soon as it is parsed, then its tokens, parse tree
+// and AST are dropped unless it defined global functions. Memory use
+// follows the largest statement instead of the file, and output starts
+// right away, but a syntax error only stops the program once the
+// statements before it have run.
+static int StreamProgram(const Options& options, InterpreterVisitor& interpreter) {
+    MappedFile file(options.in_file);
+
+    if (!file.IsOpen())
+        return -1;
+
+    std::optional<MappedCharStream> input;
+    std::unique_ptr<antlr4::TokenSource> lexer;
+
+    if (options.fast_lexer) {
+        lexer = std::make_unique<BlaiseFastLexer>(file.Data(), options.in_file);
+    } else {
+        input.emplace(file.Data(), options.in_file);
+        lexer = std::make_unique<BlaiseLexer>(&*input);
+
+        // Counting the code points has paged in the whole file
+        file.Release(0, file.Data().size());
+    }
+
+    SlidingTokenStream tokens(lexer.get());
+    BlaiseErrorListener errlistener;
+    BlaiseParser parser(&tokens);
+    // Statements that defined global functions, which point into them
+    std::list<BlaiseAst> definitions;
+    size_t released = 0;
+
+    while (tokens.LA(1) != antlr4::Token::EOF) {
+        // Frees the parse tree of the previous statement
+        tokens.DropConsumed();
+        parser.reset();
+
+        // Start indexes count code points, never more than bytes. Not
+        // worth a system call for every few pages.
+        size_t offset = tokens.LT(1)->getStartIndex();
+
+        if (offset >= released + (1 << 20)) {
+            file.Release(released, offset);
+            released = offset;
+        }
+
+        bool retried;
+        BlaiseParser::StmtContext *stmt = ParseRule(parser, tokens, errlistener, retried, &BlaiseParser::stmt);
+
+        if (parser.getNumberOfSyntaxErrors()) {
+            std::cout << "Parsing failed with " << parser.getNumberOfSyntaxErrors()
+                      << " errors" << std::endl;
+            return 1;
+        }
+
+        size_t functions = interpreter.gl_block->functions.size();
+        BlaiseAst& ast = definitions.emplace_back(BlaiseAst::Build(stmt));
+
+        interpreter.Visit(ast);
+
+        // Global functions are never removed, new ones come from ast
+        if (interpreter.gl_block->functions.size() == functions) {
+            interpreter.ReleaseTree(ast);
+            definitions.pop_back();
+        }
+    }
+
+    return 0;
+}
+
+// Syntax errors of one REPL input. They are held back until the input is
+// known to be complete: errors at the end of input only mean that the
+// statement goes on in the next line.
+class ReplErrorListener : public BlaiseErrorListener {
+public:
+    std::vector<std::string> messages;
+    size_t at_end = 0;
+
+    void syntaxError(antlr4::Recognizer *recognizer, antlr4::Token *offendingSymbol, size_t line,
+                     size_t charPositionInLine, const std::string &msg, std::exception_ptr e) override {
+        if (offendingSymbol != nullptr && offendingSymbol->getType() == antlr4::Token::EOF)
+            at_end++;
+
+        messages.push_back("Syntax error at line " + std::to_string(line) + ":"
+                           + std::to_string(charPositionInLine) + ": " + msg);
+    }
+
+    bool Incomplete() const {
+        return at_end > 0 && at_end == messages.size();
+    }
+};
+
+// Lexes and parses one REPL input, returns false on errors
+static bool ParseReplInput(const Options& options, std::string_view source, BlaiseAst& ast,
+                           ReplErrorListener& errors) {
+    MappedCharStream input(source, "<stdin>");
+    std::unique_ptr<antlr4::TokenSource> lexer = MakeLexer(options, input, source, "<stdin>", 1, 0, &errors);
+    antlr4::CommonTokenStream tokens(lexer.get());
+    BlaiseParser parser(&tokens);
+    bool retried;
+    BlaiseParser::ProgramContext *parse_result = ParseRule(parser, tokens, errors, retried, &BlaiseParser::program);
+
+    if (!errors.messages.empty())
+        return false;
+
+    ast = BlaiseAst::Build(parse_result);
+
+    return true;
+}
+
+// Runs statements read from stdin in one interpreter, so that variables
+// and functions stay defined from one input to the next. Only the new
+// input is lexed and parsed. An input that stops in the middle of a
+// statement is continued with the next line, two empty lines give up on
+// it. A global function defined again replaces the old definition.
+static int RunRepl(const Options& options) {
+    InterpreterVisitor interpreter;
+    ModuleLoader modules(options);
+    // Inputs that still define functions, which point into them
+    std::list<BlaiseAst> inputs;
+    bool interactive = isatty(STDIN_FILENO);
+    std::string buffer;
+    std::string line;
+
+    interpreter.SetReplaceDefinitions(true);
+    interpreter.SetModuleLoader([&](const BlaiseAst& importer, const std::string& path) -> const BlaiseAst& {
+        return modules.Load(importer, path);
+    });
+
+    auto run = [&](BlaiseAst& ast) {
+        try {
+            interpreter.Visit(ast);
+        } catch (const std::exception& e) {
+            std::cout << "Error: " << e.what() << std::endl;
+        }
+
+        interpreter.UnwindFrames();
+
+        inputs.remove_if([&](const BlaiseAst& input) {
+            return std::none_of(interpreter.gl_block->functions.begin(), interpreter.gl_block->functions.end(),
+                                [&](const BlaiseFunction& func) { return func.Ast() == &input; });
+        });
+    };
+
+    if (options.in_file != nullptr) {
+        BlaiseAst& ast = inputs.emplace_back();
+
+        if (int status = ParseSource(options, ast))
+            return status;
+
+        run(ast);
+    }
+
+    for (;;) {
+        if (interactive)
+            std::cout << (buffer.empty() ? "> " : ". ") << std::flush;
+
+        bool end = !std::getline(std::cin, line);
+
+        if (buffer.empty() && (end || line.empty())) {
+            if (end)
+                break;
+
+            continue;
+        }
+
+        if (!end) {
+            buffer += line;
+            buffer += '\n';
+        }
+
+        bool give_up = end || (buffer.size() >= 3 && buffer.compare(buffer.size() - 3, 3, "\n\n\n") == 0);
+
+        ReplErrorListener errors;
+        BlaiseAst& ast = inputs.emplace_back();
+
+        if (ParseReplInput(options, buffer, ast, errors)) {
+            run(ast);
+        } else {
+            inputs.pop_back();
+
+            if (errors.Incomplete() && !give_up)
+                continue;
+
+            for (const std::string& message : errors.messages)
+                std::cerr << message << std::endl;
+        }
+
+        buffer.clear();
+
+        if (end)
+            break;
+    }
+
+    return 0;
+}
+
+// Interprets every one of options.in_files on options.jobs threads, each
+// file in an interpreter of its own that writes to a buffer. A file's
+// output is printed once it and every file before it are done, so output
+// comes in the order of the files, as if they ran one after another.
+// The errors of a file that did not parse come before the line counting
+// them. Returns the status of the first file that failed.
+static int RunBatch(const Options& options) {
+    struct Result {
+        std::ostringstream out;
+        std::ostringstream err;
+        int status = 0;
+        bool parsed = false;
+        bool done = false;
+    };
+
+    std::vector<Result> results(options.in_files.size());
+    std::atomic<size_t> next = 0;
+    std::mutex mutex;
+    std::condition_variable done;
+
+    auto work = [&]() {
+        for (size_t i; (i = next++) < results.size(); ) {
+            Result& result = results[i];
+            Options file_options = options;
+            BlaiseAst ast;
+
+            file_options.in_file = options.in_files[i];
+            file_options.jobs = 1;
+            result.status = ParseSource(file_options, ast, nullptr, result.out, result.err);
+            result.parsed = result.status == 0;
+
+            if (result.status == -1)
+                result.err << "Cannot open " << file_options.in_file << std::endl;
+
+            if (result.parsed) {
+                InterpreterVisitor interpreter(result.out);
+                ModuleLoader modules(file_options, result.out, result.err);
+
+                interpreter.SetModuleLoader([&](const BlaiseAst& importer, const std::string& path)
+                                                -> const BlaiseAst& {
+                    return modules.Load(importer, path);
+                });
+                SetLimits(options, interpreter);
+
+                try {
+                    interpreter.Visit(ast);
+                } catch (const BlaiseLimitError& e) {
+                    result.err << "Error: " << e.what() << std::endl;
+                    result.status = LIMIT_EXIT_STATUS;
+                } catch (const std::exception& e) {
+                    result.err << "Error: " << e.what() << std::endl;
+                    result.status = 1;
+                }
+
+                ReportMemory(options, interpreter, result.err);
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            result.done = true;
+            done.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+
+    for (size_t i = 0; i < std::min(options.jobs, results.size()); i++)
+        workers.emplace_back(work);
+
+    int status = 0;
+
+    for (Result& result : results) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            done.wait(lock, [&]() { return result.done; });
+        }
+
+        if (result.parsed) {
+            std::cout << result.out.str() << std::flush;
+            std::cerr << result.err.str() << std::flush;
+        } else {
+            std::cerr << result.err.str() << std::flush;
+            std::cout << result.out.str() << std::flush;
+        }
+
+        if (status == 0)
+            status = result.status;
+
+        result.out = std::ostringstream();
+        result.err = std::ostringstream();
+    }
+
+    for (std::thread& worker : workers)
+        worker.join();
+
+    return status;
+}
+
+// Runs ast in interpreter starting from the snapshot in options.restore,
+// if any, and takes the one asked for by --snapshot-after on the way. A
+// snapshot that does not fit is reported and the program runs from the
+// start.
+static int RunWithSnapshots(const Options& options, const BlaiseAst& ast, InterpreterVisitor& interpreter) {
+    MappedFile file(options.in_file);
+
+    if (!file.IsOpen())
+        return -1;
+
+    size_t begin = 0;
+
+    if (!options.restore.empty()) {
+        try {
+            begin = BlaiseSnapshot::Restore(options.restore, file.Data(), ast, interpreter);
+        } catch (const BlaiseSnapshotError& e) {
+            std::cerr << "Snapshot not used: " << e.what() << std::endl;
+        }
+    }
+
+    if (!options.snapshot_out.empty()) {
+        size_t end = std::max(begin, BlaiseSnapshot::StatementsUpTo(ast, options.snapshot_after));
+
+        interpreter.RunStatements(ast, begin, end);
+
+        try {
+            BlaiseSnapshot::Save(options.snapshot_out, file.Data(), ast, end, interpreter);
+        } catch (const BlaiseSnapshotError& e) {
+            std::cout << e.what() << std::endl;
+            return 1;
+        }
+
+        begin = end;
+    }
+
+    interpreter.RunStatements(ast, begin, ast.Node(ast.Root()).child_count);
+
+    return 0;
+}
+
+// Runs the command of options. parsed is options.in_file already parsed
+// by the server, nothing if the file is still to be parsed.
+static int Run(const Options& options, const BlaiseAst *parsed = nullptr) {
+    PhaseTimer timer(options.time_phases);
+    bool snapshots = !options.snapshot_out.empty() || !options.restore.empty();
+
+    if (snapshots && (strcmp(options.command, "interp") != 0 || options.stream || options.lazy_bodies
+                      || options.in_files.size() > 1)) {
+        std::cout << "--snapshot-out and --restore require interp of one file without --stream and --lazy-bodies"
+                  << std::endl;
+        return 1;
+    }
+
+    if (options.snapshot_out.empty() != (options.snapshot_after == 0)) {
+        std::cout << "--snapshot-after and --snapshot-out go together" << std::endl;
+        return 1;
+    }
+
+    if ((options.max_steps != 0 || options.timeout != 0 || options.max_memory != 0 || options.memory_report)
+        && strcmp(options.command, "interp") != 0) {
+        std::cout << "--max-steps, --timeout, --max-memory and --memory-report require interp" << std::endl;
         return 1;
     }
 
-    if (strcmp(argv[COMMAND], "comp") == 0) {
-        TacCompilerVisitor compiler;
-        std::any result = compiler.visitProgram(parse_result);
-        std::string compiled_text = std::any_cast<std::string>(result);
-        std::cout << compiled_text << std::endl;
-    } else if (strcmp(argv[COMMAND], "interp") == 0) {
+    if (options.in_files.size() > 1) {
+        if (strcmp(options.command, "interp") != 0 || options.stream || options.lazy_bodies
+            || !options.profile_out.empty()) {
+            std::cout << "Several input files require interp without --stream, --lazy-bodies and --profile-out"
+                      << std::endl;
+            return 1;
+        }
+
+        return RunBatch(options);
+    }
+
+    if (strcmp(options.command, "lexcheck") == 0) {
+        MappedFile file(options.in_file);
+
+        if (!file.IsOpen())
+            return -1;
+
+        return CheckLexers(file.Data());
+    }
+
+    if (strcmp(options.command, "repl") == 0)
+        return RunRepl(options);
+
+    if (options.stream && strcmp(options.command, "interp") != 0) {
+        std::cout << "--stream requires interp" << std::endl;
+        return 1;
+    }
+
+    if (options.lazy_bodies && (strcmp(options.command, "interp") != 0 || options.stream)) {
+        std::cout << "--lazy-bodies requires interp without --stream" << std::endl;
+        return 1;
+    }
+
+    BlaiseAst own_ast;
+    const BlaiseAst& ast = parsed ? *parsed : own_ast;
+    std::optional<LazyBodyParser> lazy;
+
+    if (options.lazy_bodies)
+        lazy.emplace(options);
+
+    // A streamed program is parsed while it runs
+    if (!options.stream) {
+        if (parsed == nullptr) {
+            if (int status = ParseSource(options, own_ast, lazy ? &*lazy : nullptr))
+                return status;
+
+#ifdef __GLIBC__
+            // glibc keeps the pages of the freed parse tree in the heap for
+            // reuse. Hand them back to the system before running the
+            // program, a compiler exits soon anyway.
+            if (strcmp(options.command, "interp") == 0 || strcmp(options.command, "exec-tac") == 0)
+                malloc_trim(0);
+#endif
+        }
+
+        timer.Done("parse");
+    }
+
+    BlaiseProfile profile;
+
+    if (!options.profile_in.empty()) {
+        if (strcmp(options.command, "comp") == 0 && options.emit == "tac") {
+            std::cout << "--profile-in requires --emit=c or --emit=asm" << std::endl;
+            return 1;
+        }
+
+        std::ifstream profile_file(options.profile_in);
+
+        if (!profile_file.is_open()) {
+            std::cout << "Cannot open " << options.profile_in << std::endl;
+            return 1;
+        }
+
+        try {
+            profile = BlaiseProfile::Load(profile_file);
+        } catch (const std::invalid_argument& e) {
+            std::cout << "cannot read profile " << options.profile_in << ": " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    std::ofstream outfile;
+
+    if (options.out_file != nullptr) {
+        outfile.open(options.out_file);
+
+        if (!outfile.is_open()) {
+            std::cout << "Cannot open " << options.out_file << std::endl;
+            return 1;
+        }
+    }
+
+    std::ostream& out = outfile.is_open() ? outfile : std::cout;
+    ModuleLoader modules(options);
+    std::optional<BlaiseAst> joined;
+
+    // The interpreter loads modules when it runs into their imports
+    if (strcmp(options.command, "interp") != 0 && !options.stream && ModuleLoader::Imports(ast))
+        joined = modules.Join(ast);
+
+    const BlaiseAst& compiled = joined ? *joined : ast;
+
+    if (strcmp(options.command, "comp") == 0 && options.emit == "c") {
+        TacLoweringVisitor lowering;
+        TacProgram program = std::any_cast<TacProgram>(lowering.Visit(compiled));
+        if (!options.profile_in.empty())
+            TacOptimizer(profile).Optimize(program);
+        TacCEmitter emitter(std::move(program));
+        emitter.Emit(out);
+        timer.Done("compile");
+    } else if (strcmp(options.command, "comp") == 0 && options.emit == "asm") {
+        TacLoweringVisitor lowering;
+        TacProgram program = std::any_cast<TacProgram>(lowering.Visit(compiled));
+        if (!options.profile_in.empty())
+            TacOptimizer(profile).Optimize(program);
+        TacAsmEmitter emitter(std::move(program));
+        emitter.Emit(out);
+        timer.Done("compile");
+    } else if (strcmp(options.command, "comp") == 0) {
+        if (options.emit != "tac") {
+            std::cout << "Unknown emit target " << options.emit << std::endl;
+            return 1;
+        }
+
+        TacCompilerVisitor compiler(out, options.jobs);
+        compiler.Visit(compiled);
+        out << std::endl;
+        timer.Done("compile");
+    } else if (strcmp(options.command, "interp") == 0) {
         InterpreterVisitor interpreter;
-        interpreter.visitProgram(parse_result);
+
+        if (!options.profile_out.empty())
+            interpreter.SetProfile(&profile);
+
+        interpreter.SetModuleLoader([&](const BlaiseAst& importer, const std::string& path) -> const BlaiseAst& {
+            return modules.Load(importer, path);
+        });
+
+        SetLimits(options, interpreter);
+
+        try {
+            if (options.stream) {
+                if (int status = StreamProgram(options, interpreter))
+                    return status;
+            } else if (lazy) {
+                interpreter.SetBodyParser([&](const BlaiseAst& ast, const AstNode& body) -> const BlaiseAst& {
+                    return lazy->Parse(ast, body);
+                });
+
+                try {
+                    interpreter.Visit(ast);
+                } catch (const LazyBodySyntaxError& e) {
+                    std::cout << e.what() << std::endl;
+                    return 1;
+                }
+            } else if (snapshots) {
+                if (int status = RunWithSnapshots(options, ast, interpreter))
+                    return status;
+            } else {
+                interpreter.Visit(ast);
+            }
+        } catch (const BlaiseLimitError& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            ReportMemory(options, interpreter, std::cerr);
+            return LIMIT_EXIT_STATUS;
+        }
+
+        timer.Done("execute");
+        ReportMemory(options, interpreter, std::cerr);
+
+        if (!options.profile_out.empty()) {
+            std::ofstream profile_file(options.profile_out);
+
+            if (!profile_file.is_open()) {
+                std::cout << "Cannot open " << options.profile_out << std::endl;
+                return 1;
+            }
+
+            profile.Save(profile_file);
+        }
+    } else if (strcmp(options.command, "exec-tac") == 0) {
+        TacLoweringVisitor lowering;
+        TacProgram program = std::any_cast<TacProgram>(lowering.Visit(compiled));
+        if (!options.profile_in.empty())
+            TacOptimizer(profile).Optimize(program);
+        timer.Done("compile");
+        TacExecutor executor(program);
+        executor.Run();
+        timer.Done("execute");
     } else {
         std::cout << "Unknown command" << std::endl;
     }
 
     return 0;
-}
\ No newline at end of file
+}
+
+// Programs parsed by the server, by absolute path. An entry is reused as
+// long as its file keeps the same inode, size and modification time, the
+// least recently used one goes when the cache is full. A program with
+// lexer errors is parsed again on every run, so that each run reports them.
+class ProgramCache {
+    static constexpr size_t MAX_PROGRAMS = 64;
+
+    struct Entry {
+        struct stat file;
+        BlaiseAst ast;
+        uint64_t used;
+        bool reusable;
+    };
+
+    std::unordered_map<std::string, Entry> programs_;
+    uint64_t clock_ = 0;
+
+    static bool SameFile(const struct stat& a, const struct stat& b) {
+#ifdef __APPLE__
+        const timespec& a_time = a.st_mtimespec;
+        const timespec& b_time = b.st_mtimespec;
+#else
+        const timespec& a_time = a.st_mtim;
+        const timespec& b_time = b.st_mtim;
+#endif
+        return a.st_dev == b.st_dev && a.st_ino == b.st_ino && a.st_size == b.st_size &&
+               a_time.tv_sec == b_time.tv_sec && a_time.tv_nsec == b_time.tv_nsec;
+    }
+
+public:
+    // Sets ast to the program in options.in_file, parsing it unless it is
+    // cached. Returns what ParseSource does.
+    int Load(const Options& options, const BlaiseAst *& ast) {
+        struct stat file;
+        std::error_code error;
+        std::string path = std::filesystem::absolute(options.in_file, error).string();
+
+        // ParseSource could not open it either
+        if (stat(options.in_file, &file) != 0)
+            return -1;
+
+        auto found = programs_.find(path);
+
+        if (found != programs_.end() && found->second.reusable && SameFile(found->second.file, file)) {
+            found->second.used = ++clock_;
+            ast = &found->second.ast;
+            return 0;
+        }
+
+        BlaiseAst parsed;
+        size_t errors;
+
+        if (int status = ParseSource(options, parsed, nullptr, std::cout, std::cerr, &errors))
+            return status;
+
+#ifdef __GLIBC__
+        // Otherwise runs take their memory from the freed parse tree,
+        // copying every page they touch from the daemon
+        malloc_trim(0);
+#endif
+
+        if (found == programs_.end() && programs_.size() >= MAX_PROGRAMS)
+            programs_.erase(std::min_element(programs_.begin(), programs_.end(), [](const auto& a, const auto& b) {
+                return a.second.used < b.second.used;
+            }));
+
+        Entry& entry = programs_[path];
+        entry = Entry{ file, std::move(parsed), ++clock_, errors == 0 };
+        ast = &entry.ast;
+
+        return 0;
+    }
+};
+
+// Whether Run parses options.in_file as a whole before running it
+static bool ParsesFile(const Options& options) {
+    return options.in_files.size() == 1 && !options.stream && !options.lazy_bodies &&
+           (strcmp(options.command, "interp") == 0 || strcmp(options.command, "comp") == 0 ||
+            strcmp(options.command, "exec-tac") == 0);
+}
+
+// Serves runs for clients started with --socket. Programs are parsed by
+// the daemon and kept, a run only forks and executes.
+static int Serve(const Options& options) {
+    if (options.socket.empty()) {
+        std::cout << "serve requires --socket=path" << std::endl;
+        return 1;
+    }
+
+    ProgramCache programs;
+
+    return BlaiseServer::Serve(options.socket, [&](const ServerRequest& request, std::function<int()>& job) {
+        std::vector<const char *> argv = { "blaise" };
+
+        for (const std::string& arg : request.args)
+            argv.push_back(arg.c_str());
+
+        // in_file points into request, which outlives the run
+        auto run_options = std::make_shared<Options>();
+
+        if (!ParseOptions(argv.size(), argv.data(), *run_options)) {
+            PrintUsage();
+            return 1;
+        }
+
+        if (strcmp(run_options->command, "serve") == 0) {
+            std::cout << "serve cannot be run by a server" << std::endl;
+            return 1;
+        }
+
+        const BlaiseAst *ast = nullptr;
+
+        if (ParsesFile(*run_options)) {
+            if (int status = programs.Load(*run_options, ast))
+                return status;
+        }
+
+        job = [run_options, ast]() { return Run(*run_options, ast); };
+
+        return 0;
+    });
+}
+
+int main(int argc, const char** argv) {
+    Options options;
+
+    if (!ParseOptions(argc, argv, options)) {
+        PrintUsage();
+        return 1;
+    }
+
+    if (strcmp(options.command, "serve") == 0)
+        return Serve(options);
+
+    // A running server takes the run, without one it is done here
+    if (!options.socket.empty()) {
+        std::vector<std::string> args;
+
+        for (int i = 1; i < argc; i++) {
+            if (std::string(argv[i]).rfind("--socket=", 0) != 0)
+                args.push_back(argv[i]);
+        }
+
+        if (std::optional<int> status = BlaiseServer::Call(options.socket, args))
+            return *status;
+    }
+
+    return Run(options);
+}
@@ -0,0 +1,6 @@
+/*
+ * Builds the runtime header as a library: `make runtime` turns this file
+ * into libblaisert.a for programs compiled with `blaise comp --emit=asm`.
+ */
+#define BLAISE_RUNTIME_LIBRARY
+#include "BlaiseRuntime.h"
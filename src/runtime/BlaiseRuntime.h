@@ -0,0 +1,341 @@
+/*
+ * Runtime support for C code generated by `blaise comp --emit=c`.
+ *
+ * Variables whose type could not be inferred statically are stored in
+ * bl_value, a tagged union mirroring BlaiseVariable: int, double, bool,
+ * char and reference counted immutable strings. Operations follow the
+ * conversion rules of BlaiseVariable::CastToOneType: int is promoted to
+ * double, a string on the left hand side converts the other operand to
+ * its text form, every other mix of types is an error.
+ *
+ * Ownership: every function returning a bl_value returns a new reference,
+ * arguments are borrowed. bl_set() releases the old value of a variable
+ * and takes over the reference it is given.
+ *
+ * Generated C includes this header directly and gets static inline
+ * functions. BlaiseRuntime.c defines BLAISE_RUNTIME_LIBRARY to compile the
+ * same functions with external linkage into libblaisert.a, which code
+ * emitted by `blaise comp --emit=asm` links against.
+ */
+#ifndef BLAISE_RUNTIME_H
+#define BLAISE_RUNTIME_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+    BL_NONE,
+    BL_INT,
+    BL_DOUBLE,
+    BL_BOOL,
+    BL_CHAR,
+    BL_STRING,
+    BL_UNASSIGNED       /* variable not assigned yet, see bl_check() */
+} bl_type;
+
+typedef enum {
+    BL_PLUS,
+    BL_MINUS,
+    BL_MUL,
+    BL_DIV,
+    BL_EQUAL,
+    BL_NEQUAL,
+    BL_LESS,
+    BL_LEQUAL,
+    BL_GREATER,
+    BL_GEQUAL
+} bl_op;
+
+typedef struct {
+    size_t refs;
+    size_t length;
+    char data[];
+} bl_string;
+
+typedef struct {
+    bl_type type;
+    union {
+        int i;
+        double d;
+        bool b;
+        char c;
+        bl_string *s;
+    } as;
+} bl_value;
+
+#define BL_NONE_VALUE ((bl_value) { BL_NONE, { 0 } })
+#define BL_UNASSIGNED_INIT { BL_UNASSIGNED, { 0 } }
+#define BL_UNASSIGNED_VALUE ((bl_value) BL_UNASSIGNED_INIT)
+
+#if defined(__GNUC__) || defined(__clang__)
+#define BL_NORETURN __attribute__((noreturn))
+#else
+#define BL_NORETURN
+#endif
+
+#ifdef BLAISE_RUNTIME_LIBRARY
+#define BL_API
+#else
+#define BL_API static inline
+#endif
+
+BL_API BL_NORETURN void bl_fail(const char *message) {
+    fflush(stdout);
+    fprintf(stderr, "%s\n", message);
+    exit(1);
+}
+
+BL_API BL_NORETURN void bl_fail_types(const char *format, bl_type lhs, bl_type rhs) {
+    static const char *names[] = { "none", "int", "double", "bool", "char", "string", "none" };
+    char buffer[128];
+
+    snprintf(buffer, sizeof(buffer), format, names[lhs], names[rhs]);
+    bl_fail(buffer);
+}
+
+/* Constructors */
+
+BL_API bl_value bl_int(int i) {
+    bl_value v = { BL_INT, { 0 } };
+    v.as.i = i;
+    return v;
+}
+
+BL_API bl_value bl_double(double d) {
+    bl_value v = { BL_DOUBLE, { 0 } };
+    v.as.d = d;
+    return v;
+}
+
+BL_API bl_value bl_bool(bool b) {
+    bl_value v = { BL_BOOL, { 0 } };
+    v.as.b = b;
+    return v;
+}
+
+BL_API bl_value bl_char(char c) {
+    bl_value v = { BL_CHAR, { 0 } };
+    v.as.c = c;
+    return v;
+}
+
+BL_API bl_value bl_string_alloc(size_t length) {
+    bl_string *s = (bl_string *) malloc(sizeof(bl_string) + length + 1);
+
+    if (s == NULL)
+        bl_fail("Out of memory");
+
+    s->refs = 1;
+    s->length = length;
+    s->data[length] = '\0';
+
+    bl_value v = { BL_STRING, { 0 } };
+    v.as.s = s;
+    return v;
+}
+
+BL_API bl_value bl_string_new(const char *data, size_t length) {
+    bl_value v = bl_string_alloc(length);
+    memcpy(v.as.s->data, data, length);
+    return v;
+}
+
+/* Reference counting */
+
+BL_API bl_value bl_retain(bl_value v) {
+    if (v.type == BL_STRING)
+        v.as.s->refs++;
+    return v;
+}
+
+BL_API void bl_release(bl_value v) {
+    if (v.type == BL_STRING && --v.as.s->refs == 0)
+        free(v.as.s);
+}
+
+BL_API void bl_set(bl_value *dst, bl_value v) {
+    bl_release(*dst);
+    *dst = v;
+}
+
+/* Accessors for values whose type is known to the compiler */
+
+BL_API int bl_as_int(bl_value v) { return v.as.i; }
+BL_API double bl_as_double(bl_value v) { return v.as.d; }
+BL_API bool bl_as_bool(bl_value v) { return v.as.b; }
+BL_API char bl_as_char(bl_value v) { return v.as.c; }
+
+/* Reads of variables that may not have been assigned yet */
+BL_API void bl_check(bl_value v, const char *name) {
+    if (v.type != BL_UNASSIGNED)
+        return;
+
+    fflush(stdout);
+    fprintf(stderr, "Variable %s has not been defined!\n", name);
+    exit(1);
+}
+
+BL_API bool bl_truth(bl_value v, const char *message) {
+    if (v.type != BL_BOOL)
+        bl_fail(message);
+    return v.as.b;
+}
+
+/* Text form, matching the default std::ostream formatting */
+
+BL_API int bl_format(bl_value v, char *buffer, size_t size, const char **text) {
+    switch (v.type) {
+        case BL_INT:
+            *text = buffer;
+            return snprintf(buffer, size, "%d", v.as.i);
+        case BL_DOUBLE:
+            *text = buffer;
+            return snprintf(buffer, size, "%g", v.as.d);
+        case BL_BOOL:
+            *text = v.as.b ? "true" : "false";
+            return v.as.b ? 4 : 5;
+        case BL_CHAR:
+            buffer[0] = v.as.c;
+            buffer[1] = '\0';
+            *text = buffer;
+            return 1;
+        case BL_STRING:
+            *text = v.as.s->data;
+            return (int) v.as.s->length;
+        case BL_NONE:
+        case BL_UNASSIGNED:
+            break;
+    }
+
+    *text = "Something else";
+    return 14;
+}
+
+BL_API bl_value bl_concat(bl_value lhs, bl_value rhs) {
+    char lbuffer[32], rbuffer[32];
+    const char *ltext, *rtext;
+    size_t llength = (size_t) bl_format(lhs, lbuffer, sizeof(lbuffer), &ltext);
+    size_t rlength = (size_t) bl_format(rhs, rbuffer, sizeof(rbuffer), &rtext);
+
+    bl_value result = bl_string_alloc(llength + rlength);
+    memcpy(result.as.s->data, ltext, llength);
+    memcpy(result.as.s->data + llength, rtext, rlength);
+    return result;
+}
+
+BL_API int bl_compare_text(bl_value lhs, bl_value rhs) {
+    char lbuffer[32], rbuffer[32];
+    const char *ltext, *rtext;
+    size_t llength = (size_t) bl_format(lhs, lbuffer, sizeof(lbuffer), &ltext);
+    size_t rlength = (size_t) bl_format(rhs, rbuffer, sizeof(rbuffer), &rtext);
+    int order = memcmp(ltext, rtext, llength < rlength ? llength : rlength);
+
+    if (order != 0)
+        return order;
+    return llength < rlength ? -1 : llength > rlength;
+}
+
+/* Operations */
+
+BL_API bl_value bl_compare(bl_op op, int order) {
+    switch (op) {
+        case BL_EQUAL:   return bl_bool(order == 0);
+        case BL_NEQUAL:  return bl_bool(order != 0);
+        case BL_LESS:    return bl_bool(order < 0);
+        case BL_LEQUAL:  return bl_bool(order <= 0);
+        case BL_GREATER: return bl_bool(order > 0);
+        case BL_GEQUAL:  return bl_bool(order >= 0);
+        default:         break;
+    }
+
+    return BL_NONE_VALUE;
+}
+
+BL_API bl_value bl_binary(bl_op op, bl_value lhs, bl_value rhs) {
+    bool relational = op == BL_LESS || op == BL_LEQUAL || op == BL_GREATER || op == BL_GEQUAL;
+
+    if (lhs.type == BL_NONE || rhs.type == BL_NONE)
+        bl_fail("Variable has no value.");
+
+    if (lhs.type == BL_STRING && !relational) {
+        if (op == BL_PLUS)
+            return bl_concat(lhs, rhs);
+        if (op == BL_EQUAL || op == BL_NEQUAL)
+            return bl_compare(op, bl_compare_text(lhs, rhs));
+    } else if (lhs.type == BL_INT && rhs.type == BL_INT) {
+        int a = lhs.as.i, b = rhs.as.i;
+
+        switch (op) {
+            case BL_PLUS:    return bl_int(a + b);
+            case BL_MINUS:   return bl_int(a - b);
+            case BL_MUL:     return bl_int(a * b);
+            case BL_DIV:     return bl_int(a / b);
+            default:         return bl_compare(op, (a > b) - (a < b));
+        }
+    } else if ((lhs.type == BL_INT || lhs.type == BL_DOUBLE)
+               && (rhs.type == BL_INT || rhs.type == BL_DOUBLE)) {
+        double a = lhs.type == BL_INT ? lhs.as.i : lhs.as.d;
+        double b = rhs.type == BL_INT ? rhs.as.i : rhs.as.d;
+
+        switch (op) {
+            case BL_PLUS:    return bl_double(a + b);
+            case BL_MINUS:   return bl_double(a - b);
+            case BL_MUL:     return bl_double(a * b);
+            case BL_DIV:     return bl_double(a / b);
+            case BL_EQUAL:   return bl_bool(a == b);
+            case BL_NEQUAL:  return bl_bool(a != b);
+            case BL_LESS:    return bl_bool(a < b);
+            case BL_LEQUAL:  return bl_bool(a <= b);
+            case BL_GREATER: return bl_bool(a > b);
+            case BL_GEQUAL:  return bl_bool(a >= b);
+        }
+    } else if (lhs.type == BL_CHAR && rhs.type == BL_CHAR) {
+        if (op != BL_PLUS && op != BL_MINUS && op != BL_MUL && op != BL_DIV)
+            return bl_compare(op, (lhs.as.c > rhs.as.c) - (lhs.as.c < rhs.as.c));
+    } else if (lhs.type == BL_BOOL && rhs.type == BL_BOOL) {
+        if (op == BL_PLUS)
+            return bl_bool(lhs.as.b || rhs.as.b);
+        if (op == BL_EQUAL || op == BL_NEQUAL)
+            return bl_compare(op, lhs.as.b != rhs.as.b);
+    } else if (lhs.type != rhs.type && lhs.type != BL_STRING) {
+        bl_fail_types("No viable conversion from %s to %s", lhs.type, rhs.type);
+    }
+
+    bl_fail_types("Invalid operation for %s and %s", lhs.type, rhs.type);
+}
+
+BL_API bl_value bl_unary_minus(bl_value v) {
+    if (v.type == BL_INT)
+        return bl_int(-v.as.i);
+    if (v.type == BL_DOUBLE)
+        return bl_double(-v.as.d);
+
+    bl_fail_types("Invalid operation for type %s%.0s", v.type, v.type);
+}
+
+BL_API bl_value bl_unary_plus(bl_value v) {
+    if (v.type == BL_INT || v.type == BL_DOUBLE)
+        return v;
+
+    bl_fail_types("Invalid operation for type %s%.0s", v.type, v.type);
+}
+
+/* writeln */
+
+BL_API void bl_writeln(bl_value v) {
+    char buffer[32];
+    const char *text;
+    int length = bl_format(v, buffer, sizeof(buffer), &text);
+
+    fwrite(text, 1, (size_t) length, stdout);
+    putchar('\n');
+}
+
+BL_API void bl_writeln_int(int i) { printf("%d\n", i); }
+BL_API void bl_writeln_double(double d) { printf("%g\n", d); }
+BL_API void bl_writeln_bool(bool b) { puts(b ? "true" : "false"); }
+BL_API void bl_writeln_char(char c) { putchar(c); putchar('\n'); }
+
+#endif /* BLAISE_RUNTIME_H */